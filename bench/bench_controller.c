@@ -0,0 +1,1217 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 TGDrives, s.r.o.
+** https://www.tgdrives.cz
+**
+** This file is part of the TGMmini Profinet I/O device.
+**
+**
+**  TGMmini Profinet I/O device free software:
+**  you can redistribute it and/or modify it under the terms of the
+**  GNU General Public License as published by the Free Software Foundation,
+**  either version 3 of the License, or (at your option) any later version.
+**
+**  TGMmini Profinet I/O device is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License along with
+**  TGMmini Profinet I/O device. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+// bench_controller.c
+// minimal IO-controller emulator for pnet_bench
+//
+// Just enough of an IO-controller to take a device through DCP identify,
+// Connect, PrmEnd, ApplicationReady, cyclic RT_CLASS_1 data and Release.
+// All ARs are served from one thread, like a controller serving several
+// devices: one output frame per AR and cycle, and every incoming frame is
+// timestamped by the kernel.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#include "bench_controller.h"
+#include "pf_includes.h"
+#include "utils.h"
+
+#define BENCH_CTRL_PRIO              (TIMER_PRIO + 1)
+#define BENCH_ETHTYPE_VLAN           0x8100
+#define BENCH_RPC_PORT               0x8894
+#define BENCH_DCP_ID_REQ_FRAME_ID    0xFEFE
+#define BENCH_DCP_ID_RES_FRAME_ID    0xFEFF
+#define BENCH_IN_FRAME_ID_BASE       0xC000   /* RT_CLASS_1 range */
+#define BENCH_OUT_FRAME_ID_BASE      0xC100
+#define BENCH_SEND_CLOCK_FACTOR      32       /* 32 * 31.25 us = 1 ms */
+#define BENCH_C_SDU_MIN              40
+#define BENCH_FRAME_SIZE             1536
+#define BENCH_RPC_HDR_SIZE           80
+#define BENCH_NDR_SIZE               20
+#define BENCH_RPC_ARGS_MAXIMUM       1400
+#define BENCH_RPC_TIMEOUT_NS         3000000000ULL
+#define BENCH_DCP_TIMEOUT_NS         5000000000ULL
+#define BENCH_DCP_RETRY_NS           500000000ULL
+#define BENCH_DATA_STATUS_RUN        0x35     /* Primary, valid, run, no problem */
+#define BENCH_DATA_STATUS_OK_MASK    0x14     /* Valid and run */
+
+#define BENCH_PTYPE_REQUEST          0
+#define BENCH_PTYPE_RESPONSE         2
+#define BENCH_PTYPE_FAULT            3
+#define BENCH_PTYPE_REJECT           6
+
+typedef enum bench_ar_state
+{
+  BENCH_AR_IDLE,           // waiting for the previous AR to start up
+  BENCH_AR_CONNECT,        // Connect sent
+  BENCH_AR_PRMEND,         // PrmEnd sent, cyclic data started
+  BENCH_AR_APPRDY,         // waiting for ApplicationReady from the device
+  BENCH_AR_RUN,
+  BENCH_AR_RELEASE,        // Release sent
+  BENCH_AR_DONE,
+  BENCH_AR_FAILED,
+} bench_ar_state_t;
+
+typedef struct bench_uuid
+{
+  uint32_t data1;
+  uint16_t data2;
+  uint16_t data3;
+  uint8_t  data4[8];
+} bench_uuid_t;
+
+typedef struct bench_sub
+{
+  uint16_t slot;
+  uint16_t subslot;
+  uint32_t module_ident;
+  uint32_t submodule_ident;
+  uint8_t  type;            // 0 no IO, 1 input, 2 output
+  uint16_t size;
+  uint16_t in_offset;       // data and IOPS, or IOCS, in the input CR
+  uint16_t out_offset;      // data and IOPS, or IOCS, in the output CR
+} bench_sub_t;
+
+typedef struct bench_ar
+{
+  bench_ar_state_t state;
+  bench_uuid_t     ar_uuid;
+  bench_uuid_t     activity_uuid;
+  uint16_t         session_key;
+  uint32_t         seq;
+  uint16_t         opnum;             // of the outstanding request
+  uint64_t         t_req_ns;
+  uint64_t         t_connect_ns;
+  uint16_t         in_frame_id;
+  uint16_t         out_frame_id;
+  uint16_t         in_len;            // c_sdu_length
+  uint16_t         out_len;
+  uint16_t         cycle_counter;
+  uint16_t         nbr_subs;
+  bench_sub_t      subs[3 + BENCH_MAX_SLOTS];
+  bool             got_data;
+  uint64_t         last_in_ns;
+} bench_ar_t;
+
+typedef struct bench_ctrl
+{
+  const bench_cfg_t *p_cfg;
+  bench_result_t  *p_result;
+  int              raw;
+  int              udp;
+  pnet_ethaddr_t   mac;
+  pnet_ethaddr_t   dev_mac;
+  uint32_t         dev_ip;            // network byte order
+  uint64_t         cycle_ns;
+  uint64_t         dht_ns;
+  bench_ar_t       ars[BENCH_MAX_AR];
+  bool             measuring;
+  bool             measured;
+  uint64_t         t_meas_ns;
+  uint64_t         proc_cpu_ns;
+  uint64_t         thread_cpu_ns;
+  uint8_t          frame[BENCH_FRAME_SIZE];
+  uint8_t          rpc[BENCH_FRAME_SIZE];
+} bench_ctrl_t;
+
+/* Simple writer, for the frames and the RPC messages */
+typedef struct bench_buf
+{
+  uint8_t  *p;
+  uint16_t  pos;
+  bool      le;                      // for the RPC header and NDR fields
+} bench_buf_t;
+
+/******************************************************************************/
+
+static uint64_t bench_cpu_ns(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static void put_u8(bench_buf_t *b, uint8_t v)
+{
+  b->p[b->pos++] = v;
+}
+
+static void put_u16(bench_buf_t *b, uint16_t v)
+{
+  if (b->le)
+  {
+    put_u8(b, v & 0xff);
+    put_u8(b, v >> 8);
+  }
+  else
+  {
+    put_u8(b, v >> 8);
+    put_u8(b, v & 0xff);
+  }
+}
+
+static void put_u32(bench_buf_t *b, uint32_t v)
+{
+  if (b->le)
+  {
+    put_u16(b, v & 0xffff);
+    put_u16(b, v >> 16);
+  }
+  else
+  {
+    put_u16(b, v >> 16);
+    put_u16(b, v & 0xffff);
+  }
+}
+
+static void put_mem(bench_buf_t *b, const void *p_src, uint16_t len)
+{
+  memcpy(&b->p[b->pos], p_src, len);
+  b->pos += len;
+}
+
+static void put_uuid(bench_buf_t *b, const bench_uuid_t *p_uuid)
+{
+  put_u32(b, p_uuid->data1);
+  put_u16(b, p_uuid->data2);
+  put_u16(b, p_uuid->data3);
+  put_mem(b, p_uuid->data4, sizeof(p_uuid->data4));
+}
+
+static uint16_t get_u16(const uint8_t *p, bool le)
+{
+  return le ? (uint16_t)(p[0] | (p[1] << 8)) : (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const uint8_t *p, bool le)
+{
+  return le ? ((uint32_t)get_u16(p + 2, le) << 16) | get_u16(p, le)
+            : ((uint32_t)get_u16(p, le) << 16) | get_u16(p + 2, le);
+}
+
+static void get_uuid(const uint8_t *p, bool le, bench_uuid_t *p_uuid)
+{
+  p_uuid->data1 = get_u32(p, le);
+  p_uuid->data2 = get_u16(p + 4, le);
+  p_uuid->data3 = get_u16(p + 6, le);
+  memcpy(p_uuid->data4, p + 8, sizeof(p_uuid->data4));
+}
+
+static bool uuid_equal(const bench_uuid_t *p_a, const bench_uuid_t *p_b)
+{
+  return (p_a->data1 == p_b->data1) && (p_a->data2 == p_b->data2) &&
+         (p_a->data3 == p_b->data3) &&
+         (memcmp(p_a->data4, p_b->data4, sizeof(p_a->data4)) == 0);
+}
+
+/* Start a block, returns the position of the block length */
+static uint16_t put_block_begin(bench_buf_t *b, uint16_t type)
+{
+  uint16_t len_pos;
+
+  put_u16(b, type);
+  len_pos = b->pos;
+  put_u16(b, 0);
+  put_u8(b, 1);                      // version 1.0
+  put_u8(b, 0);
+  return len_pos;
+}
+
+static void put_block_end(bench_buf_t *b, uint16_t len_pos)
+{
+  const uint16_t pos = b->pos;
+
+  b->pos = len_pos;
+  put_u16(b, pos - len_pos - 2);     // From the version, on
+  b->pos = pos;
+}
+
+/*************************** AR configuration *********************************/
+
+/**
+ * Set up the submodules and both IOCR layouts of an AR.
+ *
+ * The DAP is in the first AR. The modules are spread over the ARs and
+ * alternate between input and output.
+ *
+ * @param p_cfg               In: The bench configuration
+ * @param ix                  In: The AR index
+ * @param p_ar                Out: The AR
+*/
+static void bench_ar_setup(const bench_cfg_t *p_cfg, uint16_t ix, bench_ar_t *p_ar)
+{
+  uint16_t     in_pos = 0;
+  uint16_t     out_pos = 0;
+  uint16_t     mod_ix;
+  bench_sub_t *p_sub;
+
+  memset(p_ar, 0, sizeof(*p_ar));
+  p_ar->ar_uuid.data1 = 0xbe7c0000 | ix;
+  p_ar->ar_uuid.data2 = (uint16_t)getpid();
+  p_ar->ar_uuid.data3 = (uint16_t)timeGetTime64_ns();
+  memcpy(p_ar->ar_uuid.data4, "pnetbnch", 8);
+  p_ar->activity_uuid = p_ar->ar_uuid;
+  p_ar->activity_uuid.data1 ^= 0x00ac0000;
+  p_ar->session_key = 1;
+  p_ar->in_frame_id = BENCH_IN_FRAME_ID_BASE + ix;
+  p_ar->out_frame_id = BENCH_OUT_FRAME_ID_BASE + ix;
+
+  if (ix == 0)
+  {
+    const uint16_t dap_subslots[] = { PNET_SUBMOD_DAP_IDENT, PNET_SUBMOD_DAP_INTERFACE_1_IDENT, PNET_SUBMOD_DAP_INTERFACE_1_PORT_0_IDENT };
+    for (uint16_t i = 0; i < NELEMENTS(dap_subslots); i++)
+    {
+      p_sub = &p_ar->subs[p_ar->nbr_subs++];
+      p_sub->slot = PNET_SLOT_DAP_IDENT;
+      p_sub->subslot = dap_subslots[i];
+      p_sub->module_ident = PNET_MOD_DAP_IDENT;
+      p_sub->submodule_ident = dap_subslots[i];
+      p_sub->type = PNET_DIR_NO_IO;
+    }
+  }
+
+  for (mod_ix = ix * p_cfg->nbr_modules; mod_ix < (ix + 1) * p_cfg->nbr_modules; mod_ix++)
+  {
+    p_sub = &p_ar->subs[p_ar->nbr_subs++];
+    p_sub->slot = 1 + mod_ix;
+    p_sub->subslot = BENCH_SUBSLOT;
+    p_sub->type = ((mod_ix % 2) == 0) ? PNET_DIR_INPUT : PNET_DIR_OUTPUT;
+    p_sub->size = p_cfg->data_size;
+    p_sub->module_ident = BENCH_MODULE_IDENT(p_sub->type, p_sub->size);
+    p_sub->submodule_ident = BENCH_SUBMOD_IDENT;
+  }
+
+  /* Data and IOPS first, then the IOCS for the other direction */
+  for (uint16_t i = 0; i < p_ar->nbr_subs; i++)
+  {
+    p_sub = &p_ar->subs[i];
+    if (p_sub->type != PNET_DIR_OUTPUT)
+    {
+      p_sub->in_offset = in_pos;
+      in_pos += p_sub->size + 1;
+    }
+    else
+    {
+      p_sub->out_offset = out_pos;
+      out_pos += p_sub->size + 1;
+    }
+  }
+  for (uint16_t i = 0; i < p_ar->nbr_subs; i++)
+  {
+    p_sub = &p_ar->subs[i];
+    if (p_sub->type != PNET_DIR_OUTPUT)
+    {
+      p_sub->out_offset = out_pos++;
+    }
+    else
+    {
+      p_sub->in_offset = in_pos++;
+    }
+  }
+  p_ar->in_len = (in_pos < BENCH_C_SDU_MIN) ? BENCH_C_SDU_MIN : in_pos;
+  p_ar->out_len = (out_pos < BENCH_C_SDU_MIN) ? BENCH_C_SDU_MIN : out_pos;
+}
+
+/******************************** DCE/RPC *************************************/
+
+/**
+ * Start a DCE/RPC request with the NDR header. Little-endian, as sent by
+ * most controllers. Finish with bench_rpc_send().
+ *
+ * @param c                   In: The controller
+ * @param p_ar                InOut: The AR
+ * @param opnum               In: The operation
+ * @param b                   Out: Writer positioned at the first block
+*/
+static void bench_rpc_begin(bench_ctrl_t *c, bench_ar_t *p_ar, uint16_t opnum, bench_buf_t *b)
+{
+  const bench_uuid_t object_uuid =
+    { 0xdea00000, 0x6c97, 0x11d1, { 0x82, 0x71, 0x00, 0x01, 0x00, 0x01, 0x05, 0x44 } };
+  const bench_uuid_t interface_uuid =
+    { 0xdea00001, 0x6c97, 0x11d1, { 0x82, 0x71, 0x00, 0xa0, 0x24, 0x42, 0xdf, 0x7d } };
+
+  b->p = c->rpc;
+  b->pos = 0;
+  b->le = true;
+
+  put_u8(b, 4);                      // version
+  put_u8(b, BENCH_PTYPE_REQUEST);
+  put_u8(b, 0x28);                   // idempotent, no fack
+  put_u8(b, 0);
+  put_u8(b, 0x10);                   // little-endian, ASCII
+  put_u8(b, 0);                      // IEEE float
+  put_u8(b, 0);
+  put_u8(b, 0);                      // serial high
+  put_uuid(b, &object_uuid);
+  put_uuid(b, &interface_uuid);
+  put_uuid(b, &p_ar->activity_uuid);
+  put_u32(b, 0);                     // server boot time
+  put_u32(b, 1);                     // interface version
+  put_u32(b, p_ar->seq++);
+  put_u16(b, opnum);
+  put_u16(b, 0xffff);                // interface hint
+  put_u16(b, 0xffff);                // activity hint
+  put_u16(b, 0);                     // length of body, set later
+  put_u16(b, 0);                     // fragment number
+  put_u8(b, 0);                      // authentication protocol
+  put_u8(b, 0);                      // serial low
+
+  put_u32(b, BENCH_RPC_ARGS_MAXIMUM);
+  put_u32(b, 0);                     // args length, set later
+  put_u32(b, BENCH_RPC_ARGS_MAXIMUM);
+  put_u32(b, 0);
+  put_u32(b, 0);                     // actual count, set later
+
+  b->le = false;                     // The blocks are always big-endian
+  p_ar->opnum = opnum;
+}
+
+static int bench_rpc_send(bench_ctrl_t *c, bench_ar_t *p_ar, bench_buf_t *b)
+{
+  struct sockaddr_in  addr;
+  const uint16_t      len = b->pos;
+  const uint16_t      args_len = len - BENCH_RPC_HDR_SIZE - BENCH_NDR_SIZE;
+
+  b->le = true;
+  b->pos = 74;
+  put_u16(b, len - BENCH_RPC_HDR_SIZE);
+  b->pos = BENCH_RPC_HDR_SIZE + 4;
+  put_u32(b, args_len);
+  b->pos = BENCH_RPC_HDR_SIZE + 16;
+  put_u32(b, args_len);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = c->dev_ip;
+  addr.sin_port = htons(BENCH_RPC_PORT);
+
+  p_ar->t_req_ns = timeGetTime64_ns();
+  if (sendto(c->udp, c->rpc, len, 0, (struct sockaddr *)&addr, sizeof(addr)) != len)
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: RPC send failed\n");
+    return -1;
+  }
+  return 0;
+}
+
+static void bench_put_iocr(bench_buf_t *b, const bench_cfg_t *p_cfg, const bench_ar_t *p_ar, uint16_t type)
+{
+  const bool     input = (type == 1);
+  const uint16_t len_pos = put_block_begin(b, 0x0102);
+  uint16_t       n = 0;
+
+  put_u16(b, type);
+  put_u16(b, type);                  // IOCR reference
+  put_u16(b, OS_ETHTYPE_PROFINET);
+  put_u32(b, PF_RT_CLASS_1);
+  put_u16(b, input ? p_ar->in_len : p_ar->out_len);
+  put_u16(b, input ? p_ar->in_frame_id : p_ar->out_frame_id);
+  put_u16(b, BENCH_SEND_CLOCK_FACTOR);
+  put_u16(b, p_cfg->reduction_ratio);
+  put_u16(b, 1);                     // phase
+  put_u16(b, 0);                     // sequence
+  put_u32(b, 0xffffffff);            // frame send offset, "best effort"
+  put_u16(b, p_cfg->data_hold_factor);   // watchdog factor
+  put_u16(b, p_cfg->data_hold_factor);
+  put_u16(b, 0xc000);                // VLAN tag header, priority 6
+  put_mem(b, "\0\0\0\0\0\0", 6);     // multicast MAC
+  put_u16(b, 1);                     // number of APIs
+  put_u32(b, APP_API);
+
+  /* IO data objects: the submodules sending in this direction */
+  for (uint16_t i = 0; i < p_ar->nbr_subs; i++)
+  {
+    n += ((p_ar->subs[i].type == PNET_DIR_OUTPUT) != input) ? 1 : 0;
+  }
+  put_u16(b, n);
+  for (uint16_t i = 0; i < p_ar->nbr_subs; i++)
+  {
+    const bench_sub_t *p_sub = &p_ar->subs[i];
+    if ((p_sub->type == PNET_DIR_OUTPUT) != input)
+    {
+      put_u16(b, p_sub->slot);
+      put_u16(b, p_sub->subslot);
+      put_u16(b, input ? p_sub->in_offset : p_sub->out_offset);
+    }
+  }
+
+  /* IOCS: the submodules consuming in the other direction */
+  put_u16(b, p_ar->nbr_subs - n);
+  for (uint16_t i = 0; i < p_ar->nbr_subs; i++)
+  {
+    const bench_sub_t *p_sub = &p_ar->subs[i];
+    if ((p_sub->type == PNET_DIR_OUTPUT) == input)
+    {
+      put_u16(b, p_sub->slot);
+      put_u16(b, p_sub->subslot);
+      put_u16(b, input ? p_sub->in_offset : p_sub->out_offset);
+    }
+  }
+  put_block_end(b, len_pos);
+}
+
+static int bench_send_connect(bench_ctrl_t *c, uint16_t ix)
+{
+  static const char  ctrl_name[] = "pnet-bench-ctrl";
+  const bench_cfg_t *p_cfg = c->p_cfg;
+  bench_ar_t        *p_ar = &c->ars[ix];
+  bench_buf_t        b;
+  uint16_t           len_pos;
+  bench_uuid_t       cmi_object_uuid =
+    { 0xdea00000, 0x6c97, 0x11d1, { 0x82, 0x71, 0x00, 0x01, 0x00, 0x01, 0x05, 0x44 } };
+
+  bench_rpc_begin(c, p_ar, PF_RPC_DEV_OPNUM_CONNECT, &b);
+
+  /* ARBlockReq */
+  len_pos = put_block_begin(&b, 0x0101);
+  put_u16(&b, 0x0001);               // IOCARSingle
+  put_uuid(&b, &p_ar->ar_uuid);
+  put_u16(&b, p_ar->session_key);
+  put_mem(&b, c->mac.addr, sizeof(c->mac.addr));
+  put_uuid(&b, &cmi_object_uuid);
+  put_u32(&b, 0x40000011);           // active, supervisor, advanced startup
+  put_u16(&b, 600);                  // activity timeout, 60 s
+  put_u16(&b, OS_ETHTYPE_PROFINET);
+  put_u16(&b, sizeof(ctrl_name) - 1);
+  put_mem(&b, ctrl_name, sizeof(ctrl_name) - 1);
+  put_block_end(&b, len_pos);
+
+  bench_put_iocr(&b, p_cfg, p_ar, 1);
+  bench_put_iocr(&b, p_cfg, p_ar, 2);
+
+  /* AlarmCRBlockReq */
+  len_pos = put_block_begin(&b, 0x0103);
+  put_u16(&b, 1);
+  put_u16(&b, OS_ETHTYPE_PROFINET);
+  put_u32(&b, 0);
+  put_u16(&b, 1);                    // RTA timeout factor
+  put_u16(&b, 3);                    // retries
+  put_u16(&b, 1 + ix);               // local alarm reference
+  put_u16(&b, 200);                  // max alarm data length
+  put_u16(&b, 0xc000);
+  put_u16(&b, 0xa000);
+  put_block_end(&b, len_pos);
+
+  /* ExpectedSubmoduleBlockReq, one per slot */
+  for (uint16_t i = 0; i < p_ar->nbr_subs; )
+  {
+    const uint16_t slot = p_ar->subs[i].slot;
+    uint16_t       n = 0;
+
+    while (((i + n) < p_ar->nbr_subs) && (p_ar->subs[i + n].slot == slot))
+    {
+      n++;
+    }
+    len_pos = put_block_begin(&b, 0x0104);
+    put_u16(&b, 1);                  // number of APIs
+    put_u32(&b, APP_API);
+    put_u16(&b, slot);
+    put_u32(&b, p_ar->subs[i].module_ident);
+    put_u16(&b, 0);                  // module properties
+    put_u16(&b, n);
+    for (; n > 0; n--, i++)
+    {
+      const bench_sub_t *p_sub = &p_ar->subs[i];
+      put_u16(&b, p_sub->subslot);
+      put_u32(&b, p_sub->submodule_ident);
+      put_u16(&b, p_sub->type);
+      put_u16(&b, (p_sub->type == PNET_DIR_OUTPUT) ? 2 : 1);
+      put_u16(&b, p_sub->size);
+      put_u8(&b, 1);                 // IOCS length
+      put_u8(&b, 1);                 // IOPS length
+    }
+    put_block_end(&b, len_pos);
+  }
+
+  p_ar->state = BENCH_AR_CONNECT;
+  p_ar->t_connect_ns = timeGetTime64_ns();
+  return bench_rpc_send(c, p_ar, &b);
+}
+
+/* PrmEnd and Release share the IODControlReq layout */
+static int bench_send_control(bench_ctrl_t *c, bench_ar_t *p_ar, uint16_t opnum, uint16_t block_type, uint16_t command)
+{
+  bench_buf_t b;
+  uint16_t    len_pos;
+
+  bench_rpc_begin(c, p_ar, opnum, &b);
+  len_pos = put_block_begin(&b, block_type);
+  put_u16(&b, 0);                    // padding
+  put_uuid(&b, &p_ar->ar_uuid);
+  put_u16(&b, p_ar->session_key);
+  put_u16(&b, 0);                    // reserved
+  put_u16(&b, command);
+  put_u16(&b, 0);                    // properties
+  put_block_end(&b, len_pos);
+  return bench_rpc_send(c, p_ar, &b);
+}
+
+static void bench_ar_fail(bench_ar_t *p_ar, const char *p_why)
+{
+  os_log(LOG_LEVEL_ERROR, "bench: AR %08x failed: %s\n", (unsigned)p_ar->ar_uuid.data1, p_why);
+  p_ar->state = BENCH_AR_FAILED;
+}
+
+/**
+ * Handle a DCE/RPC response from the device, and send the next request.
+ *
+ * @param c                   InOut: The controller
+ * @param p_ar                InOut: The AR the activity belongs to
+ * @param p                   In: The message
+ * @param len                 In: The length of the message
+ * @param le                  In: true if the header and NDR are little-endian
+*/
+static void bench_rpc_response(bench_ctrl_t *c, bench_ar_t *p_ar, const uint8_t *p, uint16_t len, bool le)
+{
+  const uint16_t opnum = get_u16(&p[68], le);
+  uint32_t       status;
+  uint16_t       pos;
+
+  if ((len < BENCH_RPC_HDR_SIZE + BENCH_NDR_SIZE) || (opnum != p_ar->opnum))
+  {
+    return;
+  }
+  status = get_u32(&p[BENCH_RPC_HDR_SIZE], le);
+  if ((status != 0) && (p_ar->state == BENCH_AR_RELEASE))
+  {
+    /* The device dropped the AR already, e.g. after the data hold time expired */
+    os_log(LOG_LEVEL_WARNING, "bench: release PNIO status %08x\n", (unsigned)status);
+    p_ar->state = BENCH_AR_DONE;
+    return;
+  }
+  else if (status != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: opnum %u PNIO status %08x\n", (unsigned)opnum, (unsigned)status);
+    bench_ar_fail(p_ar, "error response");
+    return;
+  }
+
+  switch (p_ar->state)
+  {
+  case BENCH_AR_CONNECT:
+    c->p_result->connect_ns = MAX(c->p_result->connect_ns, timeGetTime64_ns() - p_ar->t_connect_ns);
+    /* Check the frame ids in the IOCRBlockRes */
+    for (pos = BENCH_RPC_HDR_SIZE + BENCH_NDR_SIZE; (pos + 6) <= len; pos += 4 + get_u16(&p[pos + 2], false))
+    {
+      if ((get_u16(&p[pos], false) == 0x8102) && (pos + 12 <= len))
+      {
+        const uint16_t frame_id = get_u16(&p[pos + 10], false);
+        if ((frame_id != p_ar->in_frame_id) && (frame_id != p_ar->out_frame_id))
+        {
+          bench_ar_fail(p_ar, "unexpected frame id");
+          return;
+        }
+      }
+    }
+    p_ar->state = BENCH_AR_PRMEND;
+    if (bench_send_control(c, p_ar, PF_RPC_DEV_OPNUM_CONTROL, 0x0110, BIT(PF_CONTROL_COMMAND_BIT_PRM_END)) != 0)
+    {
+      bench_ar_fail(p_ar, "PrmEnd");
+    }
+    break;
+  case BENCH_AR_PRMEND:
+    p_ar->state = BENCH_AR_APPRDY;
+    p_ar->t_req_ns = timeGetTime64_ns();
+    break;
+  case BENCH_AR_RELEASE:
+    p_ar->state = BENCH_AR_DONE;
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Answer the ApplicationReady CControl request of the device.
+ *
+ * The response repeats the request header and the AR in the control block,
+ * with the command "done".
+ *
+ * @param c                   InOut: The controller
+ * @param p                   In: The request
+ * @param len                 In: The length of the request
+ * @param le                  In: true if the header and NDR are little-endian
+ * @param p_from              In: Where to send the response
+*/
+static void bench_rpc_ccontrol(bench_ctrl_t *c, const uint8_t *p, uint16_t len, bool le, const struct sockaddr_in *p_from)
+{
+  const uint16_t blk = BENCH_RPC_HDR_SIZE + BENCH_NDR_SIZE;
+  bench_uuid_t   ar_uuid;
+  bench_ar_t    *p_ar = NULL;
+  bench_buf_t    b;
+  uint16_t       len_pos;
+
+  if ((len < blk + 32) || (get_u16(&p[blk], false) != 0x0112))
+  {
+    return;
+  }
+  get_uuid(&p[blk + 8], false, &ar_uuid);
+  for (uint16_t ix = 0; ix < c->p_cfg->nbr_ars; ix++)
+  {
+    if (uuid_equal(&c->ars[ix].ar_uuid, &ar_uuid))
+    {
+      p_ar = &c->ars[ix];
+    }
+  }
+  if (p_ar == NULL)
+  {
+    return;
+  }
+
+  b.p = c->rpc;
+  b.pos = 0;
+  b.le = le;
+  put_mem(&b, p, BENCH_RPC_HDR_SIZE);
+  c->rpc[1] = BENCH_PTYPE_RESPONSE;
+  c->rpc[2] = 0x0a;                  // last fragment, no fack
+  b.pos = 74;
+  put_u16(&b, BENCH_NDR_SIZE + 32);
+  b.pos = BENCH_RPC_HDR_SIZE;
+  put_u32(&b, 0);                    // PNIO status OK
+  put_u32(&b, 32);
+  put_u32(&b, BENCH_RPC_ARGS_MAXIMUM);
+  put_u32(&b, 0);
+  put_u32(&b, 32);
+  b.le = false;
+  len_pos = put_block_begin(&b, 0x8112);
+  put_u16(&b, 0);
+  put_mem(&b, &p[blk + 8], 18);      // AR UUID and session key, as received
+  put_u16(&b, 0);
+  put_u16(&b, BIT(PF_CONTROL_COMMAND_BIT_DONE));
+  put_u16(&b, 0);
+  put_block_end(&b, len_pos);
+
+  (void)sendto(c->udp, c->rpc, b.pos, 0, (const struct sockaddr *)p_from, sizeof(*p_from));
+  if (p_ar->state == BENCH_AR_APPRDY)
+  {
+    p_ar->state = BENCH_AR_RUN;
+  }
+}
+
+static void bench_rpc_recv(bench_ctrl_t *c)
+{
+  uint8_t            msg[BENCH_FRAME_SIZE];
+  struct sockaddr_in from;
+  socklen_t          from_len = sizeof(from);
+  ssize_t            len;
+  bench_uuid_t       activity_uuid;
+  bool               le;
+
+  while ((len = recvfrom(c->udp, msg, sizeof(msg), MSG_DONTWAIT, (struct sockaddr *)&from, &from_len)) >= BENCH_RPC_HDR_SIZE)
+  {
+    le = (msg[4] & 0xf0) != 0;
+    switch (msg[1] & 0x1f)
+    {
+    case BENCH_PTYPE_REQUEST:
+      if (get_u16(&msg[68], le) == PF_RPC_DEV_OPNUM_CONTROL)
+      {
+        bench_rpc_ccontrol(c, msg, (uint16_t)len, le, &from);
+      }
+      break;
+    case BENCH_PTYPE_RESPONSE:
+    case BENCH_PTYPE_FAULT:
+    case BENCH_PTYPE_REJECT:
+      get_uuid(&msg[40], le, &activity_uuid);
+      for (uint16_t ix = 0; ix < c->p_cfg->nbr_ars; ix++)
+      {
+        if (uuid_equal(&c->ars[ix].activity_uuid, &activity_uuid))
+        {
+          if ((msg[1] & 0x1f) == BENCH_PTYPE_RESPONSE)
+          {
+            bench_rpc_response(c, &c->ars[ix], msg, (uint16_t)len, le);
+          }
+          else
+          {
+            bench_ar_fail(&c->ars[ix], "RPC fault or reject");
+          }
+        }
+      }
+      break;
+    default:
+      break;
+    }
+    from_len = sizeof(from);
+  }
+}
+
+/****************************** Ethernet **************************************/
+
+static uint16_t bench_eth_header(bench_ctrl_t *c, const uint8_t *p_dst, uint16_t frame_id)
+{
+  bench_buf_t b = { c->frame, 0, false };
+
+  put_mem(&b, p_dst, sizeof(pnet_ethaddr_t));
+  put_mem(&b, c->mac.addr, sizeof(c->mac.addr));
+  put_u16(&b, OS_ETHTYPE_PROFINET);
+  put_u16(&b, frame_id);
+  return b.pos;
+}
+
+/**
+ * Receive one frame, with its kernel timestamp.
+ * @return The length of the frame, or -1 if there is none.
+*/
+static ssize_t bench_eth_recv(bench_ctrl_t *c, uint64_t *p_ts_ns)
+{
+  struct iovec    iov = { c->frame, sizeof(c->frame) };
+  uint8_t         control[64];
+  struct msghdr   msg;
+  struct cmsghdr *p_cmsg;
+  ssize_t         len;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  len = recvmsg(c->raw, &msg, MSG_DONTWAIT);
+  *p_ts_ns = 0;
+  for (p_cmsg = CMSG_FIRSTHDR(&msg); (len > 0) && (p_cmsg != NULL); p_cmsg = CMSG_NXTHDR(&msg, p_cmsg))
+  {
+    if ((p_cmsg->cmsg_level == SOL_SOCKET) && (p_cmsg->cmsg_type == SCM_TIMESTAMPNS))
+    {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(p_cmsg), sizeof(ts));
+      *p_ts_ns = ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+    }
+  }
+  return len;
+}
+
+/* Position after the frame id, or 0 if it is not a Profinet frame */
+static uint16_t bench_frame_id_pos(const uint8_t *p, ssize_t len)
+{
+  uint16_t pos = 12;
+
+  if ((len >= 18) && (get_u16(&p[pos], false) == BENCH_ETHTYPE_VLAN))
+  {
+    pos += 4;
+  }
+  if ((len < pos + 4) || (get_u16(&p[pos], false) != OS_ETHTYPE_PROFINET))
+  {
+    return 0;
+  }
+  return pos + 4;
+}
+
+/**
+ * Find the device by its station name, with DCP Identify.
+ *
+ * @param c                   InOut: The controller. Sets the device MAC and IP
+ * @return 0 if the device answered, -1 if not
+*/
+static int bench_dcp_identify(bench_ctrl_t *c)
+{
+  static const uint8_t dcp_mc_addr[] = { 0x01, 0x0e, 0xcf, 0x00, 0x00, 0x00 };
+  const char          *p_name = c->p_cfg->station_name;
+  const uint16_t       name_len = (uint16_t)strlen(p_name);
+  const uint32_t       xid = 0x00be0001;
+  const uint64_t       t_start = timeGetTime64_ns();
+  uint64_t             t_send = 0;
+  bench_buf_t          b = { c->frame, 0, false };
+  struct pollfd        pfd = { c->raw, POLLIN, 0 };
+  uint64_t             ts;
+  ssize_t              len;
+  uint16_t             pos;
+
+  while ((timeGetTime64_ns() - t_start) < BENCH_DCP_TIMEOUT_NS)
+  {
+    /* Repeat the request, the link may just have come up */
+    if ((timeGetTime64_ns() - t_send) >= BENCH_DCP_RETRY_NS)
+    {
+      b.pos = bench_eth_header(c, dcp_mc_addr, BENCH_DCP_ID_REQ_FRAME_ID);
+      put_u8(&b, 0x05);              // Identify
+      put_u8(&b, 0x00);              // Request
+      put_u32(&b, xid);
+      put_u16(&b, 1);                // Response delay factor, no delay
+      put_u16(&b, 4 + name_len + (name_len & 1));
+      put_u8(&b, PF_DCP_OPT_DEVICE_PROPERTIES);
+      put_u8(&b, PF_DCP_SUB_DEV_PROP_NAME);
+      put_u16(&b, name_len);
+      put_mem(&b, p_name, name_len);
+      while (b.pos < 60)
+      {
+        put_u8(&b, 0);
+      }
+      t_send = timeGetTime64_ns();
+      if (send(c->raw, c->frame, b.pos, 0) != b.pos)
+      {
+        return -1;
+      }
+    }
+
+    (void)poll(&pfd, 1, 100);
+    while ((len = bench_eth_recv(c, &ts)) > 0)
+    {
+      pos = bench_frame_id_pos(c->frame, len);
+      if ((pos != 0) && (len >= pos + 12) &&
+          (get_u16(&c->frame[pos - 2], false) == BENCH_DCP_ID_RES_FRAME_ID) &&
+          (get_u32(&c->frame[pos + 2], false) == xid))
+      {
+        const uint16_t end = pos + 10 + get_u16(&c->frame[pos + 8], false);
+
+        c->p_result->dcp_ns = timeGetTime64_ns() - t_send;
+        memcpy(c->dev_mac.addr, &c->frame[6], sizeof(c->dev_mac.addr));
+        /* Take the IP address from the IP parameter block, if any */
+        for (pos += 10; (pos + 4 <= end) && (pos + 4 <= len); pos += (4 + get_u16(&c->frame[pos + 2], false) + 1) & ~1)
+        {
+          if ((c->frame[pos] == PF_DCP_OPT_IP) && (c->frame[pos + 1] == PF_DCP_SUB_IP_PAR) && (pos + 10 <= len))
+          {
+            uint32_t ip;
+            memcpy(&ip, &c->frame[pos + 6], sizeof(ip));
+            if (ip != 0)
+            {
+              c->dev_ip = ip;
+            }
+          }
+        }
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+static void bench_send_output(bench_ctrl_t *c, bench_ar_t *p_ar)
+{
+  bench_buf_t b = { c->frame, 0, false };
+
+  b.pos = bench_eth_header(c, c->dev_mac.addr, p_ar->out_frame_id);
+  memset(&c->frame[b.pos], 0, p_ar->out_len);
+  for (uint16_t i = 0; i < p_ar->nbr_subs; i++)
+  {
+    const bench_sub_t *p_sub = &p_ar->subs[i];
+    uint8_t           *p_data = &c->frame[b.pos + p_sub->out_offset];
+
+    if (p_sub->type == PNET_DIR_OUTPUT)
+    {
+      memset(p_data, (uint8_t)p_ar->cycle_counter, p_sub->size);
+    }
+    p_data[p_sub->size * (p_sub->type == PNET_DIR_OUTPUT)] = PNET_IOXS_GOOD;
+  }
+  b.pos += p_ar->out_len;
+
+  p_ar->cycle_counter += BENCH_SEND_CLOCK_FACTOR * c->p_cfg->reduction_ratio;
+  put_u16(&b, p_ar->cycle_counter);
+  put_u8(&b, BENCH_DATA_STATUS_RUN);
+  put_u8(&b, 0);                     // transfer status
+  (void)send(c->raw, c->frame, b.pos, 0);
+}
+
+static void bench_eth_recv_all(bench_ctrl_t *c)
+{
+  bench_result_t *p_res = c->p_result;
+  uint64_t        ts;
+  ssize_t         len;
+  uint16_t        pos;
+  uint16_t        frame_id;
+
+  while ((len = bench_eth_recv(c, &ts)) > 0)
+  {
+    pos = bench_frame_id_pos(c->frame, len);
+    if ((pos == 0) || (memcmp(&c->frame[0], c->mac.addr, sizeof(c->mac.addr)) != 0))
+    {
+      continue;
+    }
+    frame_id = get_u16(&c->frame[pos - 2], false);
+    for (uint16_t ix = 0; ix < c->p_cfg->nbr_ars; ix++)
+    {
+      bench_ar_t   *p_ar = &c->ars[ix];
+      const uint8_t data_status = c->frame[len - 2];
+      const bool    ok = ((data_status & BENCH_DATA_STATUS_OK_MASK) == BENCH_DATA_STATUS_OK_MASK);
+
+      if ((frame_id != p_ar->in_frame_id) || (len < pos + p_ar->in_len + 4))
+      {
+        continue;
+      }
+      if ((p_ar->state == BENCH_AR_RUN) && ok && (p_ar->got_data == false))
+      {
+        p_ar->got_data = true;
+        p_res->startup_ns = MAX(p_res->startup_ns, timeGetTime64_ns() - p_ar->t_connect_ns);
+      }
+      if (c->measuring)
+      {
+        p_res->n_frames_in++;
+        p_res->n_bad_frames += ok ? 0 : 1;
+        if ((p_ar->last_in_ns != 0) && (ts > p_ar->last_in_ns))
+        {
+          const uint64_t delta = ts - p_ar->last_in_ns;
+          pf_histogram_add(&p_res->inter_arrival, delta);
+          pf_histogram_add(&p_res->jitter, (delta > c->cycle_ns) ? delta - c->cycle_ns : c->cycle_ns - delta);
+          p_res->n_dht_missed += (delta > c->dht_ns) ? 1 : 0;
+        }
+      }
+      p_ar->last_in_ns = ts;
+    }
+  }
+}
+
+/******************************************************************************/
+
+static int bench_open_sockets(bench_ctrl_t *c)
+{
+  struct sockaddr_ll  sll;
+  struct sockaddr_in  addr;
+  char                if_name[IFNAMSIZ];
+  int                 one = 1;
+  int                 fd;
+
+  fd = open(c->p_cfg->netns, O_RDONLY);
+  if ((fd < 0) || (setns(fd, CLONE_NEWNET) != 0))
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: can not enter network namespace %s\n", c->p_cfg->netns);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return -1;
+  }
+  close(fd);
+
+  strncpy(if_name, c->p_cfg->if_name, sizeof(if_name) - 1);
+  if_name[sizeof(if_name) - 1] = '\0';
+  if (read_mac_address(if_name, &c->mac) != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: no interface %s\n", if_name);
+    return -1;
+  }
+
+  c->raw = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_ALL);
+  sll.sll_ifindex = (int)if_nametoindex(if_name);
+  if ((c->raw < 0) || (bind(c->raw, (struct sockaddr *)&sll, sizeof(sll)) != 0))
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: can not open raw socket on %s\n", if_name);
+    return -1;
+  }
+  (void)setsockopt(c->raw, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+#if defined (PACKET_IGNORE_OUTGOING)
+  (void)setsockopt(c->raw, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+  c->udp = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = c->p_cfg->ctrl_ip;
+  addr.sin_port = htons(BENCH_RPC_PORT);
+  (void)setsockopt(c->udp, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if ((c->udp < 0) || (bind(c->udp, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: can not bind the RPC port\n");
+    return -1;
+  }
+  return 0;
+}
+
+static void bench_measure_start(bench_ctrl_t *c, uint64_t now)
+{
+  c->measuring = true;
+  c->t_meas_ns = now;
+  c->proc_cpu_ns = bench_cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+  c->thread_cpu_ns = bench_cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+static void bench_measure_stop(bench_ctrl_t *c, uint64_t now)
+{
+  bench_result_t *p_res = c->p_result;
+
+  c->measuring = false;
+  c->measured = true;
+  p_res->run_ns = now - c->t_meas_ns;
+  p_res->process_cpu_ns = bench_cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - c->proc_cpu_ns;
+  p_res->ctrl_cpu_ns = bench_cpu_ns(CLOCK_THREAD_CPUTIME_ID) - c->thread_cpu_ns;
+}
+
+/**
+ * The cyclic loop: send the output frames on time, and in between serve
+ * the input frames and the RPC state machine of each AR.
+ *
+ * @param c                   InOut: The controller
+ * @return 0 if all ARs were released, -1 if one failed
+*/
+static int bench_loop(bench_ctrl_t *c)
+{
+  const bench_cfg_t *p_cfg = c->p_cfg;
+  struct pollfd      pfd[2] = { { c->raw, POLLIN, 0 }, { c->udp, POLLIN, 0 } };
+  uint64_t           next_ns = timeGetTime64_ns() + c->cycle_ns;
+  uint64_t           now;
+  uint16_t           n_run;
+  uint16_t           n_done;
+
+  for (;;)
+  {
+    /* The device refuses a Connect while another AR is starting up */
+    for (uint16_t ix = 0; ix < p_cfg->nbr_ars; ix++)
+    {
+      if ((c->ars[ix].state == BENCH_AR_IDLE) &&
+          ((ix == 0) || (c->ars[ix - 1].state == BENCH_AR_RUN)))
+      {
+        if (bench_send_connect(c, ix) != 0)
+        {
+          return -1;
+        }
+      }
+    }
+
+    now = timeGetTime64_ns();
+    if (now >= next_ns)
+    {
+      for (uint16_t ix = 0; ix < p_cfg->nbr_ars; ix++)
+      {
+        if ((c->ars[ix].state >= BENCH_AR_PRMEND) && (c->ars[ix].state <= BENCH_AR_RUN))
+        {
+          bench_send_output(c, &c->ars[ix]);
+        }
+      }
+      c->p_result->n_cycles += c->measuring ? 1 : 0;
+      next_ns += c->cycle_ns;
+      if (next_ns <= now)
+      {
+        next_ns = now + c->cycle_ns;   /* Overrun, skip */
+      }
+    }
+
+    n_run = 0;
+    n_done = 0;
+    for (uint16_t ix = 0; ix < p_cfg->nbr_ars; ix++)
+    {
+      bench_ar_t *p_ar = &c->ars[ix];
+      if (p_ar->state == BENCH_AR_FAILED)
+      {
+        return -1;
+      }
+      if ((p_ar->state != BENCH_AR_IDLE) && (p_ar->state != BENCH_AR_RUN) && (p_ar->state != BENCH_AR_DONE) &&
+          ((now - p_ar->t_req_ns) > BENCH_RPC_TIMEOUT_NS))
+      {
+        bench_ar_fail(p_ar, "timeout");
+        return -1;
+      }
+      n_run += ((p_ar->state == BENCH_AR_RUN) && p_ar->got_data) ? 1 : 0;
+      n_done += (p_ar->state == BENCH_AR_DONE) ? 1 : 0;
+    }
+    if (n_done == p_cfg->nbr_ars)
+    {
+      return 0;
+    }
+    if ((c->measuring == false) && (c->measured == false) && (n_run == p_cfg->nbr_ars))
+    {
+      bench_measure_start(c, now);
+    }
+    if (c->measuring && (c->p_result->n_cycles >= p_cfg->nbr_cycles))
+    {
+      bench_measure_stop(c, now);
+      for (uint16_t ix = 0; ix < p_cfg->nbr_ars; ix++)
+      {
+        c->ars[ix].state = BENCH_AR_RELEASE;
+        if (bench_send_control(c, &c->ars[ix], PF_RPC_DEV_OPNUM_RELEASE, 0x0114, BIT(PF_CONTROL_COMMAND_BIT_RELEASE)) != 0)
+        {
+          return -1;
+        }
+      }
+    }
+
+    now = timeGetTime64_ns();
+    if (next_ns > now)
+    {
+      const struct timespec tmo = { 0, (long)(next_ns - now) };
+      (void)ppoll(pfd, NELEMENTS(pfd), &tmo, NULL);
+    }
+    bench_eth_recv_all(c);
+    bench_rpc_recv(c);
+  }
+}
+
+int bench_controller_run(const bench_cfg_t *p_cfg, bench_result_t *p_result)
+{
+  static bench_ctrl_t  ctrl;
+  bench_ctrl_t        *c = &ctrl;
+  struct sched_param   param = { .sched_priority = BENCH_CTRL_PRIO };
+  int                  ret = -1;
+
+  memset(c, 0, sizeof(*c));
+  memset(p_result, 0, sizeof(*p_result));
+  pf_histogram_reset(&p_result->inter_arrival);
+  pf_histogram_reset(&p_result->jitter);
+  c->p_cfg = p_cfg;
+  c->p_result = p_result;
+  c->raw = -1;
+  c->udp = -1;
+  c->dev_ip = p_cfg->device_ip;
+  c->cycle_ns = (uint64_t)p_cfg->reduction_ratio * 1000000ULL;
+  c->dht_ns = c->cycle_ns * p_cfg->data_hold_factor;
+  p_result->cycle_us = (uint32_t)(c->cycle_ns / 1000);
+
+  /* Stay on time even when the device keeps the CPU busy */
+  (void)pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+  if ((p_cfg->nbr_ars < 1) || (p_cfg->nbr_ars > BENCH_MAX_AR) ||
+      ((p_cfg->nbr_ars * p_cfg->nbr_modules) > BENCH_MAX_SLOTS))
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: at most %u ARs and %u modules in all\n", BENCH_MAX_AR, BENCH_MAX_SLOTS);
+  }
+  else if (bench_open_sockets(c) != 0)
+  {
+    /* Logged */
+  }
+  else if (bench_dcp_identify(c) != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "bench: no DCP identify response from %s\n", p_cfg->station_name);
+  }
+  else
+  {
+    for (uint16_t ix = 0; ix < p_cfg->nbr_ars; ix++)
+    {
+      bench_ar_setup(p_cfg, ix, &c->ars[ix]);
+    }
+    ret = bench_loop(c);
+  }
+
+  if (c->raw >= 0)
+  {
+    close(c->raw);
+  }
+  if (c->udp >= 0)
+  {
+    close(c->udp);
+  }
+  p_result->ok = (ret == 0);
+  return ret;
+}
@@ -0,0 +1,101 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 TGDrives, s.r.o.
+** https://www.tgdrives.cz
+**
+** This file is part of the TGMmini Profinet I/O device.
+**
+**
+**  TGMmini Profinet I/O device free software:
+**  you can redistribute it and/or modify it under the terms of the
+**  GNU General Public License as published by the Free Software Foundation,
+**  either version 3 of the License, or (at your option) any later version.
+**
+**  TGMmini Profinet I/O device is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License along with
+**  TGMmini Profinet I/O device. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+// bench_controller.h
+// minimal IO-controller emulator for pnet_bench
+//
+
+#ifndef bench_controller_h_included
+#define bench_controller_h_included
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pnet_api.h"
+
+/*
+ * CMSU of the device starts one AR at a time and refuses a Connect while
+ * another AR is up, PNET_MAX_AR > 1 is for an AR replacing an old one.
+ * The controller connects the ARs one after another, raise this when the
+ * device runs ARs side by side.
+ */
+#define BENCH_MAX_AR                1
+#define BENCH_MAX_SLOTS             (PNET_MAX_MODULES - 1)   /* Slot 0 is the DAP */
+
+/*
+ * The bench plugs any module the controller asks for. The module ident
+ * number tells the direction (1 input, 2 output) and the data size.
+ */
+#define BENCH_MODULE_IDENT(dir, size)  (0x00B00000 | ((uint32_t)(dir) << 12) | (uint32_t)(size))
+#define BENCH_MODULE_IS_BENCH(ident)   (((ident) & 0xFFFF0000) == 0x00B00000)
+#define BENCH_MODULE_DIR(ident)        (((ident) >> 12) & 0x0F)
+#define BENCH_MODULE_SIZE(ident)       ((ident) & 0x0FFF)
+#define BENCH_SUBMOD_IDENT             0x00000001
+#define BENCH_SUBSLOT                  1
+#define BENCH_MAX_DATA_SIZE            256
+
+typedef struct bench_cfg
+{
+  const char     *netns;              // network namespace of the controller
+  const char     *if_name;            // controller side of the veth pair
+  uint32_t        ctrl_ip;            // network byte order
+  uint32_t        device_ip;          // network byte order
+  const char     *station_name;       // of the device, for DCP identify
+  uint16_t        nbr_ars;            // 1 .. BENCH_MAX_AR
+  uint16_t        nbr_modules;        // per AR, alternating input and output
+  uint16_t        data_size;          // bytes per module
+  uint16_t        reduction_ratio;    // cycle = reduction_ratio * 1 ms
+  uint16_t        data_hold_factor;
+  uint32_t        nbr_cycles;         // measured cycles per run
+} bench_cfg_t;
+
+typedef struct bench_result
+{
+  bool            ok;
+  uint64_t        dcp_ns;             // DCP identify request to response
+  uint64_t        connect_ns;         // Connect request to response, slowest AR
+  uint64_t        startup_ns;         // Connect request to first valid input data, slowest AR
+  uint32_t        cycle_us;
+  uint32_t        n_cycles;           // output frames sent per AR while measuring
+  uint32_t        n_frames_in;        // input frames received while measuring
+  uint32_t        n_bad_frames;       // input frames with invalid data status
+  uint32_t        n_dht_missed;       // input gaps longer than the data hold time
+  uint64_t        run_ns;             // wall time of the measurement
+  uint64_t        process_cpu_ns;     // CPU time of the process while measuring
+  uint64_t        ctrl_cpu_ns;        // of which the controller thread
+  pnet_histogram_t inter_arrival;     // of input frames, per AR
+  pnet_histogram_t jitter;            // |inter arrival - cycle|
+} bench_result_t;
+
+/**
+ * Run one connect, measure and release sequence against the device.
+ *
+ * Must be called from a thread of its own, as the thread moves into the
+ * network namespace of the controller.
+ *
+ * @param p_cfg               In: Configuration of the run
+ * @param p_result            Out: Measurements
+ * @return 0 if the ARs were connected, run and released
+ *         -1 if an error occurred
+*/
+int bench_controller_run(const bench_cfg_t *p_cfg, bench_result_t *p_result);
+
+#endif // bench_controller_h_included
@@ -0,0 +1,517 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 TGDrives, s.r.o.
+** https://www.tgdrives.cz
+**
+** This file is part of the TGMmini Profinet I/O device.
+**
+**
+**  TGMmini Profinet I/O device free software:
+**  you can redistribute it and/or modify it under the terms of the
+**  GNU General Public License as published by the Free Software Foundation,
+**  either version 3 of the License, or (at your option) any later version.
+**
+**  TGMmini Profinet I/O device is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License along with
+**  TGMmini Profinet I/O device. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+// bench_micro.c
+// micro benchmarks of the internal tables of the p-net device stack
+//
+// Each benchmark builds its own stack instance with pf_arena_create() and
+// times the internal functions directly, so the cost per call shows how a
+// table scales. The unit tests check the behaviour, these only measure.
+//
+//   pnet_bench -u
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pf_includes.h"
+#include "bench_micro.h"
+
+#define BENCH_MICRO_ROUNDS      200000
+
+typedef struct bench_micro
+{
+  const char   *name;
+  int         (*fn)(void);
+} bench_micro_t;
+
+static uint64_t bench_micro_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/****************************** Frame id map **********************************/
+
+static int bench_micro_frame_handler(pnet_t *net, uint16_t frame_id, os_buf_t *p_buf, uint16_t frame_id_pos, void *p_arg)
+{
+  return 1;
+}
+
+static double bench_micro_eth_lookup_ns(pnet_t *net, uint16_t frame_id)
+{
+  volatile uint32_t found = 0;
+  uint64_t          start = bench_micro_now_ns();
+
+  for (uint32_t ix = 0; ix < BENCH_MICRO_ROUNDS; ix++)
+  {
+    found += (pf_eth_frame_id_map_find(net, frame_id) != NULL);
+  }
+  return (double)(bench_micro_now_ns() - start) / BENCH_MICRO_ROUNDS;
+}
+
+// Fill the frame id map as for an increasing number of ARs and CRs (DCP and
+// alarm frame ids first, as at runtime) and time the lookup of the most
+// recently added frame id and of a frame id that is not in the map.
+// The cost per frame should stay flat as the map grows.
+static int bench_micro_eth(void)
+{
+  pnet_t   *net = pf_arena_create(NULL);
+  uint16_t  frame_id = 0xC000;
+
+  if (net == NULL)
+  {
+    return -1;
+  }
+  pf_eth_init(net);
+  pf_eth_frame_id_map_add(net, PF_DCP_HELLO_FRAME_ID, bench_micro_frame_handler, NULL, false);
+  pf_eth_frame_id_map_add(net, PF_DCP_GET_SET_FRAME_ID, bench_micro_frame_handler, NULL, false);
+  pf_eth_frame_id_map_add(net, PF_DCP_ID_REQ_FRAME_ID, bench_micro_frame_handler, NULL, false);
+
+  for (uint16_t ar = 0; ar < PNET_MAX_API * PNET_MAX_AR; ar++)
+  {
+    pf_eth_frame_id_map_add(net, 0xfe01, bench_micro_frame_handler, NULL, false);
+    pf_eth_frame_id_map_add(net, 0xfc01, bench_micro_frame_handler, NULL, false);
+    for (uint16_t cr = 0; cr < PNET_MAX_CR; cr++)
+    {
+      pf_eth_frame_id_map_add(net, frame_id, bench_micro_frame_handler, NULL, false);
+      printf("eth     %u AR(s) %u CR(s): hit %.1f ns, miss %.1f ns per frame\n",
+             (unsigned)(ar + 1), (unsigned)(cr + 1),
+             bench_micro_eth_lookup_ns(net, frame_id), bench_micro_eth_lookup_ns(net, 0xBFFF));
+      frame_id++;
+    }
+  }
+
+  pf_arena_destroy(net);
+  return 0;
+}
+
+/******************************** CPM buffer **********************************/
+
+// Time the hand-over of a received frame to the application through the
+// triple buffer of an IOCR, as done once per frame and cycle.
+static int bench_micro_cpm(void)
+{
+  pnet_t     *net = pf_arena_create(NULL);
+  pf_cpm_t   *p_cpm;
+  os_buf_t   *p_buf;
+  uint8_t    *p_data;
+  bool        new_flag;
+  uint32_t    fetched = 0;
+  uint64_t    start;
+
+  if (net == NULL)
+  {
+    return -1;
+  }
+  p_cpm = &net->cmrpc_ar[0].iocrs[0].cpm;
+  pf_cpm_create(net, &net->cmrpc_ar[0], 0);
+
+  start = bench_micro_now_ns();
+  for (uint32_t ix = 0; ix < BENCH_MICRO_ROUNDS; ix++)
+  {
+    p_buf = os_buf_alloc_with_wait(OS_BUF_MAX_SIZE);
+    pf_cpm_put_buf(p_cpm, &p_buf, 16);
+    os_buf_free(p_buf);
+    pf_cpm_get_buf(p_cpm, &new_flag, &p_data);
+    pf_cpm_get_buf_end(p_cpm);
+    fetched += new_flag;
+  }
+  printf("cpm     put + get %.1f ns per frame, %u fetched\n",
+         (double)(bench_micro_now_ns() - start) / BENCH_MICRO_ROUNDS, (unsigned)fetched);
+
+  for (uint32_t ix = 0; ix < NELEMENTS(p_cpm->buffers); ix++)
+  {
+    os_buf_free(p_cpm->buffers[ix]);
+  }
+  pf_arena_destroy(net);
+  return (fetched == BENCH_MICRO_ROUNDS) ? 0 : -1;
+}
+
+/******************************** Scheduler ***********************************/
+
+#define BENCH_MICRO_SCHED_AR        1024    // Gives about 4000 timeouts
+#define BENCH_MICRO_SCHED_ROUNDS    100
+
+static const char *bench_micro_sched_name = "bench";
+
+static void bench_micro_sched_cb(pnet_t *net, void *arg, uint32_t current_time)
+{
+  (*(uint32_t *)arg)++;
+}
+
+// Time add, remove, idle tick and expiry with all timeouts of a stack
+// instance for many ARs in use.
+static int bench_micro_sched(void)
+{
+  pnet_cfg_t  cfg;
+  pnet_t     *net;
+  uint32_t   *timeouts;
+  uint32_t    n;
+  uint32_t    fired = 0;
+  uint64_t    start;
+  double      add_ns;
+  double      churn_ns;
+  double      tick_ns;
+  double      expiry_ns;
+
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.max_ar = BENCH_MICRO_SCHED_AR;
+  net = pf_arena_create(&cfg);
+  if (net == NULL)
+  {
+    return -1;
+  }
+  n = net->scheduler_max_timeouts;
+  timeouts = os_malloc(n * sizeof(timeouts[0]));
+  pf_scheduler_init(net, 1000);
+
+  // Spread the timeouts over all wheel levels, from 10 ms to 10 min
+  start = bench_micro_now_ns();
+  for (uint32_t ix = 0; ix < n; ix++)
+  {
+    pf_scheduler_add(net, 10000 + ((ix * 7919U) % 600000U) * 1000U,
+                     bench_micro_sched_name, bench_micro_sched_cb, &fired, &timeouts[ix]);
+  }
+  add_ns = (double)(bench_micro_now_ns() - start) / n;
+
+  // Re-arm every timeout, as PPM and CPM do each cycle
+  start = bench_micro_now_ns();
+  for (uint32_t round = 0; round < BENCH_MICRO_SCHED_ROUNDS; round++)
+  {
+    for (uint32_t ix = 0; ix < n; ix++)
+    {
+      pf_scheduler_remove(net, bench_micro_sched_name, timeouts[ix]);
+      pf_scheduler_add(net, 10000 + ix, bench_micro_sched_name, bench_micro_sched_cb, &fired, &timeouts[ix]);
+    }
+  }
+  churn_ns = (double)(bench_micro_now_ns() - start) / (BENCH_MICRO_SCHED_ROUNDS * n);
+
+  start = bench_micro_now_ns();
+  for (uint32_t round = 0; round < BENCH_MICRO_SCHED_ROUNDS; round++)
+  {
+    pf_scheduler_tick(net);
+  }
+  tick_ns = (double)(bench_micro_now_ns() - start) / BENCH_MICRO_SCHED_ROUNDS;
+
+  // Let all timeouts expire, and handle them in one tick
+  for (uint32_t ix = 0; ix < n; ix++)
+  {
+    pf_scheduler_remove(net, bench_micro_sched_name, timeouts[ix]);
+    pf_scheduler_add(net, ix % 500, bench_micro_sched_name, bench_micro_sched_cb, &fired, &timeouts[ix]);
+  }
+  os_usleep(2000);
+  start = bench_micro_now_ns();
+  pf_scheduler_tick(net);
+  expiry_ns = (double)(bench_micro_now_ns() - start) / n;
+
+  printf("sched   %u timeouts: add %.1f ns, remove+add %.1f ns, idle tick %.1f ns, expiry %.1f ns/timeout (%u fired)\n",
+         (unsigned)n, add_ns, churn_ns, tick_ns, expiry_ns, (unsigned)fired);
+
+  os_mutex_destroy(net->scheduler_timeout_mutex);
+  os_free(timeouts);
+  pf_arena_destroy(net);
+  return (fired == n) ? 0 : -1;
+}
+
+/******************************** Allocator ***********************************/
+
+// Time os_malloc() and os_free() of the sizes the stack allocates at
+// runtime. Build with USE_MEM_STATS to get the longest call as well.
+static int bench_micro_mem(void)
+{
+  os_mem_stats_t  stats;
+  void           *ptr;
+  uint64_t        start;
+  double          ns;
+
+  os_mem_reset_stats();
+  start = bench_micro_now_ns();
+  for (uint32_t ix = 0; ix < BENCH_MICRO_ROUNDS; ix++)
+  {
+    ptr = os_malloc(64 + (ix % 8) * 32);
+    os_free(ptr);
+  }
+  ns = (double)(bench_micro_now_ns() - start) / BENCH_MICRO_ROUNDS;
+  os_mem_get_stats(&stats);
+
+  printf("mem     %s: %.1f ns per os_malloc + os_free, max %u ns alloc, %u ns free\n",
+         stats.p_backend, ns, (unsigned)stats.alloc_ns_max, (unsigned)stats.free_ns_max);
+  return 0;
+}
+
+/******************************** Mailbox *************************************/
+
+#define BENCH_MICRO_MBOX_PRODUCERS  4
+#define BENCH_MICRO_MBOX_MSGS       50000   // Per producer
+#define BENCH_MICRO_MBOX_SIZE       64
+
+typedef struct bench_micro_mbox_producer
+{
+  os_mbox_t  *mbox;
+  uint32_t    id;
+  uint64_t    post_ns_max;     // Longest time to get a message posted
+} bench_micro_mbox_producer_t;
+
+static void *bench_micro_mbox_post(void *arg)
+{
+  bench_micro_mbox_producer_t *p_prod = (bench_micro_mbox_producer_t *)arg;
+  uint64_t                     t0;
+  uint64_t                     ns;
+
+  for (uint32_t seq = 1; seq <= BENCH_MICRO_MBOX_MSGS; seq++)
+  {
+    t0 = bench_micro_now_ns();
+    while (os_mbox_post(p_prod->mbox, (void *)(((uintptr_t)p_prod->id << 24) | seq)) != 0)
+    {
+      sched_yield();
+    }
+    ns = bench_micro_now_ns() - t0;
+    p_prod->post_ns_max = (ns > p_prod->post_ns_max) ? ns : p_prod->post_ns_max;
+  }
+  return NULL;
+}
+
+// Time os_mbox with several threads posting and one fetching, as the
+// receive threads and the stack do.
+static int bench_micro_mbox(void)
+{
+  bench_micro_mbox_producer_t  prod[BENCH_MICRO_MBOX_PRODUCERS];
+  pthread_t                    threads[BENCH_MICRO_MBOX_PRODUCERS];
+  uint32_t                     last[BENCH_MICRO_MBOX_PRODUCERS];
+  os_mbox_t                   *mbox = os_mbox_create(BENCH_MICRO_MBOX_SIZE);
+  uint32_t                     received = 0;
+  uint32_t                     errors = 0;
+  uint64_t                     post_ns_max = 0;
+  uint64_t                     start;
+  double                       ns;
+  void                        *msg;
+  uint32_t                     t;
+  uint32_t                     seq;
+
+  if (mbox == NULL)
+  {
+    return -1;
+  }
+  memset(last, 0, sizeof(last));
+
+  start = bench_micro_now_ns();
+  for (t = 0; t < BENCH_MICRO_MBOX_PRODUCERS; t++)
+  {
+    prod[t].mbox = mbox;
+    prod[t].id = t;
+    prod[t].post_ns_max = 0;
+    pthread_create(&threads[t], NULL, bench_micro_mbox_post, &prod[t]);
+  }
+  while (received < BENCH_MICRO_MBOX_PRODUCERS * BENCH_MICRO_MBOX_MSGS)
+  {
+    if (os_mbox_fetch(mbox, &msg) != 0)
+    {
+      sched_yield();
+      continue;
+    }
+    t = (uint32_t)((uintptr_t)msg >> 24);
+    seq = (uint32_t)((uintptr_t)msg & 0xFFFFFF);
+    if ((t >= BENCH_MICRO_MBOX_PRODUCERS) || (seq != last[t] + 1))
+    {
+      errors++;
+    }
+    else
+    {
+      last[t] = seq;
+    }
+    received++;
+  }
+  for (t = 0; t < BENCH_MICRO_MBOX_PRODUCERS; t++)
+  {
+    pthread_join(threads[t], NULL);
+    post_ns_max = (prod[t].post_ns_max > post_ns_max) ? prod[t].post_ns_max : post_ns_max;
+  }
+  ns = (double)(bench_micro_now_ns() - start) / received;
+
+  printf("mbox    %u producers: %.1f ns per message, post max %u ns, %u out of order\n",
+         (unsigned)BENCH_MICRO_MBOX_PRODUCERS, ns, (unsigned)post_ns_max, (unsigned)errors);
+
+  os_mbox_destroy(mbox);
+  return (errors == 0) ? 0 : -1;
+}
+
+/******************************** Sub-slots ***********************************/
+
+// Plug a submodule in each sub-slot of each slot, as far as there is room.
+static int bench_micro_plug_all(pnet_t *net)
+{
+  for (uint16_t slot = 0; slot < PNET_MAX_MODULES; slot++)
+  {
+    for (uint16_t subslot = 1; subslot <= PNET_MAX_SUBMODULES; subslot++)
+    {
+      if (pf_cmdev_plug_submodule(net, 0, slot, subslot, 0x100 + slot, subslot,
+                                  PNET_DIR_IO, 1, 1, false) != 0)
+      {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static double bench_micro_cmdev_lookup_ns(pnet_t *net, uint16_t slot, uint16_t subslot, uint32_t *p_found)
+{
+  pf_subslot_t *p_subslot = NULL;
+  uint64_t      start = bench_micro_now_ns();
+
+  for (uint32_t ix = 0; ix < BENCH_MICRO_ROUNDS; ix++)
+  {
+    *p_found += (pf_cmdev_get_subslot_full(net, 0, slot, subslot, &p_subslot) == 0);
+  }
+  return (double)(bench_micro_now_ns() - start) / BENCH_MICRO_ROUNDS;
+}
+
+// Time the lookup of the first and of the last sub-slot, and of a slot that
+// does not exist, with all slots and sub-slots plugged. Build with a large
+// PNET_MAX_MODULES to get hundreds of modules. The cost should not depend
+// on the number of modules.
+static int bench_micro_cmdev(void)
+{
+  pnet_t            *net = pf_arena_create(NULL);
+  uint32_t           found = 0;
+  double             first_ns;
+  double             last_ns;
+  double             miss_ns;
+  int                ret;
+
+  if (net == NULL)
+  {
+    return -1;
+  }
+  pf_cmdev_init(net);
+  ret = bench_micro_plug_all(net);
+  if (ret == 0)
+  {
+    first_ns = bench_micro_cmdev_lookup_ns(net, 0, 1, &found);
+    last_ns = bench_micro_cmdev_lookup_ns(net, PNET_MAX_MODULES - 1, PNET_MAX_SUBMODULES, &found);
+    miss_ns = bench_micro_cmdev_lookup_ns(net, PNET_MAX_MODULES, 1, &found);
+    printf("cmdev   %u modules x %u submodules: first %.1f ns, last %.1f ns, miss %.1f ns per lookup\n",
+           (unsigned)PNET_MAX_MODULES, (unsigned)PNET_MAX_SUBMODULES, first_ns, last_ns, miss_ns);
+    ret = (found == 2 * BENCH_MICRO_ROUNDS) ? 0 : -1;
+  }
+
+  pf_cmdev_exit(net);
+  pf_arena_destroy(net);
+  return ret;
+}
+
+/******************************** Record read *********************************/
+
+static double bench_micro_cmrdr_read_ns(pnet_t *net, uint8_t *p_buf, uint16_t size, uint32_t *p_errors)
+{
+  pf_iod_read_request_t read_request;
+  pnet_result_t         read_status;
+  uint16_t              pos;
+  uint64_t              start = bench_micro_now_ns();
+
+  for (uint32_t ix = 0; ix < BENCH_MICRO_ROUNDS; ix++)
+  {
+    memset(&read_request, 0, sizeof(read_request));
+    memset(&read_status, 0, sizeof(read_status));
+    read_request.index = PF_IDX_API_REAL_ID_DATA;
+    pos = 0;
+    if ((pf_cmrdr_rm_read_ind(net, NULL, PF_RPC_DEV_OPNUM_READ_IMPLICIT, &read_request,
+                              &read_status, size, p_buf, &pos) != 0) ||
+        (read_status.pnio_status.error_code != 0))
+    {
+      (*p_errors)++;
+    }
+  }
+  return (double)(bench_micro_now_ns() - start) / BENCH_MICRO_ROUNDS;
+}
+
+// Time a repeated implicit read of the real identification data of the API,
+// with all slots and sub-slots plugged, from the CMRDR cache and built again
+// each time.
+static int bench_micro_cmrdr(void)
+{
+  pnet_t   *net = pf_arena_create(NULL);
+  uint8_t   buf[PF_FRAME_BUFFER_SIZE];
+  uint32_t  errors = 0;
+  uint32_t  hits;
+  double    cached_ns;
+  double    built_ns;
+  int       ret;
+
+  if (net == NULL)
+  {
+    return -1;
+  }
+  pf_cmrdr_init(net);
+  pf_cmdev_init(net);
+  ret = bench_micro_plug_all(net);
+  if (ret == 0)
+  {
+    cached_ns = bench_micro_cmrdr_read_ns(net, buf, sizeof(buf), &errors);
+    hits = net->cmrdr_cache_hits;
+
+    /* Version 0 disables the cache */
+    atomic_store(&net->cmrdr_cache_version, 0U);
+    built_ns = bench_micro_cmrdr_read_ns(net, buf, sizeof(buf), &errors);
+    printf("cmrdr   API real identification read: cached %.1f ns, built %.1f ns per read\n",
+           cached_ns, built_ns);
+    ret = ((errors == 0) && (hits == BENCH_MICRO_ROUNDS - 1)) ? 0 : -1;
+  }
+
+  pf_cmdev_exit(net);
+  pf_arena_destroy(net);
+  return ret;
+}
+
+/******************************** Runner **************************************/
+
+static const bench_micro_t bench_micro_list[] =
+{
+  { "eth",       bench_micro_eth },
+  { "cpm",       bench_micro_cpm },
+  { "sched",     bench_micro_sched },
+  { "mem",       bench_micro_mem },
+  { "mbox",      bench_micro_mbox },
+  { "cmdev",     bench_micro_cmdev },
+  { "cmrdr",     bench_micro_cmrdr },
+};
+
+int bench_micro_run(void)
+{
+  int ret = 0;
+
+  for (size_t ix = 0; ix < NELEMENTS(bench_micro_list); ix++)
+  {
+    if (bench_micro_list[ix].fn() != 0)
+    {
+      printf("%-7s failed\n", bench_micro_list[ix].name);
+      ret = -1;
+    }
+  }
+  return ret;
+}
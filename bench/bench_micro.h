@@ -0,0 +1,37 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 TGDrives, s.r.o.
+** https://www.tgdrives.cz
+**
+** This file is part of the TGMmini Profinet I/O device.
+**
+**
+**  TGMmini Profinet I/O device free software:
+**  you can redistribute it and/or modify it under the terms of the
+**  GNU General Public License as published by the Free Software Foundation,
+**  either version 3 of the License, or (at your option) any later version.
+**
+**  TGMmini Profinet I/O device is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License along with
+**  TGMmini Profinet I/O device. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+// bench_micro.h
+// micro benchmarks of the internal tables of the p-net device stack
+//
+
+#ifndef bench_micro_h_included
+#define bench_micro_h_included
+
+/**
+ * Run the micro benchmarks and print one line per measurement.
+ * They need neither root nor a network interface.
+ * @return 0 if all benchmarks ran, -1 otherwise.
+ */
+int bench_micro_run(void);
+
+#endif // bench_micro_h_included
@@ -0,0 +1,528 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 TGDrives, s.r.o.
+** https://www.tgdrives.cz
+**
+** This file is part of the TGMmini Profinet I/O device.
+**
+**
+**  TGMmini Profinet I/O device free software:
+**  you can redistribute it and/or modify it under the terms of the
+**  GNU General Public License as published by the Free Software Foundation,
+**  either version 3 of the License, or (at your option) any later version.
+**
+**  TGMmini Profinet I/O device is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License along with
+**  TGMmini Profinet I/O device. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+// pnet_bench.c
+// end-to-end benchmark of the p-net device stack
+//
+// Runs the stack on one end of a veth pair and the controller emulator of
+// bench_controller.c in a network namespace on the other end, and reports
+// the connect time, the cycle jitter, the missed data hold times and the
+// CPU time per cycle for each number of ARs and modules.
+//
+// Needs root, for the network namespace and the raw sockets:
+//   pnet_bench -a 2 -m 4 -S
+//
+// The micro benchmarks of bench_micro.c run without root:
+//   pnet_bench -u
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "pf_includes.h"
+#include "config.h"
+#include "utils.h"
+#include "bench_controller.h"
+#include "bench_micro.h"
+
+#define BENCH_NETNS             "pnbench"
+#define BENCH_DEV_IF            "pnb0"
+#define BENCH_CTRL_IF           "pnb1"
+#define BENCH_DEV_IP            "10.253.0.1"
+#define BENCH_CTRL_IP           "10.253.0.2"
+#define BENCH_STATION_NAME      "pnet-bench"
+#define BENCH_TICK_STACKSIZE    (64 * 1024)   /* The whole stack runs in this thread */
+
+typedef struct bench_app
+{
+  app_data_t          appdata;        // First, the osal threads look at running
+  pnet_t             *net;
+  uint32_t            slot_ident[PNET_MAX_MODULES];
+  bool                slot_new[PNET_MAX_MODULES]; // plugged for the AR starting up
+  volatile uint32_t   arep_ready[BENCH_MAX_AR];   // waiting for pnet_application_ready()
+  uint32_t            areps[BENCH_MAX_AR];
+  pnet_iocr_statistics_t iocr_stats[BENCH_MAX_AR][2];
+  bool                iocr_stats_valid[BENCH_MAX_AR];
+  volatile uint32_t   n_dht_aborts;
+  uint8_t             counter;
+} bench_app_t;
+
+int log_to_file;
+
+static bench_app_t  bench_app;
+static pf_device_t  bench_device;
+
+/******************************* Callbacks ************************************/
+
+static int bench_state_ind(pnet_t *net, void *arg, uint32_t arep, pnet_event_values_t state)
+{
+  bench_app_t *p_app = (bench_app_t *)arg;
+  uint16_t     err_cls = 0;
+  uint16_t     err_code = 0;
+  uint16_t     ix;
+
+  for (ix = 0; (ix < BENCH_MAX_AR) && (p_app->areps[ix] != arep) && (p_app->areps[ix] != UINT32_MAX); ix++)
+  {
+  }
+  if (ix == BENCH_MAX_AR)
+  {
+    return 0;
+  }
+
+  if (state == PNET_EVENT_PRMEND)
+  {
+    p_app->areps[ix] = arep;
+    (void)pnet_input_set_data_and_iops(net, APP_API, PNET_SLOT_DAP_IDENT, PNET_SUBMOD_DAP_IDENT, NULL, 0, PNET_IOXS_GOOD);
+    (void)pnet_input_set_data_and_iops(net, APP_API, PNET_SLOT_DAP_IDENT, PNET_SUBMOD_DAP_INTERFACE_1_IDENT, NULL, 0, PNET_IOXS_GOOD);
+    (void)pnet_input_set_data_and_iops(net, APP_API, PNET_SLOT_DAP_IDENT, PNET_SUBMOD_DAP_INTERFACE_1_PORT_0_IDENT, NULL, 0, PNET_IOXS_GOOD);
+    /* Only the outputs of this AR, the controller connects one AR at a time */
+    for (uint16_t slot = 1; slot < PNET_MAX_MODULES; slot++)
+    {
+      if (p_app->slot_new[slot] && (BENCH_MODULE_DIR(p_app->slot_ident[slot]) == PNET_DIR_OUTPUT))
+      {
+        (void)pnet_output_set_iocs(net, APP_API, slot, BENCH_SUBSLOT, PNET_IOXS_GOOD);
+      }
+      p_app->slot_new[slot] = false;
+    }
+    (void)pnet_set_provider_state(net, true);
+    p_app->arep_ready[ix] = arep;
+  }
+  else if (state == PNET_EVENT_ABORT)
+  {
+    /* The AR is still there, keep its statistics for the report */
+    p_app->iocr_stats_valid[ix] =
+      (pnet_get_iocr_statistics(net, arep, 0, &p_app->iocr_stats[ix][0]) == 0) &&
+      (pnet_get_iocr_statistics(net, arep, 1, &p_app->iocr_stats[ix][1]) == 0);
+    if ((pnet_get_ar_error_codes(net, arep, &err_cls, &err_code) == 0) &&
+        (err_cls == PNET_ERROR_CODE_1_RTA_ERR_CLS_PROTOCOL) &&
+        (err_code == PNET_ERROR_CODE_2_ABORT_AR_CONSUMER_DHT_EXPIRED))
+    {
+      p_app->n_dht_aborts++;
+    }
+    p_app->arep_ready[ix] = UINT32_MAX;
+    p_app->areps[ix] = UINT32_MAX;
+  }
+  return 0;
+}
+
+static int bench_exp_module_ind(pnet_t *net, void *arg, uint32_t api, uint16_t slot, uint32_t module_ident_number)
+{
+  bench_app_t *p_app = (bench_app_t *)arg;
+
+  if ((slot >= PNET_MAX_MODULES) ||
+      ((module_ident_number != PNET_MOD_DAP_IDENT) && !BENCH_MODULE_IS_BENCH(module_ident_number)))
+  {
+    return -1;
+  }
+  (void)pnet_pull_module(net, api, slot);
+  p_app->slot_ident[slot] = module_ident_number;
+  p_app->slot_new[slot] = true;
+  return pnet_plug_module(net, api, slot, module_ident_number);
+}
+
+static int bench_exp_submodule_ind(pnet_t *net, void *arg, uint32_t api, uint16_t slot, uint16_t subslot, uint32_t module_ident_number, uint32_t submodule_ident_number)
+{
+  pnet_submodule_dir_t dir = PNET_DIR_NO_IO;
+  uint16_t             in_len = 0;
+  uint16_t             out_len = 0;
+
+  (void)arg;
+  if (BENCH_MODULE_IS_BENCH(module_ident_number))
+  {
+    dir = (pnet_submodule_dir_t)BENCH_MODULE_DIR(module_ident_number);
+    in_len = (dir == PNET_DIR_INPUT) ? BENCH_MODULE_SIZE(module_ident_number) : 0;
+    out_len = (dir == PNET_DIR_OUTPUT) ? BENCH_MODULE_SIZE(module_ident_number) : 0;
+  }
+  else if (module_ident_number != PNET_MOD_DAP_IDENT)
+  {
+    return -1;
+  }
+  (void)pnet_pull_submodule(net, api, slot, subslot);
+  return pnet_plug_submodule(net, api, slot, subslot, module_ident_number, submodule_ident_number, dir, in_len, out_len);
+}
+
+static void bench_plug_dap(pnet_t *net, bench_app_t *p_app)
+{
+  const uint16_t subslots[] = { PNET_SUBMOD_DAP_IDENT, PNET_SUBMOD_DAP_INTERFACE_1_IDENT, PNET_SUBMOD_DAP_INTERFACE_1_PORT_0_IDENT };
+
+  (void)bench_exp_module_ind(net, p_app, APP_API, PNET_SLOT_DAP_IDENT, PNET_MOD_DAP_IDENT);
+  for (uint16_t i = 0; i < NELEMENTS(subslots); i++)
+  {
+    (void)bench_exp_submodule_ind(net, p_app, APP_API, PNET_SLOT_DAP_IDENT, subslots[i], PNET_MOD_DAP_IDENT, subslots[i]);
+  }
+}
+
+/*************************** Device application *******************************/
+
+/* What an application does each tick: new inputs, read the outputs */
+static void bench_app_tick(pnet_t *net, bench_app_t *p_app)
+{
+  uint8_t  data[BENCH_MAX_DATA_SIZE];
+  uint16_t len;
+  uint8_t  iops;
+  bool     new_flag;
+
+  p_app->counter++;
+  pnet_input_batch_begin(net);
+  for (uint16_t slot = 1; slot < PNET_MAX_MODULES; slot++)
+  {
+    const uint32_t ident = p_app->slot_ident[slot];
+    if (!BENCH_MODULE_IS_BENCH(ident))
+    {
+      continue;
+    }
+    len = BENCH_MODULE_SIZE(ident);
+    if (BENCH_MODULE_DIR(ident) == PNET_DIR_INPUT)
+    {
+      memset(data, p_app->counter, len);
+      (void)pnet_input_set_data_and_iops(net, APP_API, slot, BENCH_SUBSLOT, data, len, PNET_IOXS_GOOD);
+    }
+    else
+    {
+      len = sizeof(data);
+      (void)pnet_output_get_data_and_iops(net, APP_API, slot, BENCH_SUBSLOT, &new_flag, data, &len, &iops);
+    }
+  }
+  pnet_input_batch_end(net);
+
+  /* Only now, pnet_application_ready() wants data for all the inputs */
+  for (uint16_t ix = 0; ix < BENCH_MAX_AR; ix++)
+  {
+    const uint32_t arep = p_app->arep_ready[ix];
+    if (arep != UINT32_MAX)
+    {
+      p_app->arep_ready[ix] = UINT32_MAX;
+      (void)pnet_application_ready(net, arep);
+    }
+  }
+}
+
+/* Like the timer thread of the sample application */
+static void *bench_tick_thread(void *arg)
+{
+  bench_app_t    *p_app = (bench_app_t *)arg;
+  pnet_t         *net = p_app->net;
+  struct timespec ts;
+  uint64_t        t_next;
+  uint64_t        t_now;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  t_next = ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+
+  while (p_app->appdata.running)
+  {
+    t_next += TICK_INTERVAL_US * 1000ULL;
+    for (;;)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      t_now = ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+      if (t_now >= t_next)
+      {
+        break;
+      }
+      (void)pnet_handle_rpc(net, (uint32_t)((t_next - t_now) / 1000));
+    }
+    bench_app_tick(net, p_app);
+    pnet_handle_periodic(net);
+  }
+  return NULL;
+}
+
+/***************************** Network setup **********************************/
+
+static int bench_run_cmd(const char *p_cmd)
+{
+  const int ret = system(p_cmd);
+  if (ret != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "pnet_bench: '%s' failed\n", p_cmd);
+  }
+  return (ret == 0) ? 0 : -1;
+}
+
+static void bench_net_teardown(void)
+{
+  (void)system("ip link del " BENCH_DEV_IF " 2>/dev/null");
+  (void)system("ip netns del " BENCH_NETNS " 2>/dev/null");
+}
+
+static int bench_net_setup(void)
+{
+  bench_net_teardown();
+  if ((bench_run_cmd("ip netns add " BENCH_NETNS) != 0) ||
+      (bench_run_cmd("ip link add " BENCH_DEV_IF " type veth peer name " BENCH_CTRL_IF) != 0) ||
+      (bench_run_cmd("ip link set " BENCH_CTRL_IF " netns " BENCH_NETNS) != 0) ||
+      (bench_run_cmd("ip addr add " BENCH_DEV_IP "/24 dev " BENCH_DEV_IF) != 0) ||
+      (bench_run_cmd("ip link set " BENCH_DEV_IF " up") != 0) ||
+      (bench_run_cmd("ip netns exec " BENCH_NETNS " ip addr add " BENCH_CTRL_IP "/24 dev " BENCH_CTRL_IF) != 0) ||
+      (bench_run_cmd("ip netns exec " BENCH_NETNS " ip link set " BENCH_CTRL_IF " up") != 0) ||
+      (bench_run_cmd("ip netns exec " BENCH_NETNS " ip link set lo up") != 0))
+  {
+    bench_net_teardown();
+    return -1;
+  }
+  return 0;
+}
+
+/******************************** Report **************************************/
+
+static void *bench_ctrl_thread(void *arg)
+{
+  void **pp_arg = (void **)arg;
+  (void)bench_controller_run((const bench_cfg_t *)pp_arg[0], (bench_result_t *)pp_arg[1]);
+  return NULL;
+}
+
+static void bench_print_header(void)
+{
+  printf("ARs mods size cycle_us   dcp_ms conn_ms  start_ms  jit_avg_us jit_max_us  missed_dht  dev_cpu_us/cycle  result\n");
+}
+
+static void bench_print_result(const bench_cfg_t *p_cfg, const bench_result_t *p_res, uint32_t n_dht_aborts)
+{
+  const uint64_t dev_cpu_ns = (p_res->process_cpu_ns > p_res->ctrl_cpu_ns) ? p_res->process_cpu_ns - p_res->ctrl_cpu_ns : 0;
+  const uint32_t n = p_res->jitter.count;
+
+  printf("%3u %4u %4u %8u %8.2f %7.2f %9.2f %11.1f %10.1f %5u + %-5u %17.1f  %s\n",
+         (unsigned)p_cfg->nbr_ars, (unsigned)p_cfg->nbr_modules, (unsigned)p_cfg->data_size,
+         (unsigned)p_res->cycle_us,
+         p_res->dcp_ns / 1e6, p_res->connect_ns / 1e6, p_res->startup_ns / 1e6,
+         (n > 0) ? (p_res->jitter.sum_ns / 1e3) / n : 0.0,
+         p_res->jitter.max_ns / 1e3,
+         (unsigned)p_res->n_dht_missed, (unsigned)n_dht_aborts,
+         (p_res->n_cycles > 0) ? (dev_cpu_ns / 1e3) / p_res->n_cycles : 0.0,
+         p_res->ok ? "ok" : "FAILED");
+}
+
+static void bench_print_details(const bench_result_t *p_res, const bench_app_t *p_app)
+{
+  char name[48];
+
+  printf("   %u cycles, %u input frames, %u with bad data status, %.1f ms\n",
+         (unsigned)p_res->n_cycles, (unsigned)p_res->n_frames_in, (unsigned)p_res->n_bad_frames,
+         p_res->run_ns / 1e6);
+  pf_histogram_show("controller: input inter-arrival", &p_res->inter_arrival);
+  pf_histogram_show("controller: input jitter", &p_res->jitter);
+  for (uint16_t ix = 0; ix < BENCH_MAX_AR; ix++)
+  {
+    for (uint16_t crep = 0; p_app->iocr_stats_valid[ix] && (crep < 2); crep++)
+    {
+      const pnet_iocr_statistics_t *p_stats = &p_app->iocr_stats[ix][crep];
+      printf("   device: AR %u frame 0x%04x: %u sent, %u received, %u errors\n", (unsigned)ix,
+             (unsigned)p_stats->frame_id, (unsigned)p_stats->ppm_send_cnt,
+             (unsigned)p_stats->cpm_recv_cnt, (unsigned)p_stats->cpm_err_cnt);
+      snprintf(name, sizeof(name), "device: AR %u send deviation", (unsigned)ix);
+      if (p_stats->ppm_send_deviation.count > 0)
+      {
+        pf_histogram_show(name, &p_stats->ppm_send_deviation);
+      }
+      snprintf(name, sizeof(name), "device: AR %u output inter-arrival", (unsigned)ix);
+      if (p_stats->cpm_inter_arrival.count > 0)
+      {
+        pf_histogram_show(name, &p_stats->cpm_inter_arrival);
+      }
+    }
+  }
+}
+
+/**
+ * Run the controller against the device once, and print the result.
+ * @return 0 if the run succeeded, -1 if not
+*/
+static int bench_run_one(const bench_cfg_t *p_cfg, int verbosity)
+{
+  static bench_result_t result;
+  void                 *args[2] = { (void *)p_cfg, &result };
+  pthread_t             thread;
+
+  memset(bench_app.iocr_stats_valid, 0, sizeof(bench_app.iocr_stats_valid));
+  bench_app.n_dht_aborts = 0;
+  if (pthread_create(&thread, NULL, bench_ctrl_thread, args) != 0)
+  {
+    return -1;
+  }
+  (void)pthread_join(thread, NULL);
+
+  /* Let the device finish the release */
+  os_usleep(100 * 1000);
+  bench_print_result(p_cfg, &result, bench_app.n_dht_aborts);
+  if (verbosity > 0)
+  {
+    bench_print_details(&result, &bench_app);
+  }
+  return result.ok ? 0 : -1;
+}
+
+static void bench_usage(void)
+{
+  printf("Usage: pnet_bench [options]\n"
+         "  -a <n>   number of ARs, 1 .. %u (default 1)\n"
+         "  -m <n>   modules per AR, alternating input and output (default 2)\n"
+         "  -s <n>   data bytes per module (default 8)\n"
+         "  -r <n>   reduction ratio, cycle time in ms (default 1)\n"
+         "  -d <n>   data hold factor (default 3)\n"
+         "  -c <n>   measured cycles per run (default 5000)\n"
+         "  -S       sweep 1 .. a ARs and 1, 2, 4 .. m modules per AR\n"
+         "  -v       show histograms and the device IOCR statistics\n"
+         "  -u       only run the micro benchmarks of the internal tables\n"
+         "Total modules may not exceed %u.\n",
+         (unsigned)BENCH_MAX_AR, (unsigned)BENCH_MAX_SLOTS);
+}
+
+/******************************** Main ****************************************/
+
+int main(int argc, char *argv[])
+{
+  static pnet_cfg_t cfg;
+  pnet_footprint_t  footprint;
+  bench_cfg_t       bench_cfg;
+  bool              sweep = false;
+  int               verbosity = 0;
+  int               n_failed = 0;
+  int               opt;
+  uint32_t          ip;
+
+  memset(&bench_cfg, 0, sizeof(bench_cfg));
+  bench_cfg.netns = "/var/run/netns/" BENCH_NETNS;
+  bench_cfg.if_name = BENCH_CTRL_IF;
+  bench_cfg.ctrl_ip = inet_addr(BENCH_CTRL_IP);
+  bench_cfg.device_ip = inet_addr(BENCH_DEV_IP);
+  bench_cfg.station_name = BENCH_STATION_NAME;
+  bench_cfg.nbr_ars = 1;
+  bench_cfg.nbr_modules = 2;
+  bench_cfg.data_size = 8;
+  bench_cfg.reduction_ratio = 1;
+  bench_cfg.data_hold_factor = 3;
+  bench_cfg.nbr_cycles = 5000;
+
+  while ((opt = getopt(argc, argv, "a:m:s:r:d:c:Svuh")) != -1)
+  {
+    switch (opt)
+    {
+    case 'a': bench_cfg.nbr_ars = (uint16_t)atoi(optarg); break;
+    case 'm': bench_cfg.nbr_modules = (uint16_t)atoi(optarg); break;
+    case 's': bench_cfg.data_size = (uint16_t)atoi(optarg); break;
+    case 'r': bench_cfg.reduction_ratio = (uint16_t)atoi(optarg); break;
+    case 'd': bench_cfg.data_hold_factor = (uint16_t)atoi(optarg); break;
+    case 'c': bench_cfg.nbr_cycles = (uint32_t)atoi(optarg); break;
+    case 'S': sweep = true; break;
+    case 'v': verbosity++; break;
+    case 'u': return (bench_micro_run() == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    default:
+      bench_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if ((bench_cfg.nbr_ars < 1) || (bench_cfg.nbr_ars > BENCH_MAX_AR) || (bench_cfg.nbr_modules < 1) ||
+      ((bench_cfg.nbr_ars * bench_cfg.nbr_modules) > BENCH_MAX_SLOTS) ||
+      (bench_cfg.data_size < 1) || (bench_cfg.data_size > BENCH_MAX_DATA_SIZE) ||
+      (bench_cfg.reduction_ratio < 1) || (bench_cfg.data_hold_factor < 1))
+  {
+    bench_usage();
+    return EXIT_FAILURE;
+  }
+
+  if (bench_net_setup() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+
+  memset(&bench_app, 0, sizeof(bench_app));
+  memset(bench_app.areps, 0xff, sizeof(bench_app.areps));
+  memset((void *)bench_app.arep_ready, 0xff, sizeof(bench_app.arep_ready));
+  bench_app.appdata.running = true;
+  bench_app.appdata.main_arep = UINT32_MAX;
+  strcpy(bench_app.appdata.arguments.eth_interface, BENCH_DEV_IF);
+  strcpy(bench_app.appdata.arguments.station_name, BENCH_STATION_NAME);
+  os_init(&bench_app.appdata);
+
+  /* The device */
+  ip = inet_addr(BENCH_DEV_IP);
+  cfg.state_cb = bench_state_ind;
+  cfg.exp_module_cb = bench_exp_module_ind;
+  cfg.exp_submodule_cb = bench_exp_submodule_ind;
+  cfg.cb_arg = &bench_app;
+  cfg.im_0_data.vendor_id_hi = 0x05;
+  cfg.im_0_data.vendor_id_lo = 0x44;
+  cfg.im_0_data.im_supported = 0x001e;
+  cfg.device_id = (pnet_cfg_device_id_t){ 0x05, 0x44, 0x00, 0x01 };
+  cfg.oem_device_id = cfg.device_id;
+  strcpy(cfg.station_name, BENCH_STATION_NAME);
+  strcpy(cfg.device_vendor, "TGDrives");
+  strcpy(cfg.lldp_cfg.chassis_id, BENCH_STATION_NAME);
+  strcpy(cfg.lldp_cfg.port_id, "port-001");
+  cfg.lldp_cfg.ttl = 20;
+  cfg.ip_sys_addr = ip;
+  copy_ip_to_struct(&cfg.ip_addr, ip);
+  copy_ip_to_struct(&cfg.ip_mask, inet_addr("255.255.255.0"));
+  copy_ip_to_struct(&cfg.ip_gateway, ip);
+  cfg.p_default_device = &bench_device;
+  if (read_mac_address(BENCH_DEV_IF, &cfg.eth_addr) != 0)
+  {
+    bench_net_teardown();
+    return EXIT_FAILURE;
+  }
+
+  bench_app.net = pnet_init(BENCH_DEV_IF, TICK_INTERVAL_US, &cfg);
+  if (bench_app.net == NULL)
+  {
+    os_log(LOG_LEVEL_ERROR, "pnet_bench: pnet_init failed\n");
+    bench_net_teardown();
+    return EXIT_FAILURE;
+  }
+  pnet_get_footprint(bench_app.net, &footprint);
+  printf("Device: %u bytes for %u ARs, %u sessions, %u diag items\n", (unsigned)footprint.total,
+         (unsigned)footprint.max_ar, (unsigned)footprint.max_sessions, (unsigned)footprint.max_diag_items);
+  bench_plug_dap(bench_app.net, &bench_app);
+  bench_app.appdata.timer_thread = os_thread_create("bench_tick", TIMER_PRIO, BENCH_TICK_STACKSIZE, bench_tick_thread, &bench_app);
+
+  bench_print_header();
+  if (sweep)
+  {
+    const bench_cfg_t base = bench_cfg;
+    for (uint16_t ars = 1; ars <= base.nbr_ars; ars++)
+    {
+      for (uint16_t mods = 1; (mods <= base.nbr_modules) && ((ars * mods) <= BENCH_MAX_SLOTS); mods *= 2)
+      {
+        bench_cfg.nbr_ars = ars;
+        bench_cfg.nbr_modules = mods;
+        n_failed += (bench_run_one(&bench_cfg, verbosity) != 0) ? 1 : 0;
+      }
+    }
+  }
+  else
+  {
+    n_failed += (bench_run_one(&bench_cfg, verbosity) != 0) ? 1 : 0;
+  }
+
+  bench_app.appdata.running = false;
+  os_usleep(100 * 1000);
+  bench_net_teardown();
+  os_log_flush();
+  return (n_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
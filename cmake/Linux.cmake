@@ -21,9 +21,46 @@ if (USE_SCHED_FIFO)
   add_compile_definitions(USE_SCHED_FIFO)
 endif()
 
+option (USE_PACKET_RX_RING
+  "Receive raw Ethernet frames via a memory mapped TPACKET_V3 ring. Falls back to recv() if unavailable"
+  OFF)
+
+if (USE_PACKET_RX_RING)
+  add_compile_definitions(USE_PACKET_RX_RING)
+endif()
+
+option (USE_RUN_TO_COMPLETION
+  "Do not start Ethernet receive threads. The stack is driven by pnet_run_to_completion() in one thread"
+  OFF)
+
+if (USE_RUN_TO_COMPLETION)
+  add_compile_definitions(USE_RUN_TO_COMPLETION)
+endif()
+
+option (USE_RPMALLOC
+  "Use the thread caching rpmalloc allocator for os_malloc and os_free"
+  OFF)
+
+if (USE_RPMALLOC)
+  add_compile_definitions(USE_RPMALLOC)
+  target_sources(profinet
+    PRIVATE
+    src/rpmalloc/rpmalloc.c
+    )
+endif()
+
+option (USE_MEM_STATS
+  "Count and time os_malloc and os_free calls, see os_mem_get_stats()"
+  OFF)
+
+if (USE_MEM_STATS)
+  add_compile_definitions(USE_MEM_STATS)
+endif()
+
 target_include_directories(profinet
   PRIVATE
   src/osal/linux
+  src/rpmalloc
   )
 
 target_sources(profinet
@@ -31,6 +68,7 @@ target_sources(profinet
   src/osal/linux/osal.c
   src/osal/linux/osal_eth.c
   src/osal/linux/osal_udp.c
+  src/osal/linux/osal_netif.c
   )
 
 target_compile_options(profinet
@@ -61,6 +99,37 @@ target_sources(pn_dev
   sample_app/main_linux.c
   )
 
+option (BUILD_BENCH
+  "Build pnet_bench, the controller emulator and micro benchmarks"
+  OFF)
+
+if (BUILD_BENCH)
+  add_executable(pnet_bench "")
+
+  target_include_directories(pnet_bench
+    PRIVATE
+    ${PROFINET_BINARY_DIR}/src
+    src
+    src/common
+    src/device
+    src/osal/linux
+    sample_app
+    )
+
+  target_sources(pnet_bench
+    PRIVATE
+    bench/pnet_bench.c
+    bench/bench_controller.c
+    bench/bench_micro.c
+    sample_app/utils.c
+    )
+
+  target_link_libraries(pnet_bench
+    PUBLIC
+    profinet
+    )
+endif()
+
 file(COPY
   src/osal/linux/set_network_parameters
   DESTINATION
@@ -76,5 +145,12 @@ if (BUILD_TESTING)
   target_include_directories(pf_test
     PRIVATE
     src/osal/linux
+    src/rpmalloc
     )
+  if (USE_RPMALLOC)
+    target_sources(pf_test
+      PRIVATE
+      ${PROFINET_SOURCE_DIR}/src/rpmalloc/rpmalloc.c
+      )
+  endif()
 endif()
@@ -69,6 +69,15 @@ extern "C"
 // enable profiling of the p-net stack (measuring execution time of some routines)
 #define PNET_PROFILE                                           0
 
+/**
+ * Enable the binary event trace of the cyclic path, see pnet_trace_dump().
+ * Frame reception, CPM and PPM frames, scheduler ticks and alarms are
+ * recorded with a time stamp in a ring buffer per thread.
+ */
+#ifndef PNET_TRACE
+#define PNET_TRACE                                             0
+#endif
+
 /**
  * # Memory Usage
  *
@@ -83,18 +92,20 @@ extern "C"
  */
 // use at least two ARs: one for IOC-AR and one for DAP-AR
 // in the GSDML file must be given NumberOfDeviceAccessAR="1" in DeviceAccessPointItem (this is DAP-AR)
-#define PNET_MAX_AR                                            2     /**< Number of connections. Must be > 0. "Automated RT Tester" uses 2 */
+#define PNET_MAX_AR                                            2     /**< Default number of connections, see pnet_cfg_t.max_ar. Must be > 0. "Automated RT Tester" uses 2 */
 #define PNET_MAX_API                                           1     /**< Number of Application Processes. Must be > 0. */
 #define PNET_MAX_CR                                            2     /**< Per AR. 1 input and 1 output. */
 // number of modules is taken from GSDML file
+#ifndef PNET_MAX_MODULES
 #define PNET_MAX_MODULES                                       9     /**< Per API. Should be > 1 to allow at least one I/O module. */
+#endif
 #define PNET_MAX_SUBMODULES                                    3     /**< Per module (3 needed for DAP). */
 #define PNET_MAX_CHANNELS                                      1     /**< Per sub-slot. Used for diagnosis. */
 #define PNET_MAX_DFP_IOCR                                      2     /**< Allowed values are 0 (zero) or 2. */
 #define PNET_MAX_PORT                                          1     /**< 2 for media redundancy. Currently only 1 is supported. */
 #define PNET_MAX_LOG_BOOK_ENTRIES                              16
 #define PNET_MAX_ALARMS                                        5     /**< Per AR and queue. One queue for hi and one for lo alarms. */
-#define PNET_MAX_DIAG_ITEMS                                    200   /**< Total, per device. Max is 65534 items. */
+#define PNET_MAX_DIAG_ITEMS                                    200   /**< Default total, per device, see pnet_cfg_t.max_diag_items. Max is 65534 items. */
 
 #if PNET_OPTION_MC_CR
 #define PNET_MAX_MC_CR                                         1     /**< Par AR. */
@@ -1195,11 +1206,38 @@ typedef struct pnet_cfg
    pnet_cfg_ip_addr_t      ip_gateway;
    pnet_ethaddr_t          eth_addr;
 
-   struct pf_device       *p_default_device;        // default device configuration
+   struct pf_device       *p_default_device;        // default device configuration, fixed after pnet_init() (read records are cached)
    pf_check_peers_t        temp_check_peers_data;
    uint32_t                adjust_peer_to_peer_boundary;
+
+   /** Capacities, the tables of the stack are sized from these at pnet_init(). */
+   uint16_t                max_ar;                 /**< Number of connections. 0 (zero) means PNET_MAX_AR. */
+   uint16_t                max_diag_items;         /**< Total, per device. 0 (zero) means PNET_MAX_DIAG_ITEMS. Max is 65534 items. */
 } pnet_cfg_t;
 
+/**
+ * Memory used by a p-net stack instance.
+ *
+ * pnet_init() allocates the instance and all its tables as one block, the
+ * sizes are in bytes and include the alignment padding of each table.
+ */
+typedef struct pnet_footprint
+{
+   uint16_t                max_ar;
+   uint16_t                max_sessions;
+   uint16_t                max_diag_items;
+   uint16_t                eth_id_map_size;
+   uint32_t                max_timeouts;
+
+   size_t                  total;
+   size_t                  base;                   /**< The instance itself */
+   size_t                  ars;
+   size_t                  sessions;
+   size_t                  diag_items;
+   size_t                  eth_id_map;             /**< Including the hash index */
+   size_t                  timeouts;
+} pnet_footprint_t;
+
 /**
  * # Alarm and Diagnosis
  *
@@ -1242,11 +1280,61 @@ PNET_EXPORT pnet_t* pnet_init(
  * The period is specified by the application in the tick_us argument
  * to pnet_init.
  * The period should match the expected I/O data rate to and from the device.
+ *
+ * Always call it from the same thread. The handling of the DCE/RPC requests
+ * is not reentrant.
  * @param net              InOut: The p-net stack instance
  */
 PNET_EXPORT void pnet_handle_periodic(
    pnet_t                  *net);
 
+/**
+ * Wait for DCE/RPC requests (Connect, Read, Write, Release etc.) and handle
+ * them as soon as they arrive.
+ *
+ * pnet_handle_periodic() also handles pending requests, but only once per
+ * tick. An application that calls this function while it waits for the
+ * next tick, instead of just sleeping, serves requests without the delay of
+ * the tick interval.
+ *
+ * Must be called from the same thread as pnet_handle_periodic().
+ * @param net              InOut: The p-net stack instance
+ * @param timeout_us       In:   Max time to wait, in microseconds.
+ *                               0 handles pending requests without waiting.
+ * @return  the number of sockets that had data, 0 on timeout.
+ */
+PNET_EXPORT int pnet_handle_rpc(
+   pnet_t                  *net,
+   uint32_t                timeout_us);
+
+/**
+ * Run the stack to completion in the calling thread.
+ *
+ * Raw Ethernet frames, DCE/RPC requests and the periodic tick are all
+ * handled in this thread, as they occur, so no receive or timer threads are
+ * needed and the cyclic path has no cross-thread hand-over. Returns when
+ * *p_running becomes false.
+ *
+ * Once per tick (tick_us given to pnet_init()) tick_fn is called, followed
+ * by pnet_handle_periodic(). Do not call pnet_handle_periodic() or
+ * pnet_handle_rpc() from other threads while this runs.
+ *
+ * Only available on Linux, built with USE_RUN_TO_COMPLETION.
+ * @param net              InOut: The p-net stack instance
+ * @param cpu              In:   CPU to pin the thread to, or -1.
+ * @param tick_fn          In:   Application tick function, or NULL.
+ * @param arg              In:   Argument to tick_fn.
+ * @param p_running        In:   Keep running while this is true.
+ * @return  0  when *p_running has become false.
+ *          -1 if not supported, or if an error occurred.
+ */
+PNET_EXPORT int pnet_run_to_completion(
+   pnet_t                  *net,
+   int                     cpu,
+   void                    (*tick_fn)(pnet_t *net, void *arg),
+   void                    *arg,
+   volatile bool           *p_running);
+
 /**
  * Application signals ready to exchange data.
  *
@@ -1362,6 +1450,105 @@ PNET_EXPORT int pnet_pull_submodule(
    uint16_t                slot,
    uint16_t                subslot);
 
+/**
+ * A sub-slot, resolved to the descriptors of its cyclic data.
+ *
+ * Initialize it with pnet_subslot_handle_init() and use it with the
+ * *_by_handle() functions, which then find the sub-slot data without
+ * searching. The content is internal to the stack; the application only
+ * provides the storage.
+ *
+ * The handle stays valid while the device runs. It is resolved again
+ * automatically after an AR has been set up or released, or a module has
+ * been plugged or pulled.
+ */
+typedef struct pnet_subslot_handle
+{
+   uint64_t                opaque[8];
+} pnet_subslot_handle_t;
+
+/**
+ * Initialize a sub-slot handle.
+ *
+ * The sub-slot does not need to be plugged or in an AR yet.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param api              In:  The API.
+ * @param slot             In:  The slot.
+ * @param subslot          In:  The sub-slot.
+ * @param p_handle         Out: The handle.
+ */
+PNET_EXPORT void pnet_subslot_handle_init(
+   pnet_t                  *net,
+   uint32_t                api,
+   uint16_t                slot,
+   uint16_t                subslot,
+   pnet_subslot_handle_t   *p_handle);
+
+/**
+ * Like pnet_input_set_data_and_iops(), for a sub-slot handle.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param p_handle         InOut: The sub-slot handle.
+ * @param p_data           In:  Data buffer.
+ * @param data_len         In:  Bytes in data buffer.
+ * @param iops             In:  The device provider status.
+ * @return  0  if a sub-module data and IOPS was set.
+ *          -1 if an error occurred.
+ */
+PNET_EXPORT int pnet_input_set_data_and_iops_by_handle(
+   pnet_t                  *net,
+   pnet_subslot_handle_t   *p_handle,
+   uint8_t                 *p_data,
+   uint16_t                data_len,
+   uint8_t                 iops);
+
+/**
+ * Like pnet_output_get_data_and_iops(), for a sub-slot handle.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param p_handle         InOut: The sub-slot handle.
+ * @param p_new_flag       Out: true if new data.
+ * @param p_data           Out: The received data.
+ * @param p_data_len       In:  Size of receive buffer.
+ *                         Out: Received number of data bytes.
+ * @param p_iops           Out: The controller provider status (IOPS).
+ * @return  0  if a sub-module data and IOPS is retrieved.
+ *          -1 if an error occurred.
+ */
+PNET_EXPORT int pnet_output_get_data_and_iops_by_handle(
+   pnet_t                  *net,
+   pnet_subslot_handle_t   *p_handle,
+   bool                    *p_new_flag,
+   uint8_t                 *p_data,
+   uint16_t                *p_data_len,
+   uint8_t                 *p_iops);
+
+/**
+ * Start a batch of updates of data, IOPS and IOCS to send to the controller.
+ *
+ * Updates made by pnet_input_set_data_and_iops() and pnet_output_set_iocs()
+ * after this call are sent together, when pnet_input_batch_end() is called.
+ * Without a batch, each update is sent by itself, and the controller may
+ * get some sub-slots of a cycle updated and some not.
+ *
+ * The updates must all be made from the same thread.
+ *
+ * @param net              InOut: The p-net stack instance
+ */
+PNET_EXPORT void pnet_input_batch_begin(
+   pnet_t                  *net);
+
+/**
+ * End a batch of updates started by pnet_input_batch_begin().
+ *
+ * The new values are sent from the next cycle of each IOCR.
+ *
+ * @param net              InOut: The p-net stack instance
+ */
+PNET_EXPORT void pnet_input_batch_end(
+   pnet_t                  *net);
+
 /**
  * Updates the IOPS and data of one sub-slot to send to the controller.
  *
@@ -1393,6 +1580,9 @@ PNET_EXPORT int pnet_input_set_data_and_iops(
  * This function may be called to retrieve the IOCS value of a sub-slot
  * sent from the controller.
  *
+ * Call it from the thread that calls pnet_output_get_data_and_iops(), as
+ * it fetches the received frames too.
+ *
  * @param net              InOut: The p-net stack instance
  * @param api              In:  The API.
  * @param slot             In:  The slot.
@@ -1423,6 +1613,10 @@ PNET_EXPORT int pnet_input_get_iocs(
  * Note that the latest data and IOPS values are copied to the application
  * buffers regardless of the value of \a p_new_flag.
  *
+ * Call it from one thread only, the application thread, as it fetches the
+ * received frames. A call from a second thread while the first one copies
+ * the data fails an assert.
+ *
  * @param net              InOut: The p-net stack instance
  * @param api              In:  The API.
  * @param slot             In:  The slot.
@@ -1466,6 +1660,70 @@ PNET_EXPORT int pnet_output_set_iocs(
    uint16_t                subslot,
    uint8_t                 iocs);
 
+/**
+ * Where the values of a sub-slot are located in the input image of an IOCR.
+ */
+typedef struct pnet_input_image_layout
+{
+   uint32_t                arep;          /**< The AR sending the sub-slot. */
+   uint16_t                crep;          /**< The input IOCR of the AR. */
+   uint16_t                image_length;  /**< Size of the whole input image. */
+   uint16_t                data_offset;
+   uint16_t                data_length;
+   uint16_t                iops_offset;
+   uint16_t                iops_length;
+   uint16_t                iocs_offset;   /**< IOCS of output data, if any. */
+   uint16_t                iocs_length;
+} pnet_input_image_layout_t;
+
+/**
+ * Get the location of the data, IOPS and IOCS of a sub-slot in the input
+ * image sent to the controller.
+ *
+ * The layout is fixed while the AR is connected, so it may be fetched once
+ * per sub-slot when the AR is ready (PNET_EVENT_PRMEND), and used for every
+ * pnet_input_set_image() until the AR is released.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param api              In:  The API.
+ * @param slot             In:  The slot.
+ * @param subslot          In:  The sub-slot.
+ * @param p_layout         Out: The location of the sub-slot values.
+ * @return  0  if the sub-slot is sent to a controller.
+ *          -1 if an error occurred.
+ */
+PNET_EXPORT int pnet_input_get_image_layout(
+   pnet_t                  *net,
+   uint32_t                api,
+   uint16_t                slot,
+   uint16_t                subslot,
+   pnet_input_image_layout_t *p_layout);
+
+/**
+ * Set the whole input image of an IOCR, i.e. the data, IOPS and IOCS of all
+ * its sub-slots, with one copy.
+ *
+ * The image is built by the application at the offsets given by
+ * pnet_input_get_image_layout(). Bytes outside of those are ignored by
+ * the controller. Like pnet_input_set_data_and_iops(), the image is sent
+ * at pnet_input_batch_end() if a batch is open.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param arep             In:  The AREP.
+ * @param crep             In:  The input IOCR.
+ * @param p_image          In:  The input image.
+ * @param image_length     In:  Size of the input image. Must be the
+ *                              image_length of the layout.
+ * @return  0  if the input image was set.
+ *          -1 if an error occurred.
+ */
+PNET_EXPORT int pnet_input_set_image(
+   pnet_t                  *net,
+   uint32_t                arep,
+   uint16_t                crep,
+   const uint8_t           *p_image,
+   uint16_t                image_length);
+
 /**
  * Implements the "Local Set State" primitive.
  *
@@ -1553,6 +1811,69 @@ PNET_EXPORT int pnet_get_ar_error_codes(
    uint16_t                *p_err_cls,
    uint16_t                *p_err_code);
 
+#define PNET_HISTOGRAM_BUCKETS                                 20
+
+/**
+ * Log2 histogram of a time.
+ *
+ * buckets[0] counts times below 1 us, buckets[n] times from 2^(n-1) us up
+ * to 2^n us, and the last bucket all longer times.
+ */
+typedef struct pnet_histogram
+{
+   uint32_t                count;
+   uint32_t                min_ns;
+   uint32_t                max_ns;
+   uint64_t                sum_ns;
+   uint32_t                buckets[PNET_HISTOGRAM_BUCKETS];
+} pnet_histogram_t;
+
+/**
+ * Timing statistics of an IOCR, counted since it was started.
+ *
+ * An input CR is sent by the PPM, an output CR is received by the CPM.
+ */
+typedef struct pnet_iocr_statistics
+{
+   uint16_t                frame_id;
+   uint32_t                control_interval_us;          /** Send clock * reduction ratio */
+   uint32_t                ppm_send_cnt;
+   uint32_t                cpm_recv_cnt;
+   uint32_t                cpm_err_cnt;
+   pnet_histogram_t        ppm_send_deviation;           /** Actual vs planned send time */
+   pnet_histogram_t        ppm_send_exec;                /** Execution time of one send */
+   pnet_histogram_t        cpm_inter_arrival;            /** Time between received frames */
+} pnet_iocr_statistics_t;
+
+/**
+ * Fetch the timing statistics of an IOCR.
+ *
+ * May be called from any thread. The statistics are updated while they are
+ * copied, so the fields may differ by the last frame.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param arep             In:   The AREP.
+ * @param crep             In:   The IOCR index within the AR, 0 .. nbr of IOCRs - 1.
+ * @param p_stats          Out:  The statistics.
+ * @return  0  If the AREP and CREP are valid.
+ *          -1 if the AREP or the CREP is not valid.
+ */
+PNET_EXPORT int pnet_get_iocr_statistics(
+   pnet_t                  *net,
+   uint32_t                arep,
+   uint32_t                crep,
+   pnet_iocr_statistics_t  *p_stats);
+
+/**
+ * Fetch the memory footprint of the stack instance.
+ *
+ * @param net              In:   The p-net stack instance
+ * @param p_footprint      Out:  The capacities and sizes of the tables.
+ */
+PNET_EXPORT void pnet_get_footprint(
+   pnet_t                  *net,
+   pnet_footprint_t        *p_footprint);
+
 /**
  * Application creates an entry in the log book.
  *
@@ -1818,9 +2139,10 @@ PNET_EXPORT int pnet_diag_remove(
  *
  * @param net              InOut: The p-net stack instance
  * @param level            In:   The amount of detail to show.
+ *     0x0400              | Show buffer pool and allocator statistics, and the memory footprint.
  *     0x0800              | Show all sessions.
  *     0x1000              | Show all ARs.
- *     0x1001              |           include IOCR.
+ *     0x1001              |           include IOCR, with timing histograms.
  *     0x1002              |           include data_descriptors.
  *     0x1003              |           include IOCR and data_descriptors.
  *     0x2000              | Show CFG information.
@@ -1831,6 +2153,26 @@ PNET_EXPORT void pnet_show(
    pnet_t                  *net,
    unsigned                level);
 
+/**
+ * Copy the event trace, for offline analysis.
+ *
+ * The dump is a 16 byte header (magic "PNTR", version, record size, number
+ * of records) followed by 16 byte records (time stamp in ns, event, thread,
+ * argument), all in host byte order. Convert it to Chrome/Perfetto JSON
+ * with tools/pnet_trace_to_json.py.
+ *
+ * The trace keeps running while it is copied.
+ * Only available when PNET_TRACE is enabled.
+ * @param p_buffer         Out:  Destination buffer.
+ * @param size             In:   Size of p_buffer. Records that do not fit
+ *                               are left out.
+ * @return  the number of bytes written to p_buffer.
+ *          -1 if trace is disabled or the buffer is too small.
+ */
+PNET_EXPORT int pnet_trace_dump(
+   uint8_t                 *p_buffer,
+   uint32_t                size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -51,6 +51,14 @@ void show_usage()
   printf("                (ignore tgm-pnet-ip.dat)\n");
   printf("   -l           Disable LED control\n");
   printf("   -q           Quiet: do not display program heder\n");
+  printf("   -c MASK      Run the threads on these CPUs only (hex mask), e.g. off the PLC runtime cores\n");
+  printf("   -x           With -c: the Ethernet and timer threads get the last CPU of MASK to themselves\n");
+  printf("   -r POLICY    Scheduling policy of the threads of the stack: fifo, rr or other.\n");
+#if defined (USE_SCHED_FIFO)
+  printf("                Defaults to fifo\n");
+#else
+  printf("                Defaults to the policy of the program\n");
+#endif
 
   printf("\n");
 }
@@ -82,10 +90,13 @@ struct cmd_args parse_commandline_arguments(int argc, char *argv[])
   output_arguments.use_ip_settings = IP_SETTINGS_FILE;
   output_arguments.use_led = 1;
   output_arguments.quiet = 0;
+  output_arguments.cpu_mask = 0;
+  output_arguments.isolate = 0;
+  output_arguments.sched_policy = OS_SCHED_DEFAULT;
   log_to_file = 0;
 
   int option;
-  while ((option = getopt(argc, argv, "hedvflqi:s:")) != -1)
+  while ((option = getopt(argc, argv, "hedvflqxi:s:c:r:")) != -1)
   {
     switch (option)
     {
@@ -113,6 +124,32 @@ struct cmd_args parse_commandline_arguments(int argc, char *argv[])
     case 'q':
       output_arguments.quiet = 1;
       break;
+    case 'c':
+      output_arguments.cpu_mask = strtoull(optarg, NULL, 16);
+      break;
+    case 'x':
+      output_arguments.isolate = 1;
+      break;
+    case 'r':
+      if (strcmp(optarg, "fifo") == 0)
+      {
+        output_arguments.sched_policy = OS_SCHED_FIFO;
+      }
+      else if (strcmp(optarg, "rr") == 0)
+      {
+        output_arguments.sched_policy = OS_SCHED_RR;
+      }
+      else if (strcmp(optarg, "other") == 0)
+      {
+        output_arguments.sched_policy = OS_SCHED_OTHER;
+      }
+      else
+      {
+        printf("Unknown scheduling policy: %s\n", optarg);
+        show_usage();
+        exit(EXIT_CODE_ERROR);
+      }
+      break;
     case 'h':
     case '?':
     default:
@@ -46,7 +46,10 @@
 #define IP_SETTINGS_DATA_FILE_NAME     "/TGMotion/system/tgm-pnet-ip.dat"
 #define NAME_OF_STATION_DATA_FILE_NAME "/TGMotion/system/tgm-pnet-name.dat"
 #define IM_DATA_FILE_NAME              "/TGMotion/system/tgm-pnet-im.dat"
+#define PERSIST_JOURNAL_FILE_NAME      "/TGMotion/system/tgm-pnet.journal"
 #define LOG_FILE_NAME                  "/TGMotion/system/tgm-pnet-log.txt"
+#define TRACE_FILE_NAME                "/TGMotion/system/tgm-pnet-trace.bin"  /* With PNET_TRACE */
+#define TRACE_DUMP_SIZE                (512 * 1024)
 
 
 /**************** From the GSDML file ****************************************/
@@ -128,6 +131,7 @@ typedef struct SLOT_TYPE
   uint16_t reserved; // padding
   uint32_t param_id;    // parameter ID
   uint32_t data_offset; // offset to PLC memory
+  pnet_subslot_handle_t handle; // cyclic data access to the submodule
 } slot_t;
 
 typedef struct MODULE_TYPE
@@ -164,6 +168,9 @@ typedef struct cmd_args
   int  use_ip_settings;
   int  use_led;
   int  quiet;
+  uint64_t cpu_mask;     // CPUs of the threads, 0 any
+  int  isolate;          // cyclic threads alone on the last CPU of cpu_mask
+  os_sched_policy_t sched_policy; // of the threads of the stack, OS_SCHED_DEFAULT for the build default
 } cmd_args_t;
 
 typedef struct app_data_obj
@@ -179,6 +186,7 @@ typedef struct app_data_obj
   bool        b_disp_wrong_offset_warning;
   cmd_args_t  arguments;
   uint32_t    def_ip;
+  uint32_t    def_netmask;
   slot_t      custom_input_slots[PNET_MAX_MODULES];
   slot_t      custom_output_slots[PNET_MAX_MODULES];
   int         i2c_file;
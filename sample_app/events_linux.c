@@ -150,6 +150,8 @@ void setupPluggedModules(pnet_t *net, app_data_t *p_appdata)
 
 void setInputDataToController(pnet_t *net, app_data_t *p_appdata)
 {
+  // send all slots of this cycle to the controller together
+  pnet_input_batch_begin(net);
   for (uint16_t slot = 0; slot < PNET_MAX_MODULES; slot++)
   {
     slot_t *pInputSlot = &(p_appdata->custom_input_slots[slot]);
@@ -160,13 +162,11 @@ void setInputDataToController(pnet_t *net, app_data_t *p_appdata)
       uint8_t *ptr_to_plc_memory = get_plc_memory_ptr(pInputSlot->data_offset, size);
       if(ptr_to_plc_memory != NULL)
       {
-        (void)pnet_input_set_data_and_iops(net,
-                                           APP_API,
-                                           slot,
-                                           PNET_SUBMOD_CUSTOM_IDENT,
-                                           ptr_to_plc_memory,
-                                           size,
-                                           PNET_IOXS_GOOD);
+        (void)pnet_input_set_data_and_iops_by_handle(net,
+                                                     &pInputSlot->handle,
+                                                     ptr_to_plc_memory,
+                                                     size,
+                                                     PNET_IOXS_GOOD);
       }
       else
       {
@@ -182,6 +182,7 @@ void setInputDataToController(pnet_t *net, app_data_t *p_appdata)
       }
     }
   }
+  pnet_input_batch_end(net);
 }
 
 // zero copy variant
@@ -198,14 +199,12 @@ void getOutputDataFromController(pnet_t *net, app_data_t *p_appdata)
       uint16_t       outputdata_length = dataSize;
       bool           is_updated = false;
       uint8_t       *ptr_to_plc_memory = get_plc_memory_ptr(pOutputSlot->data_offset, dataSize);
-      (void)pnet_output_get_data_and_iops(net,
-                                          APP_API,
-                                          slot,
-                                          PNET_SUBMOD_CUSTOM_IDENT,
-                                          &is_updated,
-                                          ptr_to_plc_memory,
-                                          &outputdata_length,
-                                          &outputdata_iops);
+      (void)pnet_output_get_data_and_iops_by_handle(net,
+                                                    &pOutputSlot->handle,
+                                                    &is_updated,
+                                                    ptr_to_plc_memory,
+                                                    &outputdata_length,
+                                                    &outputdata_iops);
     }
   }
 }
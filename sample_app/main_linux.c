@@ -646,6 +646,7 @@ static int app_exp_module_ind(
           pInputSlot->size        = cfg_available_module_types[ix].insize;
           pInputSlot->param_id    = cfg_available_module_types[ix].in_offset_param_id;
           pInputSlot->data_offset = cfg_available_module_types[ix].in_def_data_offset;
+          pnet_subslot_handle_init(net, api, slot, PNET_SUBMOD_CUSTOM_IDENT, &pInputSlot->handle);
         }
         if ((data_dir == PNET_DIR_OUTPUT) || (data_dir == PNET_DIR_IO))
         {
@@ -654,6 +655,7 @@ static int app_exp_module_ind(
           pOutputSlot->size        = cfg_available_module_types[ix].outsize;
           pOutputSlot->param_id    = cfg_available_module_types[ix].out_offset_param_id;
           pOutputSlot->data_offset = cfg_available_module_types[ix].out_def_data_offset;
+          pnet_subslot_handle_init(net, api, slot, PNET_SUBMOD_CUSTOM_IDENT, &pOutputSlot->handle);
         }
       }
       else
@@ -976,6 +978,19 @@ void *timer_thread_func(void *arg)
 
   while(p_appdata->running != false)
   {
+    /* Serve DCE/RPC requests as they arrive while waiting for the next tick,
+       so Connect, Read and Write do not wait for the tick interval. */
+    for (;;)
+    {
+      struct timespec timeNow;
+      clock_gettime(CLOCK_REALTIME, &timeNow);
+      const int64_t remaining_us = (tCur - ((int64_t)(timeNow.tv_sec) * 1000000000ll + (int64_t)(timeNow.tv_nsec))) / 1000ll;
+      if (remaining_us <= 0)
+      {
+        break;
+      }
+      (void)pnet_handle_rpc(net, (uint32_t)remaining_us);
+    }
     clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &timeAbs, NULL);
 
     tick_ctr_update_data += TICK_INTERVAL_US;
@@ -1005,6 +1020,43 @@ void *timer_thread_func(void *arg)
   return NULL;
 }
 
+#if defined (USE_RUN_TO_COMPLETION)
+/* Called once per tick by pnet_run_to_completion(), before pnet_handle_periodic() */
+static void rtc_tick(pnet_t *net, void *arg)
+{
+  app_data_t *p_appdata = (app_data_t *)arg;
+  static uint32_t tick_ctr_update_data = 0;
+
+  tick_ctr_update_data += TICK_INTERVAL_US;
+  if ((p_appdata->main_arep != UINT32_MAX) && tick_ctr_update_data >= DATA_INTERVAL_US)
+  {
+    tick_ctr_update_data = 0;
+
+    /* Set data for custom input modules, if any */
+    setInputDataToController(net, p_appdata);
+
+    /* Read data from first of the custom output modules, if any */
+    getOutputDataFromController(net, p_appdata);
+  }
+}
+
+/* Runs the whole stack, pinned to the last CPU of -c, as for -x, else to the last CPU */
+void *rtc_thread_func(void *arg)
+{
+  app_data_and_stack_t *appdata_and_stack = (app_data_and_stack_t *)arg;
+  app_data_t           *p_appdata = appdata_and_stack->appdata;
+  const uint64_t        cpu_mask = p_appdata->arguments.cpu_mask;
+  const int             cpu = (cpu_mask != 0) ? (63 - __builtin_clzll(cpu_mask)) :
+                                                ((int)sysconf(_SC_NPROCESSORS_ONLN) - 1);
+
+  if (pnet_run_to_completion(appdata_and_stack->net, cpu, rtc_tick, p_appdata, &p_appdata->running) != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "[ERROR] pnet_run_to_completion failed\n");
+  }
+  return NULL;
+}
+#endif /* USE_RUN_TO_COMPLETION */
+
 void *pn_main(void *arg)
 {
   uint32_t mask = EVENT_READY_FOR_DATA | EVENT_TIMER | EVENT_ALARM | EVENT_ABORT | EVENT_TERMINATE;
@@ -1105,6 +1157,79 @@ static void faulthand(int32_t sig)
   kill(getpid(), sig);
 }
 
+/**
+ * Configure the scheduling of the threads, before any of them is created.
+ *
+ * @param p_args          In: Command line arguments
+ * @return 0 on success, -1 on error (logged)
+*/
+static int app_rt_configure(const cmd_args_t *p_args)
+{
+  static const char *cyclic_threads[] = { "os_eth_pf_task", "os_timer", "pn_tick", "pn_rtc" };
+  os_rt_cfg_t        rt_cfg;
+
+  memset(&rt_cfg, 0, sizeof(rt_cfg));
+  rt_cfg.policy = p_args->sched_policy;
+  rt_cfg.cpu_mask = p_args->cpu_mask;
+  rt_cfg.lock_memory = true;
+  rt_cfg.stack_prefault = APP_STACKSIZE;
+
+  if ((p_args->isolate != 0) && (p_args->cpu_mask != 0))
+  {
+    /* The last CPU of the mask for the cyclic path, the others for the rest */
+    const uint64_t last_cpu = 1ULL << (63 - __builtin_clzll(p_args->cpu_mask));
+
+    rt_cfg.isolate = (last_cpu != p_args->cpu_mask);
+    for (uint16_t ix = 0; ix < NELEMENTS(cyclic_threads); ix++)
+    {
+      rt_cfg.threads[ix].name = cyclic_threads[ix];
+      rt_cfg.threads[ix].cpu_mask = last_cpu;
+    }
+    rt_cfg.nbr_threads = NELEMENTS(cyclic_threads);
+  }
+
+  return os_rt_configure(&rt_cfg);
+}
+
+/**
+ * Durability callback of the persistence service. Called by its thread.
+ *
+ * @param arg             In: The application data
+ * @param p_file_name     In: The saved file
+ * @param seq             In: Sequence number of the save request
+ * @param result          In: 0 if the file is on disk, -1 if not
+*/
+static void app_persist_cb(void *arg, const char *p_file_name, uint32_t seq, int result)
+{
+  const app_data_t *p_appdata = (const app_data_t *)arg;
+
+  if (result != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "Could not save %s (request %u)\n", p_file_name, (unsigned)seq);
+  }
+  else if (p_appdata->arguments.verbosity > 0)
+  {
+    os_log(LOG_LEVEL_INFO, "Saved %s (request %u)\n", p_file_name, (unsigned)seq);
+  }
+}
+
+/**
+ * Completion callback of the IP configuration. Called by its thread.
+ *
+ * @param arg             In: The application data
+ * @param p_result        In: Result and timing of the request
+*/
+static void app_netif_cb(void *arg, const os_netif_result_t *p_result)
+{
+  const app_data_t *p_appdata = (const app_data_t *)arg;
+
+  if ((p_result->result == 0) && (p_appdata->arguments.verbosity > 0))
+  {
+    os_log(LOG_LEVEL_INFO, "IP suite set in %u us (waited %u us)\n",
+           (unsigned)p_result->apply_us, (unsigned)p_result->queue_us);
+  }
+}
+
 
 /****************************** Main ******************************************/
 
@@ -1120,7 +1245,14 @@ int main(int argc, char *argv[])
   /* Parse and display command line arguments */
   appdata.arguments = parse_commandline_arguments(argc, argv);
   appdata.running = true;
+  if (app_rt_configure(&appdata.arguments) != 0)
+  {
+    exit(EXIT_CODE_ERROR);
+  }
   os_init(&appdata);
+  os_persist_cfg_t persist_cfg = { .cb = app_persist_cb, .arg = &appdata };
+  (void)os_persist_init(&persist_cfg);
+  os_netif_set_callback(app_netif_cb, &appdata);
 
   if(appdata.arguments.quiet == 0)
   {
@@ -1148,6 +1280,7 @@ int main(int argc, char *argv[])
   pnet_default_cfg.ip_sys_addr = ip_int;
 
   uint32_t netmask_int = read_netmask(appdata.arguments.eth_interface);
+  appdata.def_netmask = netmask_int;
 
   uint32_t gateway_ip_int = read_default_gateway(appdata.arguments.eth_interface);
   if (gateway_ip_int == IP_INVALID)
@@ -1265,12 +1398,6 @@ int main(int argc, char *argv[])
 
   os_set_led(&appdata, 0, false);
 
-  if ((ret = mlockall(MCL_CURRENT | MCL_FUTURE)) == -1)
-  {
-    os_log(LOG_LEVEL_ERROR, "Error: mlockall failed with error %i\n", ret);
-    exit(EXIT_CODE_ERROR);
-  }
-
   /* Initialize Profinet stack */
   pnet_t *net = pnet_init(appdata.arguments.eth_interface, TICK_INTERVAL_US, &pnet_default_cfg);
 
@@ -1295,11 +1422,12 @@ int main(int argc, char *argv[])
   appdata.main_events = os_event_create();
   appdata.main_thread = os_thread_create("pn_main", APP_PRIO, APP_STACKSIZE, pn_main, (void *)&appdata_and_stack);
 
-#if 0
-  appdata.main_timer = os_timer_create(TICK_INTERVAL_US, main_timer_tick, (void *)&appdata_and_stack, false);
-  os_timer_start(appdata.main_timer);
+#if defined (USE_RUN_TO_COMPLETION)
+  appdata.timer_thread = os_thread_create("pn_rtc", TIMER_PRIO, APP_STACKSIZE, rtc_thread_func, (void *)&appdata_and_stack);
 #else
-  appdata.timer_thread = os_thread_create("os_timer", TIMER_PRIO, APP_STACKSIZE, timer_thread_func, (void *)&appdata_and_stack);
+  /* Not an os_timer: the tick thread waits in pnet_handle_rpc() until the
+     next tick, and this must be the thread of pnet_handle_periodic() */
+  appdata.timer_thread = os_thread_create("pn_tick", TIMER_PRIO, APP_STACKSIZE, timer_thread_func, (void *)&appdata_and_stack);
 #endif // _DEBUG
 
   // wait for Ctrl-C (SIGTERM) to finish
@@ -1313,6 +1441,22 @@ int main(int argc, char *argv[])
     os_log(LOG_LEVEL_INFO, "\n[INFO ] finishing...\n");
   }
 
+#if PNET_TRACE != 0
+  {
+    /* Convert with tools/pnet_trace_to_json.py */
+    uint8_t *p_trace = os_malloc(TRACE_DUMP_SIZE);
+    int      trace_len = (p_trace != NULL) ? pnet_trace_dump(p_trace, TRACE_DUMP_SIZE) : -1;
+    FILE    *p_file = (trace_len > 0) ? fopen(TRACE_FILE_NAME, "wb") : NULL;
+
+    if (p_file != NULL)
+    {
+      fwrite(p_trace, 1, (size_t)trace_len, p_file);
+      fclose(p_file);
+      os_log(LOG_LEVEL_INFO, "[INFO ] trace of %d bytes saved to %s\n", trace_len, TRACE_FILE_NAME);
+    }
+    os_free(p_trace);
+  }
+#endif
   os_timer_destroy(appdata.main_timer); 
   close_plc_memory();
   os_set_led(&appdata, 0, true);
@@ -503,13 +503,15 @@ static int pf_alarm_apmr_high_handler(
 
     uint32_t nbr = p_apmx->apmr_msg_nbr;
     pf_apmr_msg_t *p_apmr_msg = &p_apmx->apmr_msg[nbr];
+    p_buf = os_buf_keep(p_buf);
     p_apmr_msg->p_buf = p_buf;
     p_apmr_msg->frame_id_pos = frame_id_pos;
     if (os_mbox_post(p_apmx->p_alarm_q, (void *)p_apmr_msg) != 0)
     {
       p_apmr_msg->p_buf = NULL;
       LOG_INFO(PF_ALARM_LOG, "Alarm(%d): Lost one high alarm\n", __LINE__);
-      return 0; // not handled
+      os_buf_free(p_buf);
+      return 1; // handled, the frame is dropped
     }
     nbr++;
     if (nbr >= NELEMENTS(p_apmx->apmr_msg))
@@ -570,13 +572,15 @@ static int pf_alarm_apmr_low_handler(
 
     uint32_t nbr = p_apmx->apmr_msg_nbr;
     pf_apmr_msg_t *p_apmr_msg = &p_apmx->apmr_msg[nbr];
+    p_buf = os_buf_keep(p_buf);
     p_apmr_msg->p_buf = p_buf;
     p_apmr_msg->frame_id_pos = frame_id_pos;
     if (os_mbox_post(p_apmx->p_alarm_q, (void *)p_apmr_msg) != 0)
     {
       p_apmr_msg->p_buf = NULL;
       LOG_INFO(PF_ALARM_LOG, "Alarm(%d): Lost one low alarm\n", __LINE__);
-      return 0; // not handled
+      os_buf_free(p_buf);
+      return 1; // handled, the frame is dropped
     }
     nbr++;    /* ToDo: Make atomic */
     if (nbr >= NELEMENTS(p_apmx->apmr_msg))
@@ -1029,6 +1033,7 @@ static int pf_alarm_apms_a_data_req(
         p_rta->len = pos;
         LOG_DEBUG(PF_AL_BUF_LOG, "Alarm(%d): Send an alarm frame.\n", __LINE__);
         
+        PF_TRACE(PF_TRACE_EVENT_ALARM_SEND, p_apmx->frame_id);
         if (os_eth_send(p_apmx->p_ar->p_sess->eth_handle, p_rta) <= 0)
         {
           LOG_ERROR(PF_ALARM_LOG, "pf_alarm(%d): Error from os_eth_send(rta)\n", __LINE__);
@@ -1925,7 +1930,7 @@ int pf_alarm_periodic(
 
   if (net->global_alarm_enable == true)
   {
-    for (ix = 0; ix < PNET_MAX_AR; ix++)
+    for (ix = 0; ix < net->max_ar; ix++)
     {
       p_ar = pf_ar_find_by_index(net, ix);
       if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -1940,7 +1945,7 @@ int pf_alarm_periodic(
   {
     uint16_t ix;
     bool b_update_peers_data = false;
-    for (ix = 0U; ix < PNET_MAX_AR; ix++)
+    for (ix = 0U; ix < net->max_ar; ix++)
     {
       p_ar = pf_ar_find_by_index(net, ix);
       if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -219,15 +219,24 @@ int pf_cpm_create(
   pf_ar_t *p_ar,
   uint32_t                crep)
 {
-  uint32_t                cnt;
 
-  cnt = atomic_fetch_add(&net->cpm_instance_cnt, 1);
-  if (cnt == 0)
+  pf_cpm_t               *p_cpm = &p_ar->iocrs[crep].cpm;
+  uint32_t                ix;
+
+  (void)atomic_fetch_add(&net->cpm_instance_cnt, 1);
+
+  for (ix = 0; ix < NELEMENTS(p_cpm->buffers); ix++)
   {
-    net->cpm_buf_lock = os_mutex_create();
+    p_cpm->buffers[ix] = NULL;
+    p_cpm->buf_data_pos[ix] = 0;
   }
+  p_cpm->buf_cpm_ix = 0;
+  p_cpm->buf_app_ix = 1;
+  atomic_init(&p_cpm->buf_state, 2U);
+  atomic_init(&p_cpm->buf_app_busy, false);
+  atomic_init(&p_cpm->buf_app_reading, false);
 
-  pf_cpm_set_state(&p_ar->iocrs[crep].cpm, PF_CPM_STATE_W_START);
+  pf_cpm_set_state(p_cpm, PF_CPM_STATE_W_START);
 
   return 0;
 }
@@ -238,7 +247,7 @@ int pf_cpm_close_req(
   uint32_t   crep)
 {
   pf_cpm_t *p_cpm = &p_ar->iocrs[crep].cpm;
-  uint32_t                cnt;
+  uint32_t                ix;
 
   LOG_DEBUG(PF_CPM_LOG, "CPM: close\n");
   p_cpm->ci_running = false;    /* StopTimer */
@@ -255,21 +264,16 @@ int pf_cpm_close_req(
   {
     pf_eth_frame_id_map_remove(net, p_cpm->frame_id[1]);
   }
-  if (p_cpm->p_buffer_cpm != NULL)
-  {
-    os_buf_free(p_cpm->p_buffer_cpm);
-  }
-  if (p_cpm->p_buffer_app != NULL)
+  for (ix = 0; ix < NELEMENTS(p_cpm->buffers); ix++)
   {
-    os_buf_free(p_cpm->p_buffer_app);
+    if (p_cpm->buffers[ix] != NULL)
+    {
+      os_buf_free(p_cpm->buffers[ix]);
+      p_cpm->buffers[ix] = NULL;
+    }
   }
 
-  cnt = atomic_fetch_sub(&net->cpm_instance_cnt, 1);
-  if (cnt == 1)
-  {
-    os_mutex_destroy(net->cpm_buf_lock);
-    net->cpm_buf_lock = NULL;
-  }
+  (void)atomic_fetch_sub(&net->cpm_instance_cnt, 1);
 
   return 0;
 }
@@ -331,68 +335,90 @@ static int pf_cpm_check_src_addr(
   return ret;
 }
 
-/**
- * @internal
- * Replace the current buffer with a newer one and set the new_buf flag.
- * @param net              InOut: The p-net stack instance
- * @param p_cpm            In:   The CPM instance.
- * @param pp_buf           In:   The new buffer.
- *                         Out:  The previous buffer.
- */
-static void pf_cpm_put_buf(
-  pnet_t *net,
+void pf_cpm_put_buf(
   pf_cpm_t *p_cpm,
-  os_buf_t **pp_buf)
+  os_buf_t **pp_buf,
+  uint16_t data_pos)
 {
-  void *p;
-
-  os_mutex_lock(net->cpm_buf_lock);
-  p = p_cpm->p_buffer_cpm;
-  p_cpm->p_buffer_cpm = *pp_buf;
-  *pp_buf = p;
-  p_cpm->new_buf = true;
-  os_mutex_unlock(net->cpm_buf_lock);
+  uint32_t ix = p_cpm->buf_cpm_ix;
+
+  p_cpm->buffers[ix] = *pp_buf;
+  p_cpm->buf_data_pos[ix] = data_pos;
+
+  /* Publish the new frame and take back the buffer the app did not fetch */
+  ix = atomic_exchange_explicit(&p_cpm->buf_state, ix | PF_CPM_BUF_NEW, memory_order_acq_rel);
+  ix &= PF_CPM_BUF_IX_MASK;
+
+  *pp_buf = p_cpm->buffers[ix];
+  p_cpm->buffers[ix] = NULL;
+  p_cpm->buf_cpm_ix = (uint8_t)ix;
 }
 
-/**
- * @internal
- * Make sure that p_buffer_app points to the newest received buffer.
- * @param net              InOut: The p-net stack instance
- * @param p_cpm            In:  The CPM instance.
- * @param p_new_flag       Out: true if new data has been received.
- * @param pp_buffer        Out: A pointer to the latest received data (or NULL).
- */
-static void pf_cpm_get_buf(
-  pnet_t *net,
+void pf_cpm_get_buf(
   pf_cpm_t *p_cpm,
   bool *p_new_flag,
   uint8_t **pp_buffer)
 {
-  void *p;
-
-  os_mutex_lock(net->cpm_buf_lock);
-  if (p_cpm->new_buf == true)
+  uint32_t ix;
+  os_buf_t *p_buf;
+  bool reading = atomic_exchange_explicit(&p_cpm->buf_app_reading, true, memory_order_relaxed);
+
+  /* A second consumer could swap the frame back to the CPM while it is copied */
+  CC_ASSERT(reading == false);
+  *p_new_flag = false;
+  if (((atomic_load_explicit(&p_cpm->buf_state, memory_order_relaxed) & PF_CPM_BUF_NEW) != 0) &&
+      (atomic_exchange_explicit(&p_cpm->buf_app_busy, true, memory_order_acquire) == false))
   {
+    /* Only the CPM can set the flag, so the exchange always gets a new frame.
+       Skipped while pf_cpm_peek_buf() reads the app buffer, the next call
+       then fetches the frame. */
+    ix = atomic_exchange_explicit(&p_cpm->buf_state, p_cpm->buf_app_ix, memory_order_acq_rel);
+    p_cpm->buf_app_ix = (uint8_t)(ix & PF_CPM_BUF_IX_MASK);
+    atomic_store_explicit(&p_cpm->buf_app_busy, false, memory_order_release);
     *p_new_flag = true;
-    p = p_cpm->p_buffer_app;
-    p_cpm->p_buffer_app = p_cpm->p_buffer_cpm;
-    p_cpm->p_buffer_cpm = p;
-    p_cpm->new_buf = false;
+  }
+
+  ix = p_cpm->buf_app_ix;
+  p_buf = p_cpm->buffers[ix];
+  if (p_buf != NULL)
+  {
+    *pp_buffer = &((uint8_t *)p_buf->payload)[p_cpm->buf_data_pos[ix]];
   }
   else
   {
-    *p_new_flag = false;
+    *pp_buffer = NULL;
   }
-  os_mutex_unlock(net->cpm_buf_lock);
+}
 
-  if (p_cpm->p_buffer_app != NULL)
+void pf_cpm_get_buf_end(
+  pf_cpm_t *p_cpm)
+{
+  atomic_store_explicit(&p_cpm->buf_app_reading, false, memory_order_relaxed);
+}
+
+uint8_t *pf_cpm_peek_begin(
+  pf_cpm_t *p_cpm)
+{
+  os_buf_t *p_buf;
+
+  /* The application only holds the flag while it swaps buffers */
+  while (atomic_exchange_explicit(&p_cpm->buf_app_busy, true, memory_order_acquire))
   {
-    *pp_buffer = &((uint8_t *)((os_buf_t *)p_cpm->p_buffer_app)->payload)[p_cpm->buffer_pos];
+    os_usleep(10);
   }
-  else
+
+  p_buf = p_cpm->buffers[p_cpm->buf_app_ix];
+  if (p_buf == NULL)
   {
-    *pp_buffer = NULL;
+    return NULL;
   }
+  return &((uint8_t *)p_buf->payload)[p_cpm->buf_data_pos[p_cpm->buf_app_ix]];
+}
+
+void pf_cpm_peek_end(
+  pf_cpm_t *p_cpm)
+{
+  atomic_store_explicit(&p_cpm->buf_app_busy, false, memory_order_release);
 }
 
 /**
@@ -433,8 +459,14 @@ static int pf_cpm_c_data_ind(
   bool                    primary;
   bool                    backup;
   bool                    update_data;
+  const uint64_t          now_ns = os_get_current_time_ns();
 
   p_cpm->recv_cnt++;
+  if (p_cpm->last_recv_ns != 0)
+  {
+    pf_histogram_add(&p_cpm->inter_arrival, now_ns - p_cpm->last_recv_ns);
+  }
+  p_cpm->last_recv_ns = now_ns;
 
   switch (p_cpm->state)
   {
@@ -449,6 +481,7 @@ static int pf_cpm_c_data_ind(
 
     p_cpm->errline = __LINE__;
     p_cpm->errcnt++;
+    PF_TRACE(PF_TRACE_EVENT_CPM_REJECT, __LINE__);
     ret = 1;    /* Means "handled" */
     break;
   case PF_CPM_STATE_FRUN:
@@ -493,9 +526,11 @@ static int pf_cpm_c_data_ind(
       /* 19 */
       /* Ignore */
       LOG_DEBUG(PF_PPM_LOG, "CPM(%d): data_valid == false\n", __LINE__);
+      PF_TRACE(PF_TRACE_EVENT_CPM_REJECT, __LINE__);
     }
     else if (dht_reload)
     {
+      PF_TRACE(PF_TRACE_EVENT_CPM_ACCEPT, cycle);
       p_cpm->dht_init_timestamp = os_get_current_time_us();
 
       if (p_cpm->state == PF_CPM_STATE_FRUN)
@@ -506,9 +541,9 @@ static int pf_cpm_c_data_ind(
       if (update_data)
       {
         /* 20 */
-        pf_cpm_put_buf(net, p_cpm, &p_buf);
-        p_cpm->frame_id_pos = frame_id_pos; /* Save for consumer */
-        p_cpm->buffer_pos = p_cpm->frame_id_pos + sizeof(uint16_t);
+        p_cpm->frame_id_pos = frame_id_pos;
+        p_buf = os_buf_keep(p_buf);
+        pf_cpm_put_buf(p_cpm, &p_buf, frame_id_pos + sizeof(uint16_t));
         (void)pf_cmio_cpm_new_data_ind(p_iocr->p_ar, p_iocr->crep, true);
       }
       else
@@ -535,6 +570,7 @@ static int pf_cpm_c_data_ind(
     {
       /* Ignore */
       LOG_DEBUG(PF_PPM_LOG, "CPM(%d): data_valid != false && dht_reload == 0\n", __LINE__);
+      PF_TRACE(PF_TRACE_EVENT_CPM_REJECT, __LINE__);
     }
 
     ret = 1;    /* Means "handled" */
@@ -605,6 +641,8 @@ int pf_cpm_activate_req(
 
     p_cpm->dht_init_timestamp = os_get_current_time_us();
     p_cpm->recv_cnt = 0;
+    p_cpm->last_recv_ns = 0;
+    pf_histogram_reset(&p_cpm->inter_arrival);
 
     memcpy(&p_cpm->sa, &p_ar->ar_param.cm_initiator_mac_add, sizeof(p_cpm->sa));
 
@@ -740,11 +778,31 @@ static int pf_cpm_get_ar_iocr_desc(
   return ret;
 }
 
-int pf_cpm_get_data_and_iops(
+/**
+ * @internal
+ * Get the data and IOPS of a sub-module, given its descriptors.
+ * @param net              InOut: The p-net stack instance
+ * @param p_ar             InOut: The AR instance.
+ * @param p_iocr           InOut: The output IOCR instance.
+ * @param p_iodata         In:   The IODATA object instance.
+ * @param peek             In:   true to read the frame last fetched by the
+ *                               application, see pf_cpm_peek_begin().
+ * @param p_new_flag       Out:  true means new data has been received.
+ * @param p_data           Out:  The received data.
+ * @param p_data_len       In:   Size of receive buffer.
+ *                         Out:  Received number of data bytes.
+ * @param p_iops           Out:  The controller provider status (IOPS).
+ * @param p_iops_len       In:   Size of receive buffer.
+ *                         Out:  Received number of IOPS bytes.
+ * @return  0  if the data could be retrieved.
+ *          -1 if an error occurred.
+ */
+static int pf_cpm_iodata_get_data_and_iops(
   pnet_t   *net,
-  uint32_t  api_id,
-  uint16_t  slot_nbr,
-  uint16_t  subslot_nbr,
+  pf_ar_t  *p_ar,
+  pf_iocr_t *p_iocr,
+  pf_iodata_object_t *p_iodata,
+  bool     peek,
   bool     *p_new_flag,
   uint8_t  *p_data,
   uint16_t *p_data_len,
@@ -752,66 +810,99 @@ int pf_cpm_get_data_and_iops(
   uint8_t  *p_iops_len)
 {
   int                     ret = -1;
-  pf_iocr_t *p_iocr = NULL;
-  pf_iodata_object_t *p_iodata = NULL;
-  pf_ar_t *p_ar = NULL;
   uint8_t *p_buffer = NULL;
 
-  if (pf_cpm_get_ar_iocr_desc(net, api_id, slot_nbr, subslot_nbr, &p_ar, &p_iocr, &p_iodata) == 0)
+  switch (p_iocr->cpm.state)
   {
-    switch (p_iocr->cpm.state)
+  case PF_CPM_STATE_W_START:
+    if ((peek == false) && (p_ar->err_cls == 0)) // no error set yet?
     {
-    case PF_CPM_STATE_W_START:
-      if (p_ar->err_cls == 0) // no error set yet?
-      {
-        p_ar->err_cls = PNET_ERROR_CODE_1_CPM;
-        LOG_ERROR(PNET_LOG, "%s(%i) err_code %d -> %d\n", __FILE__, __LINE__, p_ar->err_code, PNET_ERROR_CODE_2_CPM_INVALID_STATE);
-        p_ar->err_code = PNET_ERROR_CODE_2_CPM_INVALID_STATE;
-      }
+      p_ar->err_cls = PNET_ERROR_CODE_1_CPM;
+      LOG_ERROR(PNET_LOG, "%s(%i) err_code %d -> %d\n", __FILE__, __LINE__, p_ar->err_code, PNET_ERROR_CODE_2_CPM_INVALID_STATE);
+      p_ar->err_code = PNET_ERROR_CODE_2_CPM_INVALID_STATE;
+    }
 
-      LOG_DEBUG(PF_CPM_LOG, "CPM(%d): Get data in wrong state: %u\n", __LINE__, p_iocr->cpm.state);
-      break;
-    case PF_CPM_STATE_FRUN:
-    case PF_CPM_STATE_RUN:
-      if (*p_data_len < p_iodata->data_length)
+    LOG_DEBUG(PF_CPM_LOG, "CPM(%d): Get data in wrong state: %u\n", __LINE__, p_iocr->cpm.state);
+    break;
+  case PF_CPM_STATE_FRUN:
+  case PF_CPM_STATE_RUN:
+    if (*p_data_len < p_iodata->data_length)
+    {
+      *p_data_len = 0;
+      *p_new_flag = false;
+      LOG_ERROR(PF_CPM_LOG, "CPM(%d): Buffer too small in get data\n", __LINE__);
+    }
+    else
+    {
+      if (peek)
       {
-        *p_data_len = 0;
+        p_buffer = pf_cpm_peek_begin(&p_iocr->cpm);
         *p_new_flag = false;
-        LOG_ERROR(PF_CPM_LOG, "CPM(%d): Buffer too small in get data\n", __LINE__);
       }
       else
       {
-        pf_cpm_get_buf(net, &p_iocr->cpm, p_new_flag, &p_buffer);
+        pf_cpm_get_buf(&p_iocr->cpm, p_new_flag, &p_buffer);
+      }
 
-        if (p_buffer != NULL)
+      if (p_buffer != NULL)
+      {
+        if ((p_iodata->data_length > 0) && (p_data != NULL))
         {
-          os_mutex_lock(net->cpm_buf_lock);
-          if ((p_iodata->data_length > 0) && (p_data != NULL))
-          {
-            memcpy(p_data, &p_buffer[p_iodata->data_offset], p_iodata->data_length);
-          }
-          if (p_iodata->iops_length > 0)
-          {            
-            memcpy(p_iops, &p_buffer[p_iodata->iops_offset], p_iodata->iops_length);
-          }
-          os_mutex_unlock(net->cpm_buf_lock);
-
-          *p_data_len = p_iodata->data_length;
-          *p_iops_len = (uint8_t)p_iodata->iops_length;
-           ret = 0;
+          memcpy(p_data, &p_buffer[p_iodata->data_offset], p_iodata->data_length);
         }
-        else
-        {
-          *p_data_len = 0;
-          *p_new_flag = false;
-          LOG_DEBUG(PF_CPM_LOG, "CPM(%d): No data received in get data\n", __LINE__);
+        if (p_iodata->iops_length > 0)
+        {            
+          memcpy(p_iops, &p_buffer[p_iodata->iops_offset], p_iodata->iops_length);
         }
+
+        *p_data_len = p_iodata->data_length;
+        *p_iops_len = (uint8_t)p_iodata->iops_length;
+         ret = 0;
+      }
+      else
+      {
+        *p_data_len = 0;
+        *p_new_flag = false;
+        LOG_DEBUG(PF_CPM_LOG, "CPM(%d): No data received in get data\n", __LINE__);
+      }
+
+      if (peek)
+      {
+        pf_cpm_peek_end(&p_iocr->cpm);
+      }
+      else
+      {
+        pf_cpm_get_buf_end(&p_iocr->cpm);
       }
-      break;
-    default:
-      LOG_DEBUG(PF_CPM_LOG, "CPM(%d): Set data in wrong state: %u\n", __LINE__, p_iocr->cpm.state);
-      break;
     }
+    break;
+  default:
+    LOG_DEBUG(PF_CPM_LOG, "CPM(%d): Set data in wrong state: %u\n", __LINE__, p_iocr->cpm.state);
+    break;
+  }
+
+  return ret;
+}
+
+int pf_cpm_get_data_and_iops(
+  pnet_t   *net,
+  uint32_t  api_id,
+  uint16_t  slot_nbr,
+  uint16_t  subslot_nbr,
+  bool     *p_new_flag,
+  uint8_t  *p_data,
+  uint16_t *p_data_len,
+  uint8_t  *p_iops,
+  uint8_t  *p_iops_len)
+{
+  int                     ret = -1;
+  pf_iocr_t *p_iocr = NULL;
+  pf_iodata_object_t *p_iodata = NULL;
+  pf_ar_t *p_ar = NULL;
+
+  if (pf_cpm_get_ar_iocr_desc(net, api_id, slot_nbr, subslot_nbr, &p_ar, &p_iocr, &p_iodata) == 0)
+  {
+    ret = pf_cpm_iodata_get_data_and_iops(net, p_ar, p_iocr, p_iodata, false, p_new_flag, p_data, p_data_len, p_iops, p_iops_len);
   }
   else
   {
@@ -822,11 +913,105 @@ int pf_cpm_get_data_and_iops(
   return ret;
 }
 
-int pf_cpm_get_iocs(
+int pf_cpm_peek_data_and_iops(
+  pnet_t   *net,
+  uint32_t  api_id,
+  uint16_t  slot_nbr,
+  uint16_t  subslot_nbr,
+  uint8_t  *p_data,
+  uint16_t *p_data_len,
+  uint8_t  *p_iops,
+  uint8_t  *p_iops_len)
+{
+  int                     ret = -1;
+  bool                    new_flag = false;
+  pf_iocr_t *p_iocr = NULL;
+  pf_iodata_object_t *p_iodata = NULL;
+  pf_ar_t *p_ar = NULL;
+
+  if (pf_cpm_get_ar_iocr_desc(net, api_id, slot_nbr, subslot_nbr, &p_ar, &p_iocr, &p_iodata) == 0)
+  {
+    ret = pf_cpm_iodata_get_data_and_iops(net, p_ar, p_iocr, p_iodata, true, &new_flag, p_data, p_data_len, p_iops, p_iops_len);
+  }
+
+  return ret;
+}
+
+/**
+ * @internal
+ * Make sure the output descriptors of a sub-slot handle are up to date.
+ * @param net              InOut: The p-net stack instance
+ * @param p_handle         InOut: The sub-slot handle.
+ * @return  0  If the sub-slot is in an output IOCR.
+ *          -1 If not.
+ */
+static int pf_cpm_resolve_handle(
+  pnet_t                 *net,
+  pf_subslot_handle_t    *p_handle)
+{
+  uint32_t                gen = atomic_load(&net->subslot_handle_gen);
+  pf_ar_t                *p_ar = NULL;
+  pf_iocr_t              *p_iocr = NULL;
+  pf_iodata_object_t     *p_iodata = NULL;
+
+  if (p_handle->output_gen == gen)
+  {
+    return 0;
+  }
+
+  if (pf_cpm_get_ar_iocr_desc(net, p_handle->api, p_handle->slot, p_handle->subslot, &p_ar, &p_iocr, &p_iodata) != 0)
+  {
+    LOG_DEBUG(PF_CPM_LOG, "CPM(%d): No data descriptor found for handle\n", __LINE__);
+    return -1;
+  }
+
+  p_handle->p_output_ar = p_ar;
+  p_handle->p_output_iocr = p_iocr;
+  p_handle->p_output_iodata = p_iodata;
+  p_handle->output_gen = gen;
+
+  return 0;
+}
+
+int pf_cpm_get_data_and_iops_by_handle(
+  pnet_t   *net,
+  pf_subslot_handle_t *p_handle,
+  bool     *p_new_flag,
+  uint8_t  *p_data,
+  uint16_t *p_data_len,
+  uint8_t  *p_iops,
+  uint8_t  *p_iops_len)
+{
+  int                     ret = -1;
+
+  if (pf_cpm_resolve_handle(net, p_handle) == 0)
+  {
+    ret = pf_cpm_iodata_get_data_and_iops(net, p_handle->p_output_ar, p_handle->p_output_iocr, p_handle->p_output_iodata, false, p_new_flag, p_data, p_data_len, p_iops, p_iops_len);
+  }
+
+  return ret;
+}
+
+/**
+ * @internal
+ * Get the IOCS of a sub-slot from the newest frame.
+ * @param net              InOut: The p-net stack instance
+ * @param api_id           In:   The API identifier.
+ * @param slot_nbr         In:   The slot number.
+ * @param subslot_nbr      In:   The sub-slot number.
+ * @param peek             In:   true to read the frame last fetched by the
+ *                               application, see pf_cpm_peek_begin().
+ * @param p_iocs           Out:  Copy of the received IOCS.
+ * @param p_iocs_len       Out:  The length of the received IOCS.
+ * @return  0  if the IOCS could be retrieved.
+ *          -1 if an error occurred.
+ */
+static int pf_cpm_iocs_get(
   pnet_t *net,
   uint32_t                api_id,
   uint16_t                slot_nbr,
   uint16_t                subslot_nbr,
+  bool                    peek,
   uint8_t *p_iocs,
   uint8_t *p_iocs_len)
 {
@@ -842,9 +1027,12 @@ int pf_cpm_get_iocs(
     switch (p_iocr->cpm.state)
     {
     case PF_CPM_STATE_W_START:
-      p_ar->err_cls = PNET_ERROR_CODE_1_CPM;
-      p_ar->err_code = PNET_ERROR_CODE_2_CPM_INVALID_STATE;
-      LOG_ERROR(PNET_LOG, "%s(%i) err_code %d\n", __FILE__, __LINE__, p_ar->err_code);
+      if (peek == false)
+      {
+        p_ar->err_cls = PNET_ERROR_CODE_1_CPM;
+        p_ar->err_code = PNET_ERROR_CODE_2_CPM_INVALID_STATE;
+        LOG_ERROR(PNET_LOG, "%s(%i) err_code %d\n", __FILE__, __LINE__, p_ar->err_code);
+      }
 
       LOG_DEBUG(PF_CPM_LOG, "CPM(%d): Get iocs in wrong state: %u\n", __LINE__, p_iocr->cpm.state);
       break;
@@ -856,13 +1044,18 @@ int pf_cpm_get_iocs(
       }
       else
       {
-        pf_cpm_get_buf(net, &p_iocr->cpm, &new_flag, &p_buffer);
+        if (peek)
+        {
+          p_buffer = pf_cpm_peek_begin(&p_iocr->cpm);
+        }
+        else
+        {
+          pf_cpm_get_buf(&p_iocr->cpm, &new_flag, &p_buffer);
+        }
 
         if (p_buffer != NULL)
         {
-          os_mutex_lock(net->cpm_buf_lock);
           memcpy(p_iocs, &p_buffer[p_iodata->iocs_offset], p_iodata->iocs_length);
-          os_mutex_unlock(net->cpm_buf_lock);
 
           *p_iocs_len = (uint8_t)p_iodata->iocs_length;
            ret = 0;
@@ -871,6 +1064,15 @@ int pf_cpm_get_iocs(
         {
           LOG_DEBUG(PF_CPM_LOG, "CPM(%d): No data received in get iocs\n", __LINE__);
         }
+
+        if (peek)
+        {
+          pf_cpm_peek_end(&p_iocr->cpm);
+        }
+        else
+        {
+          pf_cpm_get_buf_end(&p_iocr->cpm);
+        }
       }
       break;
     default:
@@ -887,6 +1089,28 @@ int pf_cpm_get_iocs(
   return ret;
 }
 
+int pf_cpm_get_iocs(
+  pnet_t *net,
+  uint32_t                api_id,
+  uint16_t                slot_nbr,
+  uint16_t                subslot_nbr,
+  uint8_t *p_iocs,
+  uint8_t *p_iocs_len)
+{
+  return pf_cpm_iocs_get(net, api_id, slot_nbr, subslot_nbr, false, p_iocs, p_iocs_len);
+}
+
+int pf_cpm_peek_iocs(
+  pnet_t *net,
+  uint32_t                api_id,
+  uint16_t                slot_nbr,
+  uint16_t                subslot_nbr,
+  uint8_t *p_iocs,
+  uint8_t *p_iocs_len)
+{
+  return pf_cpm_iocs_get(net, api_id, slot_nbr, subslot_nbr, true, p_iocs, p_iocs_len);
+}
+
 int pf_cpm_get_data_status(
   pf_cpm_t *p_cpm,
   uint8_t *p_data_status)
@@ -913,13 +1137,14 @@ void pf_cpm_show(
   printf("   cycle              = %i\n", (int)p_cpm->cycle);
   printf("   recv_cnt           = %u\n", (unsigned)p_cpm->recv_cnt);
   printf("   free_cnt           = %u\n", (unsigned)p_cpm->free_cnt);
-  printf("   p_buffer_app       = %p\n", p_cpm->p_buffer_app);
-  printf("   p_buffer_cpm       = %p\n", p_cpm->p_buffer_cpm);
-  printf("   p_buffer->len      = %u\n", p_cpm->p_buffer_cpm ? ((os_buf_t *)(p_cpm->p_buffer_cpm))->len : 0);
-  printf("   new_buf            = %u\n", (unsigned)p_cpm->new_buf);
+  printf("   buffers            = %p %p %p\n", p_cpm->buffers[0], p_cpm->buffers[1], p_cpm->buffers[2]);
+  printf("   buf_cpm_ix         = %u\n", (unsigned)p_cpm->buf_cpm_ix);
+  printf("   buf_app_ix         = %u\n", (unsigned)p_cpm->buf_app_ix);
+  printf("   buf_state          = %x\n", (unsigned)atomic_load(&p_cpm->buf_state));
   printf("   ci_running         = %u\n", (unsigned)p_cpm->ci_running);
   printf("   ci_timer           = %u\n", (unsigned)p_cpm->ci_timer);
   printf("   buffer_status      = %x\n", (unsigned)p_cpm->data_status);
   printf("   buffer_length      = %u\n", (unsigned)p_cpm->buffer_length);
   printf("   buffer_pos         = %u\n", (unsigned)p_cpm->buffer_pos);
+  pf_histogram_show("inter_arrival", &p_cpm->inter_arrival);
 }
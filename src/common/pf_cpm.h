@@ -34,7 +34,7 @@ void pf_cpm_init(
  *
  * This function creates a CPM instance for the specified IOCR instance.
  * Set the CPM state to W_START.
- * Allocate the buffer mutex on first call.
+ * Empty the triple buffer of received frames.
  *
  * @param net              InOut: The p-net stack instance
  * @param p_ar             In:   The AR instance.
@@ -51,7 +51,6 @@ int pf_cpm_create(
  * Close a CPM instance.
  *
  * This function terminates the specified CPM instance.
- * The buffer mutex is destroyed on the last call.
  *
  * @param net              InOut: The p-net stack instance
  * @param p_ar             In:   The AR instance.
@@ -98,6 +97,30 @@ int pf_cpm_get_iocs(
    uint8_t                 *p_iocs,
    uint8_t                 *p_iocs_len);
 
+/**
+ * Retrieve the specified sub-slot IOCS, like pf_cpm_get_iocs(), from the
+ * frame last fetched by the application, without fetching a new one.
+ *
+ * For threads other than the application thread, e.g. to answer a read
+ * request.
+ * @param net           InOut: The p-net stack instance
+ * @param api_id        In:   The API identifier.
+ * @param slot_nbr      In:   The slot number.
+ * @param subslot_nbr   In:   The sub-slot number.
+ * @param p_iocs        Out:  Copy of the received IOCS.
+ * @param p_iocs_len    In:   Size of buffer at p_iocs.
+ *                      Out:  The length of the received IOCS.
+ * @return  0  if the IOCS could be retrieved.
+ *          -1 if an error occurred.
+ */
+int pf_cpm_peek_iocs(
+   pnet_t                  *net,
+   uint32_t                api_id,
+   uint16_t                slot_nbr,
+   uint16_t                subslot_nbr,
+   uint8_t                 *p_iocs,
+   uint8_t                 *p_iocs_len);
+
 /**
  * Retrieve the specified sub-slot data and IOPS received from the controller.
  * User must supply a buffer large enough to hold the received data.
@@ -130,6 +153,64 @@ int pf_cpm_get_data_and_iops(
    uint8_t                 *p_iops,
    uint8_t                 *p_iops_len);
 
+/**
+ * Retrieve the specified sub-slot data and IOPS, like
+ * pf_cpm_get_data_and_iops(), from the frame last fetched by the
+ * application, without fetching a new one.
+ *
+ * For threads other than the application thread, e.g. to answer a read
+ * request.
+ * @param net           InOut: The p-net stack instance
+ * @param api_id        In:   The API identifier.
+ * @param slot_nbr      In:   The slot number.
+ * @param subslot_nbr   In:   The sub-slot number.
+ * @param p_data        Out:  Copy of the received data.
+ * @param p_data_len    In:   Buffer size.
+ *                      Out:  Length of received data.
+ * @param p_iops        Out:  The received IOPS.
+ * @param p_iops_len    In:   Size of buffer at p_iops.
+ *                      Out:  The length of the received IOPS.
+ * @return  0  if the data and IOPS could be retrieved.
+ *          -1 if an error occurred.
+ */
+int pf_cpm_peek_data_and_iops(
+   pnet_t                  *net,
+   uint32_t                api_id,
+   uint16_t                slot_nbr,
+   uint16_t                subslot_nbr,
+   uint8_t                 *p_data,
+   uint16_t                *p_data_len,
+   uint8_t                 *p_iops,
+   uint8_t                 *p_iops_len);
+
+/**
+ * Retrieve the sub-slot data and IOPS received from the controller, like
+ * pf_cpm_get_data_and_iops(), for a sub-slot handle.
+ *
+ * The handle is resolved again only if sub-slots have changed since the
+ * last call.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param p_handle      InOut: The sub-slot handle.
+ * @param p_new_flag    Out:  true means new data and IOPS available since last call.
+ * @param p_data        Out:  Copy of the received data.
+ * @param p_data_len    In:   Buffer size.
+ *                      Out:  Length of received data.
+ * @param p_iops        Out:  The received IOPS.
+ * @param p_iops_len    In:   Size of buffer at p_iops.
+ *                      Out:  The length of the received IOPS.
+ * @return  0  if the data and IOPS could be retrieved.
+ *          -1 if an error occurred.
+ */
+int pf_cpm_get_data_and_iops_by_handle(
+   pnet_t                  *net,
+   pf_subslot_handle_t     *p_handle,
+   bool                    *p_new_flag,
+   uint8_t                 *p_data,
+   uint16_t                *p_data_len,
+   uint8_t                 *p_iops,
+   uint8_t                 *p_iops_len);
+
 /**
  * Handle new UDP layer frames.
  *
@@ -167,6 +248,71 @@ void pf_cpm_show(
 int pf_cpm_check_cycle(
   int32_t                  prev,
   uint16_t                 now);
+
+/**
+ * Hand over a newly received frame to the application.
+ *
+ * The CPM and the application share a triple buffer per IOCR, so neither
+ * side ever waits for the other. Must only be called by the thread
+ * receiving the frames.
+ *
+ * @param p_cpm            InOut: The CPM instance.
+ * @param pp_buf           In:   The new frame.
+ *                         Out:  A frame the application never fetched,
+ *                               or NULL. To be freed by the caller.
+ * @param data_pos         In:   Start of the PROFINET data in the frame.
+ */
+void pf_cpm_put_buf(
+  pf_cpm_t                *p_cpm,
+  os_buf_t                **pp_buf,
+  uint16_t                data_pos);
+
+/**
+ * Fetch the newest received frame, if there is a new one since the last call.
+ *
+ * The frame stays valid until pf_cpm_get_buf_end(). Must only be called by
+ * the application thread: a call from a second thread before
+ * pf_cpm_get_buf_end() fails an assert. Other threads use pf_cpm_peek_begin().
+ *
+ * @param p_cpm            InOut: The CPM instance.
+ * @param p_new_flag       Out:  true if a new frame has been received.
+ * @param pp_buffer        Out:  The PROFINET data of the newest frame (or NULL).
+ */
+void pf_cpm_get_buf(
+  pf_cpm_t                *p_cpm,
+  bool                    *p_new_flag,
+  uint8_t                 **pp_buffer);
+
+/**
+ * Stop reading the frame returned by pf_cpm_get_buf().
+ *
+ * @param p_cpm            InOut: The CPM instance.
+ */
+void pf_cpm_get_buf_end(
+  pf_cpm_t                *p_cpm);
+
+/**
+ * Start reading the frame last fetched by the application, from another
+ * thread. The application does not fetch new frames until
+ * pf_cpm_peek_end() is called, the CPM keeps receiving them.
+ *
+ * This is the only access to the triple buffer allowed besides the
+ * frame receiving thread and the application thread.
+ *
+ * @param p_cpm            InOut: The CPM instance.
+ * @return  the PROFINET data of the frame, or NULL if the application has
+ *          not fetched any. Call pf_cpm_peek_end() in both cases.
+ */
+uint8_t *pf_cpm_peek_begin(
+  pf_cpm_t                *p_cpm);
+
+/**
+ * Stop reading the frame returned by pf_cpm_peek_begin().
+ *
+ * @param p_cpm            InOut: The CPM instance.
+ */
+void pf_cpm_peek_end(
+  pf_cpm_t                *p_cpm);
 #ifdef __cplusplus
 }
 #endif
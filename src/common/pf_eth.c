@@ -19,8 +19,15 @@
   *
   * The frame id map is used to quickly find the function responsible for
   * handling a frame with a specific frame id.
+  * The entries are indexed by a hash table of frame ids, with chaining of
+  * entries that hash to the same bucket. A lookup therefore costs the same
+  * regardless of how many ARs and CRs are in use.
   * Clients may add or remove entries on the fly, but there is no locking of the table.
-  * ToDo: This may be a problem in the future.
+  * The chain links are written with release and read with acquire semantics,
+  * so a concurrent reader sees either the old or the new chain, and only
+  * complete entries.
+  * A removed entry keeps its link, since a reader may still be on it. It is
+  * only reused after a moment when no reader is inside a lookup.
   * Note that frames may arrive at any time.
   */
 
@@ -33,16 +40,94 @@
 
 static pnet_ethaddr_t broadcast_mac = { { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }  };
 
+/**
+ * @internal
+ * Calculate the hash bucket for a frame id.
+ *
+ * Frame ids of cyclic data are assigned consecutively by the controller,
+ * so the low bits give distinct buckets. The high byte is folded in to
+ * separate the DCP and alarm frame ids from the cyclic ones.
+ *
+ * @param frame_id         In:   The frame ID.
+ * @return  the bucket index.
+ */
+static inline uint16_t pf_eth_frame_id_hash(
+  const pnet_t            *net,
+  uint16_t                frame_id)
+{
+  return (uint16_t)((frame_id ^ (frame_id >> 8)) & net->eth_id_hash_mask);
+}
+
+/**
+ * @internal
+ * Make the removed entries free for reuse, if no receiver is inside a lookup.
+ *
+ * A receiver that started before an entry was unlinked may still be on it,
+ * and needs its next link. A receiver that starts later can not reach it.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @return  true if the removed entries were made free.
+ */
+static bool pf_eth_frame_id_map_reclaim(
+  pnet_t                  *net)
+{
+  size_t ix;
+
+  /* Order the unlinking before the check of the receivers */
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&net->eth_id_readers) != 0)
+  {
+    return false;
+  }
+
+  for (ix = 0; ix < net->eth_id_map_size; ix++)
+  {
+    net->eth_id_map[ix].retired = false;
+  }
+
+  return true;
+}
+
 int pf_eth_init(
   pnet_t                  *net)
 {
   int ret = 0;
+  size_t ix;
 
-  memset(net->eth_id_map, 0, sizeof(net->eth_id_map));
+  memset(net->eth_id_map, 0, net->eth_id_map_size * sizeof(net->eth_id_map[0]));
+  for (ix = 0; ix < net->eth_id_map_size; ix++)
+  {
+    atomic_init(&net->eth_id_map[ix].next, PF_ETH_HASH_NONE);
+  }
+  for (ix = 0; ix <= net->eth_id_hash_mask; ix++)
+  {
+    atomic_init(&net->eth_id_hash[ix], PF_ETH_HASH_NONE);
+  }
+  atomic_init(&net->eth_id_readers, 0U);
 
   return ret;
 }
 
+pf_eth_frame_id_map_t *pf_eth_frame_id_map_find(
+  pnet_t                  *net,
+  uint16_t                frame_id)
+{
+  uint16_t ix = atomic_load_explicit(&net->eth_id_hash[pf_eth_frame_id_hash(net, frame_id)],
+                                     memory_order_acquire);
+
+  while (ix != PF_ETH_HASH_NONE)
+  {
+    if ((net->eth_id_map[ix].frame_id == frame_id) &&
+        (net->eth_id_map[ix].in_use == true))
+    {
+      return &net->eth_id_map[ix];
+    }
+    ix = atomic_load_explicit(&net->eth_id_map[ix].next, memory_order_acquire);
+  }
+
+  return NULL;
+}
+
 int pf_eth_recv(
   void                    *arg,
   os_buf_t                *p_buf)
@@ -52,7 +137,9 @@ int pf_eth_recv(
   uint16_t    type;
   uint16_t    frame_id;
   uint16_t    *p_data;
-  size_t      ix = 0;
+  pf_eth_frame_id_map_t *p_entry;
+  pf_eth_frame_handler_t frame_handler = NULL;
+  void        *p_arg = NULL;
   pnet_t      *net = (pnet_t*)arg;
 
   // check destination mac address
@@ -82,23 +169,26 @@ int pf_eth_recv(
     type = ntohs(p_data[0]);
   }
   frame_id = ntohs(p_data[1]);
+  PF_TRACE(PF_TRACE_EVENT_ETH_RX, frame_id);
 
   switch (type)
   {
   case OS_ETHTYPE_PROFINET:
-    /* Find the associated frame handler */
-    ix = 0;
-    while ((ix < NELEMENTS(net->eth_id_map)) &&
-           ((net->eth_id_map[ix].in_use == false) ||
-            (net->eth_id_map[ix].frame_id != frame_id)))
+    /* Find the associated frame handler. Its entry may be removed meanwhile. */
+    (void)atomic_fetch_add(&net->eth_id_readers, 1);
+    p_entry = pf_eth_frame_id_map_find(net, frame_id);
+    if (p_entry != NULL)
     {
-      ix++;
+      frame_handler = p_entry->frame_handler;
+      p_arg = p_entry->p_arg;
     }
-    if (ix < NELEMENTS(net->eth_id_map))
+    (void)atomic_fetch_sub(&net->eth_id_readers, 1);
+
+    if (frame_handler != NULL)
     {
       /* Call the frame handler */
-      ret = net->eth_id_map[ix].frame_handler(net, frame_id, p_buf,
-                                              type_pos + sizeof(uint16_t), net->eth_id_map[ix].p_arg);
+      ret = frame_handler(net, frame_id, p_buf,
+                          type_pos + sizeof(uint16_t), p_arg);
     }
 #ifdef _DEBUG
     else if(frame_id == PF_DCP_ID_REQ_FRAME_ID)
@@ -130,16 +220,26 @@ void pf_eth_frame_id_map_add(
   bool                     b_replace_old)
 {
   size_t  ix = 0;
+  atomic_uint_least16_t *p_link;
+  uint16_t link;
+  size_t   retired_idx = net->eth_id_map_size;
 
   // find entry with the same frame_id and lowest time
   uint64_t min_time = UINT64_MAX;
-  size_t   min_time_idx = NELEMENTS(net->eth_id_map);
+  size_t   min_time_idx = net->eth_id_map_size;
 
+  (void)pf_eth_frame_id_map_reclaim(net);
 
-  while ((ix < NELEMENTS(net->eth_id_map)) &&
-         (net->eth_id_map[ix].in_use == true))
+  while ((ix < net->eth_id_map_size) &&
+         ((net->eth_id_map[ix].in_use == true) ||
+          (net->eth_id_map[ix].retired == true)))
   {
-    if (net->eth_id_map[ix].frame_id == frame_id)
+    if ((net->eth_id_map[ix].retired == true) && (retired_idx == net->eth_id_map_size))
+    {
+      retired_idx = ix;
+    }
+    if ((net->eth_id_map[ix].in_use == true) &&
+        (net->eth_id_map[ix].frame_id == frame_id))
     {
       if (min_time < net->eth_id_map[ix].time_created)
       {
@@ -150,9 +250,19 @@ void pf_eth_frame_id_map_add(
     ix++;
   }
 
+  if ((ix >= net->eth_id_map_size) && (retired_idx < net->eth_id_map_size))
+  {
+    /* Only removed entries are left. A lookup takes well below a microsecond. */
+    while (pf_eth_frame_id_map_reclaim(net) == false)
+    {
+      os_usleep(10);
+    }
+    ix = retired_idx;
+  }
+
   if (   (b_replace_old == true)
-      && (ix >= NELEMENTS(net->eth_id_map)) 
-      && (min_time_idx < NELEMENTS(net->eth_id_map)))
+      && (ix >= net->eth_id_map_size) 
+      && (min_time_idx < net->eth_id_map_size))
   {
     ix = min_time_idx;
     LOG_WARNING(PF_ETH_LOG, "ETH(%d): Replace older FrameId 0x%X in idx %u\n",
@@ -161,17 +271,40 @@ void pf_eth_frame_id_map_add(
                 ix);
   }
 
-  if (ix < NELEMENTS(net->eth_id_map))
+  if (ix < net->eth_id_map_size)
   {
     LOG_INFO(PF_ETH_LOG, "ETH(%d): Add FrameIds 0x%x at index %u\n",
              __LINE__,
              frame_id,
              ix);
-    net->eth_id_map[ix].in_use        = true;
-    net->eth_id_map[ix].frame_id      = frame_id;
-    net->eth_id_map[ix].frame_handler = frame_handler;
-    net->eth_id_map[ix].p_arg         = p_arg;
-    net->eth_id_map[ix].time_created  = os_get_current_time_us();
+    if (net->eth_id_map[ix].in_use == true)
+    {
+      /* Replaced entry has the same frame id, so it is already hashed. */
+      net->eth_id_map[ix].frame_handler = frame_handler;
+      net->eth_id_map[ix].p_arg         = p_arg;
+      net->eth_id_map[ix].time_created  = os_get_current_time_us();
+    }
+    else
+    {
+      net->eth_id_map[ix].in_use        = true;
+      net->eth_id_map[ix].frame_id      = frame_id;
+      net->eth_id_map[ix].frame_handler = frame_handler;
+      net->eth_id_map[ix].p_arg         = p_arg;
+      net->eth_id_map[ix].time_created  = os_get_current_time_us();
+      atomic_store_explicit(&net->eth_id_map[ix].next, PF_ETH_HASH_NONE, memory_order_relaxed);
+
+      /* Link last in chain, so that older entries are found first.
+       * The release store makes the entry complete before a receiver
+       * can reach it. */
+      p_link = &net->eth_id_hash[pf_eth_frame_id_hash(net, frame_id)];
+      link = atomic_load_explicit(p_link, memory_order_relaxed);
+      while (link != PF_ETH_HASH_NONE)
+      {
+        p_link = &net->eth_id_map[link].next;
+        link = atomic_load_explicit(p_link, memory_order_relaxed);
+      }
+      atomic_store_explicit(p_link, (uint16_t)ix, memory_order_release);
+    }
   }
   else
   {
@@ -185,17 +318,27 @@ void pf_eth_frame_id_map_remove(
   pnet_t                  *net,
   uint16_t                frame_id)
 {
-  size_t ix = 0;
+  uint16_t ix;
+  atomic_uint_least16_t *p_link = &net->eth_id_hash[pf_eth_frame_id_hash(net, frame_id)];
 
-  while ((ix < NELEMENTS(net->eth_id_map)) &&
+  ix = atomic_load_explicit(p_link, memory_order_relaxed);
+  while ((ix != PF_ETH_HASH_NONE) &&
          ((net->eth_id_map[ix].in_use == false) ||
           (net->eth_id_map[ix].frame_id != frame_id)))
   {
-    ix++;
+    p_link = &net->eth_id_map[ix].next;
+    ix = atomic_load_explicit(p_link, memory_order_relaxed);
   }
 
-  if (ix < NELEMENTS(net->eth_id_map))
+  if (ix != PF_ETH_HASH_NONE)
   {
+    /* Unlink. The next field is kept, so a concurrent reader positioned
+     * on this entry still reaches the rest of the chain. The entry is
+     * not reused until no reader can be on it. */
+    atomic_store_explicit(p_link,
+                          atomic_load_explicit(&net->eth_id_map[ix].next, memory_order_relaxed),
+                          memory_order_release);
+    net->eth_id_map[ix].retired = true;
     net->eth_id_map[ix].in_use = false;
     LOG_INFO(PF_ETH_LOG, "ETH(%d): Free room for FrameId 0x%x at index %u\n",
              __LINE__,
@@ -209,11 +352,12 @@ void pf_eth_show(pnet_t *net)
   size_t ix;
 
   printf("pf_eth_show:\n");
-  for (ix = 0; ix < NELEMENTS(net->eth_id_map); ix++)
+  for (ix = 0; ix < net->eth_id_map_size; ix++)
   {
-    printf("%u: id 0x%X in use %i\n", 
+    printf("%u: id 0x%X in use %i next %u\n", 
            ix, 
            net->eth_id_map[ix].frame_id, 
-           (int)net->eth_id_map[ix].in_use);
+           (int)net->eth_id_map[ix].in_use,
+           (unsigned)atomic_load(&net->eth_id_map[ix].next));
   }
 }
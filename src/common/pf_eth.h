@@ -60,6 +60,25 @@ void pf_eth_frame_id_map_remove(
   pnet_t                  *net,
   uint16_t                frame_id);
 
+/**
+  * Find the frame id map entry for a frame id.
+  *
+  * The lookup is done via the frame id hash index, and does not depend on
+  * the number of entries in the map.
+  * If several entries have the same frame id, the oldest one is returned.
+  *
+  * A caller that runs concurrently with pf_eth_frame_id_map_remove() must
+  * count itself in net->eth_id_readers while it uses the entry, as
+  * pf_eth_recv() does. Else the entry may be reused under it.
+  *
+  * @param net              InOut: The p-net stack instance
+  * @param frame_id         In:   The frame ID to look for.
+  * @return  the map entry, or NULL if the frame id is not in the map.
+  */
+pf_eth_frame_id_map_t *pf_eth_frame_id_map_find(
+  pnet_t                  *net,
+  uint16_t                frame_id);
+
 /**
   * Inspect and possibly handle Ethernet frames:
   *
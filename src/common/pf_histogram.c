@@ -0,0 +1,98 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+/**
+ * @file
+ * @brief Log2 time histograms, for the IOCR statistics
+ *
+ * Counting a time is a few instructions and never allocates, so the
+ * histograms are always kept by the CPM and PPM.
+ */
+
+#include <string.h>
+
+#include "pf_includes.h"
+
+void pf_histogram_reset(
+   pnet_histogram_t        *p_hist)
+{
+   memset(p_hist, 0, sizeof(*p_hist));
+   p_hist->min_ns = UINT32_MAX;
+}
+
+void pf_histogram_add(
+   pnet_histogram_t        *p_hist,
+   uint64_t                time_ns)
+{
+   const uint32_t          ns = (time_ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)time_ns;
+   const uint32_t          us = ns / 1000;
+   uint32_t                ix = 0;
+
+   if (us > 0)
+   {
+      ix = 32 - __builtin_clz(us);     /* [2^(ix-1), 2^ix) us */
+      if (ix >= PNET_HISTOGRAM_BUCKETS)
+      {
+         ix = PNET_HISTOGRAM_BUCKETS - 1;
+      }
+   }
+
+   p_hist->buckets[ix]++;
+   p_hist->count++;
+   p_hist->sum_ns += ns;
+   if (ns < p_hist->min_ns)
+   {
+      p_hist->min_ns = ns;
+   }
+   if (ns > p_hist->max_ns)
+   {
+      p_hist->max_ns = ns;
+   }
+}
+
+void pf_histogram_show(
+   const char              *p_name,
+   const pnet_histogram_t  *p_hist)
+{
+   uint32_t                ix;
+
+   if (p_hist->count == 0)
+   {
+      printf("   %-18s = -\n", p_name);
+      return;
+   }
+
+   printf("   %-18s = %u, min/avg/max %u/%u/%u us |", p_name,
+          (unsigned)p_hist->count,
+          (unsigned)(p_hist->min_ns / 1000),
+          (unsigned)(p_hist->sum_ns / p_hist->count / 1000),
+          (unsigned)(p_hist->max_ns / 1000));
+   for (ix = 0; ix < PNET_HISTOGRAM_BUCKETS; ix++)
+   {
+      if (p_hist->buckets[ix] == 0)
+      {
+         /* Skip */
+      }
+      else if (ix < (PNET_HISTOGRAM_BUCKETS - 1))
+      {
+         printf(" <%u:%u", 1U << ix, (unsigned)p_hist->buckets[ix]);
+      }
+      else
+      {
+         printf(" >=%u:%u", 1U << (ix - 1), (unsigned)p_hist->buckets[ix]);
+      }
+   }
+   printf("\n");
+}
@@ -0,0 +1,53 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+#ifndef PF_HISTOGRAM_H
+#define PF_HISTOGRAM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Clear a histogram.
+ * @param p_hist           Out:  The histogram.
+ */
+void pf_histogram_reset(
+   pnet_histogram_t        *p_hist);
+
+/**
+ * Count a time in a histogram.
+ * @param p_hist           InOut: The histogram.
+ * @param time_ns          In:   The time, in ns. Saturates at UINT32_MAX.
+ */
+void pf_histogram_add(
+   pnet_histogram_t        *p_hist,
+   uint64_t                time_ns);
+
+/**
+ * Show a histogram on one line: count, min/avg/max and the used buckets.
+ * @param p_name           In:   Name to print first.
+ * @param p_hist           In:   The histogram.
+ */
+void pf_histogram_show(
+   const char              *p_name,
+   const pnet_histogram_t  *p_hist);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PF_HISTOGRAM_H */
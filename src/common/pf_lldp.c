@@ -720,7 +720,7 @@ void pf_lldp_recv(
          || (net->previous_lldp_check_peers_data.length_peer_port_id > 0))
       {
         uint16_t ix;
-        for (ix = 0U; ix < PNET_MAX_AR; ix++)
+        for (ix = 0U; ix < net->max_ar; ix++)
         {
           pf_ar_t *p_ar = pf_ar_find_by_index(net, ix);
           if (p_ar != NULL)
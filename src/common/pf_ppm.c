@@ -29,11 +29,16 @@
   * Keep track of how many instances exist and delete the mutex when the
   * number reaches 0 (zero).
   *
+  * Frames are not sent one by one. All PPM frames that become due in the
+  * same scheduler tick are queued and then sent together by
+  * pf_ppm_send_flush(), which is called when the tick is done.
+  *
   */
 
 
 #ifdef UNIT_TEST
-#define os_eth_send mock_os_eth_send
+#define os_eth_send_queue mock_os_eth_send
+#define os_eth_send_flush mock_os_eth_send_flush
 #endif
 
 #include <string.h>
@@ -87,6 +92,140 @@ static void pf_ppm_set_state(
   p_ppm->state = state;
 }
 
+/**
+ * @internal
+ * Start reading the published input data.
+ *
+ * Read buffer_data[seq & 1] and then call pf_ppm_read_retry(), until it
+ * returns false. The writer is never blocked by a reader.
+ *
+ * @param p_ppm            In:   The PPM instance.
+ * @return  the sequence number to pass to pf_ppm_read_retry().
+ */
+static uint32_t pf_ppm_read_begin(
+  pf_ppm_t               *p_ppm)
+{
+  return atomic_load_explicit(&p_ppm->buffer_seq, memory_order_acquire);
+}
+
+/**
+ * @internal
+ * Check if the read started by pf_ppm_read_begin() overlapped a publish.
+ * @param p_ppm            InOut: The PPM instance.
+ * @param seq              In:   The sequence number from pf_ppm_read_begin().
+ * @return  true if the data must be read again.
+ */
+static bool pf_ppm_read_retry(
+  pf_ppm_t               *p_ppm,
+  uint32_t                seq)
+{
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&p_ppm->buffer_seq, memory_order_relaxed) != seq)
+  {
+    p_ppm->read_retry_cnt++;
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * @internal
+ * Write into the buffer the application writes into. Only the writer may
+ * use it.
+ *
+ * The written range is added to the range copied by the next publish.
+ *
+ * @param p_ppm            InOut: The PPM instance.
+ * @param offset           In:   Offset in the input data.
+ * @param p_src            In:   The data to write.
+ * @param len              In:   Number of bytes to write.
+ */
+static void pf_ppm_write(
+  pf_ppm_t               *p_ppm,
+  uint16_t                offset,
+  const void             *p_src,
+  uint16_t                len)
+{
+  uint32_t                seq = atomic_load_explicit(&p_ppm->buffer_seq, memory_order_relaxed);
+
+  if (len > 0)
+  {
+    memcpy(&p_ppm->buffer_data[(seq + 1) & 1][offset], p_src, len);
+    p_ppm->dirty_start = MIN(p_ppm->dirty_start, offset);
+    p_ppm->dirty_end = MAX(p_ppm->dirty_end, offset + len);
+  }
+}
+
+/**
+ * @internal
+ * Publish the data written to the write buffer, if any.
+ *
+ * The write buffer becomes the one the sender reads. The written range of
+ * the now unpublished buffer is brought up to date, as the next write may
+ * change only a part of it.
+ *
+ * @param p_ppm            InOut: The PPM instance.
+ */
+static void pf_ppm_publish(
+  pf_ppm_t               *p_ppm)
+{
+  uint32_t                seq;
+
+  if (p_ppm->dirty_start < p_ppm->dirty_end)
+  {
+    seq = atomic_load_explicit(&p_ppm->buffer_seq, memory_order_relaxed);
+    atomic_store_explicit(&p_ppm->buffer_seq, seq + 1, memory_order_release);
+    /* The copy below must not be seen before the new sequence number */
+    atomic_thread_fence(memory_order_seq_cst);
+    memcpy(&p_ppm->buffer_data[seq & 1][p_ppm->dirty_start],
+           &p_ppm->buffer_data[(seq + 1) & 1][p_ppm->dirty_start],
+           p_ppm->dirty_end - p_ppm->dirty_start);
+    p_ppm->dirty_start = UINT16_MAX;
+    p_ppm->dirty_end = 0;
+  }
+}
+
+/**
+ * @internal
+ * Publish a write to the input data, unless a batch is open.
+ * @param net              InOut: The p-net stack instance
+ * @param p_ppm            InOut: The PPM instance.
+ */
+static void pf_ppm_write_done(
+  pnet_t                 *net,
+  pf_ppm_t               *p_ppm)
+{
+  if (atomic_load(&net->ppm_batch_open) == false)
+  {
+    pf_ppm_publish(p_ppm);
+  }
+}
+
+void pf_ppm_batch_begin(
+  pnet_t                 *net)
+{
+  atomic_store(&net->ppm_batch_open, true);
+}
+
+void pf_ppm_batch_end(
+  pnet_t                 *net)
+{
+  uint32_t                ar_ix;
+  uint32_t                crep;
+  pf_ar_t                *p_ar;
+
+  atomic_store(&net->ppm_batch_open, false);
+  for (ar_ix = 0; ar_ix < net->max_ar; ar_ix++)
+  {
+    p_ar = &net->cmrpc_ar[ar_ix];
+    for (crep = 0; crep < p_ar->nbr_iocrs; crep++)
+    {
+      pf_ppm_publish(&p_ar->iocrs[crep].ppm);
+    }
+  }
+}
+
 /**
  * @internal
  * Initialize a transmit buffer of a PPM instance.
@@ -144,12 +283,12 @@ static void pf_ppm_init_buf(
  * @param data_length      In:   The length of the message.
  */
 static void pf_ppm_finish_buffer(
-  pnet_t                 *net,
   pf_ppm_t               *p_ppm,
   uint16_t                data_length)
 {
   uint8_t                *p_payload = ((os_buf_t *)p_ppm->p_send_buffer)->payload;
   uint16_t                u16;
+  uint32_t                seq;
 
   if(p_payload != NULL)
   {
@@ -157,9 +296,11 @@ static void pf_ppm_finish_buffer(
     u16 = htons((uint16_t)(p_ppm->cycle));
 
     /* Insert data */
-    os_mutex_lock(net->ppm_buf_lock);
-    memcpy(&p_payload[p_ppm->buffer_pos], p_ppm->buffer_data, data_length);
-    os_mutex_unlock(net->ppm_buf_lock);
+    do
+    {
+      seq = pf_ppm_read_begin(p_ppm);
+      memcpy(&p_payload[p_ppm->buffer_pos], p_ppm->buffer_data[seq & 1], data_length);
+    } while (pf_ppm_read_retry(p_ppm, seq));
 
     /* Insert cycle counter */
     memcpy(&p_payload[p_ppm->cycle_counter_offset], &u16, sizeof(u16));
@@ -191,6 +332,8 @@ static void pf_ppm_send(
   uint32_t  current_time)
 {
   pf_iocr_t *p_arg = (pf_iocr_t *)arg;
+  const uint64_t start_ns = os_get_current_time_ns();
+  const uint64_t interval_ns = (uint64_t)p_arg->ppm.control_interval * 1000U;
 
 #if PNET_PROFILE != 0
   uint64_t   start = os_get_current_time_us();
@@ -198,24 +341,36 @@ static void pf_ppm_send(
 
   p_arg->ppm.ci_timer = UINT32_MAX;
 
+  /* Compare with when the frame should have been sent */
+  pf_histogram_add(&p_arg->ppm.send_deviation, (start_ns > p_arg->ppm.next_send_ns) ?
+                   start_ns - p_arg->ppm.next_send_ns : p_arg->ppm.next_send_ns - start_ns);
+  p_arg->ppm.next_send_ns += interval_ns;
+  if (start_ns > p_arg->ppm.next_send_ns + interval_ns)
+  {
+    /* Lost whole cycles. Count them once and re-synchronize */
+    p_arg->ppm.next_send_ns = start_ns + interval_ns;
+  }
+
   if (   (p_arg->ppm.ci_running == true) 
       && (p_arg->ppm.p_send_buffer != NULL) 
       && (p_arg->p_ar->in_use == true))
   {
     /* in_length is size of input to the controller */
-    pf_ppm_finish_buffer(net, &p_arg->ppm, p_arg->in_length);
-    /* Now send it */
+    pf_ppm_finish_buffer(&p_arg->ppm, p_arg->in_length);
+    PF_TRACE(PF_TRACE_EVENT_PPM_FINISH, p_arg->ppm.cycle);
+    /* Queue it. It is sent by pf_ppm_send_flush() at the end of the tick */
     /* ToDo: Handle RT_CLASS_UDP */
 
-    if (os_eth_send(p_arg->p_ar->p_sess->eth_handle, p_arg->ppm.p_send_buffer) <= 0)
+    if (os_eth_send_queue(p_arg->p_ar->p_sess->eth_handle, p_arg->ppm.p_send_buffer) <= 0)
     {
-      LOG_ERROR(PF_PPM_LOG, "PPM(%d): Error from os_eth_send(ppm) of %u bytes, errno %i\n", 
+      LOG_ERROR(PF_PPM_LOG, "PPM(%d): Error from os_eth_send_queue(ppm) of %u bytes, errno %i\n", 
                 __LINE__, 
                 ((os_buf_t *)p_arg->ppm.p_send_buffer)->len,
                 errno);
     }
     else
     {
+      PF_TRACE(PF_TRACE_EVENT_PPM_SEND, p_arg->param.frame_id);
       // Compensate for the execution delay variations:
       const uint32_t half_tick_interval = net->scheduler_tick_interval / 2;
       if (pf_scheduler_add(net, p_arg->ppm.control_interval - half_tick_interval, ppm_sync_name, pf_ppm_send, arg, &p_arg->ppm.ci_timer) == 0)
@@ -237,6 +392,17 @@ static void pf_ppm_send(
 #if PNET_PROFILE != 0
   p_arg->ppm.exec = (uint32_t)(os_get_current_time_us() - start);
 #endif // PNET_PROFILE != 0
+  pf_histogram_add(&p_arg->ppm.send_exec, os_get_current_time_ns() - start_ns);
+}
+
+void pf_ppm_send_flush(
+  pnet_t                 *net)
+{
+  PF_TRACE(PF_TRACE_EVENT_PPM_FLUSH, 0);
+  if (os_eth_send_flush(net->eth_handle) < 0)
+  {
+    LOG_ERROR(PF_PPM_LOG, "PPM(%d): Error from os_eth_send_flush(ppm)\n", __LINE__);
+  }
 }
 
 int pf_ppm_activate_req(
@@ -248,13 +414,8 @@ int pf_ppm_activate_req(
   const uint16_t          vlan_size = 4;
   pf_iocr_t *p_iocr = &p_ar->iocrs[crep];
   pf_ppm_t *p_ppm;
-  uint32_t                cnt;
 
-  cnt = atomic_fetch_add(&net->ppm_instance_cnt, 1);
-  if (cnt == 0)
-  {
-    net->ppm_buf_lock = os_mutex_create();
-  }
+  (void)atomic_fetch_add(&net->ppm_instance_cnt, 1);
 
   p_ppm = &p_iocr->ppm;
   if (p_ppm->state == PF_PPM_STATE_RUN)
@@ -276,6 +437,12 @@ int pf_ppm_activate_req(
     p_ppm->cycle = 0;
     p_ppm->transfer_status = 0;
 
+    p_ppm->buffer_data_length = MIN(p_iocr->param.c_sdu_length, sizeof(p_ppm->buffer_data[0]));
+    memset(p_ppm->buffer_data, 0, sizeof(p_ppm->buffer_data));
+    atomic_init(&p_ppm->buffer_seq, 0U);
+    p_ppm->dirty_start = UINT16_MAX;
+    p_ppm->dirty_end = 0;
+
     /* Pre-compute some offsets into the send buffer */
     p_ppm->cycle_counter_offset = p_ppm->buffer_pos +           /* ETH frame header */
       p_iocr->param.c_sdu_length;                           /* Profinet data length */
@@ -307,6 +474,9 @@ int pf_ppm_activate_req(
 
     p_ppm->cycle_increment = (uint32_t)p_iocr->param.send_clock_factor * (uint32_t)p_iocr->param.reduction_ratio;
     p_ppm->control_interval = (p_ppm->cycle_increment * 1000U) / 32U; /* us */
+    p_ppm->next_send_ns = os_get_current_time_ns() + (uint64_t)p_ppm->control_interval * 1000U;
+    pf_histogram_reset(&p_ppm->send_deviation);
+    pf_histogram_reset(&p_ppm->send_exec);
 
     pf_ppm_set_state(p_ppm, PF_PPM_STATE_RUN);
 
@@ -340,6 +510,8 @@ int pf_ppm_close_req(
     p_ppm->ci_timer = UINT32_MAX;
   }
 
+  /* The send buffer may still be queued for sending in this tick */
+  pf_ppm_send_flush(net);
   os_buf_free(p_ppm->p_send_buffer);
   p_ppm->p_send_buffer = NULL;
   pf_ppm_set_state(p_ppm, PF_PPM_STATE_W_START);
@@ -347,9 +519,6 @@ int pf_ppm_close_req(
   cnt = atomic_fetch_sub(&net->ppm_instance_cnt, 1);
   if (cnt == 1)
   {
-    os_mutex_destroy(net->ppm_buf_lock);
-    net->ppm_buf_lock = NULL;
-
     p_ppm->data_status = 0;
   }
 
@@ -434,6 +603,106 @@ static int pf_ppm_get_ar_iocr_desc(
 
 /**************** Set and get data, IOPS and IOCS ****************************/
 
+/**
+ * @internal
+ * Make sure the input descriptors of a sub-slot handle are up to date.
+ * @param net              InOut: The p-net stack instance
+ * @param p_handle         InOut: The sub-slot handle.
+ * @return  0  If the sub-slot is in an input IOCR.
+ *          -1 If not.
+ */
+static int pf_ppm_resolve_handle(
+  pnet_t                 *net,
+  pf_subslot_handle_t    *p_handle)
+{
+  uint32_t                gen = atomic_load(&net->subslot_handle_gen);
+  pf_ar_t                *p_ar = NULL;
+  pf_iocr_t              *p_iocr = NULL;
+  pf_iodata_object_t     *p_iodata = NULL;
+
+  if (p_handle->input_gen == gen)
+  {
+    return 0;
+  }
+
+  if (pf_ppm_get_ar_iocr_desc(net, p_handle->api, p_handle->slot, p_handle->subslot, &p_ar, &p_iocr, &p_iodata) != 0)
+  {
+    LOG_DEBUG(PF_PPM_LOG, "PPM(%d): No data descriptor found for handle\n", __LINE__);
+    return -1;
+  }
+
+  p_handle->p_input_ar = p_ar;
+  p_handle->p_input_iocr = p_iocr;
+  p_handle->p_input_iodata = p_iodata;
+  p_handle->input_gen = gen;
+
+  return 0;
+}
+
+
+/**
+ * @internal
+ * Set the data and IOPS of a sub-module, given its descriptors.
+ * @param net              InOut: The p-net stack instance
+ * @param p_ar             InOut: The AR instance.
+ * @param p_iocr           InOut: The input IOCR instance.
+ * @param p_iodata         InOut: The IODATA object instance.
+ * @param p_data           In:   The application data.
+ * @param data_len         In:   The length of the application data.
+ * @param p_iops           In:   The IOPS of the application data.
+ * @param iops_len         In:   The length of the IOPS.
+ * @return  0  if the input data and IOPS was set.
+ *          -1 if an error occurred.
+ */
+static int pf_ppm_iodata_set_data_and_iops(
+  pnet_t   *net,
+  pf_ar_t  *p_ar,
+  pf_iocr_t *p_iocr,
+  pf_iodata_object_t *p_iodata,
+  uint8_t  *p_data,
+  uint16_t  data_len,
+  uint8_t  *p_iops,
+  uint8_t   iops_len)
+{
+  int                     ret = -1;
+
+  switch (p_iocr->ppm.state)
+  {
+  case PF_PPM_STATE_W_START:
+    p_ar->err_cls = PNET_ERROR_CODE_1_PPM;
+
+    if(p_ar->err_code != 0)
+    {
+      LOG_WARNING(PNET_LOG, "%s(%i) err_code %d -> %d?\n", __FILE__, __LINE__, p_ar->err_code, PNET_ERROR_CODE_2_PPM_INVALID_STATE);
+    }
+    //p_ar->err_code = PNET_ERROR_CODE_2_PPM_INVALID_STATE;
+
+    LOG_DEBUG(PF_PPM_LOG, "PPM(%d): Set data in wrong state: %u\n", __LINE__, p_iocr->ppm.state);
+    break;
+  case PF_PPM_STATE_RUN:
+    if ((data_len == p_iodata->data_length) && (iops_len == p_iodata->iops_length))
+    {
+      pf_ppm_write(&p_iocr->ppm, p_iodata->data_offset, p_data, data_len);
+      pf_ppm_write(&p_iocr->ppm, p_iodata->iops_offset, p_iops, iops_len);
+      pf_ppm_write_done(net, &p_iocr->ppm);
+
+      p_iodata->data_avail = true;
+      ret = 0;
+    }
+    else
+    {
+      LOG_ERROR(PF_PPM_LOG, "PPM(%d): data_len, iops_len %u %u expected lengths %u %u\n", __LINE__,
+                data_len, iops_len, p_iodata->data_length, p_iodata->iops_length);
+    }
+    break;
+  default:
+    LOG_ERROR(PF_PPM_LOG, "PPM(%d): Set data in wrong state: %u\n", __LINE__, p_iocr->ppm.state);
+    break;
+  }
+
+  return ret;
+}
+
 int pf_ppm_set_data_and_iops(
   pnet_t   *net,
   uint32_t  api_id,
@@ -451,47 +720,7 @@ int pf_ppm_set_data_and_iops(
 
   if (pf_ppm_get_ar_iocr_desc(net, api_id, slot_nbr, subslot_nbr, &p_ar, &p_iocr, &p_iodata) == 0)
   {
-    switch (p_iocr->ppm.state)
-    {
-    case PF_PPM_STATE_W_START:
-      p_ar->err_cls = PNET_ERROR_CODE_1_PPM;
-
-      if(p_ar->err_code != 0)
-      {
-        LOG_WARNING(PNET_LOG, "%s(%i) err_code %d -> %d?\n", __FILE__, __LINE__, p_ar->err_code, PNET_ERROR_CODE_2_PPM_INVALID_STATE);
-      }
-      //p_ar->err_code = PNET_ERROR_CODE_2_PPM_INVALID_STATE;
-
-      LOG_DEBUG(PF_PPM_LOG, "PPM(%d): Set data in wrong state: %u\n", __LINE__, p_iocr->ppm.state);
-      break;
-    case PF_PPM_STATE_RUN:
-      if ((data_len == p_iodata->data_length) && (iops_len == p_iodata->iops_length))
-      {
-            CC_ASSERT(net->ppm_buf_lock != NULL);
-        os_mutex_lock(net->ppm_buf_lock);
-        if (data_len > 0)
-        {
-          memcpy(&p_iocr->ppm.buffer_data[p_iodata->data_offset], p_data, data_len);
-        }
-        if (iops_len > 0)
-        {
-          memcpy(&p_iocr->ppm.buffer_data[p_iodata->iops_offset], p_iops, iops_len);
-        }
-        os_mutex_unlock(net->ppm_buf_lock);
-
-        p_iodata->data_avail = true;
-        ret = 0;
-      }
-      else
-      {
-        LOG_ERROR(PF_PPM_LOG, "PPM(%d): data_len, iops_len %u %u expected lengths %u %u\n", __LINE__,
-                  data_len, iops_len, p_iodata->data_length, p_iodata->iops_length);
-      }
-      break;
-    default:
-      LOG_ERROR(PF_PPM_LOG, "PPM(%d): Set data in wrong state: %u\n", __LINE__, p_iocr->ppm.state);
-      break;
-    }
+    ret = pf_ppm_iodata_set_data_and_iops(net, p_ar, p_iocr, p_iodata, p_data, data_len, p_iops, iops_len);
   }
   else
   {
@@ -502,6 +731,24 @@ int pf_ppm_set_data_and_iops(
   return ret;
 }
 
+int pf_ppm_set_data_and_iops_by_handle(
+  pnet_t   *net,
+  pf_subslot_handle_t *p_handle,
+  uint8_t  *p_data,
+  uint16_t  data_len,
+  uint8_t  *p_iops,
+  uint8_t   iops_len)
+{
+  int                     ret = -1;
+
+  if (pf_ppm_resolve_handle(net, p_handle) == 0)
+  {
+    ret = pf_ppm_iodata_set_data_and_iops(net, p_handle->p_input_ar, p_handle->p_input_iocr, p_handle->p_input_iodata, p_data, data_len, p_iops, iops_len);
+  }
+
+  return ret;
+}
+
 int pf_ppm_set_iocs(
   pnet_t                 *net,
   uint32_t                api_id,
@@ -532,10 +779,8 @@ int pf_ppm_set_iocs(
     case PF_PPM_STATE_RUN:
       if (iocs_len == p_iodata->iocs_length)
       {
-        CC_ASSERT(net->ppm_buf_lock != NULL);
-        os_mutex_lock(net->ppm_buf_lock);
-        memcpy(&p_iocr->ppm.buffer_data[p_iodata->iocs_offset], p_iocs, iocs_len);
-        os_mutex_unlock(net->ppm_buf_lock);
+        pf_ppm_write(&p_iocr->ppm, p_iodata->iocs_offset, p_iocs, iocs_len);
+        pf_ppm_write_done(net, &p_iocr->ppm);
 
         ret = 0;
       }
@@ -578,6 +823,7 @@ int pf_ppm_get_data_and_iops(
   pf_iocr_t          *p_iocr = NULL;
   pf_iodata_object_t *p_iodata = NULL;
   pf_ar_t            *p_ar = NULL;
+  uint32_t           seq;
 
   if (pf_ppm_get_ar_iocr_desc(net, api_id, slot_nbr, subslot_nbr, &p_ar, &p_iocr, &p_iodata) == 0)
   {
@@ -596,11 +842,12 @@ int pf_ppm_get_data_and_iops(
     case PF_PPM_STATE_RUN:
       if ((*p_data_len >= p_iodata->data_length) && (*p_iops_len >= p_iodata->iops_length))
       {
-        CC_ASSERT(net->ppm_buf_lock != NULL);
-        os_mutex_lock(net->ppm_buf_lock);
-        memcpy(p_data, &p_iocr->ppm.buffer_data[p_iodata->data_offset], p_iodata->data_length);
-        memcpy(p_iops, &p_iocr->ppm.buffer_data[p_iodata->iops_offset], p_iodata->iops_length);
-        os_mutex_unlock(net->ppm_buf_lock);
+        do
+        {
+          seq = pf_ppm_read_begin(&p_iocr->ppm);
+          memcpy(p_data, &p_iocr->ppm.buffer_data[seq & 1][p_iodata->data_offset], p_iodata->data_length);
+          memcpy(p_iops, &p_iocr->ppm.buffer_data[seq & 1][p_iodata->iops_offset], p_iodata->iops_length);
+        } while (pf_ppm_read_retry(&p_iocr->ppm, seq));
 
         *p_data_len = p_iodata->data_length;
         *p_iops_len = (uint8_t)p_iodata->iops_length;
@@ -650,6 +897,7 @@ int pf_ppm_get_iocs(
   pf_iocr_t *p_iocr = NULL;
   pf_iodata_object_t *p_iodata = NULL;
   pf_ar_t *p_ar = NULL;
+  uint32_t                seq;
 
   if (pf_ppm_get_ar_iocr_desc(net, api_id, slot_nbr, subslot_nbr, &p_ar, &p_iocr, &p_iodata) == 0)
   {
@@ -668,10 +916,11 @@ int pf_ppm_get_iocs(
     case PF_PPM_STATE_RUN:
       if (*p_iocs_len >= p_iodata->iocs_length)
       {
-        CC_ASSERT(net->ppm_buf_lock != NULL);
-        os_mutex_lock(net->ppm_buf_lock);
-        memcpy(p_iocs, &p_iocr->ppm.buffer_data[p_iodata->iocs_offset], p_iodata->iocs_length);
-        os_mutex_unlock(net->ppm_buf_lock);
+        do
+        {
+          seq = pf_ppm_read_begin(&p_iocr->ppm);
+          memcpy(p_iocs, &p_iocr->ppm.buffer_data[seq & 1][p_iodata->iocs_offset], p_iodata->iocs_length);
+        } while (pf_ppm_read_retry(&p_iocr->ppm, seq));
 
         *p_iocs_len = (uint8_t)p_iodata->iocs_length;
         ret = 0;
@@ -695,6 +944,92 @@ int pf_ppm_get_iocs(
   return ret;
 }
 
+int pf_ppm_get_image_layout(
+  pnet_t                 *net,
+  uint32_t                api_id,
+  uint16_t                slot_nbr,
+  uint16_t                subslot_nbr,
+  pnet_input_image_layout_t *p_layout)
+{
+  int                     ret = -1;
+  pf_iocr_t              *p_iocr = NULL;
+  pf_iodata_object_t     *p_iodata = NULL;
+  pf_ar_t                *p_ar = NULL;
+
+  if (pf_ppm_get_ar_iocr_desc(net, api_id, slot_nbr, subslot_nbr, &p_ar, &p_iocr, &p_iodata) == 0)
+  {
+    p_layout->arep = p_ar->arep;
+    p_layout->crep = (uint16_t)p_iocr->crep;
+    p_layout->image_length = MIN(p_iocr->param.c_sdu_length, sizeof(p_iocr->ppm.buffer_data[0]));
+    p_layout->data_offset = p_iodata->data_offset;
+    p_layout->data_length = p_iodata->data_length;
+    p_layout->iops_offset = p_iodata->iops_offset;
+    p_layout->iops_length = p_iodata->iops_length;
+    p_layout->iocs_offset = p_iodata->iocs_offset;
+    p_layout->iocs_length = p_iodata->iocs_length;
+    ret = 0;
+  }
+  else
+  {
+    LOG_DEBUG(PF_PPM_LOG, "PPM(%d): No data descriptor found for image layout\n", __LINE__);
+  }
+
+  return ret;
+}
+
+int pf_ppm_set_image(
+  pnet_t                 *net,
+  pf_ar_t                *p_ar,
+  uint16_t                crep,
+  const uint8_t          *p_image,
+  uint16_t                image_length)
+{
+  int                     ret = -1;
+  pf_iocr_t              *p_iocr;
+  pf_iodata_object_t     *p_iodata;
+  uint16_t                iodata_ix;
+
+  if (crep >= p_ar->nbr_iocrs)
+  {
+    LOG_ERROR(PF_PPM_LOG, "PPM(%d): Invalid crep %u in set image\n", __LINE__, (unsigned)crep);
+    return -1;
+  }
+
+  p_iocr = &p_ar->iocrs[crep];
+  if ((p_iocr->param.iocr_type != PF_IOCR_TYPE_INPUT) &&
+      (p_iocr->param.iocr_type != PF_IOCR_TYPE_MC_PROVIDER))
+  {
+    LOG_ERROR(PF_PPM_LOG, "PPM(%d): IOCR %u is not an input IOCR\n", __LINE__, (unsigned)crep);
+  }
+  else if (p_iocr->ppm.state != PF_PPM_STATE_RUN)
+  {
+    LOG_DEBUG(PF_PPM_LOG, "PPM(%d): Set image in wrong state: %u\n", __LINE__, (unsigned)p_iocr->ppm.state);
+  }
+  else if (image_length != p_iocr->ppm.buffer_data_length)
+  {
+    LOG_ERROR(PF_PPM_LOG, "PPM(%d): image_length %u expected length %u\n", __LINE__,
+              (unsigned)image_length, (unsigned)p_iocr->ppm.buffer_data_length);
+  }
+  else
+  {
+    pf_ppm_write(&p_iocr->ppm, 0, p_image, image_length);
+    for (iodata_ix = 0; iodata_ix < p_iocr->nbr_data_desc; iodata_ix++)
+    {
+      p_iodata = &p_iocr->data_desc[iodata_ix];
+      if ((p_iodata->in_use == true) &&
+          (p_iodata->data_offset + p_iodata->data_length <= image_length) &&
+          (p_iodata->iops_offset + p_iodata->iops_length <= image_length))
+      {
+        p_iodata->data_avail = true;
+      }
+    }
+    pf_ppm_write_done(net, &p_iocr->ppm);
+    ret = 0;
+  }
+
+  return ret;
+}
+
 /*****************************************************************************/
 
 int pf_ppm_set_data_status_state(
@@ -838,4 +1173,8 @@ void pf_ppm_show(
   printf("   data_status        = %x\n", (unsigned)p_ppm->data_status);
   printf("   buffer_length      = %u\n", (unsigned)p_ppm->buffer_length);
   printf("   buffer_pos         = %u\n", (unsigned)p_ppm->buffer_pos);
+  printf("   buffer_seq         = %u\n", (unsigned)atomic_load(&p_ppm->buffer_seq));
+  printf("   read_retry_cnt     = %u\n", (unsigned)p_ppm->read_retry_cnt);
+  pf_histogram_show("send_deviation", &p_ppm->send_deviation);
+  pf_histogram_show("send_exec", &p_ppm->send_exec);
 }
@@ -55,6 +55,34 @@ int pf_ppm_close_req(
    pf_ar_t                 *p_ar,
    uint32_t                crep);
 
+/**
+ * Send the PPM frames queued during the current scheduler tick.
+ *
+ * This shall be called after pf_scheduler_tick(), and before a queued
+ * send buffer is released.
+ * @param net              InOut: The p-net stack instance
+ */
+void pf_ppm_send_flush(
+   pnet_t                  *net);
+
+/**
+ * Start a batch of input data writes.
+ *
+ * Writes of data, IOPS and IOCS are not sent until pf_ppm_batch_end().
+ * Outside a batch, each write is published by itself.
+ * @param net              InOut: The p-net stack instance
+ */
+void pf_ppm_batch_begin(
+   pnet_t                  *net);
+
+/**
+ * End a batch of input data writes, and publish them to the senders of
+ * all IOCRs at once.
+ * @param net              InOut: The p-net stack instance
+ */
+void pf_ppm_batch_end(
+   pnet_t                  *net);
+
 /**
  * Set the data and IOPS for a sub-module.
  * @param net              InOut: The p-net stack instance
@@ -78,6 +106,30 @@ int pf_ppm_set_data_and_iops(
    uint8_t                 *p_iops,
    uint8_t                 iops_len);
 
+/**
+ * Set the data and IOPS for a sub-module, like pf_ppm_set_data_and_iops(),
+ * for a sub-slot handle.
+ *
+ * The handle is resolved again only if sub-slots have changed since the
+ * last call.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param p_handle         InOut: The sub-slot handle.
+ * @param p_data           In:   The application data.
+ * @param data_len         In:   The length of the application data.
+ * @param p_iops           In:   The IOPS of the application data.
+ * @param iops_len         In:   The length of the IOPS.
+ * @return  0  if the input data and IOPS was set.
+ *          -1 if an error occurred.
+ */
+int pf_ppm_set_data_and_iops_by_handle(
+   pnet_t                  *net,
+   pf_subslot_handle_t     *p_handle,
+   uint8_t                 *p_data,
+   uint16_t                data_len,
+   uint8_t                 *p_iops,
+   uint8_t                 iops_len);
+
 /**
  * Set IOCS for a sub-module.
  * @param net              InOut: The p-net stack instance
@@ -142,6 +194,41 @@ int pf_ppm_get_iocs(
    uint8_t                 *p_iocs,
    uint8_t                 *p_iocs_len);
 
+/**
+ * Get the location of the values of a sub-module in the input image.
+ * @param net              InOut: The p-net stack instance
+ * @param api_id           In:   The API id.
+ * @param slot_nbr         In:   The slot number.
+ * @param subslot_nbr      In:   The sub-slot number.
+ * @param p_layout         Out:  The location of the sub-module values.
+ * @return  0  if the sub-module is in an input IOCR.
+ *          -1 if an error occurred.
+ */
+int pf_ppm_get_image_layout(
+   pnet_t                  *net,
+   uint32_t                api_id,
+   uint16_t                slot_nbr,
+   uint16_t                subslot_nbr,
+   pnet_input_image_layout_t *p_layout);
+
+/**
+ * Set the input image of an IOCR, with the data, IOPS and IOCS of all its
+ * sub-modules.
+ * @param net              InOut: The p-net stack instance
+ * @param p_ar             In:   The AR instance.
+ * @param crep             In:   The IOCR index.
+ * @param p_image          In:   The input image.
+ * @param image_length     In:   The length of the input image.
+ * @return  0  if the input image was set.
+ *          -1 if an error occurred.
+ */
+int pf_ppm_set_image(
+   pnet_t                  *net,
+   pf_ar_t                 *p_ar,
+   uint16_t                crep,
+   const uint8_t           *p_image,
+   uint16_t                image_length);
+
 /**
  * Implements the "Local Set State" primitive.
  * @param p_ar             In:   The AR instance.
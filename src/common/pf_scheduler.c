@@ -13,6 +13,28 @@
  * full license information.
  ********************************************************************/
 
+/**
+ * @file
+ * @brief Schedules call-backs at a specific time.
+ *
+ * The timeouts are kept in a hierarchical timing wheel. A timeout is linked
+ * into the wheel slot of the tick it expires in, so adding and removing a
+ * timeout does not depend on the number of active timeouts. The slots of the
+ * first level and the expired list are kept in expiry order, so timeouts
+ * expiring in the same tick are called in the order of their expiry time,
+ * and in the order they were added if equal.
+ *
+ * All lists are doubly linked lists of indexes into net->scheduler_timeouts,
+ * where net->scheduler_max_timeouts (the size of the table) ends a list.
+ * The list heads are in net->scheduler_lists: one per wheel slot, one for
+ * expired timeouts and one for free timeouts. The last timeout of each list
+ * is in net->scheduler_tails.
+ *
+ * pf_scheduler_tick() advances the wheel to the current time and moves all
+ * expired timeouts to the expired list in one go. Then it calls the
+ * call-backs without holding the mutex, so they may add or remove timeouts.
+ */
+
 #ifdef UNIT_TEST
 
 #endif
@@ -20,45 +42,27 @@
 #include <string.h>
 #include "pf_includes.h"
 
+#define PF_SCHEDULER_WHEEL_MASK           (PF_SCHEDULER_WHEEL_SLOTS - 1)
+#define PF_SCHEDULER_WHEEL_SPAN_BITS      (PF_SCHEDULER_WHEEL_BITS * PF_SCHEDULER_WHEEL_LEVELS)
 
-static bool pf_scheduler_is_linked(
-   pnet_t                  *net,
-   uint32_t                first,
-   uint32_t                ix)
-{
-   bool                    ret = false;
-   uint32_t                cnt = 0;
-
-   if (ix < PF_MAX_TIMEOUTS)
-   {
-      while ((first < PF_MAX_TIMEOUTS) && (cnt < 20))
-      {
-         if (first == ix)
-         {
-            ret = true;
-         }
-         first = net->scheduler_timeouts[first].next;
-         cnt++;
-      }
-   }
-
-   return ret;
-}
-
+/**
+ * @internal
+ * Unlink a timeout from the list it is in.
+ * @param net              InOut: The p-net stack instance
+ * @param ix               In:   The timeout index.
+ */
 static void pf_scheduler_unlink(
    pnet_t                  *net,
-   volatile uint32_t       *p_q,
    uint32_t                ix)
 {
-   /* Unlink from busy list */
    uint32_t                prev_ix;
    uint32_t                next_ix;
 
-   if (ix >= PF_MAX_TIMEOUTS)
+   if (ix >= net->scheduler_max_timeouts)
    {
       LOG_ERROR(PNET_LOG, "Sched(%d): ix (%u) is invalid\n", __LINE__, (unsigned)ix);
    }
-   else if (pf_scheduler_is_linked(net, *p_q, ix) == false)
+   else if (net->scheduler_timeouts[ix].list >= PF_SCHEDULER_NBR_LISTS)
    {
       LOG_ERROR(PNET_LOG, "Sched(%d): %s is not in Q\n", __LINE__, net->scheduler_timeouts[ix].p_name);
    }
@@ -66,126 +70,227 @@ static void pf_scheduler_unlink(
    {
       prev_ix = net->scheduler_timeouts[ix].prev;
       next_ix = net->scheduler_timeouts[ix].next;
-      if (*p_q == ix)
+      if (prev_ix < net->scheduler_max_timeouts)
+      {
+         net->scheduler_timeouts[prev_ix].next = next_ix;
+      }
+      else
       {
-         *p_q = next_ix;
+         net->scheduler_lists[net->scheduler_timeouts[ix].list] = next_ix;
       }
-      if (next_ix < PF_MAX_TIMEOUTS)
+      if (next_ix < net->scheduler_max_timeouts)
       {
          net->scheduler_timeouts[next_ix].prev = prev_ix;
       }
-      if (prev_ix < PF_MAX_TIMEOUTS)
+      else
       {
-         net->scheduler_timeouts[prev_ix].next = next_ix;
+         net->scheduler_tails[net->scheduler_timeouts[ix].list] = prev_ix;
       }
+
+      net->scheduler_timeouts[ix].prev = net->scheduler_max_timeouts;
+      net->scheduler_timeouts[ix].next = net->scheduler_max_timeouts;
+      net->scheduler_timeouts[ix].list = PF_SCHEDULER_NBR_LISTS;
+   }
+}
+
+/**
+ * @internal
+ * Link a timeout first in a list.
+ * @param net              InOut: The p-net stack instance
+ * @param list             In:   The list index.
+ * @param ix               In:   The timeout index. Must not be in a list.
+ */
+static void pf_scheduler_link_first(
+   pnet_t                  *net,
+   uint32_t                list,
+   uint32_t                ix)
+{
+   uint32_t                next_ix = net->scheduler_lists[list];
+
+   net->scheduler_timeouts[ix].prev = net->scheduler_max_timeouts;
+   net->scheduler_timeouts[ix].next = next_ix;
+   net->scheduler_timeouts[ix].list = list;
+   if (next_ix < net->scheduler_max_timeouts)
+   {
+      net->scheduler_timeouts[next_ix].prev = ix;
    }
+   else
+   {
+      net->scheduler_tails[list] = ix;
+   }
+   net->scheduler_lists[list] = ix;
 }
 
+/**
+ * @internal
+ * Link a timeout after another timeout, in the same list.
+ * @param net              InOut: The p-net stack instance
+ * @param ix               In:   The timeout index. Must not be in a list.
+ * @param pos              In:   The timeout to put it after.
+ */
 static void pf_scheduler_link_after(
    pnet_t                  *net,
-   volatile uint32_t       *p_q,
    uint32_t                ix,
    uint32_t                pos)
 {
-   uint32_t                next_ix;
+   uint32_t                next_ix = net->scheduler_timeouts[pos].next;
 
-   if (ix >= PF_MAX_TIMEOUTS)
+   net->scheduler_timeouts[ix].prev = pos;
+   net->scheduler_timeouts[ix].next = next_ix;
+   net->scheduler_timeouts[ix].list = net->scheduler_timeouts[pos].list;
+   if (next_ix < net->scheduler_max_timeouts)
    {
-      LOG_ERROR(PNET_LOG, "Sched(%d): ix (%u) is invalid\n", __LINE__, (unsigned)ix);
+      net->scheduler_timeouts[next_ix].prev = ix;
    }
-   else if (pf_scheduler_is_linked(net, *p_q, ix) == true)
+   else
    {
-      LOG_ERROR(PNET_LOG, "Sched(%d): %s is already in Q\n", __LINE__, net->scheduler_timeouts[ix].p_name);
+      net->scheduler_tails[net->scheduler_timeouts[pos].list] = ix;
    }
-   else if (pos >= PF_MAX_TIMEOUTS)
-   {
-      /* Put first in possible non-empty Q */
-      net->scheduler_timeouts[ix].prev = PF_MAX_TIMEOUTS;
-      net->scheduler_timeouts[ix].next = *p_q;
-      if (*p_q < PF_MAX_TIMEOUTS)
-      {
-         net->scheduler_timeouts[*p_q].prev = ix;
-      }
+   net->scheduler_timeouts[pos].next = ix;
+}
 
-      *p_q = ix;
-   }
-   else if (*p_q >= PF_MAX_TIMEOUTS)
+/**
+ * @internal
+ * Link a timeout into a list, in expiry order.
+ *
+ * Timeouts with the same expiry time keep the order they were added in.
+ * The search starts from the end, as timeouts are mostly added with a later
+ * expiry time than those already in the slot.
+ * @param net              InOut: The p-net stack instance
+ * @param list             In:   The list index.
+ * @param ix               In:   The timeout index. Must not be in a list.
+ */
+static void pf_scheduler_link_sorted(
+   pnet_t                  *net,
+   uint32_t                list,
+   uint32_t                ix)
+{
+   uint64_t                when = net->scheduler_timeouts[ix].when;
+   uint32_t                pos = net->scheduler_tails[list];
+
+   while ((pos < net->scheduler_max_timeouts) &&
+          ((int64_t)(when - net->scheduler_timeouts[pos].when) < 0LL))
    {
-      /* Q is empty - insert first in Q */
-      net->scheduler_timeouts[ix].prev = PF_MAX_TIMEOUTS;
-      net->scheduler_timeouts[ix].next = PF_MAX_TIMEOUTS;
+      pos = net->scheduler_timeouts[pos].prev;
+   }
 
-      *p_q = ix;
+   if (pos < net->scheduler_max_timeouts)
+   {
+      pf_scheduler_link_after(net, ix, pos);
    }
    else
    {
-      next_ix = net->scheduler_timeouts[pos].next;
-
-      if (next_ix < PF_MAX_TIMEOUTS)
-      {
-         net->scheduler_timeouts[next_ix].prev = ix;
-      }
-      net->scheduler_timeouts[pos].next = ix;
-
-      net->scheduler_timeouts[ix].prev = pos;
-      net->scheduler_timeouts[ix].next = next_ix;
+      pf_scheduler_link_first(net, list, ix);
    }
 }
 
-static void pf_scheduler_link_before(
+/**
+ * @internal
+ * Link a timeout into a wheel slot.
+ *
+ * The slots of the first level are kept in expiry order. The timeouts in a
+ * higher level slot are re-inserted on a lower level before they expire.
+ * They are kept in the order they were added, which mostly is expiry order
+ * as well, so the re-insertion seldom needs to search.
+ * @param net              InOut: The p-net stack instance
+ * @param list             In:   The list index of the wheel slot.
+ * @param ix               In:   The timeout index. Must not be in a list.
+ */
+static void pf_scheduler_link_slot(
    pnet_t                  *net,
-   volatile uint32_t       *p_q,
-   uint32_t                ix,
-   uint32_t                pos)
+   uint32_t                list,
+   uint32_t                ix)
 {
-   uint32_t                prev_ix;
-
-   if (ix >= PF_MAX_TIMEOUTS)
+   if (list < PF_SCHEDULER_WHEEL_SLOTS)
    {
-      LOG_ERROR(PNET_LOG, "Sched(%d): ix (%u) is invalid\n", __LINE__, (unsigned)ix);
+      pf_scheduler_link_sorted(net, list, ix);
    }
-   else if (pf_scheduler_is_linked(net, *p_q, ix) == true)
+   else if (net->scheduler_tails[list] < net->scheduler_max_timeouts)
    {
-      LOG_ERROR(PNET_LOG, "Sched(%d): %s is already in Q\n", __LINE__, net->scheduler_timeouts[ix].p_name);
+      pf_scheduler_link_after(net, ix, net->scheduler_tails[list]);
    }
-   else if (pos >= PF_MAX_TIMEOUTS)
+   else
    {
-      /* Put first in possible non-empty Q */
-      net->scheduler_timeouts[ix].prev = PF_MAX_TIMEOUTS;
-      net->scheduler_timeouts[ix].next = *p_q;
-      if (*p_q < PF_MAX_TIMEOUTS)
-      {
-         net->scheduler_timeouts[*p_q].prev = ix;
-      }
+      pf_scheduler_link_first(net, list, ix);
+   }
+}
+
+/**
+ * @internal
+ * Find the wheel slot for a timeout, relative to the current wheel position.
+ *
+ * The level is the most significant group of PF_SCHEDULER_WHEEL_BITS bits
+ * in which the expiry tick differs from the current tick. The slot is then
+ * reached, and its timeouts re-inserted on a lower level, before they expire.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param when             In:   Absolute time of the timeout.
+ * @return  the list index of the wheel slot.
+ */
+static uint32_t pf_scheduler_wheel_list(
+   pnet_t                  *net,
+   uint64_t                when)
+{
+   uint64_t                tick = when / net->scheduler_tick_interval;
+   uint64_t                now_tick = net->scheduler_wheel_tick;
+   uint32_t                level = 0;
 
-      *p_q = ix;
+   if (tick <= now_tick)
+   {
+      tick = now_tick;
    }
-   else if (*p_q >= PF_MAX_TIMEOUTS)
+   else if (((tick ^ now_tick) >> PF_SCHEDULER_WHEEL_SPAN_BITS) != 0)
    {
-      /* Q is empty - insert first in Q */
-      net->scheduler_timeouts[ix].prev = PF_MAX_TIMEOUTS;
-      net->scheduler_timeouts[ix].next = PF_MAX_TIMEOUTS;
-
-      *p_q = ix;
+      /* Beyond the wheel. Park it in the last slot and re-insert it later. */
+      tick = now_tick | ((1ULL << PF_SCHEDULER_WHEEL_SPAN_BITS) - 1);
    }
-   else
+
+   while ((level < (PF_SCHEDULER_WHEEL_LEVELS - 1)) &&
+          (((tick ^ now_tick) >> (PF_SCHEDULER_WHEEL_BITS * (level + 1))) != 0))
    {
-      prev_ix = net->scheduler_timeouts[pos].prev;
+      level++;
+   }
 
-      if (prev_ix < PF_MAX_TIMEOUTS)
-      {
-         net->scheduler_timeouts[prev_ix].next = ix;
-      }
-      net->scheduler_timeouts[pos].prev = ix;
+   return (level * PF_SCHEDULER_WHEEL_SLOTS) +
+          (uint32_t)((tick >> (PF_SCHEDULER_WHEEL_BITS * level)) & PF_SCHEDULER_WHEEL_MASK);
+}
+
+/**
+ * @internal
+ * Empty a wheel slot.
+ *
+ * Timeouts that have expired are moved to the expired list, in expiry order.
+ * The others are re-inserted into the wheel at the current wheel position.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param list             In:   The list index of the wheel slot.
+ * @param now              In:   The current time.
+ */
+static void pf_scheduler_process_slot(
+   pnet_t                  *net,
+   uint32_t                list,
+   uint64_t                now)
+{
+   uint32_t                ix = net->scheduler_lists[list];
+   uint32_t                next_ix;
 
-      net->scheduler_timeouts[ix].next = pos;
-      net->scheduler_timeouts[ix].prev = prev_ix;
+   /* Detach the whole slot, as timeouts may be re-inserted into it */
+   net->scheduler_lists[list] = net->scheduler_max_timeouts;
+   net->scheduler_tails[list] = net->scheduler_max_timeouts;
 
-      if (*p_q == pos)
+   while (ix < net->scheduler_max_timeouts)
+   {
+      next_ix = net->scheduler_timeouts[ix].next;
+      if ((int64_t)(now - net->scheduler_timeouts[ix].when) >= 0LL)
       {
-         /* ix is now first in the Q */
-         *p_q = ix;
+         pf_scheduler_link_sorted(net, PF_SCHEDULER_LIST_EXPIRED, ix);
+         net->scheduler_timeout_cnt--;
       }
+      else
+      {
+         pf_scheduler_link_slot(net, pf_scheduler_wheel_list(net, net->scheduler_timeouts[ix].when), ix);
+      }
+      ix = next_ix;
    }
 }
 
@@ -195,23 +300,33 @@ void pf_scheduler_init(
 {
    uint32_t ix;
 
-   net->scheduler_timeout_first = PF_MAX_TIMEOUTS; /* Nothing in queue */
-   net->scheduler_timeout_free = PF_MAX_TIMEOUTS;  /* Nothing in queue. */
-
    if (net->scheduler_timeout_mutex == NULL)
    {
       net->scheduler_timeout_mutex = os_mutex_create();
    }
-   memset((void *)net->scheduler_timeouts, 0, sizeof(net->scheduler_timeouts));
+   memset((void *)net->scheduler_timeouts, 0, net->scheduler_max_timeouts * sizeof(net->scheduler_timeouts[0]));
+
+   /* Nothing in any queue */
+   for (ix = 0; ix < PF_SCHEDULER_NBR_LISTS; ix++)
+   {
+      net->scheduler_lists[ix] = net->scheduler_max_timeouts;
+      net->scheduler_tails[ix] = net->scheduler_max_timeouts;
+   }
 
    net->scheduler_tick_interval = tick_interval;  /* Cannot be zero */
+   if (net->scheduler_tick_interval == 0)
+   {
+      net->scheduler_tick_interval = 1;
+   }
+   net->scheduler_wheel_tick = os_get_current_time_us() / net->scheduler_tick_interval;
+   net->scheduler_timeout_cnt = 0;
 
-   /* Link all entries into a list and put them into the free queue. */
-   for (ix = PF_MAX_TIMEOUTS; ix > 0; ix--)
+   /* Put all entries into the free queue. */
+   for (ix = net->scheduler_max_timeouts; ix > 0; ix--)
    {
       net->scheduler_timeouts[ix - 1].p_name = "<free>";
       net->scheduler_timeouts[ix - 1].in_use = false;
-      pf_scheduler_link_before(net, &net->scheduler_timeout_free, ix - 1, net->scheduler_timeout_free);
+      pf_scheduler_link_first(net, PF_SCHEDULER_LIST_FREE, ix - 1);
    }
 }
 
@@ -223,8 +338,6 @@ int pf_scheduler_add(
    void                    *arg,
    uint32_t                *p_timeout)
 {
-   uint32_t                ix_this;
-   uint32_t                ix_prev;
    uint32_t                ix_free;
    uint64_t                now = os_get_current_time_us();
 
@@ -234,50 +347,25 @@ int pf_scheduler_add(
    }
 
    os_mutex_lock(net->scheduler_timeout_mutex);
-   /* Unlink from the free list */
-   ix_free = net->scheduler_timeout_free;
-   pf_scheduler_unlink(net, &net->scheduler_timeout_free, ix_free);
-   os_mutex_unlock(net->scheduler_timeout_mutex);
-
-   if (ix_free >= PF_MAX_TIMEOUTS)
+   ix_free = net->scheduler_lists[PF_SCHEDULER_LIST_FREE];
+   if (ix_free >= net->scheduler_max_timeouts)
    {
+      os_mutex_unlock(net->scheduler_timeout_mutex);
       LOG_ERROR(PNET_LOG, "SCHEDULER(%d): Out of timeout resources for %s!!\n", __LINE__, p_name);
       return -1;
    }
 
-   const uint64_t future = now + delay;
+   /* Move from the free list to the wheel */
+   pf_scheduler_unlink(net, ix_free);
+
    net->scheduler_timeouts[ix_free].in_use = true;
    net->scheduler_timeouts[ix_free].p_name = p_name;
    net->scheduler_timeouts[ix_free].cb = cb;
    net->scheduler_timeouts[ix_free].arg = arg;
-   net->scheduler_timeouts[ix_free].when = future;
-
-   os_mutex_lock(net->scheduler_timeout_mutex);
-   if (net->scheduler_timeout_first >= PF_MAX_TIMEOUTS)
-   {
-      /* Put into empty q */
-      pf_scheduler_link_before(net, &net->scheduler_timeout_first, ix_free, PF_MAX_TIMEOUTS);
-   }
-   else if (((int64_t)(future - net->scheduler_timeouts[net->scheduler_timeout_first].when)) <= 0LL)
-   {
-      /* Put first in non-empty q */
-      pf_scheduler_link_before(net, &net->scheduler_timeout_first, ix_free, net->scheduler_timeout_first);
-   }
-   else
-   {
-      /* Find pos in non-empty q */
-      ix_prev = net->scheduler_timeout_first;
-      ix_this = net->scheduler_timeouts[net->scheduler_timeout_first].next;
-      while ((ix_this < PF_MAX_TIMEOUTS) &&
-             (((int64_t)(future - net->scheduler_timeouts[ix_this].when)) > 0LL))
-      {
-         ix_prev = ix_this;
-         ix_this = net->scheduler_timeouts[ix_this].next;
-      }
+   net->scheduler_timeouts[ix_free].when = now + delay;
 
-      /* Put after ix_prev */
-      pf_scheduler_link_after(net, &net->scheduler_timeout_first, ix_free, ix_prev);
-   }
+   pf_scheduler_link_slot(net, pf_scheduler_wheel_list(net, now + delay), ix_free);
+   net->scheduler_timeout_cnt++;
    os_mutex_unlock(net->scheduler_timeout_mutex);
 
    *p_timeout = ix_free + 1;  /* Make sure 0 is invalid. */
@@ -290,12 +378,16 @@ void pf_scheduler_remove(
    const char              *p_name,
    uint32_t                timeout)
 {
-   uint16_t                      ix;
+   uint32_t                ix;
 
    if (timeout == 0)
    {
       LOG_DEBUG(PNET_LOG, "SCHEDULER(%d): timeout(%s) == 0\n", __LINE__, p_name);
    }
+   else if (timeout > net->scheduler_max_timeouts)
+   {
+      LOG_ERROR(PNET_LOG, "SCHEDULER(%d): timeout(%s) %u is invalid\n", __LINE__, p_name, (unsigned)timeout);
+   }
    else
    {
       ix = timeout - 1;  /* Refer to _add() on how p_timeout is created */
@@ -305,13 +397,21 @@ void pf_scheduler_remove(
       {
          LOG_ERROR(PNET_LOG, "SCHEDULER(%d): Expected %s but got %s\n", __LINE__, net->scheduler_timeouts[ix].p_name, p_name);
       }
+      else if (net->scheduler_timeouts[ix].in_use == false)
+      {
+         LOG_DEBUG(PNET_LOG, "SCHEDULER(%d): %s has already expired\n", __LINE__, p_name);
+      }
       else
       {
-         pf_scheduler_unlink(net, &net->scheduler_timeout_first, ix);
+         if (net->scheduler_timeouts[ix].list != PF_SCHEDULER_LIST_EXPIRED)
+         {
+            net->scheduler_timeout_cnt--;
+         }
+         pf_scheduler_unlink(net, ix);
 
          /* Insert into free list. */
          net->scheduler_timeouts[ix].in_use = false;
-         pf_scheduler_link_before(net, &net->scheduler_timeout_free, ix, net->scheduler_timeout_free);
+         pf_scheduler_link_first(net, PF_SCHEDULER_LIST_FREE, ix);
       }
 
       os_mutex_unlock(net->scheduler_timeout_mutex);
@@ -322,40 +422,76 @@ void pf_scheduler_tick(
    pnet_t                  *net)
 {
    uint32_t                ix;
+   uint32_t                level;
    pf_scheduler_timeout_ftn_t ftn;
    void                    *arg;
    uint64_t                pf_current_time = os_get_current_time_us();
+   uint64_t                now_tick = pf_current_time / net->scheduler_tick_interval;
+   uint32_t                n_expired = 0;
 
+   PF_TRACE(PF_TRACE_EVENT_TICK_BEGIN, 0);
    os_mutex_lock(net->scheduler_timeout_mutex);
 
-   /* Send event to all expired delay entries. */
-   while ((net->scheduler_timeout_first < PF_MAX_TIMEOUTS) &&
-          ((int64_t)(pf_current_time - net->scheduler_timeouts[net->scheduler_timeout_first].when) >= 0LL))
+   if ((net->scheduler_timeout_cnt == 0) && (now_tick > net->scheduler_wheel_tick))
    {
-      /* Unlink from busy list */
-      ix = net->scheduler_timeout_first;
-      pf_scheduler_unlink(net, &net->scheduler_timeout_first, ix);
+      /* Nothing in the wheel. Just move it. */
+      net->scheduler_wheel_tick = now_tick;
+   }
+
+   /* Move all expired timeouts to the expired list. */
+   while (true)
+   {
+      pf_scheduler_process_slot(net, (uint32_t)(net->scheduler_wheel_tick & PF_SCHEDULER_WHEEL_MASK),
+                                pf_current_time);
+      if (net->scheduler_wheel_tick >= now_tick)
+      {
+         break;
+      }
+
+      net->scheduler_wheel_tick++;
+
+      /* Cascade the higher level slots that the wheel has now reached */
+      for (level = 1; level < PF_SCHEDULER_WHEEL_LEVELS; level++)
+      {
+         if ((net->scheduler_wheel_tick & ((1ULL << (PF_SCHEDULER_WHEEL_BITS * level)) - 1)) != 0)
+         {
+            break;
+         }
+         pf_scheduler_process_slot(net, (level * PF_SCHEDULER_WHEEL_SLOTS) +
+                                   (uint32_t)((net->scheduler_wheel_tick >> (PF_SCHEDULER_WHEEL_BITS * level)) & PF_SCHEDULER_WHEEL_MASK),
+                                   pf_current_time);
+      }
+   }
+
+   /* Send event to all expired entries, in expiry order. */
+   while (net->scheduler_lists[PF_SCHEDULER_LIST_EXPIRED] < net->scheduler_max_timeouts)
+   {
+      ix = net->scheduler_lists[PF_SCHEDULER_LIST_EXPIRED];
+      pf_scheduler_unlink(net, ix);
 
       ftn = net->scheduler_timeouts[ix].cb;
       arg = net->scheduler_timeouts[ix].arg;
 
       /* Insert into free list. */
       net->scheduler_timeouts[ix].in_use = false;
-      pf_scheduler_link_before(net, &net->scheduler_timeout_free, ix, net->scheduler_timeout_free);
+      pf_scheduler_link_first(net, PF_SCHEDULER_LIST_FREE, ix);
 
       /* Send event without holding the mutex. */
       os_mutex_unlock(net->scheduler_timeout_mutex);
       ftn(net, arg, pf_current_time);
       os_mutex_lock(net->scheduler_timeout_mutex);
+      n_expired++;
    }
 
    os_mutex_unlock(net->scheduler_timeout_mutex);
+   PF_TRACE(PF_TRACE_EVENT_TICK_END, n_expired);
 }
 
 void pf_scheduler_show(
    pnet_t                  *net)
 {
    uint32_t                ix;
+   uint32_t                list;
    uint32_t                cnt;
 
    printf("Scheduler (time now=%u):\n", (unsigned)os_get_current_time_us());
@@ -365,33 +501,47 @@ void pf_scheduler_show(
       os_mutex_lock(net->scheduler_timeout_mutex);
    }
 
-   printf("%-4s  %-8s  %-6s  %-6s  %-6s  %s\n", "idx", "owner", "in_use", "next", "prev", "when");
-   for (ix = 0; ix < PF_MAX_TIMEOUTS; ix++)
+   printf("%-4s  %-8s  %-6s  %-6s  %-6s  %-6s  %s\n", "idx", "owner", "in_use", "next", "prev", "list", "when");
+   for (ix = 0; ix < net->scheduler_max_timeouts; ix++)
    {
-      printf("[%02u]  %-8s  %-6s  %-6u  %-6u  %llu\n", (unsigned)ix,
+      printf("[%02u]  %-8s  %-6s  %-6u  %-6u  %-6u  %llu\n", (unsigned)ix,
          net->scheduler_timeouts[ix].p_name, net->scheduler_timeouts[ix].in_use?"true":"false",
          (unsigned)net->scheduler_timeouts[ix].next, (unsigned)net->scheduler_timeouts[ix].prev,
-         net->scheduler_timeouts[ix].when);
+         (unsigned)net->scheduler_timeouts[ix].list, net->scheduler_timeouts[ix].when);
    }
 
    if (net->scheduler_timeout_mutex != NULL)
    {
+      printf("Wheel tick: %llu  Timeouts in wheel: %u\n",
+         (unsigned long long)net->scheduler_wheel_tick, (unsigned)net->scheduler_timeout_cnt);
+
       printf("Free list:\n");
-      ix = net->scheduler_timeout_free;
+      ix = net->scheduler_lists[PF_SCHEDULER_LIST_FREE];
       cnt = 0;
-      while ((ix < PF_MAX_TIMEOUTS) && (cnt++ < 20))
+      while ((ix < net->scheduler_max_timeouts) && (cnt++ < 20))
       {
          printf("%u  ", (unsigned)ix);
          ix = net->scheduler_timeouts[ix].next;
       }
 
-      printf("\nBusy list:\n");
-      ix = net->scheduler_timeout_first;
-      cnt = 0;
-      while ((ix < PF_MAX_TIMEOUTS) && (cnt++ < 20))
+      printf("\nBusy slots:\n");
+      for (list = 0; list < PF_SCHEDULER_LIST_EXPIRED; list++)
       {
-         printf("%u  (%llu)  ", (unsigned)ix, net->scheduler_timeouts[ix].when);
-         ix = net->scheduler_timeouts[ix].next;
+         ix = net->scheduler_lists[list];
+         if (ix < net->scheduler_max_timeouts)
+         {
+            printf("[L%u:%02u]  ", (unsigned)(list / PF_SCHEDULER_WHEEL_SLOTS), (unsigned)(list % PF_SCHEDULER_WHEEL_SLOTS));
+         }
+         cnt = 0;
+         while ((ix < net->scheduler_max_timeouts) && (cnt++ < 20))
+         {
+            printf("%u  (%llu)  ", (unsigned)ix, net->scheduler_timeouts[ix].when);
+            ix = net->scheduler_timeouts[ix].next;
+         }
+         if (net->scheduler_lists[list] < net->scheduler_max_timeouts)
+         {
+            printf("\n");
+         }
       }
 
       os_mutex_unlock(net->scheduler_timeout_mutex);
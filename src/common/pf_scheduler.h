@@ -25,7 +25,7 @@ extern "C"
 /**
  * Initialize the scheduler.
  * @param net              InOut: The p-net stack instance
- * @param tick_interval    In:   System calls the tick function at these intervals (ms).
+ * @param tick_interval    In:   System calls the tick function at these intervals (us).
  */
 void pf_scheduler_init(
    pnet_t                     *net,
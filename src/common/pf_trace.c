@@ -0,0 +1,193 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+/**
+ * @file
+ * @brief Binary event trace of the cyclic path
+ *
+ * Fixed size records with a monotonic time stamp are written to a ring
+ * buffer per thread. The buffers are copied by pnet_trace_dump() and the
+ * dump is converted to Chrome/Perfetto JSON by tools/pnet_trace_to_json.py.
+ *
+ * Only built when PNET_TRACE is enabled.
+ */
+
+#include <string.h>
+
+#include "pf_includes.h"
+
+#if PNET_TRACE != 0
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define PF_TRACE_MAX_BUFFERS        8
+#define PF_TRACE_BUFFER_SIZE        4096   /* Records. Power of two */
+
+typedef struct pf_trace_buffer
+{
+   atomic_uint             head;       /* Nbr of records ever written */
+   atomic_bool             in_use;
+   pf_trace_record_t       records[PF_TRACE_BUFFER_SIZE];
+} pf_trace_buffer_t;
+
+static pf_trace_buffer_t            trace_buffers[PF_TRACE_MAX_BUFFERS];
+static pthread_once_t               trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t                trace_key;
+static __thread pf_trace_buffer_t  *trace_buffer;
+static __thread bool                trace_no_buffer;
+
+/**
+ * @internal
+ * Release the buffer of an exiting thread. Its records are kept for
+ * pnet_trace_dump() until the next owner overwrites them.
+ * @param arg              In:   The buffer.
+ */
+static void pf_trace_thread_exit(
+   void                    *arg)
+{
+   pf_trace_buffer_t       *p_trace = (pf_trace_buffer_t *)arg;
+
+   atomic_store(&p_trace->in_use, false);
+}
+
+static void pf_trace_init(void)
+{
+   (void)pthread_key_create(&trace_key, pf_trace_thread_exit);
+}
+
+/**
+ * @internal
+ * Get the trace buffer of the calling thread. Claimed on the first call,
+ * released when the thread exits.
+ * @return  the buffer, or NULL if all buffers are taken.
+ */
+static pf_trace_buffer_t *pf_trace_get_buffer(void)
+{
+   uint16_t                ix;
+   bool                    expected;
+
+   if ((trace_buffer == NULL) && (trace_no_buffer == false))
+   {
+      pthread_once(&trace_once, pf_trace_init);
+      for (ix = 0; ix < PF_TRACE_MAX_BUFFERS; ix++)
+      {
+         expected = false;
+         if (atomic_compare_exchange_strong(&trace_buffers[ix].in_use, &expected, true))
+         {
+            trace_buffer = &trace_buffers[ix];
+            pthread_setspecific(trace_key, trace_buffer);
+            break;
+         }
+      }
+      trace_no_buffer = (trace_buffer == NULL);
+   }
+
+   return trace_buffer;
+}
+
+void pf_trace_record(
+   uint16_t                event,
+   uint32_t                arg)
+{
+   pf_trace_buffer_t       *p_trace = pf_trace_get_buffer();
+   pf_trace_record_t       *p_record;
+   uint32_t                head;
+
+   if (p_trace != NULL)
+   {
+      head = atomic_load_explicit(&p_trace->head, memory_order_relaxed);
+      p_record = &p_trace->records[head & (PF_TRACE_BUFFER_SIZE - 1)];
+      p_record->timestamp = os_get_current_time_ns();
+      p_record->event = event;
+      p_record->buffer = (uint16_t)(p_trace - trace_buffers);
+      p_record->arg = arg;
+      atomic_store_explicit(&p_trace->head, head + 1, memory_order_release);
+   }
+}
+
+int pf_trace_dump(
+   uint8_t                 *p_buf,
+   uint32_t                size)
+{
+   pf_trace_dump_header_t  header;
+   pf_trace_buffer_t       *p_trace;
+   uint32_t                pos = sizeof(header);
+   uint32_t                first;
+   uint32_t                head;
+   uint32_t                ix;
+   uint32_t                n;
+   uint16_t                buf_ix;
+
+   if ((p_buf == NULL) || (size < sizeof(header)))
+   {
+      return -1;
+   }
+
+   for (buf_ix = 0; buf_ix < PF_TRACE_MAX_BUFFERS; buf_ix++)
+   {
+      p_trace = &trace_buffers[buf_ix];
+      head = atomic_load_explicit(&p_trace->head, memory_order_acquire);
+      n = (head < PF_TRACE_BUFFER_SIZE) ? head : PF_TRACE_BUFFER_SIZE;
+      n = ((size - pos) / sizeof(pf_trace_record_t) < n) ? (size - pos) / sizeof(pf_trace_record_t) : n;
+      first = head - n;
+      for (ix = first; ix != head; ix++)
+      {
+         memcpy(&p_buf[pos + (ix - first) * sizeof(pf_trace_record_t)],
+                &p_trace->records[ix & (PF_TRACE_BUFFER_SIZE - 1)], sizeof(pf_trace_record_t));
+      }
+
+      /* Leave out what the owner overwrote while we copied */
+      head = atomic_load_explicit(&p_trace->head, memory_order_acquire);
+      if ((head - first) >= PF_TRACE_BUFFER_SIZE)
+      {
+         ix = head - first - PF_TRACE_BUFFER_SIZE + 1;
+         ix = (ix > n) ? n : ix;
+         n -= ix;
+         memmove(&p_buf[pos], &p_buf[pos + ix * sizeof(pf_trace_record_t)], n * sizeof(pf_trace_record_t));
+      }
+      pos += n * sizeof(pf_trace_record_t);
+   }
+
+   header.magic = PF_TRACE_DUMP_MAGIC;
+   header.version = PF_TRACE_DUMP_VERSION;
+   header.record_size = sizeof(pf_trace_record_t);
+   header.n_records = (pos - sizeof(header)) / sizeof(pf_trace_record_t);
+   header.reserved = 0;
+   memcpy(p_buf, &header, sizeof(header));
+
+   return (int)pos;
+}
+
+#else
+
+void pf_trace_record(
+   uint16_t                event,
+   uint32_t                arg)
+{
+   (void)event;
+   (void)arg;
+}
+
+int pf_trace_dump(
+   uint8_t                 *p_buf,
+   uint32_t                size)
+{
+   (void)p_buf;
+   (void)size;
+   return -1;
+}
+
+#endif /* PNET_TRACE != 0 */
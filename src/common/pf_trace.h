@@ -0,0 +1,107 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+#ifndef PF_TRACE_H
+#define PF_TRACE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Trace events. Keep in sync with tools/pnet_trace_to_json.py.
+ */
+typedef enum pf_trace_event_values
+{
+   PF_TRACE_EVENT_ETH_RX = 1,       /* arg: frame id */
+   PF_TRACE_EVENT_CPM_ACCEPT,       /* arg: cycle counter */
+   PF_TRACE_EVENT_CPM_REJECT,       /* arg: source line */
+   PF_TRACE_EVENT_PPM_FINISH,       /* arg: cycle counter */
+   PF_TRACE_EVENT_PPM_SEND,         /* arg: frame id */
+   PF_TRACE_EVENT_PPM_FLUSH,        /* arg: 0 */
+   PF_TRACE_EVENT_TICK_BEGIN,       /* arg: 0 */
+   PF_TRACE_EVENT_TICK_END,         /* arg: nbr of expired timeouts */
+   PF_TRACE_EVENT_ALARM_SEND,       /* arg: frame id */
+} pf_trace_event_values_t;
+
+/**
+ * One trace record, as stored and as dumped.
+ */
+typedef struct pf_trace_record
+{
+   uint64_t                timestamp;  /* CLOCK_MONOTONIC, ns */
+   uint16_t                event;      /* pf_trace_event_values_t */
+   uint16_t                buffer;     /* Trace buffer, i.e. thread */
+   uint32_t                arg;
+} pf_trace_record_t;
+
+/**
+ * Header of a dump, followed by n_records pf_trace_record_t.
+ * All fields are in host byte order.
+ */
+typedef struct pf_trace_dump_header
+{
+   uint32_t                magic;      /* PF_TRACE_DUMP_MAGIC */
+   uint16_t                version;    /* PF_TRACE_DUMP_VERSION */
+   uint16_t                record_size;
+   uint32_t                n_records;
+   uint32_t                reserved;
+} pf_trace_dump_header_t;
+
+#define PF_TRACE_DUMP_MAGIC         0x52544e50  /* "PNTR" */
+#define PF_TRACE_DUMP_VERSION       1
+
+#if PNET_TRACE != 0
+#define PF_TRACE(event, arg)        pf_trace_record((event), (uint32_t)(arg))
+#else
+#define PF_TRACE(event, arg)        do { } while (0)
+#endif
+
+/**
+ * Add a record to the trace buffer of the calling thread.
+ *
+ * Each thread gets its own buffer on its first call, so no locks are taken.
+ * When the buffer is full the oldest record is overwritten. Records from
+ * threads that find no free buffer are lost.
+ *
+ * Use the PF_TRACE() macro, which compiles to nothing unless PNET_TRACE is
+ * enabled.
+ * @param event            In:   The event. pf_trace_event_values_t.
+ * @param arg              In:   Event specific argument.
+ */
+void pf_trace_record(
+   uint16_t                event,
+   uint32_t                arg);
+
+/**
+ * Copy the contents of all trace buffers.
+ *
+ * The buffers are not stopped. Records that are overwritten during the copy
+ * are left out. The records of each buffer are in time order.
+ * @param p_buf            Out:  Destination.
+ * @param size             In:   Size of p_buf.
+ * @return  the number of bytes written (header and as many records as fit).
+ *          -1 if p_buf does not hold the header or trace is disabled.
+ */
+int pf_trace_dump(
+   uint8_t                 *p_buf,
+   uint32_t                size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PF_TRACE_H */
@@ -0,0 +1,207 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+/**
+ * @file
+ * @brief Allocation of the stack instance and its tables
+ *
+ * The number of ARs, and so of sessions, frame id map entries and timeouts,
+ * and the number of diag items are set by pnet_cfg_t at runtime. The
+ * instance and all tables are carved out of one allocation, so that a small
+ * device does not pay for the tables of a large one, and the tables of one
+ * instance stay close together in memory.
+ */
+
+#include <string.h>
+
+#include "pf_includes.h"
+
+#define PF_ARENA_ALIGN              64    /* Each table starts on a cache line */
+
+/**
+ * @internal
+ * Reserve a table in the arena.
+ * @param p_offset         InOut: The current end of the arena.
+ * @param size             In:   The size of the table.
+ * @return  The offset of the table.
+ */
+static size_t pf_arena_reserve(
+   size_t                  *p_offset,
+   size_t                  size)
+{
+   size_t                  offset = (*p_offset + PF_ARENA_ALIGN - 1) & ~(size_t)(PF_ARENA_ALIGN - 1);
+
+   *p_offset = offset + size;
+
+   return offset;
+}
+
+/**
+ * @internal
+ * Calculate the capacities and the layout of the arena.
+ * @param p_cfg            In:   The configuration. May be NULL.
+ * @param p_fp             Out:  The capacities and table sizes.
+ * @param p_offsets        Out:  The offset of each table, in the order
+ *                               ars, sessions, ready, diag, map, hash, timeouts.
+ * @param p_n_hash         Out:  The number of frame id hash buckets.
+ * @return  0  if the capacities are valid.
+ *          -1 if not.
+ */
+static int pf_arena_layout(
+   const pnet_cfg_t        *p_cfg,
+   pnet_footprint_t        *p_fp,
+   size_t                  p_offsets[7],
+   uint32_t                *p_n_hash)
+{
+   uint32_t                n_ar = PNET_MAX_AR;
+   uint32_t                n_diag = PNET_MAX_DIAG_ITEMS;
+   uint32_t                n_map;
+   uint32_t                n_hash = PF_ETH_HASH_MIN;
+   int32_t                 n_timeouts;
+   size_t                  end = 0;
+   size_t                  start;
+
+   if (p_cfg != NULL)
+   {
+      if (p_cfg->max_ar > 0)
+      {
+         n_ar = p_cfg->max_ar;
+      }
+      if (p_cfg->max_diag_items > 0)
+      {
+         n_diag = p_cfg->max_diag_items;
+      }
+   }
+
+   n_map = PF_ETH_MAP_FOR(n_ar);
+   n_timeouts = PF_TIMEOUTS_FOR(n_ar);
+   /* Indexes are uint16_t and UINT16_MAX is "none" for the diag items */
+   if ((PF_SESSIONS_FOR(n_ar) >= UINT16_MAX) ||
+       (n_map >= UINT16_MAX / 2) ||
+       (n_diag >= UINT16_MAX) ||
+       (n_timeouts <= 0))
+   {
+      return -1;
+   }
+   while (n_hash < 2 * n_map)
+   {
+      n_hash *= 2;
+   }
+
+   memset(p_fp, 0, sizeof(*p_fp));
+   p_fp->max_ar = (uint16_t)n_ar;
+   p_fp->max_sessions = (uint16_t)PF_SESSIONS_FOR(n_ar);
+   p_fp->max_diag_items = (uint16_t)n_diag;
+   p_fp->eth_id_map_size = (uint16_t)n_map;
+   p_fp->max_timeouts = (uint32_t)n_timeouts;
+
+   p_fp->base = sizeof(pnet_t);
+   end = p_fp->base;
+
+   start = end;
+   p_offsets[0] = pf_arena_reserve(&end, n_ar * sizeof(pf_ar_t));
+   p_fp->ars = end - start;
+
+   start = end;
+   p_offsets[1] = pf_arena_reserve(&end, p_fp->max_sessions * sizeof(pf_session_info_t));
+   /* The ready sockets, followed by the sockets read without polling */
+   p_offsets[2] = pf_arena_reserve(&end, 2 * (p_fp->max_sessions + 3) * sizeof(uint32_t));
+   p_fp->sessions = end - start;
+
+   start = end;
+   p_offsets[3] = pf_arena_reserve(&end, n_diag * sizeof(pf_diag_item_t));
+   p_fp->diag_items = end - start;
+
+   start = end;
+   p_offsets[4] = pf_arena_reserve(&end, n_map * sizeof(pf_eth_frame_id_map_t));
+   p_offsets[5] = pf_arena_reserve(&end, n_hash * sizeof(atomic_uint_least16_t));
+   p_fp->eth_id_map = end - start;
+
+   start = end;
+   p_offsets[6] = pf_arena_reserve(&end, (size_t)n_timeouts * sizeof(pf_scheduler_timeouts_t));
+   p_fp->timeouts = end - start;
+
+   p_fp->total = end;
+   *p_n_hash = n_hash;
+
+   return 0;
+}
+
+pnet_t *pf_arena_create(
+   const pnet_cfg_t        *p_cfg)
+{
+   pnet_footprint_t        fp;
+   size_t                  offsets[7];
+   uint32_t                n_hash;
+   uint8_t                 *p_arena;
+   pnet_t                  *net;
+
+   if (pf_arena_layout(p_cfg, &fp, offsets, &n_hash) != 0)
+   {
+      LOG_ERROR(PNET_LOG, "ARENA(%d): Invalid capacities\n", __LINE__);
+      return NULL;
+   }
+
+   p_arena = os_malloc(fp.total);
+   if (p_arena == NULL)
+   {
+      LOG_ERROR(PNET_LOG, "ARENA(%d): Out of memory, %u bytes needed\n", __LINE__, (unsigned)fp.total);
+      return NULL;
+   }
+   memset(p_arena, 0, fp.total);
+
+   net = (pnet_t *)p_arena;
+   net->footprint = fp;
+
+   net->max_ar = fp.max_ar;
+   net->cmrpc_ar = (pf_ar_t *)(p_arena + offsets[0]);
+   net->max_sessions = fp.max_sessions;
+   net->cmrpc_session_info = (pf_session_info_t *)(p_arena + offsets[1]);
+   net->cmrpc_ready = (uint32_t *)(p_arena + offsets[2]);
+   net->cmrpc_unpolled = net->cmrpc_ready + fp.max_sessions + 3;
+   net->cmdev_max_diag_items = fp.max_diag_items;
+   net->cmdev_diag_items = (pf_diag_item_t *)(p_arena + offsets[3]);
+   net->eth_id_map_size = fp.eth_id_map_size;
+   net->eth_id_map = (pf_eth_frame_id_map_t *)(p_arena + offsets[4]);
+   net->eth_id_hash = (atomic_uint_least16_t *)(p_arena + offsets[5]);
+   net->eth_id_hash_mask = (uint16_t)(n_hash - 1);
+   net->scheduler_max_timeouts = fp.max_timeouts;
+   net->scheduler_timeouts = (volatile pf_scheduler_timeouts_t *)(p_arena + offsets[6]);
+
+   return net;
+}
+
+void pf_arena_destroy(
+   pnet_t                  *net)
+{
+   if (net != NULL)
+   {
+      os_free(net);
+   }
+}
+
+void pf_arena_show(
+   const pnet_t            *net)
+{
+   const pnet_footprint_t  *p_fp = &net->footprint;
+
+   printf("Memory: %u bytes total\n", (unsigned)p_fp->total);
+   printf("   instance            : %u bytes\n", (unsigned)p_fp->base);
+   printf("   %3u ARs             : %u bytes\n", (unsigned)p_fp->max_ar, (unsigned)p_fp->ars);
+   printf("   %3u sessions        : %u bytes\n", (unsigned)p_fp->max_sessions, (unsigned)p_fp->sessions);
+   printf("   %3u diag items      : %u bytes\n", (unsigned)p_fp->max_diag_items, (unsigned)p_fp->diag_items);
+   printf("   %3u frame id maps   : %u bytes\n", (unsigned)p_fp->eth_id_map_size, (unsigned)p_fp->eth_id_map);
+   printf("   %3u timeouts        : %u bytes\n", (unsigned)p_fp->max_timeouts, (unsigned)p_fp->timeouts);
+}
@@ -0,0 +1,55 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+#ifndef PF_ARENA_H
+#define PF_ARENA_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Allocate a stack instance with all its tables as one zeroed block.
+ *
+ * The tables (ARs, sessions, diag items, frame id map and timeouts) are
+ * sized from the capacities in p_cfg, where 0 (zero) means the
+ * PNET_MAX_xxx default.
+ * Sets the table pointers and capacities in the instance, nothing else.
+ * @param p_cfg            In:   The configuration. May be NULL for the defaults.
+ * @return  The instance, or NULL if out of memory or a capacity is too large.
+ */
+pnet_t *pf_arena_create(
+   const pnet_cfg_t        *p_cfg);
+
+/**
+ * Free a stack instance allocated by pf_arena_create().
+ * @param net              InOut: The p-net stack instance. May be NULL.
+ */
+void pf_arena_destroy(
+   pnet_t                  *net);
+
+/**
+ * Show the capacities and the memory used by the tables.
+ * @param net              In:   The p-net stack instance
+ */
+void pf_arena_show(
+   const pnet_t            *net);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PF_ARENA_H */
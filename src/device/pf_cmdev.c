@@ -180,9 +180,117 @@ int pf_cmdev_get_api(
   return ret;
 }
 
+/**
+ * @internal
+ * Calculate the hash of a slot or sub-slot key, for the hash indexes.
+ *
+ * Slot and sub-slot numbers are mostly small and consecutive, so all bits
+ * are mixed before the bucket is taken.
+ *
+ * @param api_id           In:   The API identifier.
+ * @param slot_nbr         In:   The slot number.
+ * @param subslot_nbr      In:   The sub-slot number. 0 (zero) for a slot.
+ * @return  the hash value.
+ */
+static inline uint32_t pf_cmdev_hash(
+  uint32_t                api_id,
+  uint16_t                slot_nbr,
+  uint16_t                subslot_nbr)
+{
+  uint32_t                h = ((uint32_t)slot_nbr << 16) | subslot_nbr;
+
+  h ^= api_id * 0x9E3779B1U;
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+
+  return h;
+}
+
+/**
+ * @internal
+ * Insert a slot instance into the slot hash index.
+ * @param net              InOut: The p-net stack instance
+ * @param p_slot           In:   The slot instance, with its api_id and slot_nbr set.
+ */
+static void pf_cmdev_slot_link(
+  pnet_t                  *net,
+  pf_slot_t               *p_slot)
+{
+  pf_slot_t               **p_head = &net->cmdev_device.slot_hash[
+    pf_cmdev_hash(p_slot->api_id, p_slot->slot_nbr, 0) % PF_CMDEV_SLOT_HASH_SIZE];
+
+  p_slot->hash_next = *p_head;
+  *p_head = p_slot;
+}
+
+/**
+ * @internal
+ * Remove a slot instance from the slot hash index.
+ * @param net              InOut: The p-net stack instance
+ * @param p_slot           In:   The slot instance.
+ */
+static void pf_cmdev_slot_unlink(
+  pnet_t                  *net,
+  pf_slot_t               *p_slot)
+{
+  pf_slot_t               **p_link = &net->cmdev_device.slot_hash[
+    pf_cmdev_hash(p_slot->api_id, p_slot->slot_nbr, 0) % PF_CMDEV_SLOT_HASH_SIZE];
+
+  while ((*p_link != NULL) && (*p_link != p_slot))
+  {
+    p_link = &(*p_link)->hash_next;
+  }
+  if (*p_link == p_slot)
+  {
+    *p_link = p_slot->hash_next;
+  }
+}
+
+/**
+ * @internal
+ * Insert a sub-slot instance into the sub-slot hash index.
+ * @param net              InOut: The p-net stack instance
+ * @param p_subslot        In:   The sub-slot instance, with its api_id, slot_nbr and subslot_nbr set.
+ */
+static void pf_cmdev_subslot_link(
+  pnet_t                  *net,
+  pf_subslot_t            *p_subslot)
+{
+  pf_subslot_t            **p_head = &net->cmdev_device.subslot_hash[
+    pf_cmdev_hash(p_subslot->api_id, p_subslot->slot_nbr, p_subslot->subslot_nbr) % PF_CMDEV_SUBSLOT_HASH_SIZE];
+
+  p_subslot->hash_next = *p_head;
+  *p_head = p_subslot;
+}
+
+/**
+ * @internal
+ * Remove a sub-slot instance from the sub-slot hash index.
+ * @param net              InOut: The p-net stack instance
+ * @param p_subslot        In:   The sub-slot instance.
+ */
+static void pf_cmdev_subslot_unlink(
+  pnet_t                  *net,
+  pf_subslot_t            *p_subslot)
+{
+  pf_subslot_t            **p_link = &net->cmdev_device.subslot_hash[
+    pf_cmdev_hash(p_subslot->api_id, p_subslot->slot_nbr, p_subslot->subslot_nbr) % PF_CMDEV_SUBSLOT_HASH_SIZE];
+
+  while ((*p_link != NULL) && (*p_link != p_subslot))
+  {
+    p_link = &(*p_link)->hash_next;
+  }
+  if (*p_link == p_subslot)
+  {
+    *p_link = p_subslot->hash_next;
+  }
+}
+
 /**
  * @internal
  * Get an slot instance of an API.
+ * @param net              InOut: The p-net stack instance
  * @param p_api            In:   The API instance.
  * @param slot_nbr         In:   The slot number.
  * @param pp_slot          Out:  The slot instance.
@@ -190,13 +298,13 @@ int pf_cmdev_get_api(
  *          -1 if an error occurred.
  */
 static int pf_cmdev_get_slot(
+  pnet_t     *net,
   pf_api_t   *p_api,
   uint16_t    slot_nbr,
   pf_slot_t **pp_slot)
 {
   int                     ret = -1;
   pf_slot_t              *p_slot = NULL;
-  uint16_t                ix;
 
   if ((p_api == NULL) || (pp_slot == NULL))
   {
@@ -204,17 +312,15 @@ static int pf_cmdev_get_slot(
   }
   else
   {
-    ix = 0;
-    while ((ix < PNET_MAX_MODULES) &&
-           ((p_api->slots[ix].in_use == false) ||
-            (slot_nbr != p_api->slots[ix].slot_nbr)))
+    p_slot = net->cmdev_device.slot_hash[pf_cmdev_hash(p_api->api_id, slot_nbr, 0) % PF_CMDEV_SLOT_HASH_SIZE];
+    while ((p_slot != NULL) &&
+           ((p_slot->slot_nbr != slot_nbr) || (p_slot->api_id != p_api->api_id)))
     {
-      ix++;
+      p_slot = p_slot->hash_next;
     }
 
-    if (ix < PNET_MAX_MODULES)
+    if (p_slot != NULL)
     {
-      p_slot = &p_api->slots[ix];
       ret = 0;
     }
 
@@ -276,18 +382,21 @@ int pf_cmdev_get_subslot_full(
   pf_subslot_t          **pp_subslot)
 {
   int                     ret = -1;
-  pf_api_t               *p_api = NULL;
-  pf_slot_t              *p_slot = NULL;
+  pf_subslot_t           *p_subslot;
 
-  if (pf_cmdev_get_api(net, api_id, &p_api) == 0)
+  p_subslot = net->cmdev_device.subslot_hash[pf_cmdev_hash(api_id, slot_nbr, subslot_nbr) % PF_CMDEV_SUBSLOT_HASH_SIZE];
+  while ((p_subslot != NULL) &&
+         ((p_subslot->subslot_nbr != subslot_nbr) ||
+          (p_subslot->slot_nbr != slot_nbr) ||
+          (p_subslot->api_id != api_id)))
   {
-    if (pf_cmdev_get_slot(p_api, slot_nbr, &p_slot) == 0)
-    {
-      if (pf_cmdev_get_subslot(p_slot, subslot_nbr, pp_subslot) == 0)
-      {
-        ret = 0;
-      }
-    }
+    p_subslot = p_subslot->hash_next;
+  }
+
+  if (p_subslot != NULL)
+  {
+    *pp_subslot = p_subslot;
+    ret = 0;
   }
 
   return ret;
@@ -304,7 +413,7 @@ int pf_cmdev_get_slot_full(
 
   if (pf_cmdev_get_api(net, api_id, &p_api) == 0)
   {
-    if (pf_cmdev_get_slot(p_api, slot_nbr, pp_slot) == 0)
+    if (pf_cmdev_get_slot(net, p_api, slot_nbr, pp_slot) == 0)
     {
       ret = 0;
     }
@@ -320,9 +429,9 @@ int pf_cmdev_get_diag_item(
 {
   int                     ret = -1;
 
-  if (item_ix < NELEMENTS(net->cmdev_device.diag_items))
+  if (item_ix < net->cmdev_max_diag_items)
   {
-    *pp_item = &net->cmdev_device.diag_items[item_ix];
+    *pp_item = &net->cmdev_diag_items[item_ix];
 
     ret = 0;
   }
@@ -346,11 +455,11 @@ int pf_cmdev_new_diag(
   *p_item_ix = net->cmdev_device.diag_items_free;
   if (*p_item_ix != PF_DIAG_IX_NULL)
   {
-    net->cmdev_device.diag_items_free = net->cmdev_device.diag_items[*p_item_ix].next;
+    net->cmdev_device.diag_items_free = net->cmdev_diag_items[*p_item_ix].next;
 
     /* Clear the entry */
-    memset(&net->cmdev_device.diag_items[*p_item_ix], 0, sizeof(net->cmdev_device.diag_items[*p_item_ix]));
-    net->cmdev_device.diag_items[*p_item_ix].in_use = true;
+    memset(&net->cmdev_diag_items[*p_item_ix], 0, sizeof(net->cmdev_diag_items[*p_item_ix]));
+    net->cmdev_diag_items[*p_item_ix].in_use = true;
 
     ret = 0;
   }
@@ -362,11 +471,11 @@ void pf_cmdev_free_diag(
   pnet_t *net,
   uint16_t                item_ix)
 {
-  if (item_ix < NELEMENTS(net->cmdev_device.diag_items))
+  if (item_ix < net->cmdev_max_diag_items)
   {
     /* Put it first in the free list. */
-    net->cmdev_device.diag_items[item_ix].in_use = false;
-    net->cmdev_device.diag_items[item_ix].next = net->cmdev_device.diag_items_free;
+    net->cmdev_diag_items[item_ix].in_use = false;
+    net->cmdev_diag_items[item_ix].next = net->cmdev_device.diag_items_free;
     net->cmdev_device.diag_items_free = item_ix;
   }
   else
@@ -434,6 +543,7 @@ static int pf_cmdev_new_api(
  * @internal
  * Instantiate a new slot structure.
  * If the slot number already exists the the operation fails.
+ * @param net              InOut: The p-net stack instance
  * @param p_api            In:   The API instance.
  * @param slot_nbr         In:   The slot number.
  * @param pp_slot          Out:  The new slot instance.
@@ -441,6 +551,7 @@ static int pf_cmdev_new_api(
  *          -1 if an error occurred.
  */
 static int pf_cmdev_new_slot(
+  pnet_t *net,
   pf_api_t *p_api,
   uint16_t                slot_nbr,
   pf_slot_t **pp_slot)
@@ -453,7 +564,7 @@ static int pf_cmdev_new_slot(
   {
     LOG_ERROR(PNET_LOG, "CMDEV(%d): NULL pointer(s)\n", __LINE__);
   }
-  else if (pf_cmdev_get_slot(p_api, slot_nbr, &p_slot) == 0)
+  else if (pf_cmdev_get_slot(net, p_api, slot_nbr, &p_slot) == 0)
   {
     /* Slot already exists */
     LOG_ERROR(PNET_LOG, "CMDEV(%d): Slot %u already exists\n", __LINE__, (unsigned)slot_nbr);
@@ -473,7 +584,9 @@ static int pf_cmdev_new_slot(
 
       memset(p_slot, 0, sizeof(*p_slot));
       p_slot->slot_nbr = slot_nbr;
+      p_slot->api_id = p_api->api_id;
       p_slot->in_use = true;
+      pf_cmdev_slot_link(net, p_slot);
 
       ret = 0;
     }
@@ -488,6 +601,7 @@ static int pf_cmdev_new_slot(
  * @internal
  * Instantiate a new sub-slot structure.
  * If the sub-slot number already exists the the operation fails.
+ * @param net              InOut: The p-net stack instance
  * @param p_slot           In:   The slot instance.
  * @param subslot_nbr      In:   The sub-slot number.
  * @param pp_subslot       Out:  The new sub-slot instance.
@@ -495,6 +609,7 @@ static int pf_cmdev_new_slot(
  *          -1 if an error occurred.
  */
 static int pf_cmdev_new_subslot(
+  pnet_t *net,
   pf_slot_t *p_slot,
   uint16_t                subslot_nbr,
   pf_subslot_t **pp_subslot)
@@ -527,8 +642,11 @@ static int pf_cmdev_new_subslot(
 
       memset(p_subslot, 0, sizeof(*p_subslot));
       p_subslot->subslot_nbr = subslot_nbr;
+      p_subslot->slot_nbr = p_slot->slot_nbr;
+      p_subslot->api_id = p_slot->api_id;
       p_subslot->diag_list = PF_DIAG_IX_NULL;
       p_subslot->in_use = true;
+      pf_cmdev_subslot_link(net, p_subslot);
 
       ret = 0;
     }
@@ -553,7 +671,7 @@ int pf_cmdev_plug_module(
   {
     LOG_ERROR(PNET_LOG, "CMDEV(%d): API %u does not exist\n", __LINE__, (unsigned)api_id);
   }
-  else if (pf_cmdev_get_slot(p_api, slot_nbr, &p_slot) == 0)
+  else if (pf_cmdev_get_slot(net, p_api, slot_nbr, &p_slot) == 0)
   {
     /* Slot already has a plugged module. Check ident numbers */
     if (p_slot->module_ident_number == module_ident_nbr)
@@ -569,7 +687,7 @@ int pf_cmdev_plug_module(
       p_slot->plug_state = PF_MOD_PLUG_WRONG_MODULE;
     }
   }
-  else if (pf_cmdev_new_slot(p_api, slot_nbr, &p_slot) != 0)
+  else if (pf_cmdev_new_slot(net, p_api, slot_nbr, &p_slot) != 0)
   {
     /* Out of slot resources */
     LOG_ERROR(PNET_LOG, "CMDEV(%d): Out of slot resources for api %u slot %u\n", __LINE__, (unsigned)api_id, (unsigned)slot_nbr);
@@ -586,6 +704,9 @@ int pf_cmdev_plug_module(
     ret = 0;
   }
 
+  /* Cached descriptors of the sub-slots may have changed */
+  pf_cmdev_invalidate_subslot_handles(net);
+
   return ret;
 }
 
@@ -604,7 +725,7 @@ int pf_cmdev_pull_submodule(
   {
     LOG_ERROR(PNET_LOG, "CMDEV(%d): API %u does not exist\n", __LINE__, (unsigned)api_id);
   }
-  else if (pf_cmdev_get_slot(p_api, slot_nbr, &p_slot) != 0)
+  else if (pf_cmdev_get_slot(net, p_api, slot_nbr, &p_slot) != 0)
   {
     LOG_DEBUG(PNET_LOG, "CMDEV(%d): No module in slot %u\n", __LINE__, (unsigned)slot_nbr);
   }
@@ -614,12 +735,16 @@ int pf_cmdev_pull_submodule(
   }
   else
   {
+    pf_cmdev_subslot_unlink(net, p_subslot);
     p_subslot->in_use = false;
     p_subslot->submodule_state.ident_info = PF_SUBMOD_PLUG_NO;
 
     ret = pf_alarm_send_pull(net, p_subslot->p_ar, api_id, slot_nbr, subslot_nbr);
   }
 
+  /* Cached descriptors of the sub-slots may have changed */
+  pf_cmdev_invalidate_subslot_handles(net);
+
   return ret;
 }
 
@@ -646,7 +771,7 @@ int pf_cmdev_plug_submodule(
   {
     LOG_ERROR(PNET_LOG, "CMDEV(%d): API %u does not exist\n", __LINE__, (unsigned)api_id);
   }
-  else if (pf_cmdev_get_slot(p_api, slot_nbr, &p_slot) != 0)
+  else if (pf_cmdev_get_slot(net, p_api, slot_nbr, &p_slot) != 0)
   {
     /* Auto-plug the module */
     if (pf_cmdev_plug_module(net, api_id, slot_nbr, module_ident_nbr) != 0)
@@ -683,11 +808,11 @@ int pf_cmdev_plug_submodule(
 
     ret = 0;
   }
-  else if (pf_cmdev_get_slot(p_api, slot_nbr, &p_slot) != 0)
+  else if (pf_cmdev_get_slot(net, p_api, slot_nbr, &p_slot) != 0)
   {
     LOG_ERROR(PNET_LOG, "CMDEV(%d): No module in slot %u\n", __LINE__, (unsigned)slot_nbr);
   }
-  else if (pf_cmdev_new_subslot(p_slot, subslot_nbr, &p_subslot) == 0)
+  else if (pf_cmdev_new_subslot(net, p_slot, subslot_nbr, &p_subslot) == 0)
   {
     /* Sub-slot created */
     p_subslot->submodule_ident_number = submod_ident_nbr;
@@ -733,6 +858,9 @@ int pf_cmdev_plug_submodule(
     LOG_ERROR(PNET_LOG, "CMDEV(%d): Out of subslot resources for api %u slot %u\n", __LINE__, (unsigned)api_id, (unsigned)slot_nbr);
   }
 
+  /* Cached descriptors of the sub-slots may have changed */
+  pf_cmdev_invalidate_subslot_handles(net);
+
   return ret;
 }
 
@@ -751,7 +879,7 @@ int pf_cmdev_pull_module(
   {
     LOG_ERROR(PNET_LOG, "CMDEV(%d): API %u does not exist\n", __LINE__, (unsigned)api_id);
   }
-  else if (pf_cmdev_get_slot(p_api, slot_nbr, &p_slot) != 0)
+  else if (pf_cmdev_get_slot(net, p_api, slot_nbr, &p_slot) != 0)
   {
     LOG_DEBUG(PNET_LOG, "CMDEV(%d): No module in slot %u\n", __LINE__, (unsigned)slot_nbr);
   }
@@ -771,6 +899,7 @@ int pf_cmdev_pull_module(
 
     if (ret == 0)
     {
+      pf_cmdev_slot_unlink(net, p_slot);
       p_slot->in_use = false;
       p_slot->plug_state = PF_MOD_PLUG_NO_MODULE;
     }
@@ -780,6 +909,9 @@ int pf_cmdev_pull_module(
     }
   }
 
+  /* Cached descriptors of the sub-slots may have changed */
+  pf_cmdev_invalidate_subslot_handles(net);
+
   return ret;
 }
 
@@ -818,6 +950,8 @@ static void pf_device_clear(
       net->cmdev_device.apis[api_ix].p_ar = NULL;
     }
   }
+
+  pf_cmrdr_invalidate(net);
 }
 
 /*************** Diagnostic strings ****************************************/
@@ -951,7 +1085,6 @@ void pf_cmdev_show(
 static int pf_cmdev_cfg_dev_show(
   pf_device_t *p_dev)
 {
-  printf("The device can use max %u APIs, and %u diag items.\n", (unsigned)PNET_MAX_API, (unsigned)PNET_MAX_DIAG_ITEMS);
   printf("The device has %u diag_items_free.\n", (unsigned)p_dev->diag_items_free);
 
   return 0;
@@ -1017,6 +1150,7 @@ static int pf_cmdev_cfg_subslot_show(
 void pf_cmdev_show_device(
   pnet_t *net)
 {
+  printf("The device can use max %u APIs, and %u diag items.\n", (unsigned)PNET_MAX_API, (unsigned)net->cmdev_max_diag_items);
   (void)pf_cmdev_cfg_traverse(
     net,
     pf_cmdev_cfg_dev_show,
@@ -1039,6 +1173,19 @@ void pf_cmdev_exit(
   }
 }
 
+void pf_cmdev_invalidate_subslot_handles(
+  pnet_t                  *net)
+{
+  /* Generation 0 is reserved for handles that were never resolved */
+  if (atomic_fetch_add(&net->subslot_handle_gen, 1) == UINT32_MAX)
+  {
+    (void)atomic_fetch_add(&net->subslot_handle_gen, 1);
+  }
+
+  /* The identification records are serialized from the same descriptors */
+  pf_cmrdr_invalidate(net);
+}
+
 void pf_cmdev_init(
   pnet_t *net)
 {
@@ -1048,17 +1195,18 @@ void pf_cmdev_init(
   if (net->cmdev_initialized == false)
   {
     net->cmdev_initialized = true;
+    atomic_init(&net->subslot_handle_gen, 1U);
 
     memset(&net->cmdev_device, 0, sizeof(net->cmdev_device));
     net->cmdev_device.diag_mutex = os_mutex_create();
 
     /* Create a list of free diag items. */
     net->cmdev_device.diag_items_free = 0;
-    for (ix = 0; ix < NELEMENTS(net->cmdev_device.diag_items) - 1; ix++)
+    for (ix = 0; ix < net->cmdev_max_diag_items - 1; ix++)
     {
-      net->cmdev_device.diag_items[ix].next = ix + 1;
+      net->cmdev_diag_items[ix].next = ix + 1;
     }
-    net->cmdev_device.diag_items[NELEMENTS(net->cmdev_device.diag_items) - 1].next = PF_DIAG_IX_NULL;
+    net->cmdev_diag_items[net->cmdev_max_diag_items - 1].next = PF_DIAG_IX_NULL;
 
     (void)pf_diag_init();
 
@@ -2851,7 +2999,7 @@ static int pf_cmdev_exp_modules_configure(
       }
 
       /* If the module is not yet plugged then let the application plug it now! */
-      if (pf_cmdev_get_slot(p_cfg_api, p_exp_mod->slot_number, &p_cfg_slot) != 0)
+      if (pf_cmdev_get_slot(net, p_cfg_api, p_exp_mod->slot_number, &p_cfg_slot) != 0)
       {
         /*
          * Return code is not interesting here.
@@ -2883,7 +3031,7 @@ static int pf_cmdev_exp_modules_configure(
         ret = -1;
       }
       /* Defer slot_number not unique test to later. */
-      else if (pf_cmdev_get_slot(p_cfg_api, p_exp_mod->slot_number, &p_cfg_slot) != 0)
+      else if (pf_cmdev_get_slot(net, p_cfg_api, p_exp_mod->slot_number, &p_cfg_slot) != 0)
       {
         /* Not supported in GSDML/Application */
         pf_set_error(p_stat, PNET_ERROR_CODE_CONNECT, PNET_ERROR_DECODE_PNIO, PNET_ERROR_CODE_1_CONN_FAULTY_EXP_BLOCK_REQ, 6);
@@ -2972,6 +3120,9 @@ static int pf_cmdev_exp_apis_configure(
     }
   }
 
+  /* Cached descriptors of the sub-slots may have changed */
+  pf_cmdev_invalidate_subslot_handles(net);
+
   return ret;
 }
 
@@ -3234,7 +3385,7 @@ static int pf_cmdev_generate_submodule_diff(
         p_ar->api_diffs[nbr_api_diffs].module_diffs[nbr_mod_diffs].slot_number = slot_nbr;
         p_ar->api_diffs[nbr_api_diffs].module_diffs[nbr_mod_diffs].submodule_diffs[nbr_sub_diffs].submodule_state.format_indicator = true;
 
-        if (pf_cmdev_get_slot(p_cfg_api, slot_nbr, &p_cfg_slot) != 0)
+        if (pf_cmdev_get_slot(net, p_cfg_api, slot_nbr, &p_cfg_slot) != 0)
         {
           /* slot_number not found in CFG for specified API */
           p_ar->api_diffs[nbr_api_diffs].module_diffs[nbr_mod_diffs].module_state = PF_MOD_PLUG_NO_MODULE;
@@ -3863,7 +4014,7 @@ void pf_cmdev_prepare_submodule_diff(
         p_ar->api_diffs[nbr_api_diffs].module_diffs[nbr_mod_diffs].slot_number = slot_nbr;
         p_ar->api_diffs[nbr_api_diffs].module_diffs[nbr_mod_diffs].submodule_diffs[nbr_sub_diffs].submodule_state.format_indicator = true;
 
-        if (pf_cmdev_get_slot(p_cfg_api, slot_nbr, &p_cfg_slot) != 0)
+        if (pf_cmdev_get_slot(net, p_cfg_api, slot_nbr, &p_cfg_slot) != 0)
         {
           /* slot_number not found in CFG for specified API */
           p_ar->api_diffs[nbr_api_diffs].module_diffs[nbr_mod_diffs].module_state = PF_MOD_PLUG_NO_MODULE;
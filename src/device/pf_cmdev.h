@@ -64,6 +64,15 @@ typedef int (*pf_ftn_subslot_t)(
 void pf_cmdev_init(
    pnet_t                  *net);
 
+/**
+ * Invalidate all sub-slot handles, so they are resolved again at their
+ * next use. Called when an AR is set up or released, and on plug and pull.
+ * Also discards the records cached by CMRDR.
+ * @param net              InOut: The p-net stack instance
+ */
+void pf_cmdev_invalidate_subslot_handles(
+   pnet_t                  *net);
+
 /**
  * Un-initialize the cmdev component.
  * Delete all modules and sub-modules.
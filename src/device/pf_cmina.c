@@ -306,7 +306,7 @@ static void pf_cmina_check_and_stop_ar(
   uint8_t  err2_code)
 {
   uint16_t ix;
-  for (ix = 0U; ix < PNET_MAX_AR; ix++)
+  for (ix = 0U; ix < net->max_ar; ix++)
   {
     pf_ar_t *p_ar = pf_ar_find_by_index(net, ix);
     if (p_ar != NULL)
@@ -635,7 +635,7 @@ int pf_cmina_dcp_set_ind(
         /* Reset name or reset to factory */
         /* Any connection active ? */
         found = false;
-        for (ix = 0; ix < PNET_MAX_AR; ix++)
+        for (ix = 0; ix < net->max_ar; ix++)
         {
           p_ar = pf_ar_find_by_index(net, ix);
           if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -659,7 +659,7 @@ int pf_cmina_dcp_set_ind(
         /* Change name or reset IP */
     /* Any connection active ? */
         found = false;
-        for (ix = 0; ix < PNET_MAX_AR; ix++)
+        for (ix = 0; ix < net->max_ar; ix++)
         {
           p_ar = pf_ar_find_by_index(net, ix);
           if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -685,7 +685,7 @@ int pf_cmina_dcp_set_ind(
         /* Change IP */
     /* Any connection active ?? */
         found = false;
-        for (ix = 0; ix < PNET_MAX_AR; ix++)
+        for (ix = 0; ix < net->max_ar; ix++)
         {
           p_ar = pf_ar_find_by_index(net, ix);
           if ((p_ar != NULL) && (p_ar->in_use == true))
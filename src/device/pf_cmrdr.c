@@ -462,12 +462,183 @@ static void pf_put_pd_port_data_adjust(
 * Contains a single function \a pf_cmrdr_rm_read_ind(),
 * that handles a RPC parameter read request.
 *
-* This implementation of CMRDR has no internal state.
 * Every call to pf_cmrdr_rm_read_ind finishes by returning the result.
-* Since there are no internal static variables there is also no need
-* for a POWER-ON state.
+* The only internal state is a cache of serialized record bodies, which
+* is emptied by pf_cmrdr_invalidate() when their source data may change.
 */
 
+void pf_cmrdr_init(
+  pnet_t                *net)
+{
+  memset(net->cmrdr_cache, 0, sizeof(net->cmrdr_cache));
+  net->cmrdr_cache_tick = 0;
+  net->cmrdr_cache_hits = 0;
+  net->cmrdr_cache_misses = 0;
+  atomic_store(&net->cmrdr_cache_version, 1U);
+}
+
+void pf_cmrdr_invalidate(
+  pnet_t                *net)
+{
+  /* Version 0 means "not initialized", and must be skipped */
+  if (atomic_load(&net->cmrdr_cache_version) != 0)
+  {
+    if (atomic_fetch_add(&net->cmrdr_cache_version, 1) == UINT32_MAX)
+    {
+      (void)atomic_fetch_add(&net->cmrdr_cache_version, 1);
+    }
+  }
+}
+
+/**
+ * @internal
+ * Find out if the answer to a read request may be cached.
+ *
+ * The AR filtered identification records are only cached when the full
+ * answer is sent, and then per AR. The zero length answer is cheap anyway.
+ * @param p_ar             In:   The AR instance.
+ * @param opnum            In:   The RPC operation.
+ * @param p_read_request   In:   The read request.
+ * @param pp_key_ar        Out:  The AR the answer depends on, or NULL.
+ * @return  true if the answer may be cached.
+ */
+static bool pf_cmrdr_cache_key(
+  pf_ar_t               *p_ar,
+  uint16_t               opnum,
+  pf_iod_read_request_t *p_read_request,
+  pf_ar_t              **pp_key_ar)
+{
+  bool                    ret = false;
+
+  *pp_key_ar = NULL;
+  switch (p_read_request->index)
+  {
+  case PF_IDX_DEV_IM_0_FILTER_DATA:
+  case PF_IDX_SUB_IM_0:
+  case PF_IDX_SUB_IM_1:
+  case PF_IDX_SUB_IM_2:
+  case PF_IDX_SUB_IM_3:
+  case PF_IDX_SUB_IM_4:
+  case PF_IDX_SUB_REAL_ID_DATA:
+  case PF_IDX_SLOT_REAL_ID_DATA:
+  case PF_IDX_API_REAL_ID_DATA:
+  case PF_IDX_DEV_API_DATA:
+    ret = true;
+    break;
+  case PF_IDX_SUB_EXP_ID_DATA:
+  case PF_IDX_SLOT_EXP_ID_DATA:
+  case PF_IDX_AR_EXP_ID_DATA:
+  case PF_IDX_AR_REAL_ID_DATA:
+    if (   (opnum == PF_RPC_DEV_OPNUM_READ_IMPLICIT)
+        || (p_ar && p_ar->nbr_iocrs > 0))
+    {
+      *pp_key_ar = p_ar;
+      ret = true;
+    }
+    break;
+  default:
+    break;
+  }
+
+  return ret;
+}
+
+/**
+ * @internal
+ * Find a cached record body.
+ * @param net              InOut: The p-net stack instance
+ * @param version          In:   The current cache version.
+ * @param p_key_ar         In:   The AR the answer depends on, or NULL.
+ * @param p_read_request   In:   The read request.
+ * @return  The cache entry, or NULL if not found.
+ */
+static pf_cmrdr_cache_entry_t *pf_cmrdr_cache_find(
+  pnet_t                *net,
+  uint32_t               version,
+  pf_ar_t               *p_key_ar,
+  pf_iod_read_request_t *p_read_request)
+{
+  uint16_t                ix;
+  pf_cmrdr_cache_entry_t *p_entry;
+
+  for (ix = 0; ix < NELEMENTS(net->cmrdr_cache); ix++)
+  {
+    p_entry = &net->cmrdr_cache[ix];
+    if ((p_entry->version == version) &&
+        (p_entry->index == p_read_request->index) &&
+        (p_entry->api == p_read_request->api) &&
+        (p_entry->slot == p_read_request->slot_number) &&
+        (p_entry->subslot == p_read_request->subslot_number) &&
+        (p_entry->p_ar == p_key_ar))
+    {
+      return p_entry;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @internal
+ * Save a serialized record body in the cache.
+ * Replaces an entry of an older version, or else the least recently used.
+ *
+ * The block writer silently skips fields that do not fit in the output
+ * buffer. The body is therefore only saved if there is still room for a
+ * whole body after it, in which case nothing can have been skipped.
+ * @param net              InOut: The p-net stack instance
+ * @param version          In:   The cache version when serializing started.
+ * @param p_key_ar         In:   The AR the answer depends on, or NULL.
+ * @param p_read_request   In:   The read request.
+ * @param p_body           In:   The serialized record body.
+ * @param len              In:   The size of the body.
+ * @param room             In:   Unused size of the output buffer after the body.
+ */
+static void pf_cmrdr_cache_save(
+  pnet_t                *net,
+  uint32_t               version,
+  pf_ar_t               *p_key_ar,
+  pf_iod_read_request_t *p_read_request,
+  const uint8_t         *p_body,
+  uint16_t               len,
+  uint16_t               room)
+{
+  uint16_t                ix;
+  pf_cmrdr_cache_entry_t *p_entry = &net->cmrdr_cache[0];
+
+  if ((len > sizeof(p_entry->body)) || (room < sizeof(p_entry->body)))
+  {
+    return;
+  }
+
+  for (ix = 0; ix < NELEMENTS(net->cmrdr_cache); ix++)
+  {
+    if (net->cmrdr_cache[ix].version != version)
+    {
+      p_entry = &net->cmrdr_cache[ix];
+      break;
+    }
+    if (net->cmrdr_cache[ix].last_use < p_entry->last_use)
+    {
+      p_entry = &net->cmrdr_cache[ix];
+    }
+  }
+
+  /*
+   * Saved with the version from before serializing, so that an
+   * invalidation meanwhile (from another thread) is not lost.
+   */
+  p_entry->version = version;
+  p_entry->last_use = ++net->cmrdr_cache_tick;
+  p_entry->p_ar = p_key_ar;
+  p_entry->api = p_read_request->api;
+  p_entry->slot = p_read_request->slot_number;
+  p_entry->subslot = p_read_request->subslot_number;
+  p_entry->index = p_read_request->index;
+  p_entry->len = len;
+  memcpy(p_entry->body, p_body, len);
+}
+
 
 int pf_cmrdr_rm_read_ind(
   pnet_t                *net,
@@ -484,14 +655,19 @@ int pf_cmrdr_rm_read_ind(
   uint8_t                *p_data = NULL;
   uint16_t                data_length_pos = 0;
   uint16_t                start_pos = 0;
-  uint8_t                 iocs[255];              /* Max possible array size */
-  uint8_t                 iops[255];              /* Max possible array size */
-  uint8_t                 subslot_data[PF_FRAME_BUFFER_SIZE];     /* Max possible array size */
+  uint8_t                *iocs = net->cmrdr_iocs;
+  uint8_t                *iops = net->cmrdr_iops;
+  uint8_t                *subslot_data = net->cmrdr_subslot_data;
   uint8_t                 iocs_len = 0;
   uint8_t                 iops_len = 0;
   uint16_t                data_len = 0;
-  bool                    new_flag = false;
+  uint32_t                cache_version = atomic_load(&net->cmrdr_cache_version);
+  bool                    cacheable = false;
+  pf_ar_t                *p_key_ar = NULL;
+  pf_cmrdr_cache_entry_t *p_entry = NULL;
+  bool                    busy = atomic_exchange(&net->cmrdr_busy, true);
 
+  CC_ASSERT(busy == false);
   read_result.sequence_number = p_read_request->sequence_number;
   read_result.ar_uuid         = p_read_request->ar_uuid;
   read_result.api             = p_read_request->api;
@@ -535,6 +711,15 @@ int pf_cmrdr_rm_read_ind(
    */
   ret = -1;
   start_pos = *p_pos;
+  if (cache_version != 0)
+  {
+    cacheable = pf_cmrdr_cache_key(p_ar, opnum, p_read_request, &p_key_ar);
+    if (cacheable == true)
+    {
+      p_entry = pf_cmrdr_cache_find(net, cache_version, p_key_ar, p_read_request);
+    }
+  }
+
   if (p_read_request->index <= PF_IDX_USER_MAX)
   {
     /* Provided by application - accept whatever it says. */
@@ -545,6 +730,15 @@ int pf_cmrdr_rm_read_ind(
       ret = 0;
     }
   }
+  else if ((p_entry != NULL) && (*p_pos + p_entry->len < res_size))
+  {
+    /* Serialized by an earlier read, and not changed since then. */
+    memcpy(&p_res[*p_pos], p_entry->body, p_entry->len);
+    *p_pos += p_entry->len;
+    p_entry->last_use = ++net->cmrdr_cache_tick;
+    net->cmrdr_cache_hits++;
+    ret = 0;
+  }
   else
   {
     LOG_DEBUG(PF_RPC_LOG, "CMRDR(%d): p_read_request->index 0x%X pos %u\n", 
@@ -720,9 +914,9 @@ int pf_cmrdr_rm_read_ind(
 
     case PF_IDX_SUB_INPUT_DATA:
       /* Sub-module data to the controller */
-      data_len = sizeof(subslot_data);
-      iops_len = sizeof(iops);
-      iocs_len = sizeof(iocs);
+      data_len = sizeof(net->cmrdr_subslot_data);
+      iops_len = sizeof(net->cmrdr_iops);
+      iocs_len = sizeof(net->cmrdr_iocs);
       if (pf_ppm_get_data_and_iops(net, p_read_request->api, p_read_request->slot_number, p_read_request->subslot_number,
                                    subslot_data, &data_len, iops, &iops_len) != 0)
       {
@@ -730,7 +924,7 @@ int pf_cmrdr_rm_read_ind(
         data_len = 0;
         iops_len = 0;
       }
-      if (pf_cpm_get_iocs(net, p_read_request->api, p_read_request->slot_number, p_read_request->subslot_number, iocs, &iocs_len) != 0)
+      if (pf_cpm_peek_iocs(net, p_read_request->api, p_read_request->slot_number, p_read_request->subslot_number, iocs, &iocs_len) != 0)
       {
         LOG_DEBUG(PNET_LOG, "CMRDR(%d): Could not get CPM IOCS\n", __LINE__);
         iocs_len = 0;
@@ -744,11 +938,11 @@ int pf_cmrdr_rm_read_ind(
       break;
     case PF_IDX_SUB_OUTPUT_DATA:
       /* Sub-module data from the controller. */
-      data_len = sizeof(subslot_data);
-      iops_len = sizeof(iops);
-      iocs_len = sizeof(iocs);
-      if (pf_cpm_get_data_and_iops(net, p_read_request->api, p_read_request->slot_number, p_read_request->subslot_number,
-                                   &new_flag, subslot_data, &data_len, iops, &iops_len) != 0)
+      data_len = sizeof(net->cmrdr_subslot_data);
+      iops_len = sizeof(net->cmrdr_iops);
+      iocs_len = sizeof(net->cmrdr_iocs);
+      if (pf_cpm_peek_data_and_iops(net, p_read_request->api, p_read_request->slot_number, p_read_request->subslot_number,
+                                    subslot_data, &data_len, iops, &iops_len) != 0)
       {
         LOG_DEBUG(PNET_LOG, "CMRDR(%d): Could not get CPM data and IOPS\n", __LINE__);
         data_len = 0;
@@ -1076,6 +1270,16 @@ int pf_cmrdr_rm_read_ind(
       ret = -1;
       break;
     }
+
+    if (cacheable == true)
+    {
+      net->cmrdr_cache_misses++;
+      if (ret == 0)
+      {
+        pf_cmrdr_cache_save(net, cache_version, p_key_ar, p_read_request,
+                            &p_res[start_pos], *p_pos - start_pos, res_size - *p_pos);
+      }
+    }
   }
 
   if (ret != 0)
@@ -1089,6 +1293,7 @@ int pf_cmrdr_rm_read_ind(
 
   read_result.record_data_length = *p_pos - start_pos;
   pf_put_uint32(true, read_result.record_data_length, res_size, p_res, &data_length_pos);   /* Insert actual data length */
+  atomic_store(&net->cmrdr_busy, false);
 
   ret = pf_cmsm_cm_read_ind(net, p_ar, p_read_request);
 
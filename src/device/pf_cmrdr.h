@@ -21,11 +21,37 @@ extern "C"
 {
 #endif
 
+/**
+ * Initialize the CMRDR component. Empties the cache of serialized records.
+ * @param net              InOut: The p-net stack instance
+ */
+void pf_cmrdr_init(
+  pnet_t                  *net);
+
+/**
+ * Discard all serialized records cached by CMRDR.
+ * Must be called whenever the device configuration, the expected
+ * configuration of an AR, or the I&M data may have changed.
+ * May be called from any thread.
+ * @param net              InOut: The p-net stack instance
+ */
+void pf_cmrdr_invalidate(
+  pnet_t                  *net);
 
 /**
  * Handle a RPC read request.
+ *
+ * The bodies of records that only change on plug, pull, connect, release
+ * and I&M write are cached, so a repeated read of them is a copy.
+ * This covers the I&M records, the I&M0 filter data, the API data and
+ * the real and expected identification data.
+ *
+ * Not reentrant: the cache and the record buffers are held in pnet_t.
+ * Reads arrive via pnet_handle_periodic() and pnet_handle_rpc(), which
+ * must be called from one thread. A concurrent call fails an assert.
  * @param net              InOut: The p-net stack instance
  * @param p_ar             In:   The AR instance.
+ * @param opnum            In:   The RPC operation (read or implicit read).
  * @param p_read_request   In:   The read request.
  * @param p_read_result    Out:  The result information.
  * @param res_size         In:   The size of the output buffer.
@@ -41,6 +41,13 @@
 #define os_udp_open mock_os_udp_open
 #define os_udp_close mock_os_udp_close
 #define os_udp_recvfrom mock_os_udp_recvfrom
+#define os_udp_recvmmsg mock_os_udp_recvmmsg
+#define os_udp_sendmmsg mock_os_udp_sendmmsg
+#define os_udp_poll_create mock_os_udp_poll_create
+#define os_udp_poll_add mock_os_udp_poll_add
+#define os_udp_poll_remove mock_os_udp_poll_remove
+#define os_udp_poll_wait mock_os_udp_poll_wait
+#define os_udp_poll_destroy mock_os_udp_poll_destroy
 #define pf_generate_uuid mock_pf_generate_uuid
 #endif
 
@@ -188,7 +195,7 @@ void pf_cmrpc_show(
 
   if (level & 0x0800)
   {
-    for (ix = 0; ix < PF_MAX_SESSION; ix++)
+    for (ix = 0; ix < net->max_sessions; ix++)
     {
       p_sess = &net->cmrpc_session_info[ix];
       printf("Session index         = %u\n", ix);
@@ -231,7 +238,7 @@ void pf_cmrpc_show(
 
   if (level & 0x1000)
   {
-    for (ar_ix = 0; ar_ix < PNET_MAX_AR; ar_ix++)
+    for (ar_ix = 0; ar_ix < net->max_ar; ar_ix++)
     {
       p_ar = pf_ar_find_by_index(net, ar_ix);
       printf("AR index              = %u\n", (unsigned)ar_ix);
@@ -326,13 +333,13 @@ static int pf_session_allocate(
   pf_cmina_get_macaddr(net, &mac_address);
 
   os_mutex_lock(net->p_cmrpc_rpc_mutex);
-  while ((ix < NELEMENTS(net->cmrpc_session_info)) &&
+  while ((ix < net->max_sessions) &&
          (net->cmrpc_session_info[ix].in_use == true))
   {
     ix++;
   }
 
-  if (ix < NELEMENTS(net->cmrpc_session_info))
+  if (ix < net->max_sessions)
   {
     p_sess = &net->cmrpc_session_info[ix];
     memset(p_sess, 0, sizeof(*p_sess));
@@ -358,14 +365,79 @@ static int pf_session_allocate(
   return ret;
 }
 
+/**
+ * @internal
+ * Open a UDP socket and add it to the poll set of CMRPC.
+ *
+ * A socket that cannot be polled, e.g. as there is no poll set, is read
+ * each time instead. See pf_cmrpc_handle_ready().
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param port             In:   The local port.
+ * @return  the socket id, or a negative value if an error occurred.
+ */
+static int pf_cmrpc_socket_open(
+  pnet_t                  *net,
+  os_ipport_t             port)
+{
+  int                     id = os_udp_open(OS_IPADDR_ANY, port);
+
+  if (id > 0)
+  {
+    if ((net->cmrpc_poll < 0) || (os_udp_poll_add(net->cmrpc_poll, id) != 0))
+    {
+      LOG_WARNING(PF_RPC_LOG, "CMRPC(%d): Could not poll socket %d (port %u), reading it without polling\n", __LINE__, id, (unsigned)port);
+      if (net->cmrpc_nbr_unpolled < net->max_sessions + 3)
+      {
+        net->cmrpc_unpolled[net->cmrpc_nbr_unpolled++] = id;
+      }
+    }
+  }
+
+  return id;
+}
+
+/**
+ * @internal
+ * Remove a UDP socket from the poll set of CMRPC and close it.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param id               In:   The socket id.
+ */
+static void pf_cmrpc_socket_close(
+  pnet_t                  *net,
+  int                     id)
+{
+  uint16_t                ix;
+
+  if (id > 0)
+  {
+    for (ix = 0; ix < net->cmrpc_nbr_unpolled; ix++)
+    {
+      if (net->cmrpc_unpolled[ix] == (uint32_t)id)
+      {
+        net->cmrpc_unpolled[ix] = net->cmrpc_unpolled[--net->cmrpc_nbr_unpolled];
+        break;
+      }
+    }
+    if (net->cmrpc_poll >= 0)
+    {
+      os_udp_poll_remove(net->cmrpc_poll, id);
+    }
+    os_udp_close(id);
+  }
+}
+
 /**
  * @internal
  * Free the session_info.
  * Close the corresponding UDP socket if necessary.
  *
+ * @param net              InOut: The p-net stack instance
  * @param p_sess           In:   The session instance.
  */
 static void pf_session_release(
+  pnet_t            *net,
   pf_session_info_t *p_sess)
 {
   if (p_sess != NULL)
@@ -374,7 +446,7 @@ static void pf_session_release(
     {
       if (p_sess->socket > 0)
       {
-        os_udp_close(p_sess->socket);
+        pf_cmrpc_socket_close(net, p_sess->socket);
       }
       LOG_DEBUG(PF_RPC_LOG, "RPC(%d): Released session %u\n", __LINE__, (unsigned)p_sess->ix);
       memset(p_sess, 0, sizeof(*p_sess));
@@ -397,14 +469,14 @@ static void pf_session_release_all(
   uint16_t                ix = 0;
 
   os_mutex_lock(net->p_cmrpc_rpc_mutex);
-  while (ix < NELEMENTS(net->cmrpc_session_info))
+  while (ix < net->max_sessions)
   {
     pf_session_info_t *p_sess = &(net->cmrpc_session_info[ix]);
     if (p_sess->in_use == true)
     {
       if (p_sess->socket > 0)
       {
-        os_udp_close(p_sess->socket);
+        pf_cmrpc_socket_close(net, p_sess->socket);
       }
     }
     net->cmrpc_session_info[ix].in_use = false;
@@ -431,13 +503,13 @@ static int pf_session_locate_by_uuid(
   uint16_t ix;
 
   ix = 0;
-  while ((ix < NELEMENTS(net->cmrpc_session_info)) &&
+  while ((ix < net->max_sessions) &&
          ((net->cmrpc_session_info[ix].in_use == false) ||
           (memcmp(p_uuid, &net->cmrpc_session_info[ix].activity_uuid, sizeof(*p_uuid)) != 0)))
   {
     ix++;
   }
-  if (ix < NELEMENTS(net->cmrpc_session_info))
+  if (ix < net->max_sessions)
   {
     *pp_sess = &net->cmrpc_session_info[ix];
     ret = 0;
@@ -466,14 +538,14 @@ static int pf_session_locate_by_ar(
   uint16_t ix;
 
   ix = 0;
-  while ((ix < NELEMENTS(net->cmrpc_session_info)) &&
+  while ((ix < net->max_sessions) &&
          ((net->cmrpc_session_info[ix].in_use == false) ||
           (net->cmrpc_session_info[ix].from_me == false) ||
           (net->cmrpc_session_info[ix].p_ar != p_ar)))
   {
     ix++;
   }
-  if (ix < NELEMENTS(net->cmrpc_session_info))
+  if (ix < net->max_sessions)
   {
     *pp_sess = &net->cmrpc_session_info[ix];
     ret = 0;
@@ -497,13 +569,13 @@ static int pf_ar_allocate(
   int                     ret = -1;
   uint16_t                ix = 0;
   os_mutex_lock(net->p_cmrpc_rpc_mutex);
-  while ((ix < NELEMENTS(net->cmrpc_ar)) &&
+  while ((ix < net->max_ar) &&
          (net->cmrpc_ar[ix].in_use == true))
   {
     ix++;
   }
 
-  if (ix < NELEMENTS(net->cmrpc_ar))
+  if (ix < net->max_ar)
   {
     memset(&net->cmrpc_ar[ix], 0, sizeof(net->cmrpc_ar[ix]));
     net->cmrpc_ar[ix].in_use = true;
@@ -514,7 +586,7 @@ static int pf_ar_allocate(
   }
   os_mutex_unlock(net->p_cmrpc_rpc_mutex);
 
-  if (ix < PNET_MAX_AR)
+  if (ix < net->max_ar)
   {
     net->cmrpc_ar[ix].arep = ix + 1;      /* Avoid AREP == 0 */
     LOG_INFO(PF_RPC_LOG, "RPC(%d): Allocate AR %u\n", __LINE__, ix);
@@ -538,6 +610,7 @@ static void pf_ar_release(
     {
       LOG_INFO(PF_RPC_LOG, "RPC(%d): Free AR %u\n", __LINE__, p_ar->arep - 1);
       memset(p_ar, 0, sizeof(*p_ar));
+      pf_cmdev_invalidate_subslot_handles(net);
     }
     else
     {
@@ -571,7 +644,7 @@ static int pf_ar_find_by_uuid(
   pf_cmdev_state_values_t cmdev_state;
 
   ix = 0;
-  while ((ix < NELEMENTS(net->cmrpc_ar)) &&
+  while ((ix < net->max_ar) &&
          ((net->cmrpc_ar[ix].in_use == false) ||
           ((pf_cmdev_get_state(&net->cmrpc_ar[ix], &cmdev_state) == 0) &&
            (cmdev_state == PF_CMDEV_STATE_POWER_ON)) ||
@@ -579,7 +652,7 @@ static int pf_ar_find_by_uuid(
   {
     ix++;
   }
-  if (ix < NELEMENTS(net->cmrpc_ar))
+  if (ix < net->max_ar)
   {
     *pp_ar = &net->cmrpc_ar[ix];
     ret = 0;
@@ -592,7 +665,7 @@ pf_ar_t *pf_ar_find_by_index(
   pnet_t *net,
   uint16_t                ix)
 {
-  if (ix < NELEMENTS(net->cmrpc_ar))
+  if (ix < net->max_ar)
   {
     return &net->cmrpc_ar[ix];
   }
@@ -611,7 +684,7 @@ int pf_ar_find_by_arep(
   if (arep > 0)
   {
     ix = arep - 1;    /* Convert to index */
-    if ((ix < NELEMENTS(net->cmrpc_ar)) &&
+    if ((ix < net->max_ar) &&
         (net->cmrpc_ar[ix].in_use == true))
     {
       *pp_ar = &net->cmrpc_ar[ix];
@@ -2500,7 +2573,7 @@ int pf_cmrpc_rm_ccontrol_req(
     pf_put_uint32(rpc_req.is_big_endian, ndr_data.array.offset, max_req_len, p_sess->out_buffer, &start_pos);
     pf_put_uint32(rpc_req.is_big_endian, ndr_data.array.actual_count, max_req_len, p_sess->out_buffer, &start_pos);
 
-    p_sess->socket = os_udp_open(OS_IPADDR_ANY, PF_RPC_CCONTROL_EPHEMERAL_PORT);
+    p_sess->socket = pf_cmrpc_socket_open(net, PF_RPC_CCONTROL_EPHEMERAL_PORT);
     if (p_sess->socket > 0)
     {
       if (os_udp_sendto(p_sess->socket, p_sess->ip_addr, p_sess->port, p_sess->out_buffer, p_sess->out_buf_sent_len) == p_sess->out_buf_sent_len)
@@ -3149,7 +3222,7 @@ static int pf_cmrpc_dce_packet(
     }
     if ((p_sess != NULL) && (p_sess->kill_session == true))
     {
-      pf_session_release(p_sess);
+      pf_session_release(net, p_sess);
     }
   }
 
@@ -3159,90 +3232,200 @@ static int pf_cmrpc_dce_packet(
   return ret;
 }
 
-void pf_cmrpc_periodic(
-  pnet_t *net)
+/**
+ * @internal
+ * Check if a socket is in the list of readable sockets.
+ *
+ * @param p_ready          In:   The readable sockets.
+ * @param nbr_ready        In:   Nbr of readable sockets.
+ * @param id               In:   The socket to look for.
+ * @return  true if the socket is readable.
+ */
+static bool pf_cmrpc_is_ready(
+  const uint32_t          *p_ready,
+  int                     nbr_ready,
+  int                     id)
 {
-  uint32_t                dcerpc_addr;
-  uint16_t                dcerpc_port;
-  int                     dcerpc_req_len;
-  uint16_t                dcerpc_resp_len = 0;
-  uint16_t                ix;
-  bool                    is_release = false;
-  int                     sent_len = 0;
+  int                     ix;
 
-  /* Poll for RPC session confirmations */
-  for (ix = 0; ix < NELEMENTS(net->cmrpc_session_info); ix++)
+  if (id > 0)
   {
-    if ((net->cmrpc_session_info[ix].in_use == true) && (net->cmrpc_session_info[ix].from_me == true))
+    for (ix = 0; ix < nbr_ready; ix++)
     {
-      dcerpc_req_len = os_udp_recvfrom(net->cmrpc_session_info[ix].socket, &dcerpc_addr, &dcerpc_port, net->cmrpc_dcerpc_req_frame, sizeof(net->cmrpc_dcerpc_req_frame));
-      if (dcerpc_req_len > 0)
+      if (p_ready[ix] == (uint32_t)id)
       {
-        dcerpc_resp_len = PF_MAX_UDP_PAYLOAD_SIZE;
-        LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): Received %u bytes UDP payload from remote port %u, on a socket in session with index %u\n", __LINE__, dcerpc_req_len, dcerpc_port, ix);
-        is_release = false;
-        (void)pf_cmrpc_dce_packet(net, dcerpc_addr, dcerpc_port, net->cmrpc_dcerpc_req_frame, dcerpc_req_len, net->cmrpc_dcerpc_rsp_frame, &dcerpc_resp_len, &is_release);
+        return true;
       }
     }
   }
 
-  /* Poll RPC requests */
-  dcerpc_req_len = os_udp_recvfrom(net->cmrpc_rpcreq_socket, &dcerpc_addr, &dcerpc_port, net->cmrpc_dcerpc_req_frame, sizeof(net->cmrpc_dcerpc_req_frame));
-  if (dcerpc_req_len > 0)
+  return false;
+}
+
+/**
+ * @internal
+ * Read the datagrams pending on a socket with one system call, and hand
+ * them to pf_cmrpc_dce_packet() one by one.
+ *
+ * All fragments of a request that have arrived are thus handled at once,
+ * instead of one per tick. The responses are sent with one system call.
+ *
+ * @param net              InOut: The p-net stack instance
+ * @param socket           In:   The socket to read from.
+ * @param send_response    In:   true if responses are sent on the socket.
+ * @param p_is_release     Out:  Set to true if a release was handled.
+ * @return  the number of datagrams handled.
+ */
+static int pf_cmrpc_dce_batch(
+  pnet_t                  *net,
+  int                     socket,
+  bool                    send_response,
+  bool                    *p_is_release)
+{
+  os_udp_msg_t            req[PF_CMRPC_UDP_BATCH];
+  os_udp_msg_t            rsp[PF_CMRPC_UDP_BATCH];
+  int                     nbr_req;
+  int                     nbr_rsp = 0;
+  int                     ix;
+  uint16_t                dcerpc_resp_len;
+  bool                    is_release;
+
+  for (ix = 0; ix < PF_CMRPC_UDP_BATCH; ix++)
   {
+    req[ix].data = net->cmrpc_dcerpc_req_frame[ix];
+    req[ix].size = sizeof(net->cmrpc_dcerpc_req_frame[ix]);
+  }
+
+  nbr_req = os_udp_recvmmsg(socket, req, PF_CMRPC_UDP_BATCH);
+  for (ix = 0; ix < nbr_req; ix++)
+  {
+    LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): Received %d bytes UDP payload from remote port %u, on socket %d (%d of %d)\n", __LINE__, req[ix].len, req[ix].port, socket, ix + 1, nbr_req);
     dcerpc_resp_len = PF_MAX_UDP_PAYLOAD_SIZE;
-    LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): Received %u bytes UDP payload from remote port %u, on the socket for incoming DCE RPC requests.\n", __LINE__, dcerpc_req_len, dcerpc_port);
     is_release = false;
-    (void)pf_cmrpc_dce_packet(net, dcerpc_addr, dcerpc_port, net->cmrpc_dcerpc_req_frame, dcerpc_req_len, net->cmrpc_dcerpc_rsp_frame, &dcerpc_resp_len, &is_release);
-    if (dcerpc_resp_len != 0)
+    (void)pf_cmrpc_dce_packet(net, req[ix].addr, req[ix].port, req[ix].data, req[ix].len, net->cmrpc_dcerpc_rsp_frame[nbr_rsp], &dcerpc_resp_len, &is_release);
+    if (is_release == true)
+    {
+      *p_is_release = true;
+    }
+    if (send_response == true)
     {
-      LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): Sending %u bytes UDP to remote port %u, on the socket used for incoming DCE RPC requests.\n", __LINE__, dcerpc_resp_len, dcerpc_port);
-      sent_len = os_udp_sendto(net->cmrpc_rpcreq_socket, dcerpc_addr, dcerpc_port, net->cmrpc_dcerpc_rsp_frame, dcerpc_resp_len);
-      if (sent_len != dcerpc_resp_len)
+      if (dcerpc_resp_len != 0)
       {
-        LOG_ERROR(PF_RPC_LOG, "CMRPC(%d): Failed to send %u UDP bytes\n", __LINE__, dcerpc_resp_len);
+        LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): Sending %u bytes UDP to remote port %u, on socket %d.\n", __LINE__, dcerpc_resp_len, req[ix].port, socket);
+        rsp[nbr_rsp].data = net->cmrpc_dcerpc_rsp_frame[nbr_rsp];
+        rsp[nbr_rsp].size = dcerpc_resp_len;
+        rsp[nbr_rsp].addr = req[ix].addr;
+        rsp[nbr_rsp].port = req[ix].port;
+        nbr_rsp++;
+      }
+      else
+      {
+        LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): No UDP data to send\n", __LINE__);
       }
     }
-    else
+  }
+
+  if ((nbr_rsp > 0) && (os_udp_sendmmsg(socket, rsp, nbr_rsp) != nbr_rsp))
+  {
+    LOG_ERROR(PF_RPC_LOG, "CMRPC(%d): Failed to send %d UDP responses\n", __LINE__, nbr_rsp);
+  }
+
+  return (nbr_req > 0) ? nbr_req : 0;
+}
+
+int pf_cmrpc_handle_ready(
+  pnet_t                  *net,
+  uint32_t                timeout_us)
+{
+  int                     nbr_polled = 0;
+  int                     nbr_ready;
+  int                     socket;
+  int                     nbr;
+  uint16_t                ix;
+  bool                    is_release = false;
+
+  /* One system call tells which sockets have data, instead of trying to
+     read from each of them. The sockets that could not be polled are read
+     each time, so do not wait long for the others. */
+  if (net->cmrpc_nbr_unpolled > 0)
+  {
+    timeout_us = MIN(timeout_us, PF_CMRPC_UNPOLLED_WAIT_US);
+  }
+  if (net->cmrpc_poll >= 0)
+  {
+    nbr_polled = os_udp_poll_wait(net->cmrpc_poll, net->cmrpc_ready, net->max_sessions + 3 - net->cmrpc_nbr_unpolled, timeout_us);
+    nbr_polled = MAX(nbr_polled, 0);
+  }
+  else if (timeout_us > 0)
+  {
+    os_usleep(timeout_us);
+  }
+
+  memcpy(&net->cmrpc_ready[nbr_polled], net->cmrpc_unpolled, net->cmrpc_nbr_unpolled * sizeof(net->cmrpc_unpolled[0]));
+  nbr_ready = nbr_polled + net->cmrpc_nbr_unpolled;
+  if (nbr_ready <= 0)
+  {
+    return 0;
+  }
+
+  /* RPC session confirmations.
+     A batch may end the session and close its socket, so stop there. */
+  for (ix = 0; ix < net->max_sessions; ix++)
+  {
+    pf_session_info_t *p_sess = &net->cmrpc_session_info[ix];
+
+    if ((p_sess->in_use == true) && (p_sess->from_me == true) &&
+        (pf_cmrpc_is_ready(net->cmrpc_ready, nbr_ready, p_sess->socket) == true))
     {
-      LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): No UDP data to send\n", __LINE__);
+      socket = p_sess->socket;
+      do
+      {
+        nbr = pf_cmrpc_dce_batch(net, socket, false, &is_release);
+      } while ((nbr == PF_CMRPC_UDP_BATCH) && (p_sess->in_use == true) && (p_sess->socket == (uint32_t)socket));
     }
-    if (is_release == true)
+  }
+
+  /* RPC requests */
+  if (pf_cmrpc_is_ready(net->cmrpc_ready, nbr_ready, net->cmrpc_rpcreq_socket) == true)
+  {
+    socket = net->cmrpc_rpcreq_socket;
+    is_release = false;
+    do
+    {
+      nbr = pf_cmrpc_dce_batch(net, socket, true, &is_release);
+    } while ((nbr == PF_CMRPC_UDP_BATCH) && (is_release == false) && (net->cmrpc_rpcreq_socket == socket));
+    if ((is_release == true) && (net->cmrpc_rpcreq_socket == socket))
     {
       LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): Closing and reopening socket used for incoming DCE RPC requests.\n", __LINE__);
-      os_udp_close(net->cmrpc_rpcreq_socket);
-      net->cmrpc_rpcreq_socket = os_udp_open(OS_IPADDR_ANY, PF_RPC_SERVER_PORT);
-
+      pf_cmrpc_socket_close(net, net->cmrpc_rpcreq_socket);
+      net->cmrpc_rpcreq_socket = pf_cmrpc_socket_open(net, PF_RPC_SERVER_PORT);
     }
   }
 
-
-  dcerpc_req_len = os_udp_recvfrom(net->pnet_socket, &dcerpc_addr, &dcerpc_port, net->pnet_req_frame, sizeof(net->pnet_req_frame));
-  if (dcerpc_req_len > 0)
+  if (pf_cmrpc_is_ready(net->cmrpc_ready, nbr_ready, net->pnet_socket) == true)
   {
-    dcerpc_resp_len = PF_MAX_UDP_PAYLOAD_SIZE;
+    socket = net->pnet_socket;
     is_release = false;
-    (void)pf_cmrpc_dce_packet(net, dcerpc_addr, dcerpc_port, net->pnet_req_frame, dcerpc_req_len, net->pnet_rsp_frame, &dcerpc_resp_len, &is_release);
-    if (dcerpc_resp_len != 0)
-    {
-      os_udp_sendto(net->pnet_socket, dcerpc_addr, dcerpc_port, net->pnet_rsp_frame, dcerpc_resp_len);
-    }
-    else
+    do
     {
-      LOG_INFO(PF_RPC_LOG, "CMRPC(%d): PNET UDP: Nothing to send!\n", __LINE__);
-    }
-    if (is_release == true)
+      nbr = pf_cmrpc_dce_batch(net, socket, true, &is_release);
+    } while ((nbr == PF_CMRPC_UDP_BATCH) && (is_release == false) && (net->pnet_socket == socket));
+    if ((is_release == true) && (net->pnet_socket == socket))
     {
       LOG_INFO(PF_RPC_LOG, "CMRPC(%d): re-open PNET UDP\n", __LINE__);
-      os_udp_close(net->pnet_socket);
-      net->pnet_socket = os_udp_open(OS_IPADDR_ANY, PF_PNET_SERVER_PORT);
+      pf_cmrpc_socket_close(net, net->pnet_socket);
+      net->pnet_socket = pf_cmrpc_socket_open(net, PF_PNET_SERVER_PORT);
     }
   }
 
   // capture syslog messages of Automated RT Tester for better diagnosis
   uint32_t                syslog_addr;
   uint16_t                syslog_port;
-  const int syslog_len = os_udp_recvfrom(net->syslog_socket, &syslog_addr, &syslog_port, net->syslog_frame, sizeof(net->syslog_frame) - 1);
+  int                     syslog_len = 0;
+  if (pf_cmrpc_is_ready(net->cmrpc_ready, nbr_ready, net->syslog_socket) == true)
+  {
+    syslog_len = os_udp_recvfrom(net->syslog_socket, &syslog_addr, &syslog_port, net->syslog_frame, sizeof(net->syslog_frame) - 1);
+  }
   if (syslog_len > 0)
   {
     if(syslog_len < (int)(sizeof(net->syslog_frame)))
@@ -3263,6 +3446,14 @@ void pf_cmrpc_periodic(
       os_log(LOG_LEVEL_INFO, "SYSLOG:\n" ANSI_COLOR_CYAN "%s" ANSI_COLOR_RESET" \n", frame_text);
     }
   }
+
+  return nbr_polled;
+}
+
+void pf_cmrpc_periodic(
+  pnet_t *net)
+{
+  (void)pf_cmrpc_handle_ready(net, 0);
 }
 
 void pf_cmrpc_init(
@@ -3271,12 +3462,19 @@ void pf_cmrpc_init(
   if (net->p_cmrpc_rpc_mutex == NULL)
   {
     net->p_cmrpc_rpc_mutex = os_mutex_create();
-    memset(net->cmrpc_ar, 0, sizeof(net->cmrpc_ar));
-    memset(net->cmrpc_session_info, 0, sizeof(net->cmrpc_session_info));
+    memset(net->cmrpc_ar, 0, net->max_ar * sizeof(net->cmrpc_ar[0]));
+    memset(net->cmrpc_session_info, 0, net->max_sessions * sizeof(net->cmrpc_session_info[0]));
+
+    net->cmrpc_nbr_unpolled = 0;
+    net->cmrpc_poll = os_udp_poll_create();
+    if (net->cmrpc_poll < 0)
+    {
+      LOG_WARNING(PF_RPC_LOG, "CMRPC(%d): Could not create poll set, reading all sockets without polling\n", __LINE__);
+    }
 
-    net->cmrpc_rpcreq_socket = os_udp_open(OS_IPADDR_ANY, PF_RPC_SERVER_PORT);
-    net->pnet_socket         = os_udp_open(OS_IPADDR_ANY, PF_PNET_SERVER_PORT);
-    net->syslog_socket       = os_udp_open(OS_IPADDR_ANY, PF_SYSLOG_PORT);
+    net->cmrpc_rpcreq_socket = pf_cmrpc_socket_open(net, PF_RPC_SERVER_PORT);
+    net->pnet_socket         = pf_cmrpc_socket_open(net, PF_PNET_SERVER_PORT);
+    net->syslog_socket       = pf_cmrpc_socket_open(net, PF_SYSLOG_PORT);
   }
 
   /* Save for later (put it into each session */
@@ -3299,8 +3497,10 @@ void pf_cmrpc_exit(
   if (net->p_cmrpc_rpc_mutex != NULL)
   {
     os_mutex_destroy(net->p_cmrpc_rpc_mutex);
-    memset(net->cmrpc_ar, 0, sizeof(net->cmrpc_ar));
-    memset(net->cmrpc_session_info, 0, sizeof(net->cmrpc_session_info));
+    os_udp_poll_destroy(net->cmrpc_poll);
+    net->cmrpc_poll = -1;
+    memset(net->cmrpc_ar, 0, net->max_ar * sizeof(net->cmrpc_ar[0]));
+    memset(net->cmrpc_session_info, 0, net->max_sessions * sizeof(net->cmrpc_session_info[0]));
   }
 }
 
@@ -3330,15 +3530,15 @@ int pf_cmrpc_cmdev_state_ind(
       {
         if (p_ar->p_sess->release_in_progress == false)
         {
-          pf_session_release(p_ar->p_sess);
+          pf_session_release(net, p_ar->p_sess);
 
           /* Re-open the global RPC socket. */
           LOG_DEBUG(PF_RPC_LOG, "CMRPC(%d): Closing and reopening socket used for incoming DCE RPC requests.\n", __LINE__);
-          os_udp_close(net->cmrpc_rpcreq_socket);
-          net->cmrpc_rpcreq_socket = os_udp_open(OS_IPADDR_ANY, PF_RPC_SERVER_PORT);
+          pf_cmrpc_socket_close(net, net->cmrpc_rpcreq_socket);
+          net->cmrpc_rpcreq_socket = pf_cmrpc_socket_open(net, PF_RPC_SERVER_PORT);
 
-          os_udp_close(net->pnet_socket);
-          net->pnet_socket = os_udp_open(OS_IPADDR_ANY, PF_PNET_SERVER_PORT);
+          pf_cmrpc_socket_close(net, net->pnet_socket);
+          net->pnet_socket = pf_cmrpc_socket_open(net, PF_PNET_SERVER_PORT);
         }
       }
       else
@@ -3349,7 +3549,7 @@ int pf_cmrpc_cmdev_state_ind(
 
       while (pf_session_locate_by_ar(net, p_ar, &p_sess) == 0)
       {
-        pf_session_release(p_sess);
+        pf_session_release(net, p_sess);
       }
 
       /* Finally free the AR */
@@ -3358,11 +3558,11 @@ int pf_cmrpc_cmdev_state_ind(
     else
     {
       // Re-open the global RPC socket.
-      os_udp_close(net->cmrpc_rpcreq_socket);
-      net->cmrpc_rpcreq_socket = os_udp_open(OS_IPADDR_ANY, PF_RPC_SERVER_PORT);
+      pf_cmrpc_socket_close(net, net->cmrpc_rpcreq_socket);
+      net->cmrpc_rpcreq_socket = pf_cmrpc_socket_open(net, PF_RPC_SERVER_PORT);
 
-      os_udp_close(net->pnet_socket);
-      net->pnet_socket = os_udp_open(OS_IPADDR_ANY, PF_PNET_SERVER_PORT);
+      pf_cmrpc_socket_close(net, net->pnet_socket);
+      net->pnet_socket = pf_cmrpc_socket_open(net, PF_PNET_SERVER_PORT);
     }
     pf_session_release_all(net);
     res = 0;
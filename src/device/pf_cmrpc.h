@@ -43,11 +43,25 @@ void pf_cmrpc_exit(
  * Handle periodic RPC tasks.
  * Check for DCE RPC requests.
  * Check for DCE RPC confirmations.
+ * Only the sockets that have data are read, see pf_cmrpc_handle_ready().
  * @param net              InOut: The p-net stack instance
  */
 void pf_cmrpc_periodic(
    pnet_t                  *net);
 
+/**
+ * Wait for DCE RPC requests and confirmations, and handle them.
+ * All RPC sockets are in one poll set, so a single system call tells which
+ * of them have data. A socket that could not be added to the poll set is
+ * read each time, and the wait is then limited to PF_CMRPC_UNPOLLED_WAIT_US.
+ * @param net              InOut: The p-net stack instance
+ * @param timeout_us       In:   Max time to wait. 0 does not block.
+ * @return  the number of polled sockets that had data, 0 on timeout.
+ */
+int pf_cmrpc_handle_ready(
+   pnet_t                  *net,
+   uint32_t                timeout_us);
+
 /**
  * Find an AR by its AREP.
  * @param net              InOut: The p-net stack instance
@@ -371,6 +371,9 @@ int pf_fspm_cm_write_ind(
       p_write_status->pnio_status.error_code_2 = 0;
       break;
     }
+
+    /* Also after a failed write, which may have changed part of the data */
+    pf_cmrdr_invalidate(net);
   }
   else
   {
@@ -392,6 +395,8 @@ void pf_fspm_clear_im_data(
   memset(net->fspm_cfg.im_3_data.im_descriptor, ' ', sizeof(net->fspm_cfg.im_3_data.im_descriptor));
   net->fspm_cfg.im_3_data.im_descriptor[sizeof(net->fspm_cfg.im_3_data.im_descriptor) - 1] = '\0';
   memset(net->fspm_cfg.im_4_data.im_signature, 0, sizeof(net->fspm_cfg.im_4_data.im_signature));
+
+  pf_cmrdr_invalidate(net);
 }
 
 void pf_fspm_get_cfg(
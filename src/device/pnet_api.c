@@ -37,19 +37,23 @@ pnet_t* pnet_init(
 {
   pnet_t                  *net;
 
-  net = os_malloc(sizeof(*net));
-  if (net == NULL)
+  if (strlen(netif) > PNET_MAX_INTERFACE_NAME_LENGTH)
   {
+    LOG_ERROR(PNET_LOG, "Too long interface name\n");
     return NULL;
   }
 
-  memset(net, 0, sizeof(*net));
-
-  if (strlen(netif) > PNET_MAX_INTERFACE_NAME_LENGTH)
+  /* The instance and all its tables, sized from p_cfg */
+  net = pf_arena_create(p_cfg);
+  if (net == NULL)
   {
-    LOG_ERROR(PNET_LOG, "Too long interface name\n");
     return NULL;
   }
+  LOG_INFO(PNET_LOG, "API(%d): %u bytes for %u ARs, %u sessions, %u diag items, %u frame ids and %u timeouts\n", __LINE__,
+    (unsigned)net->footprint.total, (unsigned)net->footprint.max_ar, (unsigned)net->footprint.max_sessions,
+    (unsigned)net->footprint.max_diag_items, (unsigned)net->footprint.eth_id_map_size,
+    (unsigned)net->footprint.max_timeouts);
+
   strcpy(net->interface_name, netif);
   net->cmdev_initialized = false;  /* TODO How to handle that pf_cmdev_exit() is used before pf_cmdev_init()? */
   // copy default/stored check peers data
@@ -62,6 +66,7 @@ pnet_t* pnet_init(
   pf_cpm_init(net);
   pf_ppm_init(net);
   pf_alarm_init(net);
+  pf_cmrdr_init(net);
 
   /* pnet_cm_init_req */
   pf_fspm_init(net, p_cfg);    /* Init cfg */
@@ -71,7 +76,7 @@ pnet_t* pnet_init(
   net->eth_handle = os_eth_init(netif, pf_eth_recv, (void*)net);
   if (net->eth_handle == NULL)
   {
-    os_free(net);
+    pf_arena_destroy(net);
     return NULL;
   }
 
@@ -99,6 +104,80 @@ void pnet_handle_periodic(
 
   /* Handle expired timeout events */
   pf_scheduler_tick(net);
+
+  /* Send the cyclic frames that became due in this tick */
+  pf_ppm_send_flush(net);
+}
+
+int pnet_handle_rpc(
+  pnet_t                  *net,
+  uint32_t                timeout_us)
+{
+  return pf_cmrpc_handle_ready(net, timeout_us);
+}
+
+/**
+ * @internal
+ * Context of pnet_run_to_completion()
+ */
+typedef struct pnet_rtc_ctx
+{
+  pnet_t                  *net;
+  void                    (*tick_fn)(pnet_t *net, void *arg);
+  void                    *arg;
+} pnet_rtc_ctx_t;
+
+static void pnet_rtc_tick(
+  void                    *arg)
+{
+  pnet_rtc_ctx_t          *p_ctx = (pnet_rtc_ctx_t *)arg;
+
+  if (p_ctx->tick_fn != NULL)
+  {
+    p_ctx->tick_fn(p_ctx->net, p_ctx->arg);
+  }
+  pnet_handle_periodic(p_ctx->net);
+}
+
+static void pnet_rtc_udp_ready(
+  void                    *arg)
+{
+  pnet_rtc_ctx_t          *p_ctx = (pnet_rtc_ctx_t *)arg;
+
+  (void)pf_cmrpc_handle_ready(p_ctx->net, 0);
+}
+
+int pnet_run_to_completion(
+  pnet_t                  *net,
+  int                     cpu,
+  void                    (*tick_fn)(pnet_t *net, void *arg),
+  void                    *arg,
+  volatile bool           *p_running)
+{
+  pnet_rtc_ctx_t          ctx;
+  os_rtc_cfg_t            cfg;
+
+  ctx.net = net;
+  ctx.tick_fn = tick_fn;
+  ctx.arg = arg;
+
+  cfg.eth_handle = net->eth_handle;
+  cfg.udp_poll_id = net->cmrpc_poll;
+  cfg.tick_us = net->scheduler_tick_interval;
+  cfg.cpu = cpu;
+  cfg.tick = pnet_rtc_tick;
+  cfg.udp_ready = pnet_rtc_udp_ready;
+  cfg.arg = &ctx;
+  cfg.p_running = p_running;
+
+  return os_run_to_completion(&cfg);
+}
+
+int pnet_trace_dump(
+  uint8_t                 *p_buffer,
+  uint32_t                size)
+{
+  return pf_trace_dump(p_buffer, size);
 }
 
 void pnet_show(
@@ -111,6 +190,40 @@ void pnet_show(
     pf_cmdev_show_device(net);
     pf_cmrpc_show(net, level);
 
+    if (level & 0x0400)
+    {
+      os_buf_stats_t send_stats;
+      os_buf_stats_t recv_stats;
+
+      os_buf_get_stats(&send_stats, &recv_stats);
+      printf("\nBuffer pools        size   used   high   fallback\n");
+      printf("   send            %4u   %4u   %4u   %u\n", (unsigned)send_stats.size, (unsigned)send_stats.used,
+             (unsigned)send_stats.high_water, (unsigned)send_stats.fallback);
+      printf("   recv            %4u   %4u   %4u   %u\n", (unsigned)recv_stats.size, (unsigned)recv_stats.used,
+             (unsigned)recv_stats.high_water, (unsigned)recv_stats.fallback);
+
+      os_mem_stats_t mem_stats;
+
+      os_mem_get_stats(&mem_stats);
+      printf("\nAllocator (%s)\n", mem_stats.p_backend);
+      printf("   alloc           %u\n", (unsigned)mem_stats.n_alloc);
+      printf("   free            %u\n", (unsigned)mem_stats.n_free);
+      printf("   alloc avg/max   %u / %u ns\n",
+             (mem_stats.n_alloc > 0) ? (unsigned)(mem_stats.alloc_ns_total / mem_stats.n_alloc) : 0U,
+             (unsigned)mem_stats.alloc_ns_max);
+      printf("   free max        %u ns\n", (unsigned)mem_stats.free_ns_max);
+
+      os_log_stats_t log_stats;
+
+      os_log_get_stats(&log_stats);
+      printf("\nLog\n");
+      printf("   queued          %u\n", (unsigned)log_stats.n_logged);
+      printf("   dropped         %u\n", (unsigned)log_stats.n_dropped);
+      printf("   direct          %u\n", (unsigned)log_stats.n_sync);
+
+      printf("\n");
+      pf_arena_show(net);
+    }
     if (level & 0x2000)
     {
       printf("\n");
@@ -149,6 +262,18 @@ void pnet_create_log_book_entry(
   pf_fspm_create_log_book_entry(net, arep, p_pnio_status, entry_detail);
 }
 
+void pnet_input_batch_begin(
+  pnet_t                  *net)
+{
+  pf_ppm_batch_begin(net);
+}
+
+void pnet_input_batch_end(
+  pnet_t                  *net)
+{
+  pf_ppm_batch_end(net);
+}
+
 int pnet_input_set_data_and_iops(
   pnet_t                  *net,
   uint32_t                api,
@@ -163,6 +288,47 @@ int pnet_input_set_data_and_iops(
   return pf_ppm_set_data_and_iops(net, api, slot, subslot, p_data, data_len, &iops, iops_len);
 }
 
+void pnet_subslot_handle_init(
+  pnet_t                  *net,
+  uint32_t                api,
+  uint16_t                slot,
+  uint16_t                subslot,
+  pnet_subslot_handle_t   *p_handle)
+{
+  pf_subslot_handle_t     *p_sub = (pf_subslot_handle_t *)p_handle;
+
+  CC_STATIC_ASSERT(sizeof(pf_subslot_handle_t) <= sizeof(pnet_subslot_handle_t));
+  memset(p_handle, 0, sizeof(*p_handle));
+  p_sub->api = api;
+  p_sub->slot = slot;
+  p_sub->subslot = subslot;
+}
+
+int pnet_input_set_data_and_iops_by_handle(
+  pnet_t                  *net,
+  pnet_subslot_handle_t   *p_handle,
+  uint8_t                 *p_data,
+  uint16_t                data_len,
+  uint8_t                 iops)
+{
+  uint8_t                 iops_len = 1;
+
+  return pf_ppm_set_data_and_iops_by_handle(net, (pf_subslot_handle_t *)p_handle, p_data, data_len, &iops, iops_len);
+}
+
+int pnet_output_get_data_and_iops_by_handle(
+  pnet_t                  *net,
+  pnet_subslot_handle_t   *p_handle,
+  bool                    *p_new_flag,
+  uint8_t                 *p_data,
+  uint16_t                *p_data_len,
+  uint8_t                 *p_iops)
+{
+  uint8_t                 iops_len = 1;
+
+  return pf_cpm_get_data_and_iops_by_handle(net, (pf_subslot_handle_t *)p_handle, p_new_flag, p_data, p_data_len, p_iops, &iops_len);
+}
+
 int pnet_input_get_iocs(
   pnet_t                  *net,
   uint32_t                api,
@@ -202,6 +368,34 @@ int pnet_output_set_iocs(
   return pf_ppm_set_iocs(net, api, slot, subslot, &iocs, iocs_len);
 }
 
+int pnet_input_get_image_layout(
+  pnet_t                  *net,
+  uint32_t                api,
+  uint16_t                slot,
+  uint16_t                subslot,
+  pnet_input_image_layout_t *p_layout)
+{
+  return pf_ppm_get_image_layout(net, api, slot, subslot, p_layout);
+}
+
+int pnet_input_set_image(
+  pnet_t                  *net,
+  uint32_t                arep,
+  uint16_t                crep,
+  const uint8_t           *p_image,
+  uint16_t                image_length)
+{
+  int                     ret = -1;
+  pf_ar_t                 *p_ar = NULL;
+
+  if (pf_ar_find_by_arep(net, arep, &p_ar) == 0)
+  {
+    ret = pf_ppm_set_image(net, p_ar, crep, p_image, image_length);
+  }
+
+  return ret;
+}
+
 int pnet_plug_module(
   pnet_t                  *net,
   uint32_t                api,
@@ -251,7 +445,7 @@ int pnet_set_state(
   uint16_t                cr_ix;
   pf_ar_t                 *p_ar = NULL;
 
-  for (ar_ix = 0; ar_ix < PNET_MAX_AR; ar_ix++)
+  for (ar_ix = 0; ar_ix < net->max_ar; ar_ix++)
   {
     p_ar = pf_ar_find_by_index(net, ar_ix);
     if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -278,7 +472,7 @@ int pnet_set_redundancy_state(
   uint16_t                cr_ix;
   pf_ar_t                 *p_ar = NULL;
 
-  for (ar_ix = 0; ar_ix < PNET_MAX_AR; ar_ix++)
+  for (ar_ix = 0; ar_ix < net->max_ar; ar_ix++)
   {
     p_ar = pf_ar_find_by_index(net, ar_ix);
     if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -305,7 +499,7 @@ int pnet_set_provider_state(
   uint16_t                cr_ix;
   pf_ar_t                 *p_ar = NULL;
 
-  for (ar_ix = 0; ar_ix < PNET_MAX_AR; ar_ix++)
+  for (ar_ix = 0; ar_ix < net->max_ar; ar_ix++)
   {
     p_ar = pf_ar_find_by_index(net, ar_ix);
     if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -367,7 +561,7 @@ int pnet_factory_reset(
   pf_ar_t                 *p_ar = NULL;
 
   /* Look for active connections */
-  for (ix = 0; ix < PNET_MAX_AR; ix++)
+  for (ix = 0; ix < net->max_ar; ix++)
   {
     p_ar = pf_ar_find_by_index(net, ix);
     if ((p_ar != NULL) && (p_ar->in_use == true))
@@ -402,6 +596,45 @@ int pnet_get_ar_error_codes(
   return ret;
 }
 
+int pnet_get_iocr_statistics(
+  pnet_t                  *net,
+  uint32_t                arep,
+  uint32_t                crep,
+  pnet_iocr_statistics_t  *p_stats)
+{
+  int                     ret = -1;
+  pf_ar_t                 *p_ar = NULL;
+  pf_iocr_t               *p_iocr;
+
+  if ((pf_ar_find_by_arep(net, arep, &p_ar) == 0) &&
+      (crep < p_ar->nbr_iocrs))
+  {
+    p_iocr = &p_ar->iocrs[crep];
+
+    memset(p_stats, 0, sizeof(*p_stats));
+    p_stats->frame_id = p_iocr->param.frame_id;
+    p_stats->control_interval_us = ((uint32_t)p_iocr->param.send_clock_factor *
+                                    (uint32_t)p_iocr->param.reduction_ratio * 1000U) / 32U;
+    p_stats->ppm_send_cnt = p_iocr->ppm.trx_cnt;
+    p_stats->cpm_recv_cnt = p_iocr->cpm.recv_cnt;
+    p_stats->cpm_err_cnt = p_iocr->cpm.errcnt;
+    p_stats->ppm_send_deviation = p_iocr->ppm.send_deviation;
+    p_stats->ppm_send_exec = p_iocr->ppm.send_exec;
+    p_stats->cpm_inter_arrival = p_iocr->cpm.inter_arrival;
+
+    ret = 0;
+  }
+
+  return ret;
+}
+
+void pnet_get_footprint(
+  pnet_t                  *net,
+  pnet_footprint_t        *p_footprint)
+{
+  *p_footprint = net->footprint;
+}
+
 int pnet_alarm_send_process_alarm(
   pnet_t                  *net,
   uint32_t                arep,
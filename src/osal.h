@@ -134,9 +134,62 @@ void os_exit(void *arg);
 
 int os_snprintf (char * str, size_t size, const char * fmt, ...) CC_FORMAT (3,4);
 void os_log (int type, const char * fmt, ...) CC_FORMAT (2,3);
+
+/**
+ * Logging statistics, for os_log()
+ */
+typedef struct os_log_stats
+{
+  uint32_t    n_logged;       /* Nbr of messages queued for the log writer */
+  uint32_t    n_dropped;      /* Nbr of messages lost, as the queue was full */
+  uint32_t    n_sync;         /* Nbr of messages written by the caller itself */
+} os_log_stats_t;
+
+/**
+ * Get logging statistics, counted since start-up.
+ *
+ * @param p_stats       Out: The statistics.
+ */
+void os_log_get_stats(os_log_stats_t *p_stats);
+
+/**
+ * Write all messages queued by os_log() before returning.
+ */
+void os_log_flush(void);
 void * os_malloc (size_t size);
 void os_free(void *ptr);
 
+/**
+ * Allocator statistics, for os_malloc() and os_free()
+ */
+typedef struct os_mem_stats
+{
+  const char *p_backend;      /* Name of the allocator in use */
+  uint32_t    n_alloc;        /* Nbr of os_malloc() calls */
+  uint32_t    n_free;         /* Nbr of os_free() calls, NULL excluded */
+  uint64_t    alloc_ns_total; /* Total time spent in os_malloc() */
+  uint32_t    alloc_ns_max;   /* Longest os_malloc() call */
+  uint32_t    free_ns_max;    /* Longest os_free() call */
+} os_mem_stats_t;
+
+/**
+ * Get allocator statistics, counted since start-up or the last
+ * os_mem_reset_stats().
+ *
+ * The counters and times are only kept when built with USE_MEM_STATS, as
+ * they add two clock readings to each os_malloc() and os_free(). They are
+ * zero otherwise.
+ *
+ * @param p_stats       Out: The statistics.
+ */
+void os_mem_get_stats(os_mem_stats_t *p_stats);
+
+/**
+ * Reset the allocator statistics, e.g. when start-up is done, to measure
+ * the steady state.
+ */
+void os_mem_reset_stats(void);
+
 void os_usleep (uint32_t us);
 uint64_t os_get_current_time_us(void);
 uint64_t os_get_current_time_ns(void);
@@ -145,6 +198,70 @@ void os_get_current_timestamp(pf_log_book_ts_t *p_ts);
 os_thread_t * os_thread_create (const char * name, int priority,
         int stacksize, void * (*entry) (void * arg), void * arg);
 
+/** Scheduling policy, for os_rt_cfg_t */
+typedef enum os_sched_policy
+{
+  OS_SCHED_DEFAULT = 0,    /* SCHED_FIFO if built with USE_SCHED_FIFO, else inherited */
+  OS_SCHED_OTHER,
+  OS_SCHED_FIFO,
+  OS_SCHED_RR,
+} os_sched_policy_t;
+
+#define OS_RT_MAX_THREADS 8
+
+/**
+ * Scheduling of one thread, found by the name given to os_thread_create()
+ */
+typedef struct os_thread_cfg
+{
+  const char        *name;          /* e.g. "os_eth_pf_task". Must stay valid */
+  os_sched_policy_t  policy;        /* OS_SCHED_DEFAULT: os_rt_cfg_t.policy */
+  int                priority;      /* 0 keeps the priority given to os_thread_create() */
+  uint64_t           cpu_mask;      /* Bit n allows CPU n. 0: os_rt_cfg_t.cpu_mask */
+} os_thread_cfg_t;
+
+/**
+ * Real-time configuration of the threads created by os_thread_create()
+ */
+typedef struct os_rt_cfg
+{
+  os_sched_policy_t  policy;         /* Of threads created with priority > 0 */
+  uint64_t           cpu_mask;       /* CPUs of all threads, 0 any CPU */
+  bool               isolate;        /* Give the CPUs in threads[].cpu_mask to those threads only */
+  bool               lock_memory;    /* mlockall(MCL_CURRENT | MCL_FUTURE) */
+  uint32_t           stack_prefault; /* Stack bytes touched when a thread starts, 0 none */
+  uint16_t           nbr_threads;
+  os_thread_cfg_t    threads[OS_RT_MAX_THREADS];
+} os_rt_cfg_t;
+
+/**
+ * Configure scheduling, CPU affinity and memory locking.
+ *
+ * Applies to the threads created by os_thread_create() after the call. The
+ * calling thread is moved to os_rt_cfg_t.cpu_mask (less the isolated CPUs)
+ * and its stack is prefaulted. Call it before os_init() and pnet_init(),
+ * as these create the threads of the stack.
+ *
+ * @param p_cfg         In: Configuration. Copied.
+ * @return  0 if all of it was applied, -1 if some of it failed (logged).
+ */
+int os_rt_configure(const os_rt_cfg_t *p_cfg);
+
+/**
+ * Create a service thread that must not compete with the real-time threads.
+ *
+ * The thread is SCHED_OTHER whatever os_rt_cfg_t.policy, USE_SCHED_FIFO and
+ * the policy of the caller, unless its os_rt_cfg_t.threads[] entry sets one.
+ *
+ * @param name          In: Name of the thread.
+ * @param stacksize     In: Stack size in bytes.
+ * @param entry         In: Thread function.
+ * @param arg           In: Passed to entry().
+ * @return  the thread, or NULL on error.
+ */
+os_thread_t *os_thread_create_background(const char *name, int stacksize,
+                                         void *(*entry) (void *arg), void *arg);
+
 os_mutex_t * os_mutex_create (void);
 void os_mutex_lock (os_mutex_t * mutex);
 void os_mutex_unlock (os_mutex_t * mutex);
@@ -163,6 +280,16 @@ void os_event_destroy (os_event_t * event);
 
 os_mbox_t * os_mbox_create (size_t size);
 int os_mbox_fetch(os_mbox_t * mbox, void ** msg);
+
+/**
+ * Fetch a message, and wait for one to be posted if the mailbox is empty.
+ *
+ * @param mbox          In: The mailbox.
+ * @param msg           Out: The message.
+ * @param time_us       In: Max time to wait, or OS_WAIT_FOREVER.
+ * @return  0 if a message was fetched, 1 on timeout or error.
+ */
+int os_mbox_fetch_wait(os_mbox_t * mbox, void ** msg, uint32_t time_us);
 int os_mbox_post(os_mbox_t * mbox, void * msg);
 bool os_mbox_is_full(os_mbox_t * mbox);
 void os_mbox_destroy(os_mbox_t * mbox);
@@ -174,6 +301,25 @@ void os_timer_start (os_timer_t * timer);
 void os_timer_stop (os_timer_t * timer);
 void os_timer_destroy (os_timer_t * timer);
 
+/**
+ * Timer statistics, counted since the timer was created
+ */
+typedef struct os_timer_stats
+{
+  uint32_t n_expiries;     /* Nbr of callbacks */
+  uint32_t n_overruns;     /* Nbr of expiries that were missed, as the previous callback was late */
+  uint32_t jitter_ns_avg;  /* Average delay from expiry to callback */
+  uint32_t jitter_ns_max;  /* Longest delay from expiry to callback */
+} os_timer_stats_t;
+
+/**
+ * Get the wake-up statistics of a timer.
+ *
+ * @param timer         In: The timer.
+ * @param p_stats       Out: The statistics.
+ */
+void os_timer_get_stats (os_timer_t * timer, os_timer_stats_t * p_stats);
+
 #ifdef _DEBUG
 os_buf_t * os_buf_alloc_dbg(uint32_t length, const char *file, int line);
 os_buf_t *os_buf_alloc_with_wait_dbg(uint32_t length, const char *file, int line);
@@ -191,6 +337,38 @@ void os_buf_free(os_buf_t *p);
 
 uint8_t os_buf_header(os_buf_t *p, int16_t header_size_increment);
 
+/**
+ * Keep a received buffer after the reception callback has returned.
+ *
+ * A frame may be passed to the reception callback in memory that is reused
+ * once the callback returns (e.g. a memory mapped receive ring). Call this
+ * before storing a received buffer for later use.
+ *
+ * @param p             In: The received buffer. Freed if it is copied.
+ * @return  p, or a copy of it in a buffer of its own.
+ */
+os_buf_t *os_buf_keep(os_buf_t *p);
+
+/**
+ * Statistics of a buffer pool
+ */
+typedef struct os_buf_stats
+{
+  uint32_t size;          /* Nbr of buffers in the pool */
+  uint32_t used;          /* Nbr of buffers allocated right now */
+  uint32_t high_water;    /* Max nbr of buffers allocated at the same time */
+  uint32_t fallback;      /* Nbr of allocations made outside the pool, as it was empty */
+} os_buf_stats_t;
+
+/**
+ * Get statistics of the buffer pools used by os_buf_alloc() (send) and
+ * os_buf_alloc_with_wait() (receive).
+ *
+ * @param p_send        Out: Send pool statistics. May be NULL.
+ * @param p_recv        Out: Receive pool statistics. May be NULL.
+ */
+void os_buf_get_stats(os_buf_stats_t *p_send, os_buf_stats_t *p_recv);
+
 /**
  * Send raw Ethernet data
  *
@@ -202,6 +380,44 @@ int os_eth_send(
    os_eth_handle_t         *handle,
    os_buf_t                *buf);
 
+/**
+ * Queue raw Ethernet data for sending at the next os_eth_send_flush()
+ *
+ * Only a reference to the buffer is queued. The caller must leave the buffer
+ * untouched until it has been flushed. When the queue is full, the queued
+ * frames are sent before this frame is queued.
+ *
+ * @param handle        In: Ethernet handle
+ * @param buf           In: Buffer with data to be sent
+ * @return  The number of bytes queued, or -1 if an error occurred.
+ */
+int os_eth_send_queue(
+   os_eth_handle_t         *handle,
+   os_buf_t                *buf);
+
+/**
+ * Send all frames queued by os_eth_send_queue() with as few system calls
+ * as possible.
+ *
+ * @param handle        In: Ethernet handle
+ * @return  The number of frames sent, or -1 if some frame could not be sent.
+ */
+int os_eth_send_flush(
+   os_eth_handle_t         *handle);
+
+/**
+ * Pass all raw Ethernet frames that have arrived to the callback given to
+ * os_eth_init(), without blocking.
+ *
+ * Used by os_run_to_completion(). When built without USE_RUN_TO_COMPLETION
+ * the frames are read by separate threads, and this must not be called.
+ *
+ * @param handle        In: Ethernet handle
+ * @return  the number of frames handled, or -1 if an error occurred.
+ */
+int os_eth_poll(
+   os_eth_handle_t         *handle);
+
 /**
  * Initialize receiving of raw Ethernet frames (in separate thread)
  *
@@ -229,6 +445,118 @@ int os_udp_recvfrom(uint32_t id,
       int size);
 void os_udp_close(uint32_t id);
 
+/**
+ * One datagram of a batch, for os_udp_recvmmsg() and os_udp_sendmmsg()
+ */
+typedef struct os_udp_msg
+{
+  uint8_t      *data;     /* Payload buffer */
+  int           size;     /* Size of the buffer (recv), or payload length (send) */
+  int           len;      /* Received payload length */
+  os_ipaddr_t   addr;     /* Remote address, source (recv) or destination (send) */
+  os_ipport_t   port;     /* Remote port */
+} os_udp_msg_t;
+
+/**
+ * Receive all datagrams that are pending on a UDP socket, up to nbr_msgs,
+ * without blocking.
+ *
+ * @param id            In: UDP socket id
+ * @param p_msgs        InOut: Buffers in, datagrams out.
+ * @param nbr_msgs      In: Nbr of entries in p_msgs.
+ * @return  the number of datagrams received, 0 if none is pending, or -1
+ *          if an error occurred.
+ */
+int os_udp_recvmmsg(uint32_t id, os_udp_msg_t *p_msgs, int nbr_msgs);
+
+/**
+ * Send several datagrams on a UDP socket, with as few system calls as
+ * possible.
+ *
+ * @param id            In: UDP socket id
+ * @param p_msgs        In: The datagrams.
+ * @param nbr_msgs      In: Nbr of entries in p_msgs.
+ * @return  the number of datagrams sent, or -1 if an error occurred.
+ */
+int os_udp_sendmmsg(uint32_t id, const os_udp_msg_t *p_msgs, int nbr_msgs);
+
+/**
+ * Create a poll set, used to wait for incoming data on several UDP sockets
+ * at the same time.
+ *
+ * @return  the poll set id, or -1 if an error occurred.
+ */
+int os_udp_poll_create(void);
+
+/**
+ * Add a UDP socket to a poll set.
+ *
+ * @param poll_id       In: Poll set id
+ * @param id            In: UDP socket id, from os_udp_open()
+ * @return  0 on success, -1 if an error occurred.
+ */
+int os_udp_poll_add(int poll_id, uint32_t id);
+
+/**
+ * Remove a UDP socket from a poll set. Must be done before the socket is
+ * closed.
+ *
+ * @param poll_id       In: Poll set id
+ * @param id            In: UDP socket id
+ */
+void os_udp_poll_remove(int poll_id, uint32_t id);
+
+/**
+ * Wait until at least one UDP socket in the poll set has data to read.
+ *
+ * A timeout of 0 only checks which sockets are readable right now, and
+ * never blocks.
+ *
+ * @param poll_id       In: Poll set id
+ * @param p_ready       Out: The ids of the readable sockets.
+ * @param max_ready     In: Size of p_ready.
+ * @param timeout_us    In: Max time to wait, in microseconds.
+ * @return  the number of readable sockets, 0 on timeout or -1 on error.
+ */
+int os_udp_poll_wait(int poll_id, uint32_t *p_ready, int max_ready, uint32_t timeout_us);
+
+/**
+ * Destroy a poll set. The sockets in it are not closed.
+ *
+ * @param poll_id       In: Poll set id
+ */
+void os_udp_poll_destroy(int poll_id);
+
+
+/**
+ * Configuration of os_run_to_completion()
+ */
+typedef struct os_rtc_cfg
+{
+  os_eth_handle_t  *eth_handle;           /* Raw Ethernet sockets, see os_eth_init() */
+  int               udp_poll_id;          /* UDP poll set, or -1. See os_udp_poll_create() */
+  uint32_t          tick_us;              /* Interval between calls to tick() */
+  int               cpu;                  /* CPU to pin the calling thread to, or -1 */
+  void            (*tick)(void *arg);     /* Called once per tick */
+  void            (*udp_ready)(void *arg);  /* Called when a socket in the poll set has data */
+  void             *arg;                  /* Passed to tick() and udp_ready() */
+  volatile bool    *p_running;            /* The loop ends when this is false */
+} os_rtc_cfg_t;
+
+/**
+ * Run-to-completion loop.
+ *
+ * Waits in one epoll set for raw Ethernet frames, UDP datagrams and a
+ * periodic timerfd, and handles each event to completion in the calling
+ * thread: frames are passed to the os_eth_init() callback, then udp_ready()
+ * and tick() are called. No other thread is involved.
+ *
+ * Only available on Linux, built with USE_RUN_TO_COMPLETION.
+ *
+ * @param p_cfg         In: Configuration.
+ * @return  0 when *p_running has become false, -1 if an error occurred.
+ */
+int os_run_to_completion(const os_rtc_cfg_t *p_cfg);
 
 int os_get_ip_suite(
   os_ipaddr_t *p_ipaddr,
@@ -252,6 +580,181 @@ int os_set_station_name(
 // save the im1 - im3 data
 int os_save_im_data(pnet_t *net);
 
+/**
+ * Called by the persistence thread when a file has been saved.
+ *
+ * @param arg           In: os_persist_cfg_t.arg.
+ * @param p_file_name   In: The file.
+ * @param seq           In: Sequence number of the latest request included.
+ * @param result        In: 0 if the content is durable on disk, -1 if not.
+ */
+typedef void (*os_persist_cb_t)(void *arg, const char *p_file_name, uint32_t seq, int result);
+
+/**
+ * Configuration of the persistence service, see os_persist_init()
+ */
+typedef struct os_persist_cfg
+{
+  const char       *p_journal;    /* Write-ahead journal. NULL: PERSIST_JOURNAL_FILE_NAME */
+  uint32_t          coalesce_us;  /* Delay to merge a burst of requests. 0: default */
+  os_persist_cb_t   cb;           /* Durability callback, or NULL. Must not block */
+  void             *arg;          /* Passed to cb() */
+} os_persist_cfg_t;
+
+/**
+ * Persistence statistics, for os_persist_write()
+ */
+typedef struct os_persist_stats
+{
+  uint32_t    n_requests;     /* Nbr of os_persist_write() calls */
+  uint32_t    n_coalesced;    /* Nbr of requests replacing a pending one */
+  uint32_t    n_commits;      /* Nbr of batches committed */
+  uint32_t    n_journaled;    /* Nbr of batches written to the journal first */
+  uint32_t    n_unchanged;    /* Nbr of files not written, as already on disk */
+  uint32_t    n_written;      /* Nbr of files written */
+  uint32_t    n_errors;       /* Nbr of files that could not be written */
+  uint32_t    n_recovered;    /* Nbr of files replayed from the journal */
+  uint32_t    commit_us_max;  /* Longest commit of a batch */
+} os_persist_stats_t;
+
+/**
+ * Configure the persistence service, and replay the journal if a save was
+ * interrupted. Optional, the defaults are used on the first save. May be
+ * called again, e.g. to set the callback.
+ *
+ * @param p_cfg         In: Configuration, or NULL for the defaults.
+ * @return  0 if the journal could be opened, -1 if not. Files are then
+ *          still saved, but not a batch of them atomically.
+ */
+int os_persist_init(const os_persist_cfg_t *p_cfg);
+
+/**
+ * Save the content of a file, in the background.
+ *
+ * The data is copied and the call returns without any file access. The
+ * persistence thread merges the requests made within
+ * os_persist_cfg_t.coalesce_us, skips files that already have the content,
+ * and replaces the others atomically (via a journal, "<name>.tmp", fdatasync
+ * and rename). The result is reported to os_persist_cfg_t.cb.
+ *
+ * @param p_file_name   In: The file. Terminated.
+ * @param p_data        In: The new content of the file.
+ * @param size          In: Size of the content.
+ * @param p_seq         Out: Sequence number of the request, or NULL.
+ * @return  0 if queued, -1 if too large or too many files.
+ */
+int os_persist_write(const char *p_file_name, const void *p_data, size_t size, uint32_t *p_seq);
+
+/**
+ * Wait until all saves requested before the call are done.
+ *
+ * @param timeout_ms    In: Max time to wait.
+ * @return  0 if done, -1 on timeout.
+ */
+int os_persist_flush(uint32_t timeout_ms);
+
+/**
+ * Get persistence statistics, counted since start-up.
+ *
+ * @param p_stats       Out: The statistics.
+ */
+void os_persist_get_stats(os_persist_stats_t *p_stats);
+
+/* Metric of the default route set by os_netif_set_ip_suite() */
+#ifndef OS_NETIF_ROUTE_METRIC
+#define OS_NETIF_ROUTE_METRIC  1024
+#endif
+
+/**
+ * Completion of os_netif_set_ip_suite(), for os_netif_cb_t
+ */
+typedef struct os_netif_result
+{
+  uint32_t    seq;            /* Of the request */
+  int         result;         /* 0 if applied, -1 if not */
+  int         error;          /* errno if not applied */
+  uint32_t    queue_us;       /* From the request to the start */
+  uint32_t    apply_us;       /* Time spent in rtnetlink */
+} os_netif_result_t;
+
+/**
+ * Called by the interface configuration thread when a request is done.
+ * Must not block.
+ *
+ * @param arg           In: As given to os_netif_set_callback().
+ * @param p_result      In: Result and timing of the request.
+ */
+typedef void (*os_netif_cb_t)(void *arg, const os_netif_result_t *p_result);
+
+/**
+ * Interface configuration statistics, for os_netif_set_ip_suite()
+ */
+typedef struct os_netif_stats
+{
+  uint32_t    n_requests;     /* Nbr of os_netif_set_ip_suite() calls */
+  uint32_t    n_superseded;   /* Nbr of requests replaced before being started */
+  uint32_t    n_done;         /* Nbr of requests applied */
+  uint32_t    n_errors;       /* Nbr of requests that failed */
+  uint32_t    apply_us_last;  /* Time in rtnetlink of the last request */
+  uint32_t    apply_us_max;   /* Longest time in rtnetlink */
+} os_netif_stats_t;
+
+/**
+ * Start the interface configuration thread. Called by os_init(), and by
+ * os_netif_set_ip_suite() if not done.
+ */
+void os_netif_start(void);
+
+/**
+ * Set the completion callback of os_netif_set_ip_suite().
+ *
+ * @param cb            In: Callback, or NULL.
+ * @param arg           In: Passed to cb().
+ */
+void os_netif_set_callback(os_netif_cb_t cb, void *arg);
+
+/**
+ * Set the IPv4 address, netmask and default gateway of a network interface,
+ * in the background.
+ *
+ * The request is copied and the call returns. A SCHED_OTHER thread applies
+ * it via rtnetlink: the other IPv4 addresses of the interface are replaced
+ * by the new one. If a gateway is given, a default route via this interface
+ * with metric OS_NETIF_ROUTE_METRIC is set, else the one set before is
+ * deleted. The other default routes of the system are not changed.
+ * A request not yet started when a new one is made is skipped. The result
+ * is reported to the os_netif_set_callback() callback. Linux only.
+ *
+ * @param p_ifname      In: Interface name. Terminated.
+ * @param ipaddr        In: IP address.
+ * @param netmask       In: Netmask. Contiguous, not 0.
+ * @param gw            In: Default gateway. 0 or ipaddr for none.
+ * @param p_seq         Out: Sequence number of the request, or NULL.
+ * @return  0 if queued, -1 if the name or netmask is invalid.
+ */
+int os_netif_set_ip_suite(
+  const char  *p_ifname,
+  os_ipaddr_t ipaddr,
+  os_ipaddr_t netmask,
+  os_ipaddr_t gw,
+  uint32_t    *p_seq);
+
+/**
+ * Wait until all os_netif_set_ip_suite() requests made before the call
+ * are done.
+ *
+ * @param timeout_ms    In: Max time to wait.
+ * @return  0 if done, -1 on timeout.
+ */
+int os_netif_flush(uint32_t timeout_ms);
+
+/**
+ * Get interface configuration statistics, counted since start-up.
+ *
+ * @param p_stats       Out: The statistics.
+ */
+void os_netif_get_stats(os_netif_stats_t *p_stats);
+
 void os_set_led(
   void *arg,
   uint16_t                id,         /* Starting from 0 */
@@ -20,6 +20,8 @@
 #include <log.h>
 
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -30,7 +32,15 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <alloca.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <linux/futex.h>
 
 #include "utils.h"
 #include "config.h"
@@ -38,171 +48,439 @@
 #include "osal.h"
 #include "plc_memory.h"
 
-#define MEMORY_TYPE_FREE          0x0
-#define MEMORY_TYPE_STATIC_SEND   0x1
-#define MEMORY_TYPE_STATIC_RECV   0x2
-#define MEMORY_TYPE_MALLOC        0x4
+#if defined (USE_RPMALLOC)
+#include "rpmalloc.h"
+#endif
 
 #define USECS_PER_SEC     (1 * 1000 * 1000)
 #define NSECS_PER_SEC     (1 * 1000 * 1000 * 1000)
+#define OS_CACHE_LINE_SIZE   64
+#define OS_PERSIST_EXIT_TIMEOUT_MS  2000   /* Wait for pending saves at exit */
+#define OS_NETIF_EXIT_TIMEOUT_MS    1000   /* Wait for the IP address to be restored at exit */
 
 //////////////////////////////////////////////////////////////////////////
 // static functions prototypes
 // 
-static void log_sys_cmd(app_data_t *p_appdata, const char *cmd);
-static void set_ip_address_to_interface(app_data_t *p_appdata, uint32_t ipaddr);
+static void set_ip_address_to_interface(app_data_t *p_appdata, uint32_t ipaddr, uint32_t netmask, uint32_t gw);
+static void os_buf_pools_init(void);
+static void os_mem_init(void);
+static void os_log_init(void);
+static void os_persist_start(void);
 
 //////////////////////////////////////////////////////////////////////////
 // static variables
 // 
-static os_mutex_t *log_mutex;
-static os_mutex_t *pbuf_mutex;
 
 #define BUF_SIZE        2048
 
-#define MAX_SEND_BUFS   16
-static uint32_t send_memory_types[MAX_SEND_BUFS];  // MEMORY_TYPE_xxx
-static os_buf_t bufs_send[MAX_SEND_BUFS];
-static uint8_t  data_send[MAX_SEND_BUFS][BUF_SIZE]; //packet data
+/**
+ * Fixed size buffer pool.
+ *
+ * The free buffers are kept in a lock-free LIFO (Treiber) stack of buffer
+ * indexes. The head holds a tag in the upper 16 bits, which is incremented
+ * on every change, so a pop racing with a pop and push of the same buffer
+ * fails its compare-and-swap instead of corrupting the stack.
+ */
+typedef struct os_buf_pool
+{
+  atomic_uint      head;         /* Tag << 16 | index of first free buffer */
+  atomic_uint      n_used;
+  atomic_uint      high_water;
+  atomic_uint      n_fallback;   /* Allocations made with malloc when empty */
+  uint32_t         memory_type;  /* MEMORY_TYPE_STATIC_xxx */
+  uint32_t         size;
+  os_buf_t         *bufs;
+  uint8_t          (*data)[BUF_SIZE];
+  atomic_ushort    *next;        /* Next free buffer, per buffer */
+  atomic_uint      *state;       /* MEMORY_TYPE_xxx, per buffer */
+} os_buf_pool_t;
+
+#define BUF_POOL_NONE   0xFFFFU  /* Empty stack */
 
+#define MAX_SEND_BUFS   16
+static os_buf_t      bufs_send[MAX_SEND_BUFS];
+static uint8_t       data_send[MAX_SEND_BUFS][BUF_SIZE]; //packet data
+static atomic_ushort send_next[MAX_SEND_BUFS];
+static atomic_uint   send_state[MAX_SEND_BUFS];
+static os_buf_pool_t send_pool =
+{
+  .head = BUF_POOL_NONE,
+  .memory_type = MEMORY_TYPE_STATIC_SEND,
+  .size = MAX_SEND_BUFS,
+  .bufs = bufs_send,
+  .data = data_send,
+  .next = send_next,
+  .state = send_state,
+};
 
-// values are ordered by possible cache access
 #define MAX_RECV_BUFS   256
-static atomic_uint nRecvBuffersAllocated;
-static uint32_t last_freed_recv_buf_idx;
-static uint32_t recv_memory_types[MAX_RECV_BUFS];   // MEMORY_TYPE_xxx
-static os_buf_t bufs_recv[MAX_RECV_BUFS];           // buffers to be returned by osal
-static uint8_t  data_recv[MAX_RECV_BUFS][BUF_SIZE]; //packet data
+static os_buf_t      bufs_recv[MAX_RECV_BUFS];           // buffers to be returned by osal
+static uint8_t       data_recv[MAX_RECV_BUFS][BUF_SIZE]; //packet data
+static atomic_ushort recv_next[MAX_RECV_BUFS];
+static atomic_uint   recv_state[MAX_RECV_BUFS];
+static os_buf_pool_t recv_pool =
+{
+  .head = BUF_POOL_NONE,
+  .memory_type = MEMORY_TYPE_STATIC_RECV,
+  .size = MAX_RECV_BUFS,
+  .bufs = bufs_recv,
+  .data = data_recv,
+  .next = recv_next,
+  .state = recv_state,
+};
+
+static pthread_once_t buf_pool_once = PTHREAD_ONCE_INIT;
+
+static pthread_once_t     mem_once = PTHREAD_ONCE_INIT;
+
+#if defined (USE_MEM_STATS)
+/* Allocator statistics, see os_mem_get_stats() */
+static atomic_uint        mem_n_alloc;
+static atomic_uint        mem_n_free;
+static atomic_ullong      mem_alloc_ns_total;
+static atomic_uint        mem_alloc_ns_max;
+static atomic_uint        mem_free_ns_max;
+#endif
 
+/* Real-time configuration, see os_rt_configure() */
+static os_rt_cfg_t        rt_cfg;
 
-void os_log(int type, const char *fmt, ...)
+/*
+ * Logging.
+ *
+ * os_log() only formats the message into a ring owned by the calling
+ * thread. It takes no lock, makes no system call and does not allocate.
+ * A SCHED_OTHER writer thread drains all rings every OS_LOG_WRITER_PERIOD_US,
+ * in the order the messages were logged, adds the time stamps, and writes
+ * them to stdout and to LOG_FILE_NAME (kept open) with one flush per batch.
+ * A message that does not fit in a full ring is dropped and counted.
+ */
+#define OS_LOG_MAX_THREADS        16
+#define OS_LOG_RING_SIZE          256       /* Messages per thread, a connect at debug level. Power of two */
+#define OS_LOG_MSG_SIZE           512
+#define OS_LOG_WRITER_PERIOD_US   (20 * 1000)
+
+typedef struct os_log_msg
 {
-  char   timestamp[16];
-  char   info[1024];
-  char   time_info[128];
-  size_t info_len;
-  time_t rawtime;
-  struct tm *timestruct;
+  uint32_t      seq;                    /* Global order of the messages */
+  int           type;
+  time_t        time;
+  char          text[OS_LOG_MSG_SIZE];
+} os_log_msg_t;
 
-  time(&rawtime);
-  timestruct = localtime(&rawtime);
-  strftime(timestamp, sizeof(timestamp), "%H:%M:%S", timestruct);
+typedef struct os_log_ring
+{
+  atomic_uint   tail;                   /* Written by the owner thread */
+  uint8_t       pad_tail[OS_CACHE_LINE_SIZE - sizeof(atomic_uint)];
+  atomic_uint   head;                   /* Written by the writer thread */
+  uint8_t       pad_head[OS_CACHE_LINE_SIZE - sizeof(atomic_uint)];
+  atomic_uint   n_dropped;
+  atomic_bool   in_use;                 /* Owned by a thread */
+  atomic_bool   owner_gone;             /* Owner has exited, free when drained */
+  os_log_msg_t  msgs[OS_LOG_RING_SIZE];
+} os_log_ring_t;
+
+static pthread_mutex_t        log_mutex = PTHREAD_MUTEX_INITIALIZER;  /* For os_log_write_sync() */
+static pthread_once_t         log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t          log_key;
+static __thread os_log_ring_t *log_ring;
+static os_log_ring_t          log_rings[OS_LOG_MAX_THREADS];
+static atomic_uint            log_seq;
+static atomic_uint            log_n_logged;
+static atomic_uint            log_n_sync;         /* Written directly, as no ring was free */
+static uint32_t               log_n_dropped_reported;
+static os_thread_t            *log_thread;
+static FILE                   *log_fp;
+
+/**
+ * @internal
+ * Write one message to stdout and, if enabled, to the log file.
+ */
+static void os_log_output(int type, time_t rawtime, const char *text)
+{
+  char        timestamp[16];
+  const char *level = NULL;
+  const char *color = NULL;
+  struct tm   timestruct;
 
-  va_list list;
+  localtime_r(&rawtime, &timestruct);
+  strftime(timestamp, sizeof(timestamp), "%H:%M:%S", &timestruct);
 
   switch (LOG_LEVEL_GET(type))
   {
   case LOG_LEVEL_DEBUG:
-    snprintf(time_info, sizeof(time_info) - 1, "%s [DEBUG] ", timestamp);
+    level = "DEBUG";
+    color = "";
     break;
   case LOG_LEVEL_INFO:
-    snprintf(time_info, sizeof(time_info) - 1, "%s [" ANSI_COLOR_GREEN "INFO " ANSI_COLOR_RESET "] ", timestamp);
+    level = "INFO ";
+    color = ANSI_COLOR_GREEN;
     break;
   case LOG_LEVEL_WARNING:
-    snprintf(time_info, sizeof(time_info) - 1, "%s [" ANSI_COLOR_MAGENTA "WARN " ANSI_COLOR_RESET "] ", timestamp);
+    level = "WARN ";
+    color = ANSI_COLOR_MAGENTA;
     break;
   case LOG_LEVEL_ERROR:
-    snprintf(time_info, sizeof(time_info) - 1, "%s [" ANSI_COLOR_RED "ERROR" ANSI_COLOR_RESET "] ", timestamp);
+    level = "ERROR";
+    color = ANSI_COLOR_RED;
     break;
-  default: 
-    time_info[0] = '\0';
+  default:
     break;
   }
 
-  va_start(list, fmt);
-  info_len = vsnprintf(info, sizeof(info)-1, fmt, list);
-  va_end(list);
-
-  os_mutex_lock(log_mutex);
-  fputs(time_info, stdout);
-  if(info_len > 0)
+  if (level != NULL)
   {
-    fputs(info, stdout);
+    fprintf(stdout, "%s [%s%s%s] ", timestamp, color, level, (color[0] != '\0') ? ANSI_COLOR_RESET : "");
   }
-  fflush(stdout);
-  os_mutex_unlock(log_mutex);
+  fputs(text, stdout);
 
-  if(log_to_file)
+  if (log_to_file)
   {
-    FILE *fp = fopen(LOG_FILE_NAME, "at");
-    if (fp != NULL)
+    if (log_fp == NULL)
     {
-      size_t time_info_len;
-      switch (LOG_LEVEL_GET(type))
+      log_fp = fopen(LOG_FILE_NAME, "at");
+    }
+    if (log_fp != NULL)
+    {
+      if (level != NULL)
       {
-      case LOG_LEVEL_DEBUG:
-        time_info_len = snprintf(time_info, sizeof(time_info) - 1, "%s [DEBUG] ", timestamp);
-        break;
-      case LOG_LEVEL_INFO:
-        time_info_len = snprintf(time_info, sizeof(time_info) - 1, "%s [INFO ] ", timestamp);
-        break;
-      case LOG_LEVEL_WARNING:
-        time_info_len = snprintf(time_info, sizeof(time_info) - 1, "%s [WARN ] ", timestamp);
-        break;
-      case LOG_LEVEL_ERROR:
-        time_info_len = snprintf(time_info, sizeof(time_info) - 1, "%s [ERROR] ", timestamp);
-        break;
-      default:
-        time_info[0] = '\0';
-        time_info_len = 0;
-        break;
+        fprintf(log_fp, "%s [%s] ", timestamp, level);
       }
-      if (time_info_len > 0)
+      fputs(text, log_fp);
+    }
+  }
+}
+
+static void os_log_flush_streams(void)
+{
+  fflush(stdout);
+  if (log_fp != NULL)
+  {
+    fflush(log_fp);
+  }
+}
+
+/**
+ * @internal
+ * Write a message right away. Used when the calling thread has no ring.
+ */
+static void os_log_write_sync(int type, const char *fmt, va_list list)
+{
+  char info[OS_LOG_MSG_SIZE];
+
+  vsnprintf(info, sizeof(info), fmt, list);
+  pthread_mutex_lock(&log_mutex);
+  os_log_output(type, time(NULL), info);
+  os_log_flush_streams();
+  pthread_mutex_unlock(&log_mutex);
+  atomic_fetch_add(&log_n_sync, 1);
+}
+
+/**
+ * @internal
+ * Write all messages in the rings, oldest first.
+ *
+ * @return  the number of messages written.
+ */
+static uint32_t os_log_drain(void)
+{
+  os_log_ring_t *ring;
+  os_log_ring_t *oldest;
+  os_log_msg_t  *msg;
+  uint32_t       n = 0;
+  uint32_t       n_dropped = 0;
+  uint32_t       ix;
+
+  pthread_mutex_lock(&log_mutex);
+  for (;;)
+  {
+    /* Merge the rings by the global sequence number */
+    oldest = NULL;
+    for (ix = 0; ix < OS_LOG_MAX_THREADS; ix++)
+    {
+      ring = &log_rings[ix];
+      if (atomic_load_explicit(&ring->head, memory_order_relaxed) !=
+          atomic_load_explicit(&ring->tail, memory_order_acquire))
       {
-        fwrite(time_info, time_info_len, 1, fp);
+        msg = &ring->msgs[atomic_load_explicit(&ring->head, memory_order_relaxed) & (OS_LOG_RING_SIZE - 1)];
+        if ((oldest == NULL) ||
+            ((int32_t)(msg->seq - oldest->msgs[atomic_load_explicit(&oldest->head, memory_order_relaxed) & (OS_LOG_RING_SIZE - 1)].seq) < 0))
+        {
+          oldest = ring;
+        }
       }
-      if (info_len > 0)
+    }
+    if (oldest == NULL)
+    {
+      break;
+    }
+
+    msg = &oldest->msgs[atomic_load_explicit(&oldest->head, memory_order_relaxed) & (OS_LOG_RING_SIZE - 1)];
+    os_log_output(msg->type, msg->time, msg->text);
+    atomic_fetch_add_explicit(&oldest->head, 1, memory_order_release);
+    n++;
+  }
+
+  for (ix = 0; ix < OS_LOG_MAX_THREADS; ix++)
+  {
+    ring = &log_rings[ix];
+    n_dropped += atomic_load(&ring->n_dropped);
+    if (atomic_load(&ring->owner_gone) &&
+        (atomic_load(&ring->head) == atomic_load(&ring->tail)))
+    {
+      atomic_store(&ring->owner_gone, false);
+      atomic_store(&ring->in_use, false);
+    }
+  }
+  if (n_dropped != log_n_dropped_reported)
+  {
+    fprintf(stdout, "[WARN ] os_log: %u messages dropped, log ring full\n",
+            (unsigned)(n_dropped - log_n_dropped_reported));
+    log_n_dropped_reported = n_dropped;
+  }
+
+  if (n > 0)
+  {
+    os_log_flush_streams();
+  }
+  pthread_mutex_unlock(&log_mutex);
+
+  return n;
+}
+
+static void *os_log_writer_thread(void *arg)
+{
+  (void)arg;
+  for (;;)
+  {
+    (void)os_log_drain();
+    os_usleep(OS_LOG_WRITER_PERIOD_US);
+  }
+
+  return NULL;
+}
+
+/**
+ * @internal
+ * Called at thread exit, via log_key. The ring is freed by the writer
+ * once it has been drained.
+ */
+static void os_log_thread_exit(void *arg)
+{
+  os_log_ring_t *ring = (os_log_ring_t *)arg;
+
+  atomic_store(&ring->owner_gone, true);
+}
+
+static void os_log_init(void)
+{
+  pthread_key_create(&log_key, os_log_thread_exit);
+  log_thread = os_thread_create_background("os_log", 16 * 1024, os_log_writer_thread, NULL);
+}
+
+/**
+ * @internal
+ * Get the ring of the calling thread. Claimed on the first call.
+ *
+ * @return  the ring, or NULL if all rings are taken.
+ */
+static os_log_ring_t *os_log_get_ring(void)
+{
+  bool     expected;
+  uint32_t ix;
+
+  if (log_ring == NULL)
+  {
+    pthread_once(&log_once, os_log_init);
+    if (log_thread == NULL)
+    {
+      return NULL;
+    }
+    for (ix = 0; ix < OS_LOG_MAX_THREADS; ix++)
+    {
+      expected = false;
+      if (atomic_compare_exchange_strong(&log_rings[ix].in_use, &expected, true))
       {
-        fwrite(info, info_len, 1, fp);
+        log_ring = &log_rings[ix];
+        pthread_setspecific(log_key, log_ring);
+        break;
       }
-      fclose(fp);
     }
   }
+
+  return log_ring;
 }
 
-void os_init(void *arg)
+void os_log(int type, const char *fmt, ...)
 {
-  app_data_t *p_appdata = (app_data_t *)arg;
+  os_log_ring_t *ring = os_log_get_ring();
+  os_log_msg_t  *msg;
+  uint32_t       tail;
+  va_list        list;
 
-  if (p_appdata->arguments.use_led != 0)
+  va_start(list, fmt);
+  if (ring == NULL)
   {
-    int i2c_file = open_led();
-    if ((i2c_file < 0) && (p_appdata->arguments.verbosity > 0))
+    os_log_write_sync(type, fmt, list);
+  }
+  else
+  {
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) >= OS_LOG_RING_SIZE)
     {
-      os_log(LOG_LEVEL_ERROR, "Could not open LED: %s\r\n", strerror(errno));
+      atomic_fetch_add_explicit(&ring->n_dropped, 1, memory_order_relaxed);
+    }
+    else
+    {
+      msg = &ring->msgs[tail & (OS_LOG_RING_SIZE - 1)];
+      msg->seq = atomic_fetch_add_explicit(&log_seq, 1, memory_order_relaxed);
+      msg->type = type;
+      msg->time = time(NULL);
+      vsnprintf(msg->text, sizeof(msg->text), fmt, list);
+      atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+      atomic_fetch_add_explicit(&log_n_logged, 1, memory_order_relaxed);
     }
-    p_appdata->i2c_file = i2c_file;
   }
+  va_end(list);
+}
 
-  memset(bufs_send, 0, sizeof(bufs_send));
-  memset(send_memory_types, 0, sizeof(send_memory_types));
-  memset(data_send, 0, sizeof(data_send));
+void os_log_flush(void)
+{
+  (void)os_log_drain();
+}
 
-  memset(bufs_recv, 0, sizeof(bufs_recv));
-  memset(recv_memory_types, 0, sizeof(send_memory_types));
-  memset(data_recv, 0, sizeof(data_recv));
+void os_log_get_stats(os_log_stats_t *p_stats)
+{
+  uint32_t ix;
 
-  size_t i;
-  for (i = 0; i < NELEMENTS(bufs_send); i++)
+  p_stats->n_logged = atomic_load(&log_n_logged);
+  p_stats->n_sync = atomic_load(&log_n_sync);
+  p_stats->n_dropped = 0;
+  for (ix = 0; ix < OS_LOG_MAX_THREADS; ix++)
   {
-    bufs_send[i].payload = data_send[i];
-    bufs_send[i].ptr_to_memory_type = &(send_memory_types[i]);
-    // caching is not used for send buffers
-    bufs_send[i].idx_to_static_buf = UINT32_MAX;
+    p_stats->n_dropped += atomic_load(&log_rings[ix].n_dropped);
   }
-  for (i = 0; i < NELEMENTS(bufs_recv); i++)
+}
+
+void os_init(void *arg)
+{
+  app_data_t *p_appdata = (app_data_t *)arg;
+
+  if (p_appdata->arguments.use_led != 0)
   {
-    bufs_recv[i].payload = data_recv[i];
-    bufs_recv[i].ptr_to_memory_type = &(recv_memory_types[i]);
-    // index used for caching
-    bufs_recv[i].idx_to_static_buf = i;
+    int i2c_file = open_led();
+    if ((i2c_file < 0) && (p_appdata->arguments.verbosity > 0))
+    {
+      os_log(LOG_LEVEL_ERROR, "Could not open LED: %s\r\n", strerror(errno));
+    }
+    p_appdata->i2c_file = i2c_file;
   }
 
-  last_freed_recv_buf_idx = 0;
-  nRecvBuffersAllocated = ATOMIC_VAR_INIT(0);
-
-  log_mutex = os_mutex_create();
-  pbuf_mutex = os_mutex_create();
+  pthread_once(&mem_once, os_mem_init);
+  pthread_once(&buf_pool_once, os_buf_pools_init);
+  pthread_once(&log_once, os_log_init);
+  os_persist_start();
+  os_netif_start();
 }
 
 void os_exit(void *arg)
@@ -213,17 +491,69 @@ void os_exit(void *arg)
     close_led(p_appdata->i2c_file);
   }
   p_appdata->i2c_file = 0;
-  set_ip_address_to_interface(p_appdata, __builtin_bswap32(p_appdata->def_ip));
+  /* No gateway: the default route set by the stack is deleted, the others were not changed */
+  set_ip_address_to_interface(p_appdata, __builtin_bswap32(p_appdata->def_ip), __builtin_bswap32(p_appdata->def_netmask), 0);
   //remove_last_added_ip_address_from_interface(p_appdata);
-  os_mutex_destroy(log_mutex);
-  log_mutex = NULL;
-  os_mutex_destroy(pbuf_mutex);
-  pbuf_mutex = NULL;
+  if (os_netif_flush(OS_NETIF_EXIT_TIMEOUT_MS) != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "os_exit: IP address not restored within %u ms\n", OS_NETIF_EXIT_TIMEOUT_MS);
+  }
+  if (os_persist_flush(OS_PERSIST_EXIT_TIMEOUT_MS) != 0)
+  {
+    os_log(LOG_LEVEL_ERROR, "os_exit: settings not saved within %u ms\n", OS_PERSIST_EXIT_TIMEOUT_MS);
+  }
+  os_log_flush();
+}
+
+/**
+ * @internal
+ * Initialize the allocator. Run once, by pthread_once().
+ */
+static void os_mem_init(void)
+{
+#if defined (USE_RPMALLOC)
+  rpmalloc_initialize();
+#endif
+}
+
+#if defined (USE_MEM_STATS)
+/**
+ * @internal
+ * Raise a maximum value, without locking.
+ * @param p_max         InOut: The maximum.
+ * @param value         In:   The new value.
+ */
+static void os_mem_update_max(atomic_uint *p_max, uint32_t value)
+{
+  uint32_t old_max = atomic_load_explicit(p_max, memory_order_relaxed);
+
+  while ((value > old_max) &&
+         !atomic_compare_exchange_weak_explicit(p_max, &old_max, value,
+                                                memory_order_relaxed, memory_order_relaxed))
+  {
+  }
 }
+#endif /* USE_MEM_STATS */
 
 void *os_malloc(size_t size)
 {
-  void *ptr = malloc(size);
+#if defined (USE_MEM_STATS)
+  uint64_t start = os_get_current_time_ns();
+  uint32_t elapsed;
+#endif
+  void *ptr;
+
+#if defined (USE_RPMALLOC)
+  pthread_once(&mem_once, os_mem_init);
+  if (rpmalloc_is_thread_initialized() == 0)
+  {
+    /* A thread not created by os_thread_create() */
+    rpmalloc_thread_initialize();
+  }
+  ptr = rpmalloc(size);
+#else
+  ptr = malloc(size);
+#endif
   if(ptr == NULL)
   {
     os_log(LOG_LEVEL_ERROR,
@@ -231,44 +561,301 @@ void *os_malloc(size_t size)
            size);
     exit(EXIT_CODE_ERROR);
   }
+
+#if defined (USE_MEM_STATS)
+  elapsed = (uint32_t)(os_get_current_time_ns() - start);
+  atomic_fetch_add_explicit(&mem_n_alloc, 1U, memory_order_relaxed);
+  atomic_fetch_add_explicit(&mem_alloc_ns_total, elapsed, memory_order_relaxed);
+  os_mem_update_max(&mem_alloc_ns_max, elapsed);
+#endif
   return ptr;
 }
 
 void os_free(void *ptr)
 {
+#if defined (USE_MEM_STATS)
+  uint64_t start;
+#endif
+
+  if (ptr == NULL)
+  {
+    return;
+  }
+
+#if defined (USE_MEM_STATS)
+  start = os_get_current_time_ns();
+#endif
+#if defined (USE_RPMALLOC)
+  rpfree(ptr);
+#else
   free(ptr);
+#endif
+#if defined (USE_MEM_STATS)
+  atomic_fetch_add_explicit(&mem_n_free, 1U, memory_order_relaxed);
+  os_mem_update_max(&mem_free_ns_max, (uint32_t)(os_get_current_time_ns() - start));
+#endif
 }
 
-os_thread_t *os_thread_create(const char *name, int priority,
-                              int stacksize, void *(*entry) (void *arg), void *arg)
+void os_mem_get_stats(os_mem_stats_t *p_stats)
+{
+  memset(p_stats, 0, sizeof(*p_stats));
+#if defined (USE_RPMALLOC)
+  p_stats->p_backend = "rpmalloc";
+#else
+  p_stats->p_backend = "malloc";
+#endif
+#if defined (USE_MEM_STATS)
+  p_stats->n_alloc = atomic_load(&mem_n_alloc);
+  p_stats->n_free = atomic_load(&mem_n_free);
+  p_stats->alloc_ns_total = atomic_load(&mem_alloc_ns_total);
+  p_stats->alloc_ns_max = atomic_load(&mem_alloc_ns_max);
+  p_stats->free_ns_max = atomic_load(&mem_free_ns_max);
+#endif
+}
+
+void os_mem_reset_stats(void)
+{
+#if defined (USE_MEM_STATS)
+  atomic_store(&mem_n_alloc, 0);
+  atomic_store(&mem_n_free, 0);
+  atomic_store(&mem_alloc_ns_total, 0);
+  atomic_store(&mem_alloc_ns_max, 0);
+  atomic_store(&mem_free_ns_max, 0);
+#endif
+}
+
+/** Thread entry and argument, passed through os_thread_entry() */
+typedef struct os_thread_start
+{
+  void *(*entry) (void *arg);
+  void *arg;
+  size_t prefault;                /* Stack bytes to touch before entry() */
+} os_thread_start_t;
+
+/**
+ * @internal
+ * Touch the pages of the stack below the caller, so that the thread does not
+ * take page faults when the stack grows in the cyclic path.
+ *
+ * @param size           In: Bytes to touch.
+ */
+static void __attribute__((noinline)) os_stack_prefault(size_t size)
+{
+  volatile uint8_t *p = alloca(size);
+  size_t            page = (size_t)sysconf(_SC_PAGESIZE);
+
+  for (size_t pos = 0; pos < size; pos += page)
+  {
+    p[pos] = 0;
+  }
+}
+
+/**
+ * @internal
+ * Prefault the stack and give the new thread its own rpmalloc heap before
+ * it runs, and release the heap when it is done.
+ *
+ * @param thread_arg     In: Will be converted to os_thread_start_t
+ * @return  the return value of the thread entry function.
+ */
+static void *os_thread_entry(void *thread_arg)
+{
+  os_thread_start_t start = *(os_thread_start_t *)thread_arg;
+  void *ret;
+
+#if defined (USE_RPMALLOC)
+  rpmalloc_thread_initialize();
+#endif
+  os_free(thread_arg);
+  if (start.prefault > 0)
+  {
+    os_stack_prefault(start.prefault);
+  }
+
+  ret = start.entry(start.arg);
+
+#if defined (USE_RPMALLOC)
+  rpmalloc_thread_finalize();
+#endif
+  return ret;
+}
+
+/**
+ * @internal
+ * Convert a CPU mask of os_rt_cfg_t.
+ *
+ * @param mask           In: Bit n allows CPU n.
+ * @param p_set          Out: The CPU set.
+ */
+static void os_cpu_mask_to_set(uint64_t mask, cpu_set_t *p_set)
+{
+  CPU_ZERO(p_set);
+  for (int cpu = 0; cpu < 64; cpu++)
+  {
+    if ((mask & (1ULL << cpu)) != 0)
+    {
+      CPU_SET(cpu, p_set);
+    }
+  }
+}
+
+/**
+ * @internal
+ * The CPUs of the threads not in os_rt_cfg_t.threads[], or of those that
+ * do not have CPUs of their own.
+ *
+ * @return  the mask, 0 if any CPU.
+ */
+static uint64_t os_rt_default_cpu_mask(void)
+{
+  uint64_t mask = rt_cfg.cpu_mask;
+  uint64_t isolated = 0;
+
+  if (rt_cfg.isolate)
+  {
+    for (uint16_t ix = 0; ix < rt_cfg.nbr_threads; ix++)
+    {
+      isolated |= rt_cfg.threads[ix].cpu_mask;
+    }
+    if (mask == 0)
+    {
+      long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      mask = (n_cpus >= 64) ? UINT64_MAX : ((1ULL << n_cpus) - 1);
+    }
+    mask &= ~isolated;
+  }
+  return mask;
+}
+
+int os_rt_configure(const os_rt_cfg_t *p_cfg)
+{
+  int       ret = 0;
+  uint64_t  mask;
+  cpu_set_t cpuset;
+
+  if (p_cfg->nbr_threads > OS_RT_MAX_THREADS)
+  {
+    os_log(LOG_LEVEL_ERROR, "[ERROR] os_rt_configure: at most %u threads\n", OS_RT_MAX_THREADS);
+    return -1;
+  }
+  rt_cfg = *p_cfg;
+
+  mask = os_rt_default_cpu_mask();
+  if (mask != 0)
+  {
+    os_cpu_mask_to_set(mask, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0)
+    {
+      os_log(LOG_LEVEL_ERROR, "[ERROR] os_rt_configure: could not use CPUs 0x%llx\n", (unsigned long long)mask);
+      ret = -1;
+    }
+  }
+  if (p_cfg->lock_memory && (mlockall(MCL_CURRENT | MCL_FUTURE) != 0))
+  {
+    os_log(LOG_LEVEL_ERROR, "[ERROR] os_rt_configure: mlockall failed: %s\n", strerror(errno));
+    ret = -1;
+  }
+  if (p_cfg->stack_prefault > 0)
+  {
+    os_stack_prefault(p_cfg->stack_prefault);
+  }
+  return ret;
+}
+
+/**
+ * @internal
+ * Create a thread.
+ *
+ * @param name          In: Name, also used to find its os_rt_cfg_t.threads[] entry.
+ * @param policy        In: Policy, unless set by the os_rt_cfg_t.threads[] entry.
+ * @param priority      In: Priority, unless set by the os_rt_cfg_t.threads[] entry.
+ * @param stacksize     In: Stack size in bytes, in addition to PTHREAD_STACK_MIN.
+ * @param entry         In: Thread function.
+ * @param arg           In: Passed to entry().
+ * @return  the thread, or NULL on error.
+ */
+static os_thread_t *os_thread_create_policy(const char *name, os_sched_policy_t policy,
+                                            int priority, int stacksize,
+                                            void *(*entry) (void *arg), void *arg)
 {
   int result;
   pthread_t *thread = os_malloc(sizeof(*thread));
   pthread_attr_t attr;
+  uint64_t cpu_mask = os_rt_default_cpu_mask();
+  cpu_set_t cpuset;
 
   pthread_attr_init(&attr);
   pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN + stacksize);
 
+  for (uint16_t ix = 0; ix < rt_cfg.nbr_threads; ix++)
+  {
+    const os_thread_cfg_t *p_thread = &rt_cfg.threads[ix];
+    if ((p_thread->name != NULL) && (strcmp(p_thread->name, name) == 0))
+    {
+      policy = (p_thread->policy != OS_SCHED_DEFAULT) ? p_thread->policy : policy;
+      priority = (p_thread->priority != 0) ? p_thread->priority : priority;
+      cpu_mask = (p_thread->cpu_mask != 0) ? p_thread->cpu_mask : cpu_mask;
+      break;
+    }
+  }
+
 #if defined (USE_SCHED_FIFO)
-  if(priority > 0)
+  if (policy == OS_SCHED_DEFAULT)
+  {
+    policy = OS_SCHED_FIFO;
+  }
+#endif
+  if (((policy == OS_SCHED_FIFO) || (policy == OS_SCHED_RR)) && (priority > 0))
   {
     CC_STATIC_ASSERT(_POSIX_THREAD_PRIORITY_SCHEDULING > 0);
     struct sched_param param = { .sched_priority = priority };
     pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
-    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedpolicy(&attr, (policy == OS_SCHED_FIFO) ? SCHED_FIFO : SCHED_RR);
     pthread_attr_setschedparam(&attr, &param);
-}
-#endif
+  }
+  else if (policy == OS_SCHED_OTHER)
+  {
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+  }
+  if (cpu_mask != 0)
+  {
+    os_cpu_mask_to_set(cpu_mask, &cpuset);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+  }
 
-  result = pthread_create(thread, &attr, entry, arg);
+  os_thread_start_t *p_start = os_malloc(sizeof(*p_start));
+  p_start->entry = entry;
+  p_start->arg = arg;
+  p_start->prefault = MIN(rt_cfg.stack_prefault, (uint32_t)stacksize);
+  result = pthread_create(thread, &attr, os_thread_entry, p_start);
+  pthread_attr_destroy(&attr);
   if (result != 0)
+  {
+    /* Not logged, the log thread itself is created here */
+    os_free(p_start);
+    os_free(thread);
     return NULL;
+  }
 
   pthread_setname_np(*thread, name);
-  pthread_attr_destroy(&attr);
   return thread;
 }
 
+os_thread_t *os_thread_create(const char *name, int priority,
+                              int stacksize, void *(*entry) (void *arg), void *arg)
+{
+  return os_thread_create_policy(name, rt_cfg.policy, priority, stacksize, entry, arg);
+}
+
+os_thread_t *os_thread_create_background(const char *name, int stacksize,
+                                         void *(*entry) (void *arg), void *arg)
+{
+  return os_thread_create_policy(name, OS_SCHED_OTHER, 0, stacksize, entry, arg);
+}
+
 os_mutex_t *os_mutex_create(void)
 {
   int result;
@@ -517,248 +1104,1341 @@ void os_event_destroy(os_event_t *event)
   os_free(event);
 }
 
+/*
+ * Mailbox.
+ *
+ * Bounded lock-free ring of message slots, safe for many posters and
+ * fetchers. Each slot has a sequence number, which tells whether the slot
+ * is free for the post at a position, or holds the message for the fetch
+ * at that position. A poster claims a position by moving the tail with
+ * compare-and-swap, and publishes the message by updating the slot
+ * sequence. Fetching works the same way on the head.
+ *
+ * The head and the tail are on separate cache lines, so posters and the
+ * fetcher do not invalidate each other's line on every message.
+ *
+ * os_mbox_fetch_wait() sleeps on a futex, which posters only wake when
+ * someone waits.
+ */
+typedef struct os_mbox_slot
+{
+  atomic_size_t   seq;
+  void            *msg;
+} os_mbox_slot_t;
+
+struct os_mbox
+{
+  atomic_size_t   tail;       /* Next position to post to */
+  uint8_t         pad_tail[OS_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+  atomic_size_t   head;       /* Next position to fetch from */
+  uint8_t         pad_head[OS_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+  atomic_uint     n_posts;    /* Futex word, incremented by each post */
+  atomic_uint     n_waiters;
+  size_t          size;       /* Max nbr of messages */
+  size_t          mask;       /* Nbr of slots - 1. Nbr of slots is a power of two */
+  os_mbox_slot_t  slots[];
+};
+
 os_mbox_t *os_mbox_create(size_t size)
 {
   os_mbox_t *mbox;
-  pthread_mutexattr_t attr;
+  size_t n_slots = 1;
+  size_t i;
 
-  mbox = (os_mbox_t *)os_malloc(sizeof(*mbox) + (size * sizeof(void *)));
+  while (n_slots < size)
+  {
+    n_slots <<= 1;
+  }
 
-  pthread_mutexattr_init(&attr);
-  pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
-  pthread_mutex_init(&mbox->mutex, &attr);
+  mbox = (os_mbox_t *)os_malloc(sizeof(*mbox) + (n_slots * sizeof(os_mbox_slot_t)));
+  if (mbox == NULL)
+  {
+    return NULL;
+  }
 
-  mbox->r = 0;
-  mbox->w = 0;
-  mbox->count = 0;
+  atomic_init(&mbox->tail, 0);
+  atomic_init(&mbox->head, 0);
+  atomic_init(&mbox->n_posts, 0);
+  atomic_init(&mbox->n_waiters, 0);
   mbox->size = size;
+  mbox->mask = n_slots - 1;
+  for (i = 0; i < n_slots; i++)
+  {
+    atomic_init(&mbox->slots[i].seq, i);
+    mbox->slots[i].msg = NULL;
+  }
 
   return mbox;
 }
 
 int os_mbox_fetch(os_mbox_t *mbox, void **msg)
 {
+  os_mbox_slot_t *slot;
+  size_t pos;
+  size_t seq;
+
   if (mbox == NULL)
   {
     return 1; // error
   }
 
-  pthread_mutex_lock(&mbox->mutex);
+  pos = atomic_load_explicit(&mbox->head, memory_order_relaxed);
+  for (;;)
+  {
+    slot = &mbox->slots[pos & mbox->mask];
+    seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq == pos + 1)
+    {
+      /* Message published. Claim it. */
+      if (atomic_compare_exchange_weak_explicit(&mbox->head, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if ((intptr_t)(seq - (pos + 1)) < 0)
+    {
+      return 1; // empty
+    }
+    else
+    {
+      pos = atomic_load_explicit(&mbox->head, memory_order_relaxed);
+    }
+  }
+
+  *msg = slot->msg;
+  /* Free the slot for the post one lap ahead */
+  atomic_store_explicit(&slot->seq, pos + mbox->mask + 1, memory_order_release);
+  return 0;
+}
+
+int os_mbox_fetch_wait(os_mbox_t *mbox, void **msg, uint32_t time_us)
+{
+  struct timespec timeout;
+  uint64_t deadline = 0;
+  uint64_t now;
+  unsigned int n_posts;
+
+  if (time_us != OS_WAIT_FOREVER)
+  {
+    deadline = os_get_current_time_us() + time_us;
+  }
+
+  for (;;)
+  {
+    if (os_mbox_fetch(mbox, msg) == 0)
+    {
+      return 0;
+    }
+    if (mbox == NULL)
+    {
+      return 1;
+    }
+
+    /* Register as waiter, then check again, so a post in between is not missed */
+    n_posts = atomic_load(&mbox->n_posts);
+    atomic_fetch_add(&mbox->n_waiters, 1);
+    if (os_mbox_fetch(mbox, msg) == 0)
+    {
+      atomic_fetch_sub(&mbox->n_waiters, 1);
+      return 0;
+    }
+
+    if (time_us == OS_WAIT_FOREVER)
+    {
+      syscall(SYS_futex, &mbox->n_posts, FUTEX_WAIT_PRIVATE, n_posts, NULL, NULL, 0);
+    }
+    else
+    {
+      now = os_get_current_time_us();
+      if (now >= deadline)
+      {
+        atomic_fetch_sub(&mbox->n_waiters, 1);
+        return 1; // timeout
+      }
+      timeout.tv_sec = (deadline - now) / USECS_PER_SEC;
+      timeout.tv_nsec = ((deadline - now) % USECS_PER_SEC) * 1000;
+      syscall(SYS_futex, &mbox->n_posts, FUTEX_WAIT_PRIVATE, n_posts, &timeout, NULL, 0);
+    }
+    atomic_fetch_sub(&mbox->n_waiters, 1);
+  }
+}
+
+int os_mbox_post(os_mbox_t *mbox, void *msg)
+{
+  os_mbox_slot_t *slot;
+  size_t pos;
+  size_t seq;
 
-  if (mbox->count == 0)
+  if (mbox == NULL)
   {
-    pthread_mutex_unlock(&mbox->mutex);
     return 1; // error
   }
 
-  *msg = mbox->msg[mbox->r++];
-  if (mbox->r == mbox->size)
+  pos = atomic_load_explicit(&mbox->tail, memory_order_relaxed);
+  for (;;)
   {
-    mbox->r = 0;
+    slot = &mbox->slots[pos & mbox->mask];
+    seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq == pos)
+    {
+      /* Slot free. There may be more slots than size, so check the count too. */
+      if ((intptr_t)(pos - atomic_load_explicit(&mbox->head, memory_order_acquire)) >= (intptr_t)mbox->size)
+      {
+        return 1; // full
+      }
+      if (atomic_compare_exchange_weak_explicit(&mbox->tail, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if ((intptr_t)(seq - pos) < 0)
+    {
+      return 1; // full
+    }
+    else
+    {
+      pos = atomic_load_explicit(&mbox->tail, memory_order_relaxed);
+    }
   }
 
-  mbox->count--;
+  slot->msg = msg;
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
 
-  pthread_mutex_unlock(&mbox->mutex);
+  atomic_fetch_add(&mbox->n_posts, 1);
+  if (atomic_load(&mbox->n_waiters) > 0)
+  {
+    syscall(SYS_futex, &mbox->n_posts, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
   return 0;
 }
 
-int os_mbox_post(os_mbox_t *mbox, void *msg)
+bool os_mbox_is_full(os_mbox_t * mbox)
 {
+  size_t head;
+  size_t tail;
+
   if (mbox == NULL)
   {
-    return 1; // error
+    return true;
+  }
+
+  head = atomic_load_explicit(&mbox->head, memory_order_acquire);
+  tail = atomic_load_explicit(&mbox->tail, memory_order_acquire);
+  return (tail - head) >= mbox->size;
+}
+
+void os_mbox_destroy(os_mbox_t *mbox)
+{
+  os_free(mbox);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Timer service.
+ *
+ * Each timer is a timerfd. All of them are in one epoll set, served by a
+ * single thread that calls the timer callbacks. The thread holds
+ * timer_mutex while it handles the expiries of one epoll_wait(), except
+ * while it calls a callback, so os_timer_destroy() can wait until no expiry
+ * refers to the timer any more. A timer destroyed by a callback is freed by
+ * the thread itself, after the round.
+ */
+#define OS_TIMER_MAX_EVENTS   16
+
+static pthread_once_t  timer_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  timer_cond = PTHREAD_COND_INITIALIZER;
+static int             timer_epoll_fd = -1;
+static int             timer_wake_fd = -1;   /* eventfd, wakes up the service thread */
+static uint32_t        timer_loop_cnt;       /* Incremented after each epoll_wait() */
+static os_thread_t     *timer_thread;
+static pthread_t       timer_tid;            /* The service thread */
+static os_timer_t      *timer_free_list;     /* Destroyed during the current round */
+
+static uint64_t os_timer_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @internal
+ * Handle one expiry of a timer. Called by the service thread with
+ * timer_mutex held, which is released while the callback runs.
+ */
+static void os_timer_expired(os_timer_t *timer)
+{
+  uint64_t expirations = 0;
+  uint64_t now;
+  uint64_t jitter;
+
+  if ((timer->fd < 0) ||
+      (read(timer->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) ||
+      (expirations == 0))
+  {
+    /* Destroyed, or stopped after the expiry was reported */
+    return;
+  }
+
+  now = os_timer_now_ns();
+  jitter = (now > timer->expected_ns) ? now - timer->expected_ns : 0;
+  timer->n_expiries++;
+  timer->n_overruns += (uint32_t)(expirations - 1);
+  timer->jitter_ns_total += jitter;
+  if (jitter > timer->jitter_ns_max)
+  {
+    timer->jitter_ns_max = (jitter > UINT32_MAX) ? UINT32_MAX : (uint32_t)jitter;
+  }
+  timer->expected_ns += expirations * timer->period_ns;
+
+  if (timer->fn)
+  {
+    pthread_mutex_unlock(&timer_mutex);
+    timer->fn(timer, timer->arg);
+    pthread_mutex_lock(&timer_mutex);
+  }
+}
+
+static void *os_timer_thread(void *arg)
+{
+  struct epoll_event events[OS_TIMER_MAX_EVENTS];
+  os_timer_t *timer;
+  uint64_t value;
+  int n;
+  int ix;
+
+  (void)arg;
+  timer_tid = pthread_self();
+  for (;;)
+  {
+    n = epoll_wait(timer_epoll_fd, events, OS_TIMER_MAX_EVENTS, -1);
+
+    pthread_mutex_lock(&timer_mutex);
+    for (ix = 0; ix < n; ix++)
+    {
+      if (events[ix].data.ptr == NULL)
+      {
+        (void)read(timer_wake_fd, &value, sizeof(value));
+      }
+      else
+      {
+        os_timer_expired(events[ix].data.ptr);
+      }
+    }
+    while (timer_free_list != NULL)
+    {
+      timer = timer_free_list;
+      timer_free_list = timer->next_free;
+      os_free(timer);
+    }
+    timer_loop_cnt++;
+    pthread_cond_broadcast(&timer_cond);
+    pthread_mutex_unlock(&timer_mutex);
+  }
+
+  return NULL;
+}
+
+static void os_timer_service_init(void)
+{
+  struct epoll_event ev;
+
+  timer_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  timer_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if ((timer_epoll_fd < 0) || (timer_wake_fd < 0))
+  {
+    os_log(LOG_LEVEL_ERROR, "[ERROR] os_timer: could not create the timer service\n");
+    return;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  epoll_ctl(timer_epoll_fd, EPOLL_CTL_ADD, timer_wake_fd, &ev);
+
+  /* The callbacks run the stack, e.g. pnet_handle_periodic() */
+  timer_thread = os_thread_create("os_timer", TIMER_PRIO, 64 * 1024, os_timer_thread, NULL);
+}
+
+os_timer_t *os_timer_create(uint32_t us, void (*fn) (os_timer_t *, void *arg),
+                            void *arg, bool oneshot)
+{
+  os_timer_t *timer;
+  struct epoll_event ev;
+
+  pthread_once(&timer_once, os_timer_service_init);
+  if (timer_thread == NULL)
+  {
+    return NULL;
+  }
+
+  timer = (os_timer_t *)os_malloc(sizeof(*timer));
+  if (timer == NULL)
+  {
+    return NULL;
+  }
+  memset(timer, 0, sizeof(*timer));
+  timer->fn = fn;
+  timer->arg = arg;
+  timer->us = us;
+  timer->oneshot = oneshot;
+
+  timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (timer->fd < 0)
+  {
+    os_free(timer);
+    return NULL;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = timer;
+  if (epoll_ctl(timer_epoll_fd, EPOLL_CTL_ADD, timer->fd, &ev) != 0)
+  {
+    close(timer->fd);
+    os_free(timer);
+    return NULL;
+  }
+
+  return timer;
+}
+
+void os_timer_set(os_timer_t *timer, uint32_t us)
+{
+  timer->us = us;
+}
+
+void os_timer_start(os_timer_t *timer)
+{
+  if(timer != NULL)
+  {
+    struct itimerspec its;
+
+    /* Start timer */
+    its.it_value.tv_sec = timer->us / USECS_PER_SEC;
+    its.it_value.tv_nsec = (timer->us % USECS_PER_SEC) * 1000;
+    its.it_interval.tv_sec = (timer->oneshot) ? 0 : its.it_value.tv_sec;
+    its.it_interval.tv_nsec = (timer->oneshot) ? 0 : its.it_value.tv_nsec;
+    timer->period_ns = (uint64_t)timer->us * 1000;
+    timer->expected_ns = os_timer_now_ns() + timer->period_ns;
+    timerfd_settime(timer->fd, 0, &its, NULL);
+  }
+}
+
+void os_timer_stop(os_timer_t *timer)
+{
+  if(timer != NULL)
+  {
+    struct itimerspec its;
+
+    /* Stop timer */
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(timer->fd, 0, &its, NULL);
+  }
+}
+
+void os_timer_get_stats(os_timer_t *timer, os_timer_stats_t *p_stats)
+{
+  memset(p_stats, 0, sizeof(*p_stats));
+  if (timer != NULL)
+  {
+    pthread_mutex_lock(&timer_mutex);
+    p_stats->n_expiries = timer->n_expiries;
+    p_stats->n_overruns = timer->n_overruns;
+    p_stats->jitter_ns_max = timer->jitter_ns_max;
+    p_stats->jitter_ns_avg = (timer->n_expiries > 0) ?
+      (uint32_t)(timer->jitter_ns_total / timer->n_expiries) : 0;
+    pthread_mutex_unlock(&timer_mutex);
+  }
+}
+
+void os_timer_destroy(os_timer_t *timer)
+{
+  uint64_t one = 1;
+  uint32_t loop_cnt;
+
+  if(timer != NULL)
+  {
+    pthread_mutex_lock(&timer_mutex);
+    epoll_ctl(timer_epoll_fd, EPOLL_CTL_DEL, timer->fd, NULL);
+    close(timer->fd);
+    timer->fd = -1;
+
+    if ((timer_thread != NULL) && pthread_equal(pthread_self(), timer_tid))
+    {
+      /* Called by a callback. Later expiries of the round may refer to
+         the timer, so the service thread frees it after the round. */
+      timer->next_free = timer_free_list;
+      timer_free_list = timer;
+      pthread_mutex_unlock(&timer_mutex);
+      return;
+    }
+
+    /* An expiry may already have been fetched by the service thread.
+       Wait until it has finished its current round. */
+    loop_cnt = timer_loop_cnt;
+    (void)write(timer_wake_fd, &one, sizeof(one));
+    while (timer_loop_cnt == loop_cnt)
+    {
+      pthread_cond_wait(&timer_cond, &timer_mutex);
+    }
+    pthread_mutex_unlock(&timer_mutex);
+
+    os_free(timer);
+  }
+}
+
+/* Event sources of os_run_to_completion() */
+#define OS_RTC_ETH     1
+#define OS_RTC_UDP     2
+#define OS_RTC_TICK    3
+
+#define OS_RTC_IDLE_TMO_MS   100   /* Max time before p_running is checked */
+
+int os_run_to_completion(const os_rtc_cfg_t *p_cfg)
+{
+#if defined (USE_RUN_TO_COMPLETION)
+  struct epoll_event events[8];
+  struct epoll_event ev;
+  struct itimerspec its;
+  uint64_t expirations;
+  bool eth_ready;
+  bool udp_ready;
+  bool tick;
+  int epoll_fd;
+  int tick_fd;
+  int n;
+  int ix;
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if ((epoll_fd < 0) || (tick_fd < 0))
+  {
+    os_log(LOG_LEVEL_ERROR, "[ERROR] os_run_to_completion: could not create epoll set or timer\n");
+    if (epoll_fd >= 0)
+    {
+      close(epoll_fd);
+    }
+    return -1;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = OS_RTC_TICK;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tick_fd, &ev);
+  ev.data.u32 = OS_RTC_ETH;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p_cfg->eth_handle->pf_socket, &ev);
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p_cfg->eth_handle->lldp_socket, &ev);
+  if (p_cfg->udp_poll_id >= 0)
+  {
+    /* The UDP poll set is an epoll fd itself, which is readable when any
+       of its sockets is. */
+    ev.data.u32 = OS_RTC_UDP;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p_cfg->udp_poll_id, &ev);
+  }
+
+  if (p_cfg->cpu >= 0)
+  {
+    cpu_set_t cpuset;
+
+    CPU_ZERO(&cpuset);
+    CPU_SET(p_cfg->cpu, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0)
+    {
+      os_log(LOG_LEVEL_WARNING, "[WARNING] os_run_to_completion: could not pin to CPU %d\n", p_cfg->cpu);
+    }
+  }
+
+  its.it_value.tv_sec = p_cfg->tick_us / USECS_PER_SEC;
+  its.it_value.tv_nsec = (p_cfg->tick_us % USECS_PER_SEC) * 1000;
+  its.it_interval = its.it_value;
+  timerfd_settime(tick_fd, 0, &its, NULL);
+
+  while (*p_cfg->p_running != false)
+  {
+    n = epoll_wait(epoll_fd, events, NELEMENTS(events), OS_RTC_IDLE_TMO_MS);
+
+    eth_ready = false;
+    udp_ready = false;
+    tick = false;
+    for (ix = 0; ix < n; ix++)
+    {
+      eth_ready |= (events[ix].data.u32 == OS_RTC_ETH);
+      udp_ready |= (events[ix].data.u32 == OS_RTC_UDP);
+      tick      |= (events[ix].data.u32 == OS_RTC_TICK);
+    }
+
+    /* Incoming frames first, so the tick sees the newest cyclic data.
+       os_eth_poll() reads the sockets empty and gives every receive ring
+       block back to the kernel, so they are not readable again until new
+       frames arrive. */
+    if (eth_ready)
+    {
+      (void)os_eth_poll(p_cfg->eth_handle);
+    }
+    if (udp_ready && (p_cfg->udp_ready != NULL))
+    {
+      p_cfg->udp_ready(p_cfg->arg);
+    }
+    if (tick && (read(tick_fd, &expirations, sizeof(expirations)) == sizeof(expirations)))
+    {
+      p_cfg->tick(p_cfg->arg);
+    }
+  }
+
+  close(tick_fd);
+  close(epoll_fd);
+  return 0;
+#else
+  (void)p_cfg;
+  os_log(LOG_LEVEL_ERROR, "[ERROR] os_run_to_completion: not built with USE_RUN_TO_COMPLETION\n");
+  return -1;
+#endif /* USE_RUN_TO_COMPLETION */
+}
+
+uint8_t os_buf_header(os_buf_t *p, int16_t header_size_increment)
+{
+  (void)p;
+  (void)header_size_increment;
+  return 255;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Persistence.
+ *
+ * os_persist_write() copies the new content of a file into a slot and
+ * returns. A SCHED_OTHER thread waits OS_PERSIST_COALESCE_US after the
+ * first request of a burst, so repeated writes of the same file are merged,
+ * and then commits all pending files as one batch:
+ *
+ * - Files whose content is already on disk are skipped.
+ * - If more than one file changed, the batch is written to the journal,
+ *   followed by a trailer with a CRC, and the journal is fdatasync'ed.
+ * - Each file is written to "<name>.tmp", fdatasync'ed and renamed over
+ *   the file. The directories are fsync'ed.
+ * - The journal is truncated.
+ *
+ * A crash thus leaves each file with its old or its new content. A complete
+ * journal found at start-up is replayed, so the files of a batch are all
+ * updated or none of them. A torn journal is discarded.
+ */
+#define OS_PERSIST_MAX_FILES        8
+#define OS_PERSIST_MAX_NAME         128       /* Including ".tmp" and termination */
+#define OS_PERSIST_MAX_SIZE         2048
+#define OS_PERSIST_COALESCE_US      (100 * 1000)
+#define OS_PERSIST_RECORD_MAGIC     0x574E5050U   /* "PPNW" */
+#define OS_PERSIST_TRAILER_MAGIC    0x434E5050U   /* "PPNC" */
+#define OS_PERSIST_JOURNAL_SIZE     (OS_PERSIST_MAX_FILES * \
+                                     (sizeof(os_persist_record_t) + OS_PERSIST_MAX_NAME + OS_PERSIST_MAX_SIZE) + \
+                                     sizeof(os_persist_trailer_t))
+
+typedef struct os_persist_file
+{
+  char          name[OS_PERSIST_MAX_NAME];   /* Empty if the slot is free */
+  uint8_t       data[OS_PERSIST_MAX_SIZE];
+  uint32_t      size;
+  uint32_t      seq;                         /* Of the latest request */
+  bool          dirty;
+  uint32_t      slot;                        /* Index in persist_files */
+  bool          changed;                     /* Differs from the file, for a batch entry */
+  int           result;                      /* Of the commit, for a batch entry */
+  int           error;                       /* errno if the commit failed */
+} os_persist_file_t;
+
+/* Journal record header, followed by the name (not terminated) and the data */
+typedef struct os_persist_record
+{
+  uint32_t      magic;
+  uint32_t      name_len;
+  uint32_t      size;
+} os_persist_record_t;
+
+/* Last in a complete journal */
+typedef struct os_persist_trailer
+{
+  uint32_t      magic;
+  uint32_t      n_records;
+  uint32_t      length;                      /* Of the records */
+  uint32_t      crc;                         /* Of the records */
+} os_persist_trailer_t;
+
+static pthread_once_t     persist_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t    persist_mutex = PTHREAD_MUTEX_INITIALIZER;         /* Slots, sequence numbers */
+static pthread_mutex_t    persist_commit_mutex = PTHREAD_MUTEX_INITIALIZER;  /* Journal, configuration */
+static pthread_cond_t     persist_cond;        /* Signalled on requests */
+static pthread_cond_t     persist_done_cond;   /* Broadcast when a batch is done */
+static os_thread_t       *persist_thread;
+static atomic_bool        persist_configured;  /* Read without a lock by os_persist_write() */
+static bool               persist_flush_req;
+static uint32_t           persist_n_dirty;
+static uint32_t           persist_seq;         /* Of the latest request */
+static uint32_t           persist_done_seq;    /* Requests up to this one are done */
+static os_persist_cfg_t   persist_cfg;
+static char               persist_journal[OS_PERSIST_MAX_NAME];
+static int                persist_journal_fd = -1;
+static os_persist_stats_t persist_stats;
+static os_persist_file_t  persist_files[OS_PERSIST_MAX_FILES];
+static os_persist_file_t  persist_batch[OS_PERSIST_MAX_FILES];   /* Owned by the thread */
+static int                persist_last_result[OS_PERSIST_MAX_FILES];
+static uint8_t            persist_journal_buf[OS_PERSIST_JOURNAL_SIZE];
+
+static uint32_t os_persist_crc32(const uint8_t *p_data, size_t size)
+{
+  uint32_t crc = 0xFFFFFFFFU;
+  size_t   ix;
+  int      bit;
+
+  for (ix = 0; ix < size; ix++)
+  {
+    crc ^= p_data[ix];
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+    }
   }
 
-  pthread_mutex_lock(&mbox->mutex);
+  return ~crc;
+}
 
-  if (mbox->count == mbox->size)
+static void os_persist_abs_time(struct timespec *p_ts, uint64_t us)
+{
+  clock_gettime(CLOCK_MONOTONIC, p_ts);
+  p_ts->tv_sec += us / USECS_PER_SEC;
+  p_ts->tv_nsec += (us % USECS_PER_SEC) * 1000;
+  if (p_ts->tv_nsec >= NSECS_PER_SEC)
   {
-    pthread_mutex_unlock(&mbox->mutex);
-    return 1;
+    p_ts->tv_sec++;
+    p_ts->tv_nsec -= NSECS_PER_SEC;
   }
+}
 
-  mbox->msg[mbox->w++] = msg;
-  if (mbox->w == mbox->size)
+/**
+ * @internal
+ * Get the length of the directory part of a file name.
+ */
+static size_t os_persist_dir_len(const char *p_file_name)
+{
+  const char *p_slash = strrchr(p_file_name, '/');
+
+  return (p_slash == NULL) ? 0 : (size_t)(p_slash - p_file_name);
+}
+
+/**
+ * @internal
+ * fsync the directory holding a file, so a rename or create in it is durable.
+ */
+static int os_persist_sync_dir(const char *p_file_name)
+{
+  char        dir[OS_PERSIST_MAX_NAME];
+  const char *p_slash = strrchr(p_file_name, '/');
+  int         fd;
+  int         rv;
+
+  if (p_slash == NULL)
+  {
+    strcpy(dir, ".");
+  }
+  else if (p_slash == p_file_name)
+  {
+    strcpy(dir, "/");
+  }
+  else
   {
-    mbox->w = 0;
+    snprintf(dir, sizeof(dir), "%.*s", (int)(p_slash - p_file_name), p_file_name);
   }
 
-  mbox->count++;
+  fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  rv = fsync(fd);
+  close(fd);
+
+  return rv;
+}
+
+static int os_persist_write_all(int fd, const uint8_t *p_data, size_t size)
+{
+  ssize_t n;
+
+  while (size > 0)
+  {
+    n = write(fd, p_data, size);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+    p_data += n;
+    size -= (size_t)n;
+  }
 
-  pthread_mutex_unlock(&mbox->mutex);
   return 0;
 }
 
-bool os_mbox_is_full(os_mbox_t * mbox)
+/**
+ * @internal
+ * Check if a file already has the given content.
+ */
+static bool os_persist_is_unchanged(const char *p_file_name, const uint8_t *p_data, uint32_t size)
 {
-  if (mbox == NULL)
+  static uint8_t buf[OS_PERSIST_MAX_SIZE + 1];   /* Used by one thread at a time */
+  ssize_t        n;
+  int            fd;
+
+  fd = open(p_file_name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
   {
-    return true;
+    return false;
   }
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+
+  return (n == (ssize_t)size) && (memcmp(buf, p_data, size) == 0);
+}
 
-  bool b_is_full = false;
+/**
+ * @internal
+ * Replace the content of a file: write "<name>.tmp", fdatasync it and
+ * rename it over the file. The directory is not synced.
+ */
+static int os_persist_replace(const char *p_file_name, const uint8_t *p_data, uint32_t size)
+{
+  char tmp[OS_PERSIST_MAX_NAME];
+  int  fd;
+  int  rv;
 
-  pthread_mutex_lock(&mbox->mutex);
-  if (mbox->count == mbox->size)
+  snprintf(tmp, sizeof(tmp), "%s.tmp", p_file_name);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  rv = os_persist_write_all(fd, p_data, size);
+  if (rv == 0)
+  {
+    rv = fdatasync(fd);
+  }
+  if (close(fd) != 0)
+  {
+    rv = -1;
+  }
+  if (rv == 0)
   {
-    b_is_full = true;
+    rv = rename(tmp, p_file_name);
+  }
+  if (rv != 0)
+  {
+    (void)unlink(tmp);
   }
-  pthread_mutex_unlock(&mbox->mutex);
 
-  return b_is_full;
+  return rv;
 }
 
-void os_mbox_destroy(os_mbox_t *mbox)
+/**
+ * @internal
+ * Empty the journal, once its batch is on disk.
+ */
+static void os_persist_journal_clear(void)
 {
-  if(mbox != NULL)
+  if ((ftruncate(persist_journal_fd, 0) != 0) || (fdatasync(persist_journal_fd) != 0))
   {
-    pthread_mutex_destroy(&mbox->mutex);
-    os_free(mbox);
+    os_log(LOG_LEVEL_WARNING, "os_persist: could not clear %s: %s\n", persist_journal, strerror(errno));
   }
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * @internal
+ * Write the changed files of a batch to the journal and fdatasync it.
+ *
+ * @return  0 if the journal is complete on disk, -1 if not.
+ */
+static int os_persist_journal_write(os_persist_file_t *p_batch, uint32_t n_batch)
+{
+  os_persist_record_t  record;
+  os_persist_trailer_t trailer;
+  uint32_t             length = 0;
+  uint32_t             n_records = 0;
+  uint32_t             ix;
 
-static void *os_timer_thread(void *arg)
+  for (ix = 0; ix < n_batch; ix++)
+  {
+    if (p_batch[ix].changed == false)
+    {
+      continue;
+    }
+    record.magic = OS_PERSIST_RECORD_MAGIC;
+    record.name_len = (uint32_t)strlen(p_batch[ix].name);
+    record.size = p_batch[ix].size;
+    memcpy(&persist_journal_buf[length], &record, sizeof(record));
+    length += sizeof(record);
+    memcpy(&persist_journal_buf[length], p_batch[ix].name, record.name_len);
+    length += record.name_len;
+    memcpy(&persist_journal_buf[length], p_batch[ix].data, record.size);
+    length += record.size;
+    n_records++;
+  }
+
+  trailer.magic = OS_PERSIST_TRAILER_MAGIC;
+  trailer.n_records = n_records;
+  trailer.length = length;
+  trailer.crc = os_persist_crc32(persist_journal_buf, length);
+  memcpy(&persist_journal_buf[length], &trailer, sizeof(trailer));
+  length += sizeof(trailer);
+
+  if ((lseek(persist_journal_fd, 0, SEEK_SET) != 0) ||
+      (os_persist_write_all(persist_journal_fd, persist_journal_buf, length) != 0) ||
+      (fdatasync(persist_journal_fd) != 0))
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * @internal
+ * Replay a complete journal, and empty it. Called with persist_commit_mutex.
+ */
+static void os_persist_recover(void)
 {
-  os_timer_t *timer = arg;
-  sigset_t sigset;
-  siginfo_t si;
-  struct timespec tmo;
+  os_persist_record_t  record;
+  os_persist_trailer_t trailer;
+  char                 name[OS_PERSIST_MAX_NAME];
+  ssize_t              n;
+  uint32_t             pos = 0;
+  uint32_t             ix;
+  int                  rv = 0;
+
+  n = pread(persist_journal_fd, persist_journal_buf, sizeof(persist_journal_buf), 0);
+  if (n <= 0)
+  {
+    return;   /* Empty: the last batch was completed */
+  }
 
-  timer->thread_id = (pid_t)syscall(SYS_gettid);
+  if (n < (ssize_t)sizeof(trailer))
+  {
+    trailer.magic = 0;
+  }
+  else
+  {
+    memcpy(&trailer, &persist_journal_buf[n - sizeof(trailer)], sizeof(trailer));
+  }
+  if ((trailer.magic != OS_PERSIST_TRAILER_MAGIC) ||
+      (trailer.length != (uint32_t)n - sizeof(trailer)) ||
+      (trailer.crc != os_persist_crc32(persist_journal_buf, trailer.length)))
+  {
+    /* Torn write. No file of the batch has been touched */
+    os_log(LOG_LEVEL_WARNING, "os_persist: discarding incomplete journal %s\n", persist_journal);
+    os_persist_journal_clear();
+    return;
+  }
 
-  /* Add SIGALRM */
-  sigemptyset(&sigset);
-  sigprocmask(SIG_BLOCK, &sigset, NULL);
-  sigaddset(&sigset, SIGALRM);
+  for (ix = 0; (ix < trailer.n_records) && (rv == 0); ix++)
+  {
+    memcpy(&record, &persist_journal_buf[pos], sizeof(record));
+    pos += sizeof(record);
+    if ((record.magic != OS_PERSIST_RECORD_MAGIC) ||
+        (record.name_len >= sizeof(name)) ||
+        (pos + record.name_len + record.size > trailer.length))
+    {
+      rv = -1;
+      break;
+    }
+    memcpy(name, &persist_journal_buf[pos], record.name_len);
+    name[record.name_len] = '\0';
+    pos += record.name_len;
+    rv = os_persist_replace(name, &persist_journal_buf[pos], record.size);
+    if (rv == 0)
+    {
+      rv = os_persist_sync_dir(name);
+    }
+    pos += record.size;
+    if (rv == 0)
+    {
+      persist_stats.n_recovered++;
+    }
+  }
+
+  if (rv == 0)
+  {
+    os_log(LOG_LEVEL_INFO, "os_persist: replayed %u files from %s\n", (unsigned)trailer.n_records, persist_journal);
+    os_persist_journal_clear();
+  }
+  else
+  {
+    /* Keep the journal, to try again at the next start */
+    persist_stats.n_errors++;
+    os_log(LOG_LEVEL_ERROR, "os_persist: could not replay %s\n", persist_journal);
+  }
+}
+
+/**
+ * @internal
+ * Commit a batch. Called by the thread, with persist_commit_mutex.
+ * Sets the result of each file.
+ */
+static void os_persist_commit(os_persist_file_t *p_batch, uint32_t n_batch)
+{
+  uint32_t n_changed = 0;
+  uint32_t ix;
+  uint32_t jx;
+  int      rv = 0;
+
+  for (ix = 0; ix < n_batch; ix++)
+  {
+    p_batch[ix].error = 0;
+    p_batch[ix].result = 0;
+    p_batch[ix].changed = !os_persist_is_unchanged(p_batch[ix].name, p_batch[ix].data, p_batch[ix].size);
+    if (p_batch[ix].changed)
+    {
+      n_changed++;
+    }
+    else
+    {
+      persist_stats.n_unchanged++;
+    }
+  }
+
+  /* One file is replaced atomically by the rename, no journal is needed */
+  if ((n_changed > 1) && (persist_journal_fd >= 0))
+  {
+    rv = os_persist_journal_write(p_batch, n_batch);
+    if (rv == 0)
+    {
+      persist_stats.n_journaled++;
+    }
+  }
+
+  for (ix = 0; ix < n_batch; ix++)
+  {
+    if (p_batch[ix].changed == false)
+    {
+      continue;
+    }
+    p_batch[ix].result = (rv == 0) ? os_persist_replace(p_batch[ix].name, p_batch[ix].data, p_batch[ix].size) : -1;
+    if (p_batch[ix].result != 0)
+    {
+      p_batch[ix].error = errno;
+    }
+  }
+
+  /* Sync each directory once */
+  for (ix = 0; ix < n_batch; ix++)
+  {
+    if ((p_batch[ix].changed == false) || (p_batch[ix].result != 0))
+    {
+      continue;
+    }
+    for (jx = 0; jx < ix; jx++)
+    {
+      if (p_batch[jx].changed && (p_batch[jx].result == 0) &&
+          (os_persist_dir_len(p_batch[jx].name) == os_persist_dir_len(p_batch[ix].name)) &&
+          (strncmp(p_batch[jx].name, p_batch[ix].name, os_persist_dir_len(p_batch[ix].name)) == 0))
+      {
+        break;
+      }
+    }
+    if ((jx == ix) && (os_persist_sync_dir(p_batch[ix].name) != 0))
+    {
+      p_batch[ix].result = -1;
+      p_batch[ix].error = errno;
+    }
+  }
+
+  for (ix = 0; ix < n_batch; ix++)
+  {
+    if (p_batch[ix].result != 0)
+    {
+      persist_stats.n_errors++;
+      rv = -1;
+    }
+    else if (p_batch[ix].changed)
+    {
+      persist_stats.n_written++;
+    }
+  }
+
+  /* A partly applied batch is kept, to be replayed at the next start */
+  if ((n_changed > 1) && (persist_journal_fd >= 0) && (rv == 0))
+  {
+    os_persist_journal_clear();
+  }
+}
+
+static void *os_persist_thread(void *arg)
+{
+  struct timespec deadline;
+  uint32_t        n_batch;
+  uint32_t        batch_seq;
+  uint64_t        t0;
+  uint32_t        commit_us;
+  uint32_t        ix;
+
+  (void)arg;
+  for (;;)
+  {
+    pthread_mutex_lock(&persist_mutex);
+    while (persist_n_dirty == 0)
+    {
+      pthread_cond_wait(&persist_cond, &persist_mutex);
+    }
+
+    /* Let a burst of requests be merged */
+    os_persist_abs_time(&deadline, persist_cfg.coalesce_us);
+    while ((persist_flush_req == false) &&
+           (pthread_cond_timedwait(&persist_cond, &persist_mutex, &deadline) != ETIMEDOUT))
+    {
+    }
+    persist_flush_req = false;
+    pthread_mutex_unlock(&persist_mutex);
+
+    pthread_mutex_lock(&persist_commit_mutex);
+    pthread_mutex_lock(&persist_mutex);
+    n_batch = 0;
+    for (ix = 0; ix < OS_PERSIST_MAX_FILES; ix++)
+    {
+      if (persist_files[ix].dirty)
+      {
+        persist_batch[n_batch++] = persist_files[ix];
+        persist_files[ix].dirty = false;
+      }
+    }
+    persist_n_dirty = 0;
+    batch_seq = persist_seq;
+    pthread_mutex_unlock(&persist_mutex);
+
+    t0 = os_get_current_time_us();
+    os_persist_commit(persist_batch, n_batch);
+    commit_us = (uint32_t)(os_get_current_time_us() - t0);
+    persist_stats.n_commits++;
+    if (commit_us > persist_stats.commit_us_max)
+    {
+      persist_stats.commit_us_max = commit_us;
+    }
+
+    for (ix = 0; ix < n_batch; ix++)
+    {
+      /* Log when a file starts failing, not at every retry */
+      if ((persist_batch[ix].result != 0) && (persist_last_result[persist_batch[ix].slot] == 0))
+      {
+        os_log(LOG_LEVEL_ERROR, "os_persist: could not write %s: %s\n",
+               persist_batch[ix].name, strerror(persist_batch[ix].error));
+      }
+      persist_last_result[persist_batch[ix].slot] = persist_batch[ix].result;
+      if (persist_cfg.cb != NULL)
+      {
+        persist_cfg.cb(persist_cfg.arg, persist_batch[ix].name, persist_batch[ix].seq, persist_batch[ix].result);
+      }
+    }
+    pthread_mutex_unlock(&persist_commit_mutex);
 
-  tmo.tv_sec = 0;
-  tmo.tv_nsec = 500 * 1000 * 1000;
+    pthread_mutex_lock(&persist_mutex);
+    persist_done_seq = batch_seq;
+    pthread_cond_broadcast(&persist_done_cond);
+    pthread_mutex_unlock(&persist_mutex);
+  }
 
-  while (!timer->exit)
+  return NULL;
+}
+
+static void os_persist_service_init(void)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&persist_cond, &attr);
+  pthread_cond_init(&persist_done_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  persist_thread = os_thread_create_background("os_persist", 16 * 1024, os_persist_thread, NULL);
+}
+
+static void os_persist_start(void)
+{
+  pthread_once(&persist_once, os_persist_service_init);
+}
+
+/**
+ * @internal
+ * Configure the service, open and replay the journal.
+ *
+ * @param p_cfg         In: Configuration, or NULL for the defaults.
+ * @param b_if_needed   In: Keep the configuration if already configured.
+ *                          Then returns without waiting for a commit.
+ */
+static int os_persist_configure(const os_persist_cfg_t *p_cfg, bool b_if_needed)
+{
+  const char *p_journal;
+  int         rv = 0;
+
+  os_persist_start();
+  if (persist_thread == NULL)
   {
-    int sig = sigtimedwait(&sigset, &si, &tmo);
-    if (sig == SIGALRM)
+    return -1;
+  }
+
+  /* A commit holds persist_commit_mutex during its disk I/O */
+  if (b_if_needed && atomic_load(&persist_configured))
+  {
+    return 0;
+  }
+
+  pthread_mutex_lock(&persist_commit_mutex);
+  if ((b_if_needed == false) || (atomic_load(&persist_configured) == false))
+  {
+    memset(&persist_cfg, 0, sizeof(persist_cfg));
+    if (p_cfg != NULL)
+    {
+      persist_cfg = *p_cfg;
+    }
+    if (persist_cfg.coalesce_us == 0)
+    {
+      persist_cfg.coalesce_us = OS_PERSIST_COALESCE_US;
+    }
+    p_journal = (persist_cfg.p_journal != NULL) ? persist_cfg.p_journal : PERSIST_JOURNAL_FILE_NAME;
+    snprintf(persist_journal, sizeof(persist_journal), "%s", p_journal);
+    persist_cfg.p_journal = persist_journal;
+
+    if (persist_journal_fd >= 0)
+    {
+      close(persist_journal_fd);
+    }
+    persist_journal_fd = open(persist_journal, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (persist_journal_fd < 0)
     {
-      if (timer->fn)
-      {
-        timer->fn(timer, timer->arg);
-      }
+      /* Files are still replaced atomically, but a batch is not */
+      os_log(LOG_LEVEL_WARNING, "os_persist: no journal, could not open %s: %s\n", persist_journal, strerror(errno));
+      rv = -1;
+    }
+    else
+    {
+      (void)os_persist_sync_dir(persist_journal);
+      os_persist_recover();
     }
+    atomic_store(&persist_configured, true);
   }
+  pthread_mutex_unlock(&persist_commit_mutex);
 
-  printf("[INFO ] os_timer_thread terminated\n");
-  return NULL;
+  return rv;
 }
 
-os_timer_t *os_timer_create(uint32_t us, void (*fn) (os_timer_t *, void *arg),
-                            void *arg, bool oneshot)
+int os_persist_init(const os_persist_cfg_t *p_cfg)
 {
-  os_timer_t *timer;
-  struct sigevent sev;
-  sigset_t sigset;
-
-  /* Block SIGALRM in calling thread */
-  sigemptyset(&sigset);
-  sigaddset(&sigset, SIGALRM);
-  sigprocmask(SIG_BLOCK, &sigset, NULL);
-
-  timer = (os_timer_t *)os_malloc(sizeof(*timer));
+  return os_persist_configure(p_cfg, false);
+}
 
-  timer->exit = false;
-  timer->thread_id = 0;
-  timer->fn = fn;
-  timer->arg = arg;
-  timer->us = us;
-  timer->oneshot = oneshot;
+int os_persist_write(const char *p_file_name, const void *p_data, size_t size, uint32_t *p_seq)
+{
+  os_persist_file_t *p_file = NULL;
+  uint32_t           ix;
 
-  /* Create timer thread */
-  timer->thread = os_thread_create("os_timer", TIMER_PRIO, 1024, os_timer_thread, timer);
-  if (timer->thread == NULL)
+  if ((strlen(p_file_name) + sizeof(".tmp") > OS_PERSIST_MAX_NAME) || (size > OS_PERSIST_MAX_SIZE))
   {
-    os_free(timer);
-    return NULL;
+    return -1;
   }
-
-  /* Wait until timer thread sets its (kernel) thread id */
-  do
+  (void)os_persist_configure(NULL, true);
+  if (persist_thread == NULL)
   {
-    sched_yield();
-  } while (timer->thread_id == 0);
+    return -1;
+  }
 
-  /* Create timer */
-  sev.sigev_notify = SIGEV_THREAD_ID;
-  sev.sigev_value.sival_ptr = timer;
-  sev._sigev_un._tid = timer->thread_id;
-  sev.sigev_signo = SIGALRM;
-  sev.sigev_notify_attributes = NULL;
+  pthread_mutex_lock(&persist_mutex);
+  for (ix = 0; ix < OS_PERSIST_MAX_FILES; ix++)
+  {
+    if (strcmp(persist_files[ix].name, p_file_name) == 0)
+    {
+      p_file = &persist_files[ix];
+      break;
+    }
+    if ((p_file == NULL) && (persist_files[ix].name[0] == '\0'))
+    {
+      p_file = &persist_files[ix];
+    }
+  }
+  if (p_file == NULL)
+  {
+    pthread_mutex_unlock(&persist_mutex);
+    return -1;
+  }
 
-  if (timer_create(CLOCK_MONOTONIC, &sev, &timer->timerid) == -1)
+  if (p_file->dirty)
   {
-    os_free(timer);
-    return NULL;
+    persist_stats.n_coalesced++;
+  }
+  else
+  {
+    persist_n_dirty++;
+  }
+  strcpy(p_file->name, p_file_name);
+  memcpy(p_file->data, p_data, size);
+  p_file->size = (uint32_t)size;
+  p_file->seq = ++persist_seq;
+  p_file->dirty = true;
+  p_file->slot = (uint32_t)(p_file - persist_files);
+  persist_stats.n_requests++;
+  if (p_seq != NULL)
+  {
+    *p_seq = p_file->seq;
   }
+  pthread_cond_signal(&persist_cond);
+  pthread_mutex_unlock(&persist_mutex);
 
-  return timer;
+  return 0;
 }
 
-void os_timer_set(os_timer_t *timer, uint32_t us)
+int os_persist_flush(uint32_t timeout_ms)
 {
-  timer->us = us;
-}
+  struct timespec deadline;
+  uint32_t        target;
+  int             rv = 0;
 
-void os_timer_start(os_timer_t *timer)
-{
-  if(timer != NULL)
+  if (persist_thread == NULL)
   {
-    struct itimerspec its;
-
-    /* Start timer */
-    its.it_value.tv_sec = 0;
-    its.it_value.tv_nsec = 1000 * timer->us;
-    its.it_interval.tv_sec = (timer->oneshot) ? 0 : its.it_value.tv_sec;
-    its.it_interval.tv_nsec = (timer->oneshot) ? 0 : its.it_value.tv_nsec;
-    timer_settime(timer->timerid, 0, &its, NULL);
+    return 0;   /* Nothing was ever requested */
   }
-}
 
-void os_timer_stop(os_timer_t *timer)
-{
-  if(timer != NULL)
+  os_persist_abs_time(&deadline, (uint64_t)timeout_ms * 1000);
+  pthread_mutex_lock(&persist_mutex);
+  target = persist_seq;
+  if ((int32_t)(target - persist_done_seq) > 0)
   {
-    struct itimerspec its;
-
-    /* Stop timer */
-    its.it_value.tv_sec = 0;
-    its.it_value.tv_nsec = 0;
-    its.it_interval.tv_sec = 0;
-    its.it_interval.tv_nsec = 0;
-    timer_settime(timer->timerid, 0, &its, NULL);
+    persist_flush_req = true;
+    pthread_cond_signal(&persist_cond);
   }
-}
-
-void os_timer_destroy(os_timer_t *timer)
-{
-  if(timer != NULL)
+  while ((rv == 0) && ((int32_t)(target - persist_done_seq) > 0))
   {
-    timer->exit = true;
-    pthread_join(*timer->thread, NULL);
-    timer_delete(timer->timerid);
-    os_free(timer);
+    if (pthread_cond_timedwait(&persist_done_cond, &persist_mutex, &deadline) == ETIMEDOUT)
+    {
+      rv = ((int32_t)(target - persist_done_seq) > 0) ? -1 : 0;
+    }
   }
+  pthread_mutex_unlock(&persist_mutex);
+
+  return rv;
 }
 
-uint8_t os_buf_header(os_buf_t *p, int16_t header_size_increment)
+void os_persist_get_stats(os_persist_stats_t *p_stats)
 {
-  (void)p;
-  (void)header_size_increment;
-  return 255;
+  pthread_mutex_lock(&persist_commit_mutex);
+  pthread_mutex_lock(&persist_mutex);
+  *p_stats = persist_stats;
+  pthread_mutex_unlock(&persist_mutex);
+  pthread_mutex_unlock(&persist_commit_mutex);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////
-
 int os_set_ip_suite(
   void       *arg,
   os_ipaddr_t ipaddr,
@@ -769,15 +2449,17 @@ int os_set_ip_suite(
   int rv                = 0;
   app_data_t *p_appdata = (app_data_t *)arg;
 
-  const uint32_t def_ip = __builtin_bswap32(p_appdata->def_ip);
+  const uint32_t def_ip      = __builtin_bswap32(p_appdata->def_ip);
+  const uint32_t def_netmask = __builtin_bswap32(p_appdata->def_netmask);
 
+  // applied in the background, see os_netif_set_ip_suite()
   if (ipaddr == 0)
   {
-    set_ip_address_to_interface(p_appdata, def_ip);
+    set_ip_address_to_interface(p_appdata, def_ip, def_netmask, 0);
   }
   else
   {
-    set_ip_address_to_interface(p_appdata, ipaddr);
+    set_ip_address_to_interface(p_appdata, ipaddr, netmask, gw);
   }
 
   pf_full_ip_suite_t data;
@@ -789,34 +2471,8 @@ int os_set_ip_suite(
     data.ip_suite.ip_gateway = __builtin_bswap32(gw);
   }
 
-  // first read the file and compare the contents
-  bool b_data_different = true;
-  FILE *fp = fopen(IP_SETTINGS_DATA_FILE_NAME, "r");
-  if (fp != NULL)
-  {
-    pf_full_ip_suite_t temp = { 0 };
-    fread(&temp, sizeof(temp), 1, fp);
-    fclose(fp);
-    if (memcmp(&temp, &data, sizeof(data)) == 0)
-    {
-      b_data_different = false;
-    }
-  }
-
-  if(b_data_different)
-  {
-    fp = fopen(IP_SETTINGS_DATA_FILE_NAME, "w");
-    if (fp != NULL)
-    {
-      fwrite(&data, sizeof(data), 1, fp);
-      fclose(fp);
-      system("sync");
-    }
-    else
-    {
-      rv = -1;
-    }
-  }
+  // saved by the persistence thread, only if the file content differs
+  rv = os_persist_write(IP_SETTINGS_DATA_FILE_NAME, &data, sizeof(data), NULL);
 
 //  if (p_appdata->arguments.verbosity > 0)
   {
@@ -836,7 +2492,6 @@ int os_set_ip_suite(
 
 int os_set_station_name(void *arg, const char *name, bool b_temporary)
 {
-  int rv = 0;
   //app_data_t *p_appdata = (app_data_t *)arg;
 //  if (p_appdata->arguments.verbosity > 0)
   {
@@ -852,101 +2507,29 @@ int os_set_station_name(void *arg, const char *name, bool b_temporary)
     strcpy(name_of_station, name);
   }
 
-  // first read the file and compare the contents
-  bool b_data_different = true;
-  FILE *fp = fopen(NAME_OF_STATION_DATA_FILE_NAME, "r");
-  if (fp != NULL)
-  {
-    char temp[STATTION_NAME_SIZE] = { 0 };
-    fread(temp, sizeof(temp), 1, fp);
-    fclose(fp);
-    if (memcmp(name_of_station, temp, sizeof(name_of_station)) == 0)
-    {
-      b_data_different = false;
-    }
-  }
-
-  if(b_data_different)
-  {
-    fp = fopen(NAME_OF_STATION_DATA_FILE_NAME, "w");
-    if (fp != NULL)
-    {
-      fwrite(&name_of_station, sizeof(name_of_station), 1, fp);
-      fclose(fp);
-      system("sync");
-    }
-    else
-    {
-      rv = -1;
-    }
-  }
-  return rv;
+  return os_persist_write(NAME_OF_STATION_DATA_FILE_NAME, name_of_station, sizeof(name_of_station), NULL);
 }
 
 int os_save_im_data(pnet_t *net)
-{  
-  bool b_data_different = true;
-  int rv = 0;
-  // first read the file and compare the contents
-  FILE *fp = fopen(IM_DATA_FILE_NAME, "r");
-  if (fp != NULL)
-  {
-    pnet_im_1_t im_1_data = { 0 };
-    pnet_im_2_t im_2_data = { 0 };
-    pnet_im_3_t im_3_data = { 0 };
-    pf_check_peers_t check_peers = { 0 };
-    uint32_t adjust_peer_boundary = 0;
-
-    fread(&im_1_data, sizeof(im_1_data), 1, fp);
-    fread(&im_2_data, sizeof(im_2_data), 1, fp);
-    fread(&im_3_data, sizeof(im_3_data), 1, fp);
-    fread(&check_peers, sizeof(check_peers), 1, fp);
-    fread(&adjust_peer_boundary, sizeof(adjust_peer_boundary), 1, fp);
-    fclose(fp);
-
-    b_data_different = false;
-    if (memcmp(&im_1_data, &(net->fspm_cfg.im_1_data), sizeof(im_1_data)) != 0)
-    {
-      b_data_different = true;
-    }
-    if (memcmp(&im_2_data, &(net->fspm_cfg.im_2_data), sizeof(im_2_data)) != 0)
-    {
-      b_data_different = true;
-    }
-    if (memcmp(&im_3_data, &(net->fspm_cfg.im_3_data), sizeof(im_3_data)) != 0)
-    {
-      b_data_different = true;
-    }
-    if (memcmp(&check_peers, &(net->temp_check_peers_data), sizeof(check_peers)) != 0)
-    {
-      b_data_different = true;
-    }
-    if (adjust_peer_boundary != net->adjust_peer_to_peer_boundary)
-    {
-      b_data_different = true;
-    }
-  }
-  
-  // save to disk only if data are different -> protect the SD card
-  if(b_data_different)
-  {
-    fp = fopen(IM_DATA_FILE_NAME, "w");
-    if (fp != NULL)
-    {
-      fwrite(&(net->fspm_cfg.im_1_data), sizeof(net->fspm_cfg.im_1_data), 1, fp);
-      fwrite(&(net->fspm_cfg.im_2_data), sizeof(net->fspm_cfg.im_2_data), 1, fp);
-      fwrite(&(net->fspm_cfg.im_3_data), sizeof(net->fspm_cfg.im_3_data), 1, fp);
-      fwrite(&(net->temp_check_peers_data), sizeof(net->temp_check_peers_data), 1, fp);
-      fwrite(&(net->adjust_peer_to_peer_boundary), sizeof(net->adjust_peer_to_peer_boundary), 1, fp);
-      fclose(fp);
-      system("sync");
-    }
-    else
-    {
-      rv = -1;
-    }
-  }
-  return rv;
+{
+  uint8_t data[sizeof(net->fspm_cfg.im_1_data) + sizeof(net->fspm_cfg.im_2_data) +
+               sizeof(net->fspm_cfg.im_3_data) + sizeof(net->temp_check_peers_data) +
+               sizeof(net->adjust_peer_to_peer_boundary)];
+  size_t  pos = 0;
+
+  // same layout as read by os_get_ip_suite()
+  memcpy(&data[pos], &(net->fspm_cfg.im_1_data), sizeof(net->fspm_cfg.im_1_data));
+  pos += sizeof(net->fspm_cfg.im_1_data);
+  memcpy(&data[pos], &(net->fspm_cfg.im_2_data), sizeof(net->fspm_cfg.im_2_data));
+  pos += sizeof(net->fspm_cfg.im_2_data);
+  memcpy(&data[pos], &(net->fspm_cfg.im_3_data), sizeof(net->fspm_cfg.im_3_data));
+  pos += sizeof(net->fspm_cfg.im_3_data);
+  memcpy(&data[pos], &(net->temp_check_peers_data), sizeof(net->temp_check_peers_data));
+  pos += sizeof(net->temp_check_peers_data);
+  memcpy(&data[pos], &(net->adjust_peer_to_peer_boundary), sizeof(net->adjust_peer_to_peer_boundary));
+
+  // saved only if different -> protect the SD card
+  return os_persist_write(IM_DATA_FILE_NAME, data, sizeof(data), NULL);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -962,6 +2545,10 @@ int os_get_ip_suite(
   pf_full_ip_suite_t data;
   memset(&data, 0, sizeof(data));
 
+  // replay an interrupted save, and wait for pending ones
+  (void)os_persist_configure(NULL, true);
+  (void)os_persist_flush(OS_PERSIST_EXIT_TIMEOUT_MS);
+
   FILE *fp = fopen(IP_SETTINGS_DATA_FILE_NAME, "r");
   if (fp != NULL)
   {
@@ -1030,63 +2617,174 @@ void os_set_led(void *arg, uint16_t id, bool on)
 
 //////////////////////////////////////////////////////////////////////////
 
-void log_sys_cmd(app_data_t *p_appdata, const char *cmd)
+void set_ip_address_to_interface(app_data_t *p_appdata, uint32_t ipaddr, uint32_t netmask, uint32_t gw)
 {
-  if (p_appdata->arguments.verbosity > 0)
+  if (ipaddr != 0)
   {
-    os_log(LOG_LEVEL_INFO, "**** Executing command: %s ****\n", cmd);
+    if (p_appdata->arguments.verbosity > 0)
+    {
+      char strIpAddr[64];
+      sprint_ip_address(strIpAddr, sizeof(strIpAddr), __builtin_bswap32(ipaddr));
+      os_log(LOG_LEVEL_INFO, "Setting IP address %s/%d of %s\n", strIpAddr,
+             __builtin_popcount(netmask), p_appdata->arguments.eth_interface);
+    }
+    if (os_netif_set_ip_suite(p_appdata->arguments.eth_interface, ipaddr, netmask, gw, NULL) != 0)
+    {
+      os_log(LOG_LEVEL_ERROR, "Invalid IP suite for %s\n", p_appdata->arguments.eth_interface);
+    }
   }
 }
 
-void set_ip_address_to_interface(app_data_t *p_appdata, uint32_t ipaddr)
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @internal
+ * Put all buffers of a pool on its free stack.
+ * @param pool          InOut: The pool.
+ */
+static void os_buf_pool_init(os_buf_pool_t *pool)
 {
-  if (ipaddr != 0)
+  uint32_t i;
+
+  for (i = 0; i < pool->size; i++)
   {
-    char cmd[STATTION_NAME_SIZE * 2];
-    char strIpAddr[64];
-    sprint_ip_address(strIpAddr, sizeof(strIpAddr), __builtin_bswap32(ipaddr));
-    sprintf(cmd, "ifconfig %s %s", p_appdata->arguments.eth_interface, strIpAddr);
-    log_sys_cmd(p_appdata, cmd);
-    system(cmd);
+    memset(&pool->bufs[i], 0, sizeof(pool->bufs[i]));
+    pool->bufs[i].payload = pool->data[i];
+    pool->bufs[i].memory_type = MEMORY_TYPE_FREE;
+    pool->bufs[i].idx_to_static_buf = i;
+    atomic_init(&pool->state[i], MEMORY_TYPE_FREE);
+    atomic_init(&pool->next[i], (i + 1 < pool->size) ? (uint16_t)(i + 1) : BUF_POOL_NONE);
   }
+  atomic_init(&pool->n_used, 0);
+  atomic_init(&pool->high_water, 0);
+  atomic_init(&pool->n_fallback, 0);
+  atomic_store(&pool->head, (pool->size > 0) ? 0 : BUF_POOL_NONE);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-
-#ifdef _DEBUG
-os_buf_t * os_buf_alloc_dbg(uint32_t length, const char *file, int line)
-#else
-os_buf_t *os_buf_alloc(uint32_t length)
-#endif // _DEBUG
+/**
+ * @internal
+ * Initialize the static buffer pools. Run once, by pthread_once().
+ * Until then the pools are empty, and all buffers are allocated with malloc.
+ */
+static void os_buf_pools_init(void)
 {
-  CC_ASSERT(length < BUF_SIZE - sizeof(os_buf_t));
+  CC_STATIC_ASSERT(MAX_SEND_BUFS < BUF_POOL_NONE);
+  CC_STATIC_ASSERT(MAX_RECV_BUFS < BUF_POOL_NONE);
 
-  os_buf_t *p = NULL;
+  os_buf_pool_init(&send_pool);
+  os_buf_pool_init(&recv_pool);
+}
 
-  // first check the static pbufs
-  os_mutex_lock(pbuf_mutex);
+/**
+ * @internal
+ * Take a buffer from a pool, without locking.
+ * @param pool          InOut: The pool.
+ * @return  the buffer, or NULL if the pool is empty.
+ */
+static os_buf_t *os_buf_pool_get(os_buf_pool_t *pool)
+{
+  uint32_t old_head = atomic_load(&pool->head);
+  uint32_t new_head;
+  uint32_t ix;
+  uint32_t used;
+  uint32_t high_water;
 
-  for (size_t i = 0; i < NELEMENTS(send_memory_types); i++)
+  do
   {
-    if(send_memory_types[i] == MEMORY_TYPE_FREE)
+    ix = old_head & 0xFFFFU;
+    if (ix == BUF_POOL_NONE)
     {
-      send_memory_types[i] = MEMORY_TYPE_STATIC_SEND;
-      p = &(bufs_send[i]);
-      p->memory_type = MEMORY_TYPE_STATIC_SEND;
-      break;
+      return NULL;
     }
+    new_head = ((old_head + 0x10000U) & 0xFFFF0000U) |
+               atomic_load_explicit(&pool->next[ix], memory_order_relaxed);
+  } while (!atomic_compare_exchange_weak(&pool->head, &old_head, new_head));
+
+  atomic_store(&pool->state[ix], pool->memory_type);
+  pool->bufs[ix].memory_type = pool->memory_type;
+
+  used = atomic_fetch_add(&pool->n_used, 1U) + 1U;
+  high_water = atomic_load(&pool->high_water);
+  while ((used > high_water) &&
+         !atomic_compare_exchange_weak(&pool->high_water, &high_water, used))
+  {
+  }
+
+  return &pool->bufs[ix];
+}
+
+/**
+ * @internal
+ * Return a buffer to its pool, without locking.
+ * @param pool          InOut: The pool.
+ * @param p             In:   The buffer.
+ * @return  true if the buffer was returned,
+ *          false if it was already free.
+ */
+static bool os_buf_pool_put(os_buf_pool_t *pool, os_buf_t *p)
+{
+  uint32_t ix = p->idx_to_static_buf;
+  uint32_t old_head;
+  uint32_t new_head;
+
+  if (atomic_exchange(&pool->state[ix], MEMORY_TYPE_FREE) == MEMORY_TYPE_FREE)
+  {
+    return false;
+  }
+  p->memory_type = MEMORY_TYPE_FREE;
+
+  old_head = atomic_load(&pool->head);
+  do
+  {
+    atomic_store_explicit(&pool->next[ix], (uint16_t)(old_head & 0xFFFFU), memory_order_relaxed);
+    new_head = ((old_head + 0x10000U) & 0xFFFF0000U) | ix;
+  } while (!atomic_compare_exchange_weak(&pool->head, &old_head, new_head));
+
+  atomic_fetch_sub(&pool->n_used, 1U);
+  return true;
+}
+
+/**
+ * @internal
+ * Allocate a buffer from a pool. Use malloc if the pool is empty.
+ * @param pool          InOut: The pool.
+ * @param length        In:   The buffer length.
+ * @return  the buffer.
+ */
+static os_buf_t *os_buf_alloc_from_pool(os_buf_pool_t *pool, uint32_t length)
+{
+  os_buf_t *p = NULL;
+
+  pthread_once(&buf_pool_once, os_buf_pools_init);
+
+  if (length <= BUF_SIZE)
+  {
+    p = os_buf_pool_get(pool);
   }
 
   if (p == NULL)
   {
+    atomic_fetch_add(&pool->n_fallback, 1U);
     p = os_malloc(sizeof(os_buf_t) + sizeof(uint32_t) + length);
     p->payload = (void *)((uint8_t *)p + sizeof(os_buf_t));  /* Payload follows header struct */
     p->memory_type = MEMORY_TYPE_MALLOC;
-    p->ptr_to_memory_type = NULL;
     p->idx_to_static_buf = UINT32_MAX;
+    p->release = NULL;
   }
 
   p->len = length;
+  return p;
+}
+
+#ifdef _DEBUG
+os_buf_t * os_buf_alloc_dbg(uint32_t length, const char *file, int line)
+#else
+os_buf_t *os_buf_alloc(uint32_t length)
+#endif // _DEBUG
+{
+  CC_ASSERT(length < BUF_SIZE - sizeof(os_buf_t));
+
+  os_buf_t *p = os_buf_alloc_from_pool(&send_pool, length);
 
 #ifdef _DEBUG
   p->m_p_alloc_file = file;
@@ -1096,40 +2794,6 @@ os_buf_t *os_buf_alloc(uint32_t length)
   p->m_free_count = 0;
 #endif // _DEBUG
 
-  os_mutex_unlock(pbuf_mutex);
-
-  return p;
-}
-
-static os_buf_t *os_buf_alloc_for_recv(uint32_t length)
-{
-  os_buf_t *p = NULL;
-
-  // use the cached last freed index
-  if (   (last_freed_recv_buf_idx < NELEMENTS(recv_memory_types))
-      && (recv_memory_types[last_freed_recv_buf_idx] == MEMORY_TYPE_FREE))
-  {
-    recv_memory_types[last_freed_recv_buf_idx] = MEMORY_TYPE_STATIC_RECV;
-    p = &(bufs_recv[last_freed_recv_buf_idx]);
-    p->memory_type = MEMORY_TYPE_STATIC_RECV;
-    // invalidate cached value for now
-    last_freed_recv_buf_idx = NELEMENTS(recv_memory_types);
-    atomic_fetch_add(&nRecvBuffersAllocated, 1U);
-  }
-  else
-  {
-    for (size_t i = 0; i < NELEMENTS(recv_memory_types); i++)
-    {
-      if (recv_memory_types[i] == MEMORY_TYPE_FREE)
-      {
-        recv_memory_types[i] = MEMORY_TYPE_STATIC_RECV;
-        p = &(bufs_recv[i]);
-        p->memory_type = MEMORY_TYPE_STATIC_RECV;
-        atomic_fetch_add(&nRecvBuffersAllocated, 1U);
-        break;
-      }
-    }
-  }
   return p;
 }
 
@@ -1139,23 +2803,7 @@ os_buf_t *os_buf_alloc_with_wait_dbg(uint32_t length, const char *file, int line
 os_buf_t *os_buf_alloc_with_wait(uint32_t length)
 #endif // _DEBUG
 {
-  os_buf_t *p = NULL;
-  os_mutex_lock(pbuf_mutex);
-
-  if(atomic_load(&nRecvBuffersAllocated) < NELEMENTS(recv_memory_types))
-  {
-    p = os_buf_alloc_for_recv(length);
-  }  
-
-  if (p == NULL)
-  {
-    p = os_malloc(sizeof(os_buf_t) + sizeof(uint32_t) + length);
-    p->payload = (void *)((uint8_t *)p + sizeof(os_buf_t));  /* Payload follows header struct */
-    p->memory_type = MEMORY_TYPE_MALLOC;
-    p->ptr_to_memory_type = NULL;
-    p->idx_to_static_buf = UINT32_MAX;
-  }
-  p->len = length;
+  os_buf_t *p = os_buf_alloc_from_pool(&recv_pool, length);
 
 #ifdef _DEBUG
   p->m_p_alloc_file = file;
@@ -1165,7 +2813,6 @@ os_buf_t *os_buf_alloc_with_wait(uint32_t length)
   p->m_free_count = 0;
 #endif // _DEBUG
 
-  os_mutex_unlock(pbuf_mutex);
   return p;
 }
 
@@ -1175,32 +2822,32 @@ void os_buf_free_dbg(os_buf_t *p, const char *file, int line)
 void os_buf_free(os_buf_t *p)
 #endif // _DEBUG
 {
+  bool freed = true;
+
   // free of NULL pointer is allowed, so just return here
   if (p == NULL)
   {
     return;
   }
 
-  os_mutex_lock(pbuf_mutex);
   if (p->memory_type & (MEMORY_TYPE_STATIC_RECV|MEMORY_TYPE_STATIC_SEND))
   {
-    if (p->memory_type == MEMORY_TYPE_STATIC_RECV)
-    {
-      atomic_fetch_sub(&nRecvBuffersAllocated, 1U);
-      // cache the last freed recv buffer for faster subsequent alloc
-      last_freed_recv_buf_idx = p->idx_to_static_buf;
-    }
-    p->memory_type = MEMORY_TYPE_FREE;
-    // p->ptr_to_memory type points to recv_memory_types[] array
-    if(p->ptr_to_memory_type != NULL)
-    {
-      *(p->ptr_to_memory_type) = MEMORY_TYPE_FREE;
-    }
 #ifdef _DEBUG
     p->m_p_free_file = file;
     p->m_free_line = line;
     p->m_free_count++;
 #endif // _DEBUG
+    freed = os_buf_pool_put((p->memory_type == MEMORY_TYPE_STATIC_RECV) ? &recv_pool : &send_pool, p);
+  }
+  else if (p->memory_type == MEMORY_TYPE_EXTERNAL)
+  {
+#ifdef _DEBUG
+    p->m_p_free_file = file;
+    p->m_free_line = line;
+    p->m_free_count++;
+#endif // _DEBUG
+    p->memory_type = MEMORY_TYPE_FREE;
+    p->release(p);
   }
   else if (p->memory_type == MEMORY_TYPE_MALLOC)
   {
@@ -1212,7 +2859,12 @@ void os_buf_free(os_buf_t *p)
 #endif // _DEBUG
     os_free(p);
   }
-  else if (p->memory_type == MEMORY_TYPE_FREE)
+  else
+  {
+    freed = false;
+  }
+
+  if (freed == false)
   {
 #ifdef _DEBUG
     LOG_WARNING(PNET_LOG,
@@ -1234,5 +2886,47 @@ void os_buf_free(os_buf_t *p)
     LOG_WARNING(PNET_LOG, "OSAL(%d): Double pbuf free:\n",__LINE__);
 #endif // _DEBUG
   }
-  os_mutex_unlock(pbuf_mutex);
+}
+
+os_buf_t *os_buf_keep(os_buf_t *p)
+{
+  os_buf_t *p_copy;
+
+  if ((p == NULL) || (p->memory_type != MEMORY_TYPE_EXTERNAL))
+  {
+    return p;
+  }
+
+  p_copy = os_buf_alloc_with_wait(OS_BUF_MAX_SIZE);
+  p_copy->len = MIN(p->len, OS_BUF_MAX_SIZE);
+  memcpy(p_copy->payload, p->payload, p_copy->len);
+  os_buf_free(p);
+
+  return p_copy;
+}
+
+/**
+ * @internal
+ * Copy the statistics of a buffer pool.
+ * @param pool          In:   The pool.
+ * @param p_stats       Out:  The statistics.
+ */
+static void os_buf_pool_get_stats(os_buf_pool_t *pool, os_buf_stats_t *p_stats)
+{
+  p_stats->size = pool->size;
+  p_stats->used = atomic_load(&pool->n_used);
+  p_stats->high_water = atomic_load(&pool->high_water);
+  p_stats->fallback = atomic_load(&pool->n_fallback);
+}
+
+void os_buf_get_stats(os_buf_stats_t *p_send, os_buf_stats_t *p_recv)
+{
+  if (p_send != NULL)
+  {
+    os_buf_pool_get_stats(&send_pool, p_send);
+  }
+  if (p_recv != NULL)
+  {
+    os_buf_pool_get_stats(&recv_pool, p_recv);
+  }
 }
@@ -25,10 +25,200 @@
 #include <sys/socket.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
 #include <linux/if_ether.h>
 #include "config.h"
 
+#if defined (USE_PACKET_RX_RING)
+#include <poll.h>
+#include <sys/mman.h>
+
+/*
+ * Memory mapped receive ring (PACKET_RX_RING, TPACKET_V3).
+ *
+ * The kernel fills blocks of frames, and hands a block over when it is full
+ * or when OS_ETH_RX_RING_BLOCK_TMO_MS has elapsed. The frames are passed to
+ * the callback without copying, and the block is given back to the kernel as
+ * soon as all its frames have been passed on. A frame that the stack keeps
+ * after the callback has returned is copied out by os_buf_keep().
+ */
+#define OS_ETH_RX_RING_BLOCK_SIZE       4096    /* Bytes. Multiple of the page size */
+#define OS_ETH_RX_RING_BLOCK_NR         64
+#define OS_ETH_RX_RING_FRAME_SIZE       2048
+#define OS_ETH_RX_RING_BLOCK_TMO_MS     1       /* Max delay of a partly filled block */
+#define OS_ETH_RX_RING_POLL_TMO_MS      100
+
+struct os_eth_rx_ring
+{
+  uint8_t                   *p_map;
+  size_t                    map_size;
+  uint32_t                  next_block;
+  os_buf_t                  buf;          /* The frame being passed to the callback */
+};
+
+/**
+ * @internal
+ * os_buf_t release function for frames in the receive ring.
+ * The block is given back to the kernel by os_eth_rx_ring_poll().
+ *
+ * @param p              InOut: The buffer, os_eth_rx_ring.buf
+ */
+static void os_eth_rx_ring_buf_release(os_buf_t *p)
+{
+  (void)p;
+}
+
+/**
+ * @internal
+ * Set up a TPACKET_V3 receive ring on a raw socket.
+ *
+ * @param s              In: The socket.
+ * @return  the ring, or NULL if not supported. The socket is then left
+ *          unchanged, so that recv() can be used instead.
+ */
+static struct os_eth_rx_ring *os_eth_rx_ring_create(int s)
+{
+  struct os_eth_rx_ring *ring;
+  struct tpacket_req3   req;
+  int                   version = TPACKET_V3;
+
+  if (setsockopt(s, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0)
+  {
+    os_log(LOG_LEVEL_WARNING, "TPACKET_V3 not supported: %s\n", strerror(errno));
+    return NULL;
+  }
+
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = OS_ETH_RX_RING_BLOCK_SIZE;
+  req.tp_block_nr = OS_ETH_RX_RING_BLOCK_NR;
+  req.tp_frame_size = OS_ETH_RX_RING_FRAME_SIZE;
+  req.tp_frame_nr = (OS_ETH_RX_RING_BLOCK_SIZE * OS_ETH_RX_RING_BLOCK_NR) / OS_ETH_RX_RING_FRAME_SIZE;
+  req.tp_retire_blk_tov = OS_ETH_RX_RING_BLOCK_TMO_MS;
+  if (setsockopt(s, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0)
+  {
+    os_log(LOG_LEVEL_WARNING, "PACKET_RX_RING not available: %s\n", strerror(errno));
+    version = TPACKET_V1;
+    setsockopt(s, SOL_PACKET, PACKET_VERSION, &version, sizeof(version));
+    return NULL;
+  }
+
+  ring = os_malloc(sizeof(*ring));
+  memset(ring, 0, sizeof(*ring));
+  ring->map_size = (size_t)req.tp_block_size * req.tp_block_nr;
+  ring->p_map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, s, 0);
+  if (ring->p_map == MAP_FAILED)
+  {
+    os_log(LOG_LEVEL_WARNING, "PACKET_RX_RING mmap failed: %s\n", strerror(errno));
+    memset(&req, 0, sizeof(req));
+    setsockopt(s, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+    version = TPACKET_V1;
+    setsockopt(s, SOL_PACKET, PACKET_VERSION, &version, sizeof(version));
+    os_free(ring);
+    return NULL;
+  }
+
+  ring->buf.memory_type = MEMORY_TYPE_FREE;
+  ring->buf.idx_to_static_buf = UINT32_MAX;
+  ring->buf.release = os_eth_rx_ring_buf_release;
+  ring->next_block = 0;
+
+  os_log(LOG_LEVEL_INFO, "Using PACKET_RX_RING: %u blocks of %u bytes\n",
+         (unsigned)OS_ETH_RX_RING_BLOCK_NR, (unsigned)OS_ETH_RX_RING_BLOCK_SIZE);
+  return ring;
+}
+
+#if !defined (USE_RUN_TO_COMPLETION)
+/**
+ * @internal
+ * Unmap the receive ring.
+ *
+ * @param ring           In: The ring.
+ */
+static void os_eth_rx_ring_destroy(struct os_eth_rx_ring *ring)
+{
+  munmap(ring->p_map, ring->map_size);
+  os_free(ring);
+}
+#endif /* USE_RUN_TO_COMPLETION */
+
+/**
+ * @internal
+ * Pass the frames of all ring blocks that the kernel has handed over to the
+ * callback, without blocking.
+ *
+ * @param eth_handle     InOut: The Ethernet handle.
+ * @return  the number of frames handled.
+ */
+static int os_eth_rx_ring_poll(os_eth_handle_t *eth_handle)
+{
+  struct os_eth_rx_ring     *ring = eth_handle->rx_ring;
+  struct tpacket_block_desc *p_desc;
+  struct tpacket3_hdr       *p_hdr;
+  os_buf_t                  *p = &ring->buf;
+  uint32_t                  num_pkts;
+  uint32_t                  i;
+  int                       handled;
+  int                       n = 0;
+
+  for (;;)
+  {
+    p_desc = (struct tpacket_block_desc *)(ring->p_map + ring->next_block * OS_ETH_RX_RING_BLOCK_SIZE);
+    if ((__atomic_load_n(&p_desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+    {
+      return n;
+    }
+
+    num_pkts = p_desc->hdr.bh1.num_pkts;
+    p_hdr = (struct tpacket3_hdr *)((uint8_t *)p_desc + p_desc->hdr.bh1.offset_to_first_pkt);
+    for (i = 0; i < num_pkts; i++)
+    {
+      eth_handle->n_bytes_recv += p_hdr->tp_snaplen;
+      p->payload = (uint8_t *)p_hdr + p_hdr->tp_mac;
+      p->len = MIN(p_hdr->tp_snaplen, OS_BUF_MAX_SIZE);
+      p->memory_type = MEMORY_TYPE_EXTERNAL;
+
+      handled = (eth_handle->callback != NULL) ? eth_handle->callback(eth_handle->arg, p) : 0;
+
+      /* A handled frame has been freed, or copied out by os_buf_keep() */
+      CC_ASSERT((handled == 0) || (p->memory_type == MEMORY_TYPE_FREE));
+      p->memory_type = MEMORY_TYPE_FREE;
+      p_hdr = (struct tpacket3_hdr *)((uint8_t *)p_hdr + p_hdr->tp_next_offset);
+    }
+    n += num_pkts;
+
+    __atomic_store_n(&p_desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    ring->next_block = (ring->next_block + 1) % OS_ETH_RX_RING_BLOCK_NR;
+  }
+}
+
+#if !defined (USE_RUN_TO_COMPLETION)
+/**
+ * @internal
+ * Receive loop of the Profinet socket when the receive ring is in use.
+ *
+ * @param eth_handle     InOut: The Ethernet handle.
+ * @param p_appdata      In:   Application data, for the running flag.
+ */
+static void os_eth_pf_task_rx_ring(os_eth_handle_t *eth_handle, app_data_t *p_appdata)
+{
+  struct pollfd          pfd;
+
+  pfd.fd = eth_handle->pf_socket;
+  pfd.events = POLLIN | POLLERR;
+  pfd.revents = 0;
+
+  while (p_appdata->running != false)
+  {
+    if (os_eth_rx_ring_poll(eth_handle) == 0)
+    {
+      poll(&pfd, 1, OS_ETH_RX_RING_POLL_TMO_MS);
+    }
+  }
+}
+#endif /* USE_RUN_TO_COMPLETION */
+#endif /* USE_PACKET_RX_RING */
+
+#if !defined (USE_RUN_TO_COMPLETION)
  /**
   * @internal
   * Run a thread that listens to incoming raw Ethernet sockets.
@@ -49,6 +239,20 @@ static void *os_eth_pf_task(void *thread_arg)
 
   eth_handle->n_bytes_recv = 0;
   eth_handle->n_bytes_sent = 0;
+
+#if defined (USE_PACKET_RX_RING)
+  if (eth_handle->rx_ring != NULL)
+  {
+    os_eth_pf_task_rx_ring(eth_handle, p_appdata);
+
+    os_log(LOG_LEVEL_INFO, "os_eth_task terminated\n");
+    os_eth_rx_ring_destroy(eth_handle->rx_ring);
+    os_mutex_destroy(eth_handle->mutex);
+    os_free(eth_handle);
+    return NULL;
+  }
+#endif /* USE_PACKET_RX_RING */
+
   os_buf_t *p = os_buf_alloc_with_wait(OS_BUF_MAX_SIZE);
 
   while (p_appdata->running != false)
@@ -135,6 +339,69 @@ static void *os_eth_lldp_task(void *thread_arg)
   return NULL;
 }
 
+#endif /* USE_RUN_TO_COMPLETION */
+
+/**
+ * @internal
+ * Pass all frames pending on a raw socket to the callback, without blocking.
+ *
+ * @param eth_handle     InOut: The Ethernet handle.
+ * @param socket         In:   The raw socket.
+ * @return  the number of frames handled.
+ */
+static int os_eth_recv_pending(os_eth_handle_t *eth_handle, int socket)
+{
+  os_buf_t        *p;
+  ssize_t          readlen;
+  int              handled;
+  int              n = 0;
+
+  for (;;)
+  {
+    p = os_buf_alloc_with_wait(OS_BUF_MAX_SIZE);
+    readlen = recv(socket, p->payload, OS_BUF_MAX_SIZE, MSG_DONTWAIT);
+    if (readlen <= 0)
+    {
+      os_buf_free(p);
+      return n;
+    }
+    p->len = readlen;
+    eth_handle->n_bytes_recv += readlen;
+    n++;
+
+    handled = (eth_handle->callback != NULL) ? eth_handle->callback(eth_handle->arg, p) : 0;
+    if (handled == 0)
+    {
+      os_buf_free(p);
+    }
+  }
+}
+
+int os_eth_poll(
+  os_eth_handle_t   *handle)
+{
+  int n = 0;
+
+  if (handle == NULL)
+  {
+    return -1;
+  }
+
+#if defined (USE_PACKET_RX_RING)
+  if (handle->rx_ring != NULL)
+  {
+    n = os_eth_rx_ring_poll(handle);
+  }
+  else
+#endif /* USE_PACKET_RX_RING */
+  {
+    n = os_eth_recv_pending(handle, handle->pf_socket);
+  }
+  n += os_eth_recv_pending(handle, handle->lldp_socket);
+
+  return n;
+}
+
 static int open_socket(
   const char        *if_name,
   int                protocol)
@@ -192,12 +459,29 @@ os_eth_handle_t *os_eth_init(
 
   handle->pf_socket = open_socket(if_name, OS_ETHTYPE_PROFINET);
   handle->lldp_socket = open_socket(if_name, OS_ETHTYPE_LLDP);
+  handle->rx_ring = NULL;
+  handle->send_queue_len = 0;
+  handle->send_drop_cnt = 0;
+#if defined (USE_PACKET_RX_RING)
+  if (handle->pf_socket > 0)
+  {
+    handle->rx_ring = os_eth_rx_ring_create(handle->pf_socket);
+  }
+#endif /* USE_PACKET_RX_RING */
   
   if (handle->pf_socket > 0 && handle->lldp_socket > 0)
   {
     handle->mutex       = os_mutex_create();
+#if defined (USE_RUN_TO_COMPLETION)
+    /* Frames are read by os_eth_poll(), from the run-to-completion loop */
+    handle->n_bytes_recv = 0;
+    handle->n_bytes_sent = 0;
+    handle->pf_thread   = NULL;
+    handle->lldp_thread = NULL;
+#else
     handle->pf_thread   = os_thread_create("os_eth_pf_task",   ETH_PRIO,  4096, os_eth_pf_task, handle);
     handle->lldp_thread = os_thread_create("os_eth_lldp_task", LLDP_PRIO, 4096, os_eth_lldp_task, handle);
+#endif
     return handle;
   }
   else
@@ -221,3 +505,104 @@ int os_eth_send(
   }
   return ret;
 }
+
+/**
+ * @internal
+ * Send the queued frames with sendmmsg().
+ *
+ * A frame the kernel refuses (e.g. send timeout) is dropped and counted,
+ * and sending continues with the next frame.
+ *
+ * The caller must hold handle->mutex.
+ *
+ * @param handle        InOut: Ethernet handle
+ * @return  The number of frames sent, or -1 if some frame could not be sent.
+ */
+static int os_eth_send_flush_locked(
+  os_eth_handle_t *handle)
+{
+  struct mmsghdr msgs[OS_ETH_SEND_BATCH_SIZE];
+  struct iovec   iov[OS_ETH_SEND_BATCH_SIZE];
+  uint32_t       ix;
+  uint32_t       pos = 0;
+  uint32_t       n_dropped = 0;
+  int            n_sent;
+
+  memset(msgs, 0, handle->send_queue_len * sizeof(msgs[0]));
+  for (ix = 0; ix < handle->send_queue_len; ix++)
+  {
+    iov[ix].iov_base = handle->send_queue[ix]->payload;
+    iov[ix].iov_len = handle->send_queue[ix]->len;
+    msgs[ix].msg_hdr.msg_iov = &iov[ix];
+    msgs[ix].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (pos < handle->send_queue_len)
+  {
+    n_sent = sendmmsg(handle->pf_socket, &msgs[pos], handle->send_queue_len - pos, 0);
+    if (n_sent > 0)
+    {
+      for (ix = pos; ix < pos + (uint32_t)n_sent; ix++)
+      {
+        handle->n_bytes_sent += msgs[ix].msg_len;
+      }
+      pos += (uint32_t)n_sent;
+    }
+    else if ((n_sent < 0) && (errno == EINTR))
+    {
+      continue;
+    }
+    else
+    {
+      /* Skip the frame the kernel refused */
+      n_dropped++;
+      pos++;
+    }
+  }
+
+  handle->send_queue_len = 0;
+  if (n_dropped > 0)
+  {
+    handle->send_drop_cnt += n_dropped;
+    os_log(LOG_LEVEL_ERROR, "os_eth_send_flush: %u frame(s) not sent, errno %i\n",
+           (unsigned)n_dropped, errno);
+    return -1;
+  }
+
+  return (int)pos;
+}
+
+int os_eth_send_queue(
+  os_eth_handle_t *handle,
+  os_buf_t *buf)
+{
+  int ret = -1;
+  if ((handle != NULL) && (buf != NULL))
+  {
+    os_mutex_lock(handle->mutex);
+    if (handle->send_queue_len >= NELEMENTS(handle->send_queue))
+    {
+      (void)os_eth_send_flush_locked(handle);
+    }
+    handle->send_queue[handle->send_queue_len++] = buf;
+    os_mutex_unlock(handle->mutex);
+    ret = buf->len;
+  }
+  return ret;
+}
+
+int os_eth_send_flush(
+  os_eth_handle_t *handle)
+{
+  int ret = 0;
+  if(handle != NULL)
+  {
+    os_mutex_lock(handle->mutex);
+    if (handle->send_queue_len > 0)
+    {
+      ret = os_eth_send_flush_locked(handle);
+    }
+    os_mutex_unlock(handle->mutex);
+  }
+  return ret;
+}
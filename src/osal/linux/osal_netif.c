@@ -0,0 +1,586 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+/*
+ * IP configuration of a network interface, via rtnetlink.
+ *
+ * os_netif_set_ip_suite() copies the request and returns. The "os_netif"
+ * thread applies the latest request over one rtnetlink socket: the other
+ * IPv4 addresses of the interface are deleted, the new address is added
+ * with its prefix length and broadcast address, and the default route is
+ * replaced if a gateway is given. A request replaced by a newer one before
+ * it is started is skipped. Nothing is forked.
+ */
+
+#include <osal.h>
+#include <log.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define OS_NETIF_MAX_ADDRS      16        /* IPv4 addresses of an interface handled */
+#define OS_NETIF_RECV_TIMEOUT_S 1
+#define OS_NETIF_BUF_SIZE       8192
+
+typedef struct os_netif_req
+{
+  char          ifname[IFNAMSIZ];
+  os_ipaddr_t   ipaddr;
+  os_ipaddr_t   netmask;
+  os_ipaddr_t   gw;
+  uint32_t      seq;
+  uint64_t      t_request_us;
+} os_netif_req_t;
+
+typedef struct os_netif_addr
+{
+  uint32_t      addr;                     /* Network byte order */
+  uint8_t       prefix_len;
+} os_netif_addr_t;
+
+/* Room for one rtnetlink request with a few attributes */
+typedef struct os_netif_msg
+{
+  struct nlmsghdr nh;
+  union
+  {
+    struct ifaddrmsg ifa;
+    struct rtmsg     rt;
+  } u;
+  uint8_t       attrs[64];
+} os_netif_msg_t;
+
+static pthread_once_t       netif_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t      netif_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       netif_cond;          /* Signalled on requests */
+static pthread_cond_t       netif_done_cond;     /* Broadcast when a request is done */
+static os_thread_t         *netif_thread;
+static bool                 netif_pending;
+static os_netif_req_t       netif_req;           /* The pending request */
+static uint32_t             netif_seq;           /* Of the latest request */
+static uint32_t             netif_done_seq;      /* Requests up to this one are done */
+static os_netif_cb_t        netif_cb;
+static void                *netif_cb_arg;
+static os_netif_stats_t     netif_stats;
+static int                  netif_fd = -1;       /* Owned by the thread */
+static uint32_t             netif_nl_seq;        /* Owned by the thread */
+static uint8_t              netif_buf[OS_NETIF_BUF_SIZE];   /* Owned by the thread */
+static int                  netif_route_if_index;  /* Of the default route set, 0 none. Owned by the thread */
+static uint32_t             netif_route_gw;        /* Network byte order. Owned by the thread */
+
+/**
+ * @internal
+ * Convert a netmask to a prefix length.
+ *
+ * @param netmask       In: The netmask, host byte order.
+ * @return  the prefix length, or -1 if the mask is 0 or not contiguous.
+ */
+static int os_netif_prefix_len(os_ipaddr_t netmask)
+{
+  int len = __builtin_popcount(netmask);
+
+  if ((len == 0) || (netmask != (0xFFFFFFFFU << (32 - len))))
+  {
+    return -1;
+  }
+
+  return len;
+}
+
+static void os_netif_add_attr(struct nlmsghdr *p_nh, size_t max_len, uint16_t type, const void *p_data, size_t len)
+{
+  struct rtattr *p_rta = (struct rtattr *)((uint8_t *)p_nh + NLMSG_ALIGN(p_nh->nlmsg_len));
+
+  if (NLMSG_ALIGN(p_nh->nlmsg_len) + RTA_SPACE(len) <= max_len)
+  {
+    p_rta->rta_type = type;
+    p_rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(p_rta), p_data, len);
+    p_nh->nlmsg_len = NLMSG_ALIGN(p_nh->nlmsg_len) + RTA_SPACE(len);
+  }
+}
+
+static int os_netif_open(void)
+{
+  struct sockaddr_nl local;
+  struct timeval     tmo = { .tv_sec = OS_NETIF_RECV_TIMEOUT_S };
+  int                fd;
+
+  fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  memset(&local, 0, sizeof(local));
+  local.nl_family = AF_NETLINK;
+  if ((bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0) ||
+      (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo)) != 0))
+  {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int os_netif_send(struct nlmsghdr *p_nh)
+{
+  struct sockaddr_nl kernel;
+
+  memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+  p_nh->nlmsg_seq = ++netif_nl_seq;
+  p_nh->nlmsg_flags |= NLM_F_REQUEST;
+
+  return (sendto(netif_fd, p_nh, p_nh->nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) ==
+          (ssize_t)p_nh->nlmsg_len) ? 0 : -1;
+}
+
+/**
+ * @internal
+ * Send a request and wait for its acknowledge.
+ *
+ * @return  0 on success, -1 with errno set on error.
+ */
+static int os_netif_request(struct nlmsghdr *p_nh)
+{
+  struct nlmsghdr *p_resp;
+  struct nlmsgerr *p_err;
+  ssize_t          n;
+
+  p_nh->nlmsg_flags |= NLM_F_ACK;
+  if (os_netif_send(p_nh) != 0)
+  {
+    return -1;
+  }
+
+  for (;;)
+  {
+    n = recv(netif_fd, netif_buf, sizeof(netif_buf), 0);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+    for (p_resp = (struct nlmsghdr *)netif_buf; NLMSG_OK(p_resp, (size_t)n); p_resp = NLMSG_NEXT(p_resp, n))
+    {
+      if ((p_resp->nlmsg_seq == p_nh->nlmsg_seq) && (p_resp->nlmsg_type == NLMSG_ERROR))
+      {
+        p_err = (struct nlmsgerr *)NLMSG_DATA(p_resp);
+        if (p_err->error != 0)
+        {
+          errno = -p_err->error;
+          return -1;
+        }
+        return 0;
+      }
+    }
+  }
+}
+
+/**
+ * @internal
+ * Get the IPv4 addresses of an interface.
+ *
+ * @return  the number of addresses, or -1 on error.
+ */
+static int os_netif_get_addrs(int if_index, os_netif_addr_t *p_addrs)
+{
+  os_netif_msg_t    msg;
+  struct nlmsghdr  *p_resp;
+  struct ifaddrmsg *p_ifa;
+  struct rtattr    *p_rta;
+  int               rta_len;
+  ssize_t           n;
+  int               n_addrs = 0;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  msg.nh.nlmsg_type = RTM_GETADDR;
+  msg.nh.nlmsg_flags = NLM_F_DUMP;
+  msg.u.ifa.ifa_family = AF_INET;
+  if (os_netif_send(&msg.nh) != 0)
+  {
+    return -1;
+  }
+
+  for (;;)
+  {
+    n = recv(netif_fd, netif_buf, sizeof(netif_buf), 0);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+    for (p_resp = (struct nlmsghdr *)netif_buf; NLMSG_OK(p_resp, (size_t)n); p_resp = NLMSG_NEXT(p_resp, n))
+    {
+      if (p_resp->nlmsg_seq != msg.nh.nlmsg_seq)
+      {
+        continue;
+      }
+      if (p_resp->nlmsg_type == NLMSG_DONE)
+      {
+        return n_addrs;
+      }
+      if (p_resp->nlmsg_type == NLMSG_ERROR)
+      {
+        errno = -((struct nlmsgerr *)NLMSG_DATA(p_resp))->error;
+        return -1;
+      }
+      p_ifa = (struct ifaddrmsg *)NLMSG_DATA(p_resp);
+      if ((p_resp->nlmsg_type != RTM_NEWADDR) || ((int)p_ifa->ifa_index != if_index) ||
+          (n_addrs >= OS_NETIF_MAX_ADDRS))
+      {
+        continue;
+      }
+      rta_len = IFA_PAYLOAD(p_resp);
+      for (p_rta = IFA_RTA(p_ifa); RTA_OK(p_rta, rta_len); p_rta = RTA_NEXT(p_rta, rta_len))
+      {
+        if (p_rta->rta_type == IFA_LOCAL)
+        {
+          memcpy(&p_addrs[n_addrs].addr, RTA_DATA(p_rta), sizeof(p_addrs[n_addrs].addr));
+          p_addrs[n_addrs].prefix_len = p_ifa->ifa_prefixlen;
+          n_addrs++;
+          break;
+        }
+      }
+    }
+  }
+}
+
+static int os_netif_addr_request(uint16_t type, uint16_t flags, int if_index, uint32_t addr, uint8_t prefix_len)
+{
+  os_netif_msg_t msg;
+  uint32_t       broadcast;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  msg.nh.nlmsg_type = type;
+  msg.nh.nlmsg_flags = flags;
+  msg.u.ifa.ifa_family = AF_INET;
+  msg.u.ifa.ifa_prefixlen = prefix_len;
+  msg.u.ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+  msg.u.ifa.ifa_index = if_index;
+  os_netif_add_attr(&msg.nh, sizeof(msg), IFA_LOCAL, &addr, sizeof(addr));
+  os_netif_add_attr(&msg.nh, sizeof(msg), IFA_ADDRESS, &addr, sizeof(addr));
+  if ((type == RTM_NEWADDR) && (prefix_len < 31))
+  {
+    broadcast = addr | htonl(0xFFFFFFFFU >> prefix_len);
+    os_netif_add_attr(&msg.nh, sizeof(msg), IFA_BROADCAST, &broadcast, sizeof(broadcast));
+  }
+
+  return os_netif_request(&msg.nh);
+}
+
+/**
+ * @internal
+ * Add, replace or delete the default route of the stack. It has its own
+ * metric, so the other default routes are neither replaced nor deleted.
+ *
+ * @param type          In: RTM_NEWROUTE or RTM_DELROUTE.
+ * @param if_index      In: Interface.
+ * @param gw            In: Gateway, network byte order.
+ * @return  0 on success, -1 with errno set on error.
+ */
+static int os_netif_default_route(uint16_t type, int if_index, uint32_t gw)
+{
+  os_netif_msg_t msg;
+  uint32_t       oif = (uint32_t)if_index;
+  uint32_t       metric = OS_NETIF_ROUTE_METRIC;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+  msg.nh.nlmsg_type = type;
+  msg.nh.nlmsg_flags = (type == RTM_NEWROUTE) ? (NLM_F_CREATE | NLM_F_REPLACE) : 0;
+  msg.u.rt.rtm_family = AF_INET;
+  msg.u.rt.rtm_dst_len = 0;
+  msg.u.rt.rtm_table = RT_TABLE_MAIN;
+  msg.u.rt.rtm_protocol = RTPROT_BOOT;
+  msg.u.rt.rtm_scope = RT_SCOPE_UNIVERSE;
+  msg.u.rt.rtm_type = RTN_UNICAST;
+  os_netif_add_attr(&msg.nh, sizeof(msg), RTA_GATEWAY, &gw, sizeof(gw));
+  os_netif_add_attr(&msg.nh, sizeof(msg), RTA_OIF, &oif, sizeof(oif));
+  os_netif_add_attr(&msg.nh, sizeof(msg), RTA_PRIORITY, &metric, sizeof(metric));
+
+  return os_netif_request(&msg.nh);
+}
+
+/**
+ * @internal
+ * Apply a request. Called by the thread.
+ *
+ * @return  0 on success, -1 with errno set on error.
+ */
+static int os_netif_apply(const os_netif_req_t *p_req)
+{
+  os_netif_addr_t addrs[OS_NETIF_MAX_ADDRS];
+  uint32_t        addr = htonl(p_req->ipaddr);
+  int             prefix_len = os_netif_prefix_len(p_req->netmask);
+  int             if_index;
+  int             n_addrs;
+  int             ix;
+  int             n_deleted = 0;
+  bool            b_present = false;
+
+  if (prefix_len < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  if_index = (int)if_nametoindex(p_req->ifname);
+  if (if_index == 0)
+  {
+    return -1;
+  }
+  if ((netif_fd < 0) && ((netif_fd = os_netif_open()) < 0))
+  {
+    return -1;
+  }
+
+  n_addrs = os_netif_get_addrs(if_index, addrs);
+  if (n_addrs < 0)
+  {
+    return -1;
+  }
+
+  /* Replace the addresses, as ifconfig did. Keep the new one if already set */
+  for (ix = 0; ix < n_addrs; ix++)
+  {
+    if ((addrs[ix].addr == addr) && (addrs[ix].prefix_len == prefix_len))
+    {
+      b_present = true;
+    }
+    else if (os_netif_addr_request(RTM_DELADDR, 0, if_index, addrs[ix].addr, addrs[ix].prefix_len) != 0)
+    {
+      return -1;
+    }
+    else
+    {
+      n_deleted++;
+    }
+  }
+  /* Deleting a primary address also deletes its secondaries */
+  if (((b_present == false) || (n_deleted > 0)) &&
+      (os_netif_addr_request(RTM_NEWADDR, NLM_F_CREATE | NLM_F_REPLACE, if_index, addr, (uint8_t)prefix_len) != 0))
+  {
+    return -1;
+  }
+
+  /* 0.0.0.0, or the own address, means no gateway. The route set before
+   * is replaced, or deleted. It may be gone with the address deleted above */
+  if ((p_req->gw != 0) && (p_req->gw != p_req->ipaddr))
+  {
+    if (os_netif_default_route(RTM_NEWROUTE, if_index, htonl(p_req->gw)) != 0)
+    {
+      return -1;
+    }
+    netif_route_if_index = if_index;
+    netif_route_gw = htonl(p_req->gw);
+  }
+  else if (netif_route_if_index != 0)
+  {
+    if ((os_netif_default_route(RTM_DELROUTE, netif_route_if_index, netif_route_gw) != 0) &&
+        (errno != ESRCH))
+    {
+      return -1;
+    }
+    netif_route_if_index = 0;
+  }
+
+  return 0;
+}
+
+static void *os_netif_thread(void *arg)
+{
+  os_netif_req_t     req;
+  os_netif_result_t  result;
+  os_netif_cb_t      cb;
+  void              *cb_arg;
+  uint64_t           t_start;
+  uint64_t           t_done;
+
+  (void)arg;
+  for (;;)
+  {
+    pthread_mutex_lock(&netif_mutex);
+    while (netif_pending == false)
+    {
+      pthread_cond_wait(&netif_cond, &netif_mutex);
+    }
+    req = netif_req;
+    netif_pending = false;
+    pthread_mutex_unlock(&netif_mutex);
+
+    t_start = os_get_current_time_us();
+    result.seq = req.seq;
+    result.result = os_netif_apply(&req);
+    result.error = (result.result == 0) ? 0 : errno;
+    t_done = os_get_current_time_us();
+    result.queue_us = (uint32_t)(t_start - req.t_request_us);
+    result.apply_us = (uint32_t)(t_done - t_start);
+    if (result.result != 0)
+    {
+      os_log(LOG_LEVEL_ERROR, "os_netif: could not configure %s: %s\n", req.ifname, strerror(result.error));
+    }
+
+    pthread_mutex_lock(&netif_mutex);
+    if (result.result == 0)
+    {
+      netif_stats.n_done++;
+    }
+    else
+    {
+      netif_stats.n_errors++;
+    }
+    netif_stats.apply_us_last = result.apply_us;
+    if (result.apply_us > netif_stats.apply_us_max)
+    {
+      netif_stats.apply_us_max = result.apply_us;
+    }
+    cb = netif_cb;
+    cb_arg = netif_cb_arg;
+    pthread_mutex_unlock(&netif_mutex);
+
+    if (cb != NULL)
+    {
+      cb(cb_arg, &result);
+    }
+
+    pthread_mutex_lock(&netif_mutex);
+    netif_done_seq = req.seq;
+    pthread_cond_broadcast(&netif_done_cond);
+    pthread_mutex_unlock(&netif_mutex);
+  }
+
+  return NULL;
+}
+
+static void os_netif_init(void)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&netif_cond, &attr);
+  pthread_cond_init(&netif_done_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  netif_thread = os_thread_create_background("os_netif", 16 * 1024, os_netif_thread, NULL);
+}
+
+void os_netif_start(void)
+{
+  pthread_once(&netif_once, os_netif_init);
+}
+
+void os_netif_set_callback(os_netif_cb_t cb, void *arg)
+{
+  pthread_mutex_lock(&netif_mutex);
+  netif_cb = cb;
+  netif_cb_arg = arg;
+  pthread_mutex_unlock(&netif_mutex);
+}
+
+int os_netif_set_ip_suite(
+  const char  *p_ifname,
+  os_ipaddr_t ipaddr,
+  os_ipaddr_t netmask,
+  os_ipaddr_t gw,
+  uint32_t    *p_seq)
+{
+  if ((strlen(p_ifname) >= IFNAMSIZ) || (os_netif_prefix_len(netmask) < 0))
+  {
+    return -1;
+  }
+  os_netif_start();
+  if (netif_thread == NULL)
+  {
+    return -1;
+  }
+
+  pthread_mutex_lock(&netif_mutex);
+  if (netif_pending)
+  {
+    netif_stats.n_superseded++;
+  }
+  strcpy(netif_req.ifname, p_ifname);
+  netif_req.ipaddr = ipaddr;
+  netif_req.netmask = netmask;
+  netif_req.gw = gw;
+  netif_req.seq = ++netif_seq;
+  netif_req.t_request_us = os_get_current_time_us();
+  netif_pending = true;
+  netif_stats.n_requests++;
+  if (p_seq != NULL)
+  {
+    *p_seq = netif_req.seq;
+  }
+  pthread_cond_signal(&netif_cond);
+  pthread_mutex_unlock(&netif_mutex);
+
+  return 0;
+}
+
+int os_netif_flush(uint32_t timeout_ms)
+{
+  struct timespec deadline;
+  uint32_t        target;
+  int             rv = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000 * 1000;
+  if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000 * 1000 * 1000;
+  }
+
+  pthread_mutex_lock(&netif_mutex);
+  target = netif_seq;
+  while ((rv == 0) && ((int32_t)(target - netif_done_seq) > 0))
+  {
+    if (pthread_cond_timedwait(&netif_done_cond, &netif_mutex, &deadline) == ETIMEDOUT)
+    {
+      rv = ((int32_t)(target - netif_done_seq) > 0) ? -1 : 0;
+    }
+  }
+  pthread_mutex_unlock(&netif_mutex);
+
+  return rv;
+}
+
+void os_netif_get_stats(os_netif_stats_t *p_stats)
+{
+  pthread_mutex_lock(&netif_mutex);
+  *p_stats = netif_stats;
+  pthread_mutex_unlock(&netif_mutex);
+}
@@ -34,6 +34,16 @@ extern "C"
 
 #define OS_BUF_MAX_SIZE 1522
 
+/* Max number of frames queued by os_eth_send_queue() before they are sent */
+#define OS_ETH_SEND_BATCH_SIZE 32
+
+/* Values of os_buf_t.memory_type */
+#define MEMORY_TYPE_FREE          0x0
+#define MEMORY_TYPE_STATIC_SEND   0x1
+#define MEMORY_TYPE_STATIC_RECV   0x2
+#define MEMORY_TYPE_MALLOC        0x4
+#define MEMORY_TYPE_EXTERNAL      0x8   /* Owned elsewhere, freed via os_buf_t.release */
+
 typedef pthread_t os_thread_t;
 typedef pthread_mutex_t os_mutex_t;
 
@@ -51,26 +61,23 @@ typedef struct os_event
   uint32_t flags;
 } os_event_t;
 
-typedef struct os_mbox
-{
-  pthread_mutex_t mutex;
-  size_t r;
-  size_t w;
-  size_t count;
-  size_t size;
-  void * msg[];
-} os_mbox_t;
+/* Lock-free ring, defined in osal.c */
+typedef struct os_mbox os_mbox_t;
 
 typedef struct os_timer
 {
-  os_thread_t *thread;
   void(*fn) (struct os_timer *, void * arg);
   void * arg;
   uint32_t us;
-  timer_t timerid;
-  pid_t thread_id;
-  bool exit;
+  int fd;                    /* timerfd, in the epoll set of the timer service */
   bool oneshot;
+  uint64_t period_ns;        /* Period in use, set by os_timer_start() */
+  uint64_t expected_ns;      /* CLOCK_MONOTONIC time of the next expiry */
+  uint32_t n_expiries;
+  uint32_t n_overruns;
+  uint32_t jitter_ns_max;
+  uint64_t jitter_ns_total;
+  struct os_timer *next_free; /* Destroyed by a callback, freed after its round */
 } os_timer_t;
 
 typedef struct os_buf
@@ -78,8 +85,8 @@ typedef struct os_buf
   void     *payload;
   uint32_t len;
   uint32_t  memory_type;
-  uint32_t *ptr_to_memory_type;
   uint32_t  idx_to_static_buf;
+  void    (*release)(struct os_buf *p);   /* For MEMORY_TYPE_EXTERNAL */
 #ifdef _DEBUG
   const char *m_p_alloc_file;
   int         m_alloc_line;
@@ -113,6 +120,10 @@ typedef struct os_eth_handle
   int                     lldp_socket;
   os_thread_t             *pf_thread;
   os_thread_t             *lldp_thread;
+  struct os_eth_rx_ring   *rx_ring;       /* PACKET_RX_RING of pf_socket, or NULL if recv() is used */
+  os_buf_t                *send_queue[OS_ETH_SEND_BATCH_SIZE];  /* Protected by mutex */
+  uint32_t                send_queue_len;
+  uint32_t                send_drop_cnt;  /* Queued frames the kernel did not accept */
 } os_eth_handle_t;
 
 #ifdef __cplusplus
@@ -13,6 +13,10 @@
  * full license information.
  ********************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* ppoll(), recvmmsg(), sendmmsg() */
+#endif
+
 #include <string.h>
 #include "pf_includes.h"
 #include <stdio.h>
@@ -22,6 +26,10 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <netpacket/packet.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
 
 
 int os_udp_open(os_ipaddr_t addr, os_ipport_t port)
@@ -101,6 +109,89 @@ int os_udp_recvfrom(uint32_t id,
   return len;
 }
 
+/* Max nbr of datagrams passed to one recvmmsg() or sendmmsg() */
+#define OS_UDP_MAX_BATCH   16
+
+int os_udp_recvmmsg(uint32_t id,
+                    os_udp_msg_t *p_msgs,
+                    int nbr_msgs)
+{
+  struct mmsghdr     hdrs[OS_UDP_MAX_BATCH];
+  struct iovec       iovs[OS_UDP_MAX_BATCH];
+  struct sockaddr_in remotes[OS_UDP_MAX_BATCH];
+  int                n;
+  int                ix;
+
+  nbr_msgs = MIN(nbr_msgs, OS_UDP_MAX_BATCH);
+  memset(hdrs, 0, nbr_msgs * sizeof(hdrs[0]));
+  for (ix = 0; ix < nbr_msgs; ix++)
+  {
+    iovs[ix].iov_base = p_msgs[ix].data;
+    iovs[ix].iov_len = p_msgs[ix].size;
+    hdrs[ix].msg_hdr.msg_iov = &iovs[ix];
+    hdrs[ix].msg_hdr.msg_iovlen = 1;
+    hdrs[ix].msg_hdr.msg_name = &remotes[ix];
+    hdrs[ix].msg_hdr.msg_namelen = sizeof(remotes[ix]);
+  }
+
+  n = recvmmsg(id, hdrs, nbr_msgs, MSG_DONTWAIT, NULL);
+  if (n < 0)
+  {
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? 0 : -1;
+  }
+  for (ix = 0; ix < n; ix++)
+  {
+    p_msgs[ix].len = hdrs[ix].msg_len;
+    p_msgs[ix].addr = ntohl(remotes[ix].sin_addr.s_addr);
+    p_msgs[ix].port = ntohs(remotes[ix].sin_port);
+  }
+
+  return n;
+}
+
+int os_udp_sendmmsg(uint32_t id,
+                    const os_udp_msg_t *p_msgs,
+                    int nbr_msgs)
+{
+  struct mmsghdr     hdrs[OS_UDP_MAX_BATCH];
+  struct iovec       iovs[OS_UDP_MAX_BATCH];
+  struct sockaddr_in remotes[OS_UDP_MAX_BATCH];
+  int                sent = 0;
+  int                batch;
+  int                n;
+  int                ix;
+
+  while (sent < nbr_msgs)
+  {
+    batch = MIN(nbr_msgs - sent, OS_UDP_MAX_BATCH);
+    memset(hdrs, 0, batch * sizeof(hdrs[0]));
+    for (ix = 0; ix < batch; ix++)
+    {
+      remotes[ix] = (struct sockaddr_in) {
+         .sin_family = AF_INET,
+         .sin_addr.s_addr = htonl(p_msgs[sent + ix].addr),
+         .sin_port = htons(p_msgs[sent + ix].port),
+         .sin_zero = { 0 },
+      };
+      iovs[ix].iov_base = p_msgs[sent + ix].data;
+      iovs[ix].iov_len = p_msgs[sent + ix].size;
+      hdrs[ix].msg_hdr.msg_iov = &iovs[ix];
+      hdrs[ix].msg_hdr.msg_iovlen = 1;
+      hdrs[ix].msg_hdr.msg_name = &remotes[ix];
+      hdrs[ix].msg_hdr.msg_namelen = sizeof(remotes[ix]);
+    }
+
+    n = sendmmsg(id, hdrs, batch, 0);
+    if (n <= 0)
+    {
+      return -1;
+    }
+    sent += n;
+  }
+
+  return sent;
+}
+
 void os_udp_close(uint32_t id)
 {
   if (id > 0)
@@ -108,3 +199,72 @@ void os_udp_close(uint32_t id)
     close(id);
   }
 }
+
+/* Max nbr of ready sockets fetched by one os_udp_poll_wait() */
+#define OS_UDP_POLL_MAX_EVENTS   16
+
+int os_udp_poll_create(void)
+{
+  return epoll_create1(EPOLL_CLOEXEC);
+}
+
+int os_udp_poll_add(int poll_id, uint32_t id)
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = id;
+
+  return epoll_ctl(poll_id, EPOLL_CTL_ADD, id, &ev);
+}
+
+void os_udp_poll_remove(int poll_id, uint32_t id)
+{
+  (void)epoll_ctl(poll_id, EPOLL_CTL_DEL, id, NULL);
+}
+
+int os_udp_poll_wait(int poll_id, uint32_t *p_ready, int max_ready, uint32_t timeout_us)
+{
+  struct epoll_event events[OS_UDP_POLL_MAX_EVENTS];
+  struct pollfd      pfd;
+  struct timespec    timeout;
+  int                n;
+  int                ix;
+
+  if (timeout_us > 0)
+  {
+    /* epoll_wait() only has millisecond resolution. Wait on the epoll fd
+       itself with ppoll(), which takes a timespec. */
+    pfd.fd = poll_id;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    timeout.tv_sec = timeout_us / 1000000;
+    timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+    n = ppoll(&pfd, 1, &timeout, NULL);
+    if (n <= 0)
+    {
+      return ((n < 0) && (errno != EINTR)) ? -1 : 0;
+    }
+  }
+
+  n = epoll_wait(poll_id, events, MIN(max_ready, OS_UDP_POLL_MAX_EVENTS), 0);
+  if (n < 0)
+  {
+    return (errno == EINTR) ? 0 : -1;
+  }
+  for (ix = 0; ix < n; ix++)
+  {
+    p_ready[ix] = events[ix].data.u32;
+  }
+
+  return n;
+}
+
+void os_udp_poll_destroy(int poll_id)
+{
+  if (poll_id >= 0)
+  {
+    close(poll_id);
+  }
+}
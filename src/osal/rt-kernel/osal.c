@@ -82,17 +82,44 @@ void os_log (int type, const char * fmt, ...)
    va_end (list);
 }
 
+void os_log_get_stats(os_log_stats_t *p_stats)
+{
+   /* os_log() writes directly */
+   memset(p_stats, 0, sizeof(*p_stats));
+}
+
+void os_log_flush(void)
+{
+}
+
 void * os_malloc (size_t size)
 {
    return malloc (size);
 }
 
+void os_mem_get_stats(os_mem_stats_t *p_stats)
+{
+   /* The rt-kernel heap is not instrumented */
+   memset(p_stats, 0, sizeof(*p_stats));
+   p_stats->p_backend = "malloc";
+}
+
+void os_mem_reset_stats(void)
+{
+}
+
 os_thread_t * os_thread_create (const char * name, int priority,
         int stacksize, void (*entry) (void * arg), void * arg)
 {
    return task_spawn (name, entry, priority, stacksize, arg);
 }
 
+int os_rt_configure (const os_rt_cfg_t * p_cfg)
+{
+   /* Not supported, rt-kernel tasks get their priority from task_spawn() */
+   return -1;
+}
+
 os_mutex_t * os_mutex_create (void)
 {
    return mtx_create();
@@ -123,6 +150,11 @@ uint32_t os_get_current_time_us (void)
    return 1000 * tick_to_ms (tick_get());
 }
 
+uint64_t os_get_current_time_ns (void)
+{
+   return (uint64_t)tick_to_ms (tick_get()) * 1000 * 1000;
+}
+
 os_sem_t * os_sem_create (size_t count)
 {
    return sem_create (count);
@@ -212,6 +244,11 @@ int os_mbox_fetch (os_mbox_t * mbox, void ** msg, uint32_t time)
    return tmo;
 }
 
+int os_mbox_fetch_wait (os_mbox_t * mbox, void ** msg, uint32_t time_us)
+{
+   return os_mbox_fetch (mbox, msg, (time_us == OS_WAIT_FOREVER) ? OS_WAIT_FOREVER : time_us / 1000);
+}
+
 int os_mbox_post (os_mbox_t * mbox, void * msg, uint32_t time)
 {
    int tmo = 0;
@@ -260,6 +297,18 @@ void os_timer_destroy (os_timer_t * timer)
    tmr_destroy (timer);
 }
 
+int os_run_to_completion (const os_rtc_cfg_t * p_cfg)
+{
+   /* Not supported, the stack is driven by rt-kernel tasks */
+   return -1;
+}
+
+void os_timer_get_stats (os_timer_t * timer, os_timer_stats_t * p_stats)
+{
+   /* Not measured, the rt-kernel timers run in the kernel tick */
+   memset (p_stats, 0, sizeof(*p_stats));
+}
+
 os_buf_t * os_buf_alloc(uint16_t length)
 {
    return pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
@@ -277,6 +326,25 @@ uint8_t os_buf_header(os_buf_t *p, int16_t header_size_increment)
    return pbuf_header(p, header_size_increment);
 }
 
+os_buf_t *os_buf_keep(os_buf_t *p)
+{
+   /* Received pbufs are owned by the stack */
+   return p;
+}
+
+void os_buf_get_stats(os_buf_stats_t *p_send, os_buf_stats_t *p_recv)
+{
+   /* The lwIP pbuf pool keeps its own statistics */
+   if (p_send != NULL)
+   {
+      memset(p_send, 0, sizeof(*p_send));
+   }
+   if (p_recv != NULL)
+   {
+      memset(p_recv, 0, sizeof(*p_recv));
+   }
+}
+
 void os_get_button(uint16_t id, bool *p_pressed)
 {
    if (id == 0)
@@ -95,3 +95,24 @@ int os_eth_send(
    }
    return ret;
 }
+
+int os_eth_send_queue(
+   os_eth_handle_t   *handle,
+   os_buf_t          *buf)
+{
+   /* lwIP has no batched link output - send right away */
+   return os_eth_send(handle, buf);
+}
+
+int os_eth_send_flush(
+   os_eth_handle_t   *handle)
+{
+   return 0;
+}
+
+int os_eth_poll(
+   os_eth_handle_t   *handle)
+{
+   /* Frames are delivered by the lwIP input hook */
+   return -1;
+}
@@ -96,7 +96,160 @@ int os_udp_recvfrom(uint32_t id,
    return len;
 }
 
+/* lwIP has no recvmmsg()/sendmmsg(). Loop over the datagrams instead. */
+int os_udp_recvmmsg(uint32_t id,
+      os_udp_msg_t *p_msgs,
+      int nbr_msgs)
+{
+   int ix;
+   int len;
+
+   for (ix = 0; ix < nbr_msgs; ix++)
+   {
+      len = os_udp_recvfrom(id, &p_msgs[ix].addr, &p_msgs[ix].port, p_msgs[ix].data, p_msgs[ix].size);
+      if (len <= 0)
+      {
+         break;
+      }
+      p_msgs[ix].len = len;
+   }
+
+   return ix;
+}
+
+int os_udp_sendmmsg(uint32_t id,
+      const os_udp_msg_t *p_msgs,
+      int nbr_msgs)
+{
+   int ix;
+
+   for (ix = 0; ix < nbr_msgs; ix++)
+   {
+      if (os_udp_sendto(id, p_msgs[ix].addr, p_msgs[ix].port, p_msgs[ix].data, p_msgs[ix].size) != p_msgs[ix].size)
+      {
+         return (ix > 0) ? ix : -1;
+      }
+   }
+
+   return ix;
+}
+
 void os_udp_close(uint32_t id)
 {
    close(id);
 }
+
+/* lwIP has no epoll. A poll set is a list of sockets, waited on with select(). */
+#define OS_UDP_POLL_MAX_SETS     2
+#define OS_UDP_POLL_MAX_SOCKETS  8
+
+typedef struct os_udp_poll_set
+{
+   bool        in_use;
+   uint32_t    ids[OS_UDP_POLL_MAX_SOCKETS];
+   int         nbr_ids;
+} os_udp_poll_set_t;
+
+static os_udp_poll_set_t os_udp_poll_sets[OS_UDP_POLL_MAX_SETS];
+
+int os_udp_poll_create(void)
+{
+   int ix;
+
+   for (ix = 0; ix < OS_UDP_POLL_MAX_SETS; ix++)
+   {
+      if (os_udp_poll_sets[ix].in_use == false)
+      {
+         memset(&os_udp_poll_sets[ix], 0, sizeof(os_udp_poll_sets[ix]));
+         os_udp_poll_sets[ix].in_use = true;
+         return ix;
+      }
+   }
+
+   return -1;
+}
+
+int os_udp_poll_add(int poll_id, uint32_t id)
+{
+   os_udp_poll_set_t *p_set;
+
+   if ((poll_id < 0) || (poll_id >= OS_UDP_POLL_MAX_SETS))
+   {
+      return -1;
+   }
+   p_set = &os_udp_poll_sets[poll_id];
+   if (p_set->nbr_ids >= OS_UDP_POLL_MAX_SOCKETS)
+   {
+      return -1;
+   }
+   p_set->ids[p_set->nbr_ids++] = id;
+
+   return 0;
+}
+
+void os_udp_poll_remove(int poll_id, uint32_t id)
+{
+   os_udp_poll_set_t *p_set;
+   int ix;
+
+   if ((poll_id < 0) || (poll_id >= OS_UDP_POLL_MAX_SETS))
+   {
+      return;
+   }
+   p_set = &os_udp_poll_sets[poll_id];
+   for (ix = 0; ix < p_set->nbr_ids; ix++)
+   {
+      if (p_set->ids[ix] == id)
+      {
+         p_set->ids[ix] = p_set->ids[--p_set->nbr_ids];
+         return;
+      }
+   }
+}
+
+int os_udp_poll_wait(int poll_id, uint32_t *p_ready, int max_ready, uint32_t timeout_us)
+{
+   os_udp_poll_set_t *p_set;
+   fd_set   readset;
+   struct timeval tv;
+   int      maxfd = -1;
+   int      ix;
+   int      n = 0;
+
+   if ((poll_id < 0) || (poll_id >= OS_UDP_POLL_MAX_SETS))
+   {
+      return -1;
+   }
+   p_set = &os_udp_poll_sets[poll_id];
+
+   FD_ZERO(&readset);
+   for (ix = 0; ix < p_set->nbr_ids; ix++)
+   {
+      FD_SET((int)p_set->ids[ix], &readset);
+      maxfd = MAX(maxfd, (int)p_set->ids[ix]);
+   }
+   tv.tv_sec = timeout_us / 1000000;
+   tv.tv_usec = timeout_us % 1000000;
+
+   if (select(maxfd + 1, &readset, NULL, NULL, &tv) <= 0)
+   {
+      return 0;
+   }
+   for (ix = 0; (ix < p_set->nbr_ids) && (n < max_ready); ix++)
+   {
+      if (FD_ISSET((int)p_set->ids[ix], &readset))
+      {
+         p_ready[n++] = p_set->ids[ix];
+      }
+   }
+
+   return n;
+}
+
+void os_udp_poll_destroy(int poll_id)
+{
+   if ((poll_id >= 0) && (poll_id < OS_UDP_POLL_MAX_SETS))
+   {
+      os_udp_poll_sets[poll_id].in_use = false;
+   }
+}
@@ -39,12 +39,15 @@ extern "C"
 #include "pf_cpm.h"
 #include "pf_dcp.h"
 #include "pf_eth.h"
+#include "pf_histogram.h"
 #include "pf_lldp.h"
 #include "pf_ppm.h"
 #include "pf_ptcp.h"
 #include "pf_scheduler.h"
+#include "pf_trace.h"
 
 /* device */
+#include "pf_arena.h"
 #include "pf_cmdev.h"
 #include "pf_cmdmc.h"
 #include "pf_cmina.h"
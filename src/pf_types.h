@@ -68,6 +68,10 @@ typedef uint16_t os_ipport_t;
 #define PF_FRAME_BUFFER_SIZE  1500
 
 #define PF_MAX_UDP_PAYLOAD_SIZE           1440
+#define PF_CMRPC_UDP_BATCH                8           /* Max nbr of RPC datagrams read or sent per system call */
+#define PF_CMRPC_UNPOLLED_WAIT_US         1000        /* Max wait for RPC datagrams, if some sockets cannot be polled */
+#define PF_CMRDR_CACHE_ENTRIES            16          /* Nbr of serialized records kept by CMRDR */
+#define PF_CMRDR_CACHE_BODY_SIZE          512         /* Max size of a serialized record kept by CMRDR */
 #define PF_LLDP_TIMEOUT                   10000000ULL // = 10s in us
 // #define DHT_ADJUST_INIT                   0
 // #define DHT_ADJUST_RELAX                  1
@@ -677,24 +681,61 @@ typedef struct pf_alarm_err
     */
 } pf_alarm_err_t;
 
-#define PF_MAX_SESSION                    (2*(PNET_MAX_AR) + 1)               /* 2 per ar, and one spare. */
+/*
+ * The tables below are sized at runtime from pnet_cfg_t.max_ar, see
+ * pf_arena_create(). The PF_xxx_FOR(n_ar) macros give the size for n_ar
+ * ARs, and the PF_MAX_xxx macros the size for PNET_MAX_AR ARs.
+ */
+#define PF_SESSIONS_FOR(n_ar)             (2 * (n_ar) + 1)                    /* 2 per ar, and one spare. */
+#define PF_MAX_SESSION                    PF_SESSIONS_FOR(PNET_MAX_AR)
 
 /*
- * Keep this value small as it define the number of entries in the
- * frame id map and all entries are probed until a match is found.
+ * Number of entries in the frame id map. Received frames are looked up
+ * through a hash index (see PF_ETH_HASH_MIN), so the lookup cost does not
+ * depend on this value.
  *
  * Each input CR may have 2 frameIds (for RTC3)
  * Add space for DCP:     0xfefc..0xfeff.
  * Add space for alarms:  0xfc01, 0xfe01.
  */
-#define PF_ETH_MAX_MAP                    ((PNET_MAX_API) * (PNET_MAX_AR) * (PNET_MAX_CR) * 2 + 4 + 2)
+#define PF_ETH_MAP_FOR(n_ar)              ((PNET_MAX_API) * (n_ar) * (PNET_MAX_CR) * 2 + 4 + 2)
+#define PF_ETH_MAX_MAP                    PF_ETH_MAP_FOR(PNET_MAX_AR)
+
+/*
+ * Number of buckets in the frame id hash index, at least.
+ * It is a power of two, and at least twice the map size so that the
+ * chains stay short (normally one entry) regardless of the map size.
+ */
+#define PF_ETH_HASH_MIN                   32
+
+#define PF_ETH_HASH_NONE                  0xFFFF   /* End of hash chain */
 
 /**
  * The scheduler is used by both the CPM and PPM machines.
  * The DCP uses the scheduler for responding to multi-cast messages.
  * pf_cmsm uses it to supervise the startup sequence.
  */
+#ifndef PF_MAX_TIMEOUTS
 #define PF_MAX_TIMEOUTS                   (2 * (PNET_MAX_AR) * (PNET_MAX_CR) + 10)
+#endif
+/* PF_MAX_TIMEOUTS is for PNET_MAX_AR ARs. Each AR more or less needs 2 per CR. */
+#define PF_TIMEOUTS_FOR(n_ar)             ((PF_MAX_TIMEOUTS) + 2 * (PNET_MAX_CR) * ((int)(n_ar) - (PNET_MAX_AR)))
+
+/**
+ * The scheduler keeps its timeouts in a hierarchical timing wheel.
+ * Each level has PF_SCHEDULER_WHEEL_SLOTS slots, and a slot on level n
+ * spans PF_SCHEDULER_WHEEL_SLOTS^n scheduler ticks.
+ * Four levels of 64 slots cover 2^24 ticks. Timeouts further away are
+ * parked in the last level and re-inserted when it is reached.
+ */
+#define PF_SCHEDULER_WHEEL_BITS           6
+#define PF_SCHEDULER_WHEEL_SLOTS          (1U << PF_SCHEDULER_WHEEL_BITS)
+#define PF_SCHEDULER_WHEEL_LEVELS         4
+
+/* List heads: all wheel slots, then the expired list and the free list */
+#define PF_SCHEDULER_LIST_EXPIRED         (PF_SCHEDULER_WHEEL_LEVELS * PF_SCHEDULER_WHEEL_SLOTS)
+#define PF_SCHEDULER_LIST_FREE            (PF_SCHEDULER_LIST_EXPIRED + 1)
+#define PF_SCHEDULER_NBR_LISTS            (PF_SCHEDULER_LIST_FREE + 1)
 
 #define PF_CMINA_FS_HELLO_RETRY           3
 #define PF_CMINA_FS_HELLO_INTERVAL        (3*1000)     /* ms => 3s. Default is 30ms */
@@ -745,6 +786,7 @@ typedef struct pf_scheduler_timeouts
    uint64_t                      when; /* absolute time of timeout */
    uint32_t                      next;    /* Next in list */
    uint32_t                      prev;    /* Previous in list */
+   uint32_t                      list;    /* The list it is linked into */
 
    pf_scheduler_timeout_ftn_t    cb;      /* Call-back to call on timeout */
    void                          *arg;    /* call-back argument */
@@ -770,7 +812,9 @@ typedef int (*pf_eth_frame_handler_t)(
 typedef struct pf_eth_frame_id_map
 {
    bool                    in_use;
+   bool                    retired;    /* Removed, but a receiver may still be on it */
    uint16_t                frame_id;
+   atomic_uint_least16_t   next;       /* Next entry in hash chain, or PF_ETH_HASH_NONE */
    pf_eth_frame_handler_t  frame_handler;
    void                    *p_arg;
    uint64_t                time_created;
@@ -1319,15 +1363,33 @@ typedef struct pf_ppm
    uint16_t                data_status_offset;
    uint16_t                transfer_status_offset;
 
-   uint8_t                 buffer_data[PF_FRAME_BUFFER_SIZE];   /* Max */
+   /*
+    * Double buffered input data, guarded by a sequence counter.
+    * The sender reads buffer_data[buffer_seq & 1], the application writes
+    * the other buffer and publishes it by incrementing buffer_seq.
+    */
+   uint8_t                 buffer_data[2][PF_FRAME_BUFFER_SIZE];   /* Max */
+   atomic_uint             buffer_seq;
+   uint16_t                buffer_data_length;  /* Bytes in use in buffer_data */
+   uint16_t                dirty_start;         /* Written but not published, */
+   uint16_t                dirty_end;           /* empty if start >= end */
+   uint32_t                read_retry_cnt;      /* Reads that overlapped a publish */
 
    uint32_t                trx_cnt;
 
    uint32_t                control_interval;
    bool                    ci_running;
    uint32_t                ci_timer;
+
+   uint64_t                next_send_ns;        /* Planned time of the next send */
+   pnet_histogram_t        send_deviation;
+   pnet_histogram_t        send_exec;
 } pf_ppm_t;
 
+#define PF_CPM_NBR_BUFFERS          3
+#define PF_CPM_BUF_IX_MASK          0x03U
+#define PF_CPM_BUF_NEW              0x04U    /* The third buffer has not been read */
+
 typedef struct pf_cpm
 {
    pf_cpm_state_values_t   state;
@@ -1344,9 +1406,20 @@ typedef struct pf_cpm
    uint16_t                nbr_frame_id;        /* 1 or 2 */
    uint16_t                frame_id[2];         /* 2 needed for some instances of RT_CLASS_3 */
 
-   void                    *p_buffer_app;       /* Owned by app */
-   void                    *p_buffer_cpm;       /* owned by cpm */
-   bool                    new_buf;             /* New data to be received */
+   /*
+    * Triple buffer of received frames. The CPM owns buffers[buf_cpm_ix],
+    * the application owns buffers[buf_app_ix], and the third buffer is
+    * handed over with an atomic exchange of buf_state. The start of the
+    * PROFINET data travels with each buffer, as it depends on the VLAN tag
+    * of the frame.
+    */
+   void                    *buffers[PF_CPM_NBR_BUFFERS];
+   uint16_t                buf_data_pos[PF_CPM_NBR_BUFFERS];
+   uint8_t                 buf_cpm_ix;
+   uint8_t                 buf_app_ix;
+   atomic_uint             buf_state;           /* Index of the third buffer | PF_CPM_BUF_NEW */
+   atomic_bool             buf_app_busy;        /* buf_app_ix is being changed or peeked at */
+   atomic_bool             buf_app_reading;     /* Between pf_cpm_get_buf() and pf_cpm_get_buf_end() */
    uint16_t                frame_id_pos;        /* Handles VLAN in ETH header */
 
    uint8_t                 data_status;
@@ -1368,6 +1441,9 @@ typedef struct pf_cpm
 
    /* CMIO data */
    bool                    cmio_start;         /* cmInstance.start/stop */
+
+   uint64_t                last_recv_ns;        /* 0 means "never" */
+   pnet_histogram_t        inter_arrival;
 } pf_cpm_t;
 
 typedef struct pf_iodata_object
@@ -1717,6 +1793,26 @@ typedef struct pf_ar
 #endif
 } pf_ar_t;
 
+/*
+ * The content of a pnet_subslot_handle_t.
+ * The descriptors are valid while input_gen resp. output_gen equals
+ * pnet_t.subslot_handle_gen.
+ */
+typedef struct pf_subslot_handle
+{
+   uint32_t                api;
+   uint16_t                slot;
+   uint16_t                subslot;
+   uint32_t                input_gen;
+   uint32_t                output_gen;
+   pf_ar_t                 *p_input_ar;
+   pf_iocr_t               *p_input_iocr;
+   pf_iodata_object_t      *p_input_iodata;
+   pf_ar_t                 *p_output_ar;
+   pf_iocr_t               *p_output_iocr;
+   pf_iodata_object_t      *p_output_iodata;
+} pf_subslot_handle_t;
+
 
 /*
  * ============= Plugable typedefs ==================
@@ -1849,6 +1945,9 @@ typedef struct pf_subslot
 {
    bool                    in_use;
    uint16_t                subslot_nbr;
+   uint16_t                slot_nbr;         /* Of the slot it is in */
+   uint32_t                api_id;           /* Of the API it is in */
+   struct pf_subslot       *hash_next;       /* Next in the chain of device.subslot_hash[] */
 
    /* Submodule plug information */
    uint32_t                exp_submodule_ident_number;
@@ -1881,6 +1980,8 @@ typedef struct pf_slot
    /* Run-time information */
    pf_ar_t                 *p_ar;
    uint16_t                slot_nbr;
+   uint32_t                api_id;           /* Of the API it is in */
+   struct pf_slot          *hash_next;       /* Next in the chain of device.slot_hash[] */
 } pf_slot_t;
 
 typedef struct pf_api
@@ -1893,10 +1994,19 @@ typedef struct pf_api
    pf_ar_t                 *p_ar;
 } pf_api_t;
 
+/*
+ * Number of buckets in the slot and sub-slot hash indexes of the device.
+ * About twice the number of slots and sub-slots, so the chains stay short.
+ */
+#define PF_CMDEV_SLOT_HASH_SIZE           (2 * (PNET_MAX_API) * (PNET_MAX_MODULES) + 1)
+#define PF_CMDEV_SUBSLOT_HASH_SIZE        (2 * (PNET_MAX_API) * (PNET_MAX_MODULES) * (PNET_MAX_SUBMODULES) + 1)
+
 /*
  * The device struct contains information about the configured API's.
  * The api member contains a hierarchy which may be traversed using
  * the function pf_cmdev_cfg_traverse().
+ * The slots and sub-slots in use are also found by their numbers through
+ * the hash indexes, which are kept by the plug and pull functions.
  */
 typedef struct pf_device
 {
@@ -1904,14 +2014,15 @@ typedef struct pf_device
     * Record things that are needed for the read/write record data service.
     */
    pf_api_t                apis[PNET_MAX_API];
+   pf_slot_t               *slot_hash[PF_CMDEV_SLOT_HASH_SIZE];          /* By (api, slot) */
+   pf_subslot_t            *subslot_hash[PF_CMDEV_SUBSLOT_HASH_SIZE];    /* By (api, slot, subslot) */
 
    /*
     * This is the pool of diag items.
     * It is used instead of dynamic memory to avoid fragmentation.
     */
    os_mutex_t              *diag_mutex;      /* Protect the diag items */
-   pf_diag_item_t          diag_items[PNET_MAX_DIAG_ITEMS];
-   uint16_t                diag_items_free;  /* Head of the unused list */
+   uint16_t                diag_items_free;  /* Head of the unused list, in pnet_t.cmdev_diag_items */
 } pf_device_t;
 
 /*
@@ -2022,16 +2133,31 @@ typedef struct pf_log_book
    bool                    wrap;       /* All entries valid */
 } pf_log_book_t;
 
+/**
+ * A serialized record body, kept by CMRDR until the next pf_cmrdr_invalidate().
+ */
+typedef struct pf_cmrdr_cache_entry
+{
+   uint32_t                version;    /* 0 if unused */
+   uint32_t                last_use;
+   pf_ar_t                 *p_ar;      /* NULL if the record does not depend on the AR */
+   uint32_t                api;
+   uint16_t                slot;
+   uint16_t                subslot;
+   uint16_t                index;
+   uint16_t                len;
+   uint8_t                 body[PF_CMRDR_CACHE_BODY_SIZE];
+} pf_cmrdr_cache_entry_t;
 
 struct pnet
 {
    char                                interface_name[PNET_MAX_INTERFACE_NAME_LENGTH];  /** Terminated */
    uint32_t                            os_buf_alloc_cnt;
    bool                                global_alarm_enable;
-   os_mutex_t                          *cpm_buf_lock;
    atomic_int                          cpm_instance_cnt;
-   os_mutex_t                          *ppm_buf_lock;
    atomic_int                          ppm_instance_cnt;
+   atomic_bool                         ppm_batch_open;
+   atomic_uint                         subslot_handle_gen;  /* See pf_subslot_handle_t */
    uint16_t                            dcp_global_block_qualifier;
    pnet_ethaddr_t                      dcp_sam;
    pnet_ethaddr_t                      last_valid_src_eth_addr;
@@ -2040,14 +2166,23 @@ struct pnet
    uint32_t                            dcp_timeout;
    uint32_t                            dcp_sam_timeout;
    os_eth_handle_t                     *eth_handle;
-   pf_eth_frame_id_map_t               eth_id_map[PF_ETH_MAX_MAP];
-   volatile pf_scheduler_timeouts_t    scheduler_timeouts[PF_MAX_TIMEOUTS];
-   volatile uint32_t                   scheduler_timeout_first;
-   volatile uint32_t                   scheduler_timeout_free;
+   pf_eth_frame_id_map_t               *eth_id_map;
+   uint16_t                            eth_id_map_size;
+   uint16_t                            eth_id_hash_mask;                /* Nbr of buckets - 1 */
+   atomic_uint_least16_t               *eth_id_hash;                    /* First entry of each hash chain */
+   atomic_uint                         eth_id_readers;                  /* Receivers inside a lookup */
+   volatile pf_scheduler_timeouts_t    *scheduler_timeouts;
+   uint32_t                            scheduler_max_timeouts;          /* Also the "none" index */
+   volatile uint32_t                   scheduler_lists[PF_SCHEDULER_NBR_LISTS];
+   volatile uint32_t                   scheduler_tails[PF_SCHEDULER_NBR_LISTS];  /* Last timeout of each list */
+   uint64_t                            scheduler_wheel_tick;   /* Current wheel position */
+   uint32_t                            scheduler_timeout_cnt;  /* Nbr of timeouts in the wheel */
    os_mutex_t                          *scheduler_timeout_mutex;
    uint32_t                            scheduler_tick_interval;
    bool                                cmdev_initialized;
    pf_device_t                         cmdev_device;
+   pf_diag_item_t                      *cmdev_diag_items;      /* The pool of diag items */
+   uint16_t                            cmdev_max_diag_items;
    pf_cmina_dcp_ase_t                  cmina_nonvolatile_dcp_ase;
    pf_cmina_dcp_ase_t                  cmina_current_dcp_ase;
    pf_cmina_state_values_t             cmina_state;
@@ -2058,11 +2193,26 @@ struct pnet
    bool                                cmina_commit_ip_suite;
    os_mutex_t                          *p_cmrpc_rpc_mutex;
    uint32_t                            cmrpc_session_number;
-   pf_ar_t                             cmrpc_ar[PNET_MAX_AR];
-   pf_session_info_t                   cmrpc_session_info[PF_MAX_SESSION];
+   pf_ar_t                             *cmrpc_ar;
+   uint16_t                            max_ar;
+   pf_session_info_t                   *cmrpc_session_info;
+   uint16_t                            max_sessions;
+   uint32_t                            *cmrpc_ready;          /* Ready sockets, max_sessions + 3 */
+   uint32_t                            *cmrpc_unpolled;       /* Sockets not in cmrpc_poll, max_sessions + 3 */
+   uint16_t                            cmrpc_nbr_unpolled;
    int                                 cmrpc_rpcreq_socket;
-   uint8_t                             cmrpc_dcerpc_req_frame[PF_FRAME_BUFFER_SIZE];
-   uint8_t                             cmrpc_dcerpc_rsp_frame[PF_FRAME_BUFFER_SIZE];
+   int                                 cmrpc_poll;  /* Poll set of all RPC, session, PNET and syslog sockets */
+   uint8_t                             cmrpc_dcerpc_req_frame[PF_CMRPC_UDP_BATCH][PF_FRAME_BUFFER_SIZE];
+   uint8_t                             cmrpc_dcerpc_rsp_frame[PF_CMRPC_UDP_BATCH][PF_FRAME_BUFFER_SIZE];
+   atomic_uint                         cmrdr_cache_version;   /* 0 disables the cache, see pf_cmrdr_invalidate() */
+   uint32_t                            cmrdr_cache_tick;
+   uint32_t                            cmrdr_cache_hits;
+   uint32_t                            cmrdr_cache_misses;
+   pf_cmrdr_cache_entry_t              cmrdr_cache[PF_CMRDR_CACHE_ENTRIES];
+   atomic_bool                         cmrdr_busy;            /* In pf_cmrdr_rm_read_ind(), which owns the buffers below */
+   uint8_t                             cmrdr_iocs[255];       /* Max possible array size */
+   uint8_t                             cmrdr_iops[255];       /* Max possible array size */
+   uint8_t                             cmrdr_subslot_data[PF_FRAME_BUFFER_SIZE];
    pf_cmsu_state_values_t              cmsu_state;
    pf_cmwrr_state_values_t             cmwrr_state;
    const pnet_cfg_t                    *p_fspm_default_cfg;
@@ -2075,8 +2225,6 @@ struct pnet
    uint16_t                            alarm_dst_reference;
    int                                 pnet_socket; // port: 0xC000
    int                                 syslog_socket; // port: 514
-   uint8_t                             pnet_req_frame[PF_FRAME_BUFFER_SIZE];
-   uint8_t                             pnet_rsp_frame[PF_FRAME_BUFFER_SIZE];
    uint8_t                             syslog_frame[PF_FRAME_BUFFER_SIZE];
    pf_check_peers_t                    lldp_check_peers_data; // data got by LLDP
    char                                real_peer_port_id[MAX_PORT_NAME_LENGTH]; // full real port id
@@ -2092,6 +2240,7 @@ struct pnet
    char                                alias_name[ALIAS_NAME_SIZE];
    bool                                remote_peers_check_locked;
    uint16_t                            iocr_frame_id[2];         /* 2 needed for some instances of RT_CLASS_3 */
+   pnet_footprint_t                    footprint;                /* Of the arena holding this instance */
 };
 
 // useful null UUID for memcmp()
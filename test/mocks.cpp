@@ -22,6 +22,7 @@ uint8_t pnet_log_level;
 
 os_mutex_t  *mock_mutex;
 mock_os_data_t mock_os_data;
+bool mock_os_udp_poll_fail = false;
 
 void mock_clear(void)
 {
@@ -78,6 +79,12 @@ int mock_os_eth_send(
    return p_buf->len;
 }
 
+int mock_os_eth_send_flush(
+   os_eth_handle_t         *handle)
+{
+   return 0;
+}
+
 int mock_os_udp_open(
    os_ipaddr_t             addr,
    os_ipport_t             port)
@@ -132,11 +139,78 @@ int mock_os_udp_recvfrom(
    return len;
 }
 
+int mock_os_udp_recvmmsg(
+   uint32_t                id,
+   os_udp_msg_t            *p_msgs,
+   int                     nbr_msgs)
+{
+   int                     len;
+
+   len = mock_os_udp_recvfrom(id, &p_msgs[0].addr, &p_msgs[0].port, p_msgs[0].data, p_msgs[0].size);
+   p_msgs[0].len = len;
+
+   return (len > 0) ? 1 : 0;
+}
+
+int mock_os_udp_sendmmsg(
+   uint32_t                id,
+   const os_udp_msg_t      *p_msgs,
+   int                     nbr_msgs)
+{
+   int                     ix;
+
+   for (ix = 0; ix < nbr_msgs; ix++)
+   {
+      (void)mock_os_udp_sendto(id, p_msgs[ix].addr, p_msgs[ix].port, p_msgs[ix].data, p_msgs[ix].size);
+   }
+
+   return nbr_msgs;
+}
+
 void mock_os_udp_close(
    uint32_t                id)
 {
 }
 
+int mock_os_udp_poll_create(void)
+{
+   return mock_os_udp_poll_fail ? -1 : 1;
+}
+
+int mock_os_udp_poll_add(
+   int                     poll_id,
+   uint32_t                id)
+{
+   return mock_os_udp_poll_fail ? -1 : 0;
+}
+
+void mock_os_udp_poll_remove(
+   int                     poll_id,
+   uint32_t                id)
+{
+}
+
+int mock_os_udp_poll_wait(
+   int                     poll_id,
+   uint32_t                *p_ready,
+   int                     max_ready,
+   uint32_t                timeout_us)
+{
+   if (mock_os_udp_poll_fail)
+   {
+      return 0;
+   }
+
+   /* All mocked sockets share the id from mock_os_udp_open() */
+   p_ready[0] = 2;
+   return 1;
+}
+
+void mock_os_udp_poll_destroy(
+   int                     poll_id)
+{
+}
+
 int mock_os_save_blob(
    int                     file_index,
    void                    *object,
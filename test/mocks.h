@@ -46,6 +46,9 @@ typedef struct mock_os_data_obj
 
 extern mock_os_data_t mock_os_data;
 
+/* Make the UDP poll set functions fail. Not reset by mock_clear(). */
+extern bool mock_os_udp_poll_fail;
+
 void mock_init(void);
 void mock_clear(void);
 void mock_set_os_udp_recvfrom_buffer(uint8_t *p_src, uint16_t len);
@@ -55,6 +58,7 @@ os_eth_handle_t* mock_os_eth_init(
    os_eth_callback_t *callback,
    void *arg);
 int mock_os_eth_send(os_eth_handle_t *handle, os_buf_t * buf);
+int mock_os_eth_send_flush(os_eth_handle_t *handle);
 void mock_os_cpy_mac_addr(uint8_t * mac_addr);
 int mock_os_udp_open(os_ipaddr_t addr, os_ipport_t port);
 int mock_os_udp_sendto(uint32_t id,
@@ -68,6 +72,13 @@ int mock_os_udp_recvfrom(uint32_t id,
       uint8_t * data,
       int size);
 void mock_os_udp_close(uint32_t id);
+int mock_os_udp_recvmmsg(uint32_t id, os_udp_msg_t *p_msgs, int nbr_msgs);
+int mock_os_udp_sendmmsg(uint32_t id, const os_udp_msg_t *p_msgs, int nbr_msgs);
+int mock_os_udp_poll_create(void);
+int mock_os_udp_poll_add(int poll_id, uint32_t id);
+void mock_os_udp_poll_remove(int poll_id, uint32_t id);
+int mock_os_udp_poll_wait(int poll_id, uint32_t *p_ready, int max_ready, uint32_t timeout_us);
+void mock_os_udp_poll_destroy(int poll_id);
 int mock_os_set_ip_suite(
    const char              *interface_name,
    os_ipaddr_t             *p_ipaddr,
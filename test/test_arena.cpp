@@ -0,0 +1,140 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+#include "utils_for_testing.h"
+#include "mocks.h"
+
+#include "pf_includes.h"
+
+#include <gtest/gtest.h>
+
+class ArenaTest : public PnetIntegrationTest {};
+
+class ArenaUnitTest : public PnetUnitTest
+{
+protected:
+   pnet_cfg_t cfg;
+
+   virtual void SetUp() override
+   {
+      memset(&cfg, 0, sizeof(cfg));
+   };
+
+   /* The table lies within the arena, after the instance itself */
+   void expect_inside(pnet_t *net, const volatile void *p_table, size_t size)
+   {
+      uintptr_t start = (uintptr_t)net + sizeof(pnet_t);
+      uintptr_t end = (uintptr_t)net + net->footprint.total;
+
+      EXPECT_GE ((uintptr_t)p_table, start);
+      EXPECT_LE ((uintptr_t)p_table + size, end);
+      EXPECT_EQ (0u, ((uintptr_t)p_table - (uintptr_t)net) % 64);
+   }
+};
+
+
+TEST_F (ArenaTest, ArenaFootprintOfInstance)
+{
+   pnet_footprint_t footprint;
+
+   pnet_get_footprint(net, &footprint);
+   EXPECT_EQ (PNET_MAX_AR, footprint.max_ar);
+   EXPECT_EQ (PF_MAX_SESSION, footprint.max_sessions);
+   EXPECT_EQ (PNET_MAX_DIAG_ITEMS, footprint.max_diag_items);
+   EXPECT_GT (footprint.total, sizeof(pnet_t));
+}
+
+TEST_F (ArenaUnitTest, ArenaDefaults)
+{
+   pnet_t *net = pf_arena_create(&cfg);
+
+   ASSERT_NE (nullptr, net);
+   EXPECT_EQ (PNET_MAX_AR, net->max_ar);
+   EXPECT_EQ (PF_MAX_SESSION, net->max_sessions);
+   EXPECT_EQ (PNET_MAX_DIAG_ITEMS, net->cmdev_max_diag_items);
+   EXPECT_EQ (PF_ETH_MAX_MAP, net->eth_id_map_size);
+   EXPECT_EQ ((uint32_t)PF_MAX_TIMEOUTS, net->scheduler_max_timeouts);
+
+   /* Power of two, and at least twice the map */
+   EXPECT_EQ (0, (net->eth_id_hash_mask + 1) & net->eth_id_hash_mask);
+   EXPECT_GE (net->eth_id_hash_mask + 1, 2 * net->eth_id_map_size);
+
+   expect_inside(net, net->cmrpc_ar, net->max_ar * sizeof(pf_ar_t));
+   expect_inside(net, net->cmrpc_session_info, net->max_sessions * sizeof(pf_session_info_t));
+   expect_inside(net, net->cmrpc_ready, (net->max_sessions + 3) * sizeof(uint32_t));
+   expect_inside(net, net->cmdev_diag_items, net->cmdev_max_diag_items * sizeof(pf_diag_item_t));
+   expect_inside(net, net->eth_id_map, net->eth_id_map_size * sizeof(pf_eth_frame_id_map_t));
+   expect_inside(net, net->eth_id_hash, (net->eth_id_hash_mask + 1) * sizeof(uint16_t));
+   expect_inside(net, net->scheduler_timeouts, net->scheduler_max_timeouts * sizeof(pf_scheduler_timeouts_t));
+
+   /* pf_arena_create(NULL) also gives the defaults */
+   pnet_t *net_null = pf_arena_create(NULL);
+   ASSERT_NE (nullptr, net_null);
+   EXPECT_EQ (net->footprint.total, net_null->footprint.total);
+
+   pf_arena_destroy(net_null);
+   pf_arena_destroy(net);
+}
+
+TEST_F (ArenaUnitTest, ArenaScalesWithCapacities)
+{
+   pnet_t *net_small;
+   pnet_t *net_large;
+
+   cfg.max_ar = 1;
+   cfg.max_diag_items = 20;
+   net_small = pf_arena_create(&cfg);
+   cfg.max_ar = 8;
+   cfg.max_diag_items = 1000;
+   net_large = pf_arena_create(&cfg);
+   ASSERT_NE (nullptr, net_small);
+   ASSERT_NE (nullptr, net_large);
+
+   EXPECT_EQ (1, net_small->max_ar);
+   EXPECT_EQ (3, net_small->max_sessions);
+   EXPECT_EQ (20, net_small->cmdev_max_diag_items);
+   EXPECT_EQ (PF_ETH_MAP_FOR(1), net_small->eth_id_map_size);
+   EXPECT_EQ (8, net_large->max_ar);
+   EXPECT_EQ (17, net_large->max_sessions);
+   EXPECT_EQ (1000, net_large->cmdev_max_diag_items);
+   EXPECT_EQ (PF_ETH_MAP_FOR(8), net_large->eth_id_map_size);
+   EXPECT_GT (net_large->scheduler_max_timeouts, net_small->scheduler_max_timeouts);
+
+   /* The instance is the same, only the tables grow */
+   EXPECT_EQ (net_small->footprint.base, net_large->footprint.base);
+   EXPECT_GE (net_large->footprint.ars, 8 * sizeof(pf_ar_t));
+   EXPECT_LT (net_small->footprint.ars, net_large->footprint.ars);
+   EXPECT_LT (net_small->footprint.total, net_large->footprint.total);
+
+   /* The last AR of the large instance is usable */
+   net_large->cmrpc_ar[7].arep = 8;
+   net_large->cmrpc_ar[7].in_use = true;
+   pf_ar_t *p_ar = NULL;
+   EXPECT_EQ (0, pf_ar_find_by_arep(net_large, 8, &p_ar));
+   EXPECT_EQ (&net_large->cmrpc_ar[7], p_ar);
+
+   pf_arena_destroy(net_small);
+   pf_arena_destroy(net_large);
+}
+
+TEST_F (ArenaUnitTest, ArenaRejectsTooLargeCapacities)
+{
+   cfg.max_diag_items = UINT16_MAX;
+   EXPECT_EQ (nullptr, pf_arena_create(&cfg));
+
+   cfg.max_diag_items = 0;
+   cfg.max_ar = 40000;
+   EXPECT_EQ (nullptr, pf_arena_create(&cfg));
+}
@@ -26,9 +26,58 @@
 
 #include <gtest/gtest.h>
 
-
 class CmdevUnitTest : public PnetUnitTest {};
 
+class CmdevTest : public PnetIntegrationTest {};
+
+
+static uint8_t connect_req[] =
+{
+                                                             0x04, 0x00, 0x28, 0x00, 0x10, 0x00,
+ 0x00, 0x00, 0x00, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0x01, 0xbe, 0xef,
+ 0xfe, 0xed, 0x01, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0xa0, 0x24, 0x42,
+ 0xdf, 0x7d, 0xbb, 0xac, 0x97, 0xe2, 0x76, 0x54, 0x9f, 0x47, 0xa5, 0xbd, 0xa5, 0xe3, 0x7d, 0x98,
+ 0xe5, 0xda, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+ 0xff, 0xff, 0xff, 0xff, 0x86, 0x01, 0x00, 0x00, 0x00, 0x00, 0x24, 0x10, 0x00, 0x00, 0x72, 0x01,
+ 0x00, 0x00, 0x24, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x72, 0x01, 0x00, 0x00, 0x01, 0x01,
+ 0x00, 0x42, 0x01, 0x00, 0x00, 0x01, 0x30, 0xab, 0xa9, 0xa3, 0xf7, 0x64, 0xb7, 0x44, 0xb3, 0xb6,
+ 0x7e, 0xe2, 0x8a, 0x1a, 0x02, 0xcb, 0x00, 0x02, 0xc8, 0x5b, 0x76, 0xe6, 0x89, 0xdf, 0xde, 0xa0,
+ 0x00, 0x00, 0x6c, 0x97, 0x11, 0xd1, 0x82, 0x71, 0x00, 0x01, 0xf0, 0x00, 0x00, 0x01, 0x40, 0x00,
+ 0x00, 0x11, 0x02, 0x58, 0x88, 0x92, 0x00, 0x0c, 0x72, 0x74, 0x2d, 0x6c, 0x61, 0x62, 0x73, 0x2d,
+ 0x64, 0x65, 0x6d, 0x6f, 0x01, 0x02, 0x00, 0x50, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x88, 0x92,
+ 0x00, 0x00, 0x00, 0x02, 0x00, 0x28, 0x80, 0x01, 0x00, 0x20, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+ 0xff, 0xff, 0xff, 0xff, 0x00, 0x03, 0x00, 0x03, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+ 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+ 0x80, 0x00, 0x00, 0x01, 0x00, 0x00, 0x80, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x01, 0x00, 0x03,
+ 0x00, 0x01, 0x00, 0x01, 0x00, 0x01, 0x00, 0x05, 0x01, 0x02, 0x00, 0x50, 0x01, 0x00, 0x00, 0x02,
+ 0x00, 0x02, 0x88, 0x92, 0x00, 0x00, 0x00, 0x02, 0x00, 0x28, 0x80, 0x00, 0x00, 0x20, 0x00, 0x01,
+ 0x00, 0x01, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x00, 0x03, 0x00, 0x03, 0xc0, 0x00, 0x00, 0x00,
+ 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x01,
+ 0x00, 0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x01,
+ 0x00, 0x00, 0x80, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x01, 0x00, 0x03, 0x01, 0x04, 0x00, 0x3c,
+ 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+ 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x01,
+ 0x80, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x01, 0x80, 0x01,
+ 0x00, 0x00, 0x80, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x01, 0x01, 0x04, 0x00, 0x26,
+ 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x32, 0x00, 0x00,
+ 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x01, 0x01, 0x01,
+ 0x00, 0x02, 0x00, 0x01, 0x01, 0x01, 0x01, 0x03, 0x00, 0x16, 0x01, 0x00, 0x00, 0x01, 0x88, 0x92,
+ 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0x00, 0x02, 0x00, 0xc8, 0xc0, 0x00, 0xa0, 0x00
+};
+
+static uint8_t release_req[] =
+{
+                                                             0x04, 0x00, 0x28, 0x00, 0x10, 0x00,
+ 0x00, 0x00, 0x00, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0x01, 0xbe, 0xef,
+ 0xfe, 0xed, 0x01, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0xa0, 0x24, 0x42,
+ 0xdf, 0x7d, 0xbb, 0xac, 0x97, 0xe2, 0x76, 0x54, 0x9f, 0x47, 0xa5, 0xbd, 0xa5, 0xe3, 0x7d, 0x98,
+ 0xe5, 0xda, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x01, 0x00,
+ 0xff, 0xff, 0xff, 0xff, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e, 0x00, 0x00, 0x00, 0x20, 0x00,
+ 0x00, 0x00, 0x3e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x01, 0x14,
+ 0x00, 0x1c, 0x01, 0x00, 0x00, 0x00, 0x30, 0xab, 0xa9, 0xa3, 0xf7, 0x64, 0xb7, 0x44, 0xb3, 0xb6,
+ 0x7e, 0xe2, 0x8a, 0x1a, 0x02, 0xcb, 0x00, 0x02, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00
+};
+
 
 TEST_F (CmdevUnitTest, CmdevCalculateDatadirectionInDescriptor)
 {
@@ -391,3 +440,270 @@ TEST_F (CmdevUnitTest, CmdevCheckArType)
    ret = pf_cmdev_check_ar_type(0xFFFF);
    EXPECT_EQ (-1, ret);
 }
+
+TEST_F (CmdevUnitTest, CmdevInvalidateSubslotHandles)
+{
+   pnet_t * net = (pnet_t *)calloc (1, sizeof(pnet_t));
+
+   net->subslot_handle_gen = 1;
+   pf_cmdev_invalidate_subslot_handles (net);
+   EXPECT_EQ (2u, net->subslot_handle_gen);
+
+   /* Generation 0 means "never resolved", and must be skipped */
+   net->subslot_handle_gen = UINT32_MAX;
+   pf_cmdev_invalidate_subslot_handles (net);
+   EXPECT_EQ (1u, net->subslot_handle_gen);
+
+   free (net);
+}
+
+/**
+ * Set and get the data of slot 1 sub-slot 1 by lookup and by handle, and
+ * check that both give the same result.
+ * @return the result of setting the input data by handle.
+ */
+static int use_handle(pnet_t *net, pnet_subslot_handle_t *p_handle)
+{
+   uint8_t                 out_data[] = { 0x33 };
+   uint8_t                 in_data[10];
+   uint16_t                in_len;
+   bool                    new_flag = false;
+   uint8_t                 iops = PNET_IOXS_BAD;
+   int                     ret;
+   int                     ret_input;
+   int                     ret_output;
+
+   ret = pnet_input_set_data_and_iops (net, TEST_API_IDENT, 1, 1, out_data, sizeof(out_data), PNET_IOXS_GOOD);
+   ret_input = pnet_input_set_data_and_iops_by_handle (net, p_handle, out_data, sizeof(out_data), PNET_IOXS_GOOD);
+   EXPECT_EQ (ret, ret_input);
+
+   in_len = sizeof(in_data);
+   ret = pnet_output_get_data_and_iops (net, TEST_API_IDENT, 1, 1, &new_flag, in_data, &in_len, &iops);
+   in_len = sizeof(in_data);
+   ret_output = pnet_output_get_data_and_iops_by_handle (net, p_handle, &new_flag, in_data, &in_len, &iops);
+   EXPECT_EQ (ret, ret_output);
+
+   return ret_input;
+}
+
+/**
+ * Check that a sub-slot handle is resolved to the descriptors of the
+ * sub-slot in the AR.
+ */
+static void expect_handle_resolved(pnet_t *net, pnet_subslot_handle_t *p_handle, pf_ar_t *p_ar)
+{
+   pf_subslot_handle_t     *p_sub = (pf_subslot_handle_t *)p_handle;
+
+   EXPECT_EQ (atomic_load (&net->subslot_handle_gen), p_sub->input_gen);
+   EXPECT_EQ (atomic_load (&net->subslot_handle_gen), p_sub->output_gen);
+   EXPECT_EQ (p_ar, p_sub->p_input_ar);
+   EXPECT_EQ (p_ar, p_sub->p_output_ar);
+   ASSERT_TRUE (p_sub->p_input_iocr != NULL);
+   ASSERT_TRUE (p_sub->p_output_iocr != NULL);
+   EXPECT_EQ (PF_IOCR_TYPE_INPUT, p_sub->p_input_iocr->param.iocr_type);
+   EXPECT_EQ (PF_IOCR_TYPE_OUTPUT, p_sub->p_output_iocr->param.iocr_type);
+   ASSERT_TRUE (p_sub->p_input_iodata != NULL);
+   ASSERT_TRUE (p_sub->p_output_iodata != NULL);
+   EXPECT_EQ (1, p_sub->p_input_iodata->slot_nbr);
+   EXPECT_EQ (1, p_sub->p_input_iodata->subslot_nbr);
+   EXPECT_EQ (1, p_sub->p_output_iodata->slot_nbr);
+   EXPECT_EQ (1, p_sub->p_output_iodata->subslot_nbr);
+}
+
+TEST_F (CmdevTest, CmdevSubslotHandleFollowsArAndPlugPull)
+{
+   pnet_subslot_handle_t   handle;
+   pf_subslot_t            *p_subslot = NULL;
+   pf_slot_t               *p_slot = NULL;
+   pf_ar_t                 *p_ar = NULL;
+   uint32_t                module_ident;
+   uint32_t                submodule_ident;
+   uint32_t                gen;
+
+   pnet_subslot_handle_init (net, TEST_API_IDENT, 1, 1, &handle);
+   EXPECT_EQ (-1, use_handle (net, &handle));
+
+   mock_set_os_udp_recvfrom_buffer (connect_req, sizeof(connect_req));
+   os_usleep (TEST_UDP_DELAY);
+   EXPECT_EQ (1, appdata.call_counters.connect_calls);
+   ASSERT_EQ (0, pf_ar_find_by_arep (net, appdata.main_arep, &p_ar));
+   EXPECT_EQ (0, use_handle (net, &handle));
+   expect_handle_resolved (net, &handle, p_ar);
+
+   /* Resolved again after the AR is released */
+   gen = atomic_load (&net->subslot_handle_gen);
+   mock_set_os_udp_recvfrom_buffer (release_req, sizeof(release_req));
+   os_usleep (TEST_UDP_DELAY);
+   EXPECT_EQ (1, appdata.call_counters.release_calls);
+   EXPECT_NE (gen, atomic_load (&net->subslot_handle_gen));
+   EXPECT_EQ (-1, use_handle (net, &handle));
+
+   /* And after a new AR is set up */
+   mock_set_os_udp_recvfrom_buffer (connect_req, sizeof(connect_req));
+   os_usleep (TEST_UDP_DELAY);
+   EXPECT_EQ (2, appdata.call_counters.connect_calls);
+   ASSERT_EQ (0, pf_ar_find_by_arep (net, appdata.main_arep, &p_ar));
+   EXPECT_EQ (0, use_handle (net, &handle));
+   expect_handle_resolved (net, &handle, p_ar);
+
+   /* Pull and plug the sub-module */
+   ASSERT_EQ (0, pf_cmdev_get_slot_full (net, TEST_API_IDENT, 1, &p_slot));
+   ASSERT_EQ (0, pf_cmdev_get_subslot_full (net, TEST_API_IDENT, 1, 1, &p_subslot));
+   module_ident = p_slot->module_ident_number;
+   submodule_ident = p_subslot->submodule_ident_number;
+
+   gen = atomic_load (&net->subslot_handle_gen);
+   EXPECT_EQ (0, pnet_pull_submodule (net, TEST_API_IDENT, 1, 1));
+   EXPECT_NE (gen, atomic_load (&net->subslot_handle_gen));
+   EXPECT_EQ (-1, use_handle (net, &handle));
+
+   gen = atomic_load (&net->subslot_handle_gen);
+   EXPECT_EQ (0, pnet_plug_submodule (net, TEST_API_IDENT, 1, 1, module_ident, submodule_ident,
+                                      PNET_DIR_IO, 1, 1));
+   EXPECT_NE (gen, atomic_load (&net->subslot_handle_gen));
+   (void)use_handle (net, &handle);
+}
+
+/**
+ * Plug a submodule in each sub-slot of each slot, as far as there is room.
+ */
+static void plug_all(pnet_t *net)
+{
+   uint16_t slot;
+   uint16_t subslot;
+
+   for (slot = 0; slot < PNET_MAX_MODULES; slot++)
+   {
+      for (subslot = 1; subslot <= PNET_MAX_SUBMODULES; subslot++)
+      {
+         ASSERT_EQ (0, pf_cmdev_plug_submodule (net, 0, slot, subslot, 0x100 + slot,
+                                                subslot, PNET_DIR_IO, 1, 1, false));
+      }
+   }
+}
+
+TEST_F (CmdevUnitTest, CmdevSubslotIndex)
+{
+   pnet_t *net = pf_arena_create (NULL);
+   pf_subslot_t *p_subslot = NULL;
+   pf_slot_t *p_slot = NULL;
+   uint16_t slot;
+   uint16_t subslot;
+
+   pf_cmdev_init (net);
+   plug_all (net);
+
+   for (slot = 0; slot < PNET_MAX_MODULES; slot++)
+   {
+      ASSERT_EQ (0, pf_cmdev_get_slot_full (net, 0, slot, &p_slot));
+      EXPECT_EQ (slot, p_slot->slot_nbr);
+      EXPECT_EQ (0x100u + slot, p_slot->module_ident_number);
+      for (subslot = 1; subslot <= PNET_MAX_SUBMODULES; subslot++)
+      {
+         ASSERT_EQ (0, pf_cmdev_get_subslot_full (net, 0, slot, subslot, &p_subslot));
+         EXPECT_EQ (slot, p_subslot->slot_nbr);
+         EXPECT_EQ (subslot, p_subslot->subslot_nbr);
+         EXPECT_EQ (subslot, p_subslot->submodule_ident_number);
+         EXPECT_EQ (&p_slot->subslots[subslot - 1], p_subslot);
+      }
+   }
+   EXPECT_EQ (-1, pf_cmdev_get_subslot_full (net, 0, 0, PNET_MAX_SUBMODULES + 1, &p_subslot));
+   EXPECT_EQ (-1, pf_cmdev_get_subslot_full (net, 1, 0, 1, &p_subslot));
+   EXPECT_EQ (-1, pf_cmdev_get_slot_full (net, 0, PNET_MAX_MODULES, &p_slot));
+
+   /* Pulled sub-slots and modules are no longer found */
+   EXPECT_EQ (0, pf_cmdev_pull_submodule (net, 0, 1, 2));
+   EXPECT_EQ (-1, pf_cmdev_get_subslot_full (net, 0, 1, 2, &p_subslot));
+   EXPECT_EQ (0, pf_cmdev_get_subslot_full (net, 0, 1, 1, &p_subslot));
+   EXPECT_EQ (0, pf_cmdev_get_subslot_full (net, 0, 1, 3, &p_subslot));
+   EXPECT_EQ (0, pf_cmdev_pull_module (net, 0, 0));
+   EXPECT_EQ (-1, pf_cmdev_get_slot_full (net, 0, 0, &p_slot));
+   EXPECT_EQ (-1, pf_cmdev_get_subslot_full (net, 0, 0, 1, &p_subslot));
+
+   /* And found again when plugged again, in a reused entry */
+   EXPECT_EQ (0, pf_cmdev_plug_submodule (net, 0, 0, 7, 0x200, 0x207, PNET_DIR_IO, 1, 1, false));
+   ASSERT_EQ (0, pf_cmdev_get_subslot_full (net, 0, 0, 7, &p_subslot));
+   EXPECT_EQ (0x207u, p_subslot->submodule_ident_number);
+   ASSERT_EQ (0, pf_cmdev_get_slot_full (net, 0, 0, &p_slot));
+   EXPECT_EQ (0x200u, p_slot->module_ident_number);
+
+   pf_cmdev_exit (net);
+   pf_arena_destroy (net);
+}
+
+/**
+ * Read a record through CMRDR, as an implicit read without AR.
+ * @return the position after the read result.
+ */
+static uint16_t read_record(pnet_t *net, uint16_t index, uint16_t slot, uint16_t subslot,
+                            uint8_t *p_buf, uint16_t size)
+{
+   pf_iod_read_request_t   read_request;
+   pnet_result_t           read_status;
+   uint16_t                pos = 0;
+
+   memset(&read_request, 0, sizeof(read_request));
+   memset(&read_status, 0, sizeof(read_status));
+   read_request.index = index;
+   read_request.slot_number = slot;
+   read_request.subslot_number = subslot;
+   memset(p_buf, 0, size);
+   EXPECT_EQ (0, pf_cmrdr_rm_read_ind (net, NULL, PF_RPC_DEV_OPNUM_READ_IMPLICIT,
+                                       &read_request, &read_status, size, p_buf, &pos));
+   EXPECT_EQ (0, read_status.pnio_status.error_code);
+
+   return pos;
+}
+
+TEST_F (CmdevUnitTest, CmrdrReadCacheFollowsPlugPullAndImData)
+{
+   pnet_t *net = pf_arena_create (NULL);
+   uint8_t first[PF_FRAME_BUFFER_SIZE];
+   uint8_t again[PF_FRAME_BUFFER_SIZE];
+   uint16_t first_len;
+   uint16_t len;
+
+   pf_cmrdr_init (net);
+   pf_cmdev_init (net);
+   plug_all (net);
+
+   first_len = read_record (net, PF_IDX_SUB_REAL_ID_DATA, 1, 1, first, sizeof(first));
+   EXPECT_FALSE (atomic_load (&net->cmrdr_busy));
+   EXPECT_EQ (0u, net->cmrdr_cache_hits);
+   EXPECT_EQ (1u, net->cmrdr_cache_misses);
+
+   /* Repeated reads are served from the cache, with the same answer */
+   len = read_record (net, PF_IDX_SUB_REAL_ID_DATA, 1, 1, again, sizeof(again));
+   EXPECT_EQ (1u, net->cmrdr_cache_hits);
+   ASSERT_EQ (first_len, len);
+   EXPECT_EQ (0, memcmp (first, again, len));
+
+   /* Plug and pull make the next read build the answer again */
+   EXPECT_EQ (0, pf_cmdev_pull_submodule (net, 0, 1, 1));
+   len = read_record (net, PF_IDX_SUB_REAL_ID_DATA, 1, 1, again, sizeof(again));
+   EXPECT_EQ (1u, net->cmrdr_cache_hits);
+   EXPECT_EQ (2u, net->cmrdr_cache_misses);
+   EXPECT_LT (len, first_len);
+
+   EXPECT_EQ (0, pf_cmdev_plug_submodule (net, 0, 1, 1, 0x101, 0x4711, PNET_DIR_IO, 1, 1, false));
+   len = read_record (net, PF_IDX_SUB_REAL_ID_DATA, 1, 1, again, sizeof(again));
+   EXPECT_EQ (3u, net->cmrdr_cache_misses);
+   ASSERT_EQ (first_len, len);
+   EXPECT_NE (0, memcmp (first, again, len));
+
+   /* And so does a change of the I&M data */
+   net->fspm_cfg.im_1_data.im_tag_function[0] = 'X';
+   first_len = read_record (net, PF_IDX_SUB_IM_1, 0, 1, first, sizeof(first));
+   len = read_record (net, PF_IDX_SUB_IM_1, 0, 1, again, sizeof(again));
+   EXPECT_EQ (2u, net->cmrdr_cache_hits);
+   EXPECT_EQ (0, memcmp (first, again, len));
+
+   pf_fspm_clear_im_data (net);
+   len = read_record (net, PF_IDX_SUB_IM_1, 0, 1, again, sizeof(again));
+   EXPECT_EQ (2u, net->cmrdr_cache_hits);
+   ASSERT_EQ (first_len, len);
+   EXPECT_NE (0, memcmp (first, again, len));
+
+   pf_cmdev_exit (net);
+   pf_arena_destroy (net);
+}
@@ -37,6 +37,23 @@
 class CmrpcUnitTest : public PnetUnitTest {};
 class CmrpcTest : public PnetIntegrationTest {};
 
+/* As CmrpcTest, but the UDP sockets cannot be polled */
+class CmrpcNoPollTest : public PnetIntegrationTest
+{
+protected:
+   virtual void SetUp() override
+   {
+      mock_os_udp_poll_fail = true;
+      PnetIntegrationTest::SetUp();
+   };
+
+   virtual void TearDown() override
+   {
+      PnetIntegrationTest::TearDown();
+      mock_os_udp_poll_fail = false;
+   };
+};
+
 
 /**
  * Connect request data
@@ -414,6 +431,28 @@ TEST_F (CmrpcTest, CmrpcConnectReleaseTest)
    EXPECT_EQ(mock_os_data.udp_sendto_len, 132);
 }
 
+TEST_F (CmrpcNoPollTest, CmrpcConnectReleaseWithoutPollSet)
+{
+   /* The RPC, PNET and syslog sockets */
+   EXPECT_EQ(net->cmrpc_poll, -1);
+   EXPECT_EQ(net->cmrpc_nbr_unpolled, 3);
+
+   mock_set_os_udp_recvfrom_buffer(connect_req, sizeof(connect_req));
+   os_usleep(TEST_UDP_DELAY);
+   EXPECT_EQ(appdata.call_counters.connect_calls, 1);
+   EXPECT_EQ(appdata.cmdev_state, PNET_EVENT_STARTUP);
+   EXPECT_EQ(mock_os_data.udp_sendto_count, 1);
+
+   mock_set_os_udp_recvfrom_buffer(release_req, sizeof(release_req));
+   os_usleep(TEST_UDP_DELAY);
+   EXPECT_EQ(appdata.call_counters.release_calls, 1);
+   EXPECT_EQ(appdata.cmdev_state, PNET_EVENT_ABORT);
+
+   /* The socket of the released session is closed, the others stay */
+   EXPECT_EQ(net->cmrpc_nbr_unpolled, 3);
+   EXPECT_EQ(pnet_handle_rpc(net, 0), 0);
+}
+
 TEST_F(CmrpcTest, CmrpcConnectionTimeoutTest)
 {
    int                     ret;
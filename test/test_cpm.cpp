@@ -19,6 +19,8 @@
 #include "pf_includes.h"
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
 
 
 class CpmUnitTest : public PnetUnitTest {};
@@ -104,3 +106,255 @@ TEST_F (CpmUnitTest, CpmCheckCycle)
    EXPECT_EQ ( 0, pf_cpm_check_cycle(0x0010, 0x0011));
    EXPECT_EQ ( 0, pf_cpm_check_cycle(0x0010, 0x0012));
 }
+
+TEST_F (CpmUnitTest, CpmTripleBufferHandsOverNewestFrame)
+{
+   pnet_t * net = (pnet_t *)calloc (1, sizeof(pnet_t));
+   pf_ar_t * p_ar = (pf_ar_t *)calloc (1, sizeof(pf_ar_t));
+   pf_cpm_t * p_cpm = &p_ar->iocrs[0].cpm;
+   os_buf_t * p_buf;
+   uint8_t * p_data = NULL;
+   bool new_flag = true;
+   uint32_t ix;
+
+   pf_cpm_create (net, p_ar, 0);
+
+   pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+   EXPECT_FALSE (new_flag);
+   EXPECT_EQ (nullptr, p_data);
+   pf_cpm_get_buf_end (p_cpm);
+
+   /* Two frames before the app fetches: the older one is handed back */
+   for (ix = 1; ix <= 2; ix++)
+   {
+      p_buf = os_buf_alloc (64);
+      ((uint8_t *)p_buf->payload)[0] = (uint8_t)ix;
+      pf_cpm_put_buf (p_cpm, &p_buf, 0);
+      if (ix == 1)
+      {
+         EXPECT_EQ (nullptr, p_buf);
+      }
+      else
+      {
+         ASSERT_NE (nullptr, p_buf);
+         EXPECT_EQ (1, ((uint8_t *)p_buf->payload)[0]);
+         os_buf_free (p_buf);
+      }
+   }
+
+   pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+   EXPECT_TRUE (new_flag);
+   ASSERT_NE (nullptr, p_data);
+   EXPECT_EQ (2, p_data[0]);
+   pf_cpm_get_buf_end (p_cpm);
+
+   /* Nothing new, but the last frame is still there */
+   pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+   EXPECT_FALSE (new_flag);
+   ASSERT_NE (nullptr, p_data);
+   EXPECT_EQ (2, p_data[0]);
+   pf_cpm_get_buf_end (p_cpm);
+
+   for (ix = 0; ix < NELEMENTS(p_cpm->buffers); ix++)
+   {
+      if (p_cpm->buffers[ix] != NULL)
+      {
+         os_buf_free ((os_buf_t *)p_cpm->buffers[ix]);
+      }
+   }
+   free (p_ar);
+   free (net);
+}
+
+TEST_F (CpmUnitTest, CpmTripleBufferKeepsDataPosPerFrame)
+{
+   pnet_t * net = (pnet_t *)calloc (1, sizeof(pnet_t));
+   pf_ar_t * p_ar = (pf_ar_t *)calloc (1, sizeof(pf_ar_t));
+   pf_cpm_t * p_cpm = &p_ar->iocrs[0].cpm;
+   os_buf_t * p_buf;
+   uint8_t * p_data = NULL;
+   bool new_flag = false;
+   uint32_t ix;
+
+   pf_cpm_create (net, p_ar, 0);
+
+   /* Without VLAN tag, data at 16 */
+   p_buf = os_buf_alloc (64);
+   ((uint8_t *)p_buf->payload)[16] = 0x11;
+   pf_cpm_put_buf (p_cpm, &p_buf, 16);
+   EXPECT_EQ (nullptr, p_buf);
+
+   pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+   EXPECT_TRUE (new_flag);
+   ASSERT_NE (nullptr, p_data);
+   EXPECT_EQ (0x11, p_data[0]);
+   pf_cpm_get_buf_end (p_cpm);
+
+   /* With VLAN tag, data at 20. The fetched frame keeps its position. */
+   p_buf = os_buf_alloc (64);
+   ((uint8_t *)p_buf->payload)[20] = 0x22;
+   pf_cpm_put_buf (p_cpm, &p_buf, 20);
+   EXPECT_EQ (nullptr, p_buf);
+
+   p_data = pf_cpm_peek_begin (p_cpm);
+   ASSERT_NE (nullptr, p_data);
+   EXPECT_EQ (0x11, p_data[0]);
+   pf_cpm_peek_end (p_cpm);
+
+   /* Peeking did not fetch the new frame */
+   pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+   EXPECT_TRUE (new_flag);
+   ASSERT_NE (nullptr, p_data);
+   EXPECT_EQ (0x22, p_data[0]);
+   pf_cpm_get_buf_end (p_cpm);
+
+   for (ix = 0; ix < NELEMENTS(p_cpm->buffers); ix++)
+   {
+      if (p_cpm->buffers[ix] != NULL)
+      {
+         os_buf_free ((os_buf_t *)p_cpm->buffers[ix]);
+      }
+   }
+   free (p_ar);
+   free (net);
+}
+
+TEST_F (CpmUnitTest, CpmTripleBufferPeekWithoutFrame)
+{
+   pnet_t * net = (pnet_t *)calloc (1, sizeof(pnet_t));
+   pf_ar_t * p_ar = (pf_ar_t *)calloc (1, sizeof(pf_ar_t));
+   pf_cpm_t * p_cpm = &p_ar->iocrs[0].cpm;
+   os_buf_t * p_buf;
+   bool new_flag = false;
+   uint8_t * p_data = NULL;
+
+   pf_cpm_create (net, p_ar, 0);
+   EXPECT_EQ (nullptr, pf_cpm_peek_begin (p_cpm));
+   pf_cpm_peek_end (p_cpm);
+
+   /* A frame not yet fetched by the application is not peeked at */
+   p_buf = os_buf_alloc (64);
+   pf_cpm_put_buf (p_cpm, &p_buf, 0);
+   EXPECT_EQ (nullptr, pf_cpm_peek_begin (p_cpm));
+   pf_cpm_peek_end (p_cpm);
+
+   pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+   EXPECT_TRUE (new_flag);
+   EXPECT_NE (nullptr, p_data);
+   pf_cpm_get_buf_end (p_cpm);
+
+   for (uint32_t ix = 0; ix < NELEMENTS(p_cpm->buffers); ix++)
+   {
+      os_buf_free ((os_buf_t *)p_cpm->buffers[ix]);
+   }
+   free (p_ar);
+   free (net);
+}
+
+TEST_F (CpmUnitTest, CpmTripleBufferSecondConsumerAsserts)
+{
+   pnet_t * net = (pnet_t *)calloc (1, sizeof(pnet_t));
+   pf_ar_t * p_ar = (pf_ar_t *)calloc (1, sizeof(pf_ar_t));
+   pf_cpm_t * p_cpm = &p_ar->iocrs[0].cpm;
+   uint8_t * p_data = NULL;
+   bool new_flag = false;
+
+   pf_cpm_create (net, p_ar, 0);
+   pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+   EXPECT_DEBUG_DEATH (pf_cpm_get_buf (p_cpm, &new_flag, &p_data), "");
+   pf_cpm_get_buf_end (p_cpm);
+
+   free (p_ar);
+   free (net);
+}
+
+TEST_F (CpmUnitTest, CpmTripleBufferConcurrentPutGet)
+{
+   const uint32_t frames = 200000;
+   pnet_t * net = (pnet_t *)calloc (1, sizeof(pnet_t));
+   pf_ar_t * p_ar = (pf_ar_t *)calloc (1, sizeof(pf_ar_t));
+   pf_cpm_t * p_cpm = &p_ar->iocrs[0].cpm;
+   std::atomic<bool> done (false);
+   std::atomic<bool> done_fetching (false);
+   uint32_t errors = 0;
+   uint32_t peek_errors = 0;
+   uint32_t fetched = 0;
+   uint32_t last = 0;
+   uint32_t ix;
+
+   pf_cpm_create (net, p_ar, 0);
+
+   std::thread producer ([p_cpm, &done, frames]() {
+      os_buf_t * p_buf;
+      uint32_t seq;
+
+      for (seq = 1; seq <= frames; seq++)
+      {
+         p_buf = os_buf_alloc (64);
+         for (uint32_t pos = 0; pos < 64; pos += sizeof(seq))
+         {
+            memcpy (&((uint8_t *)p_buf->payload)[pos], &seq, sizeof(seq));
+         }
+         pf_cpm_put_buf (p_cpm, &p_buf, 0);
+         if (p_buf != NULL)
+         {
+            os_buf_free (p_buf);
+         }
+      }
+      done = true;
+   });
+
+   /* A read request peeks at the frame of the application meanwhile */
+   std::thread peeker ([p_cpm, &done_fetching, &peek_errors]() {
+      uint8_t * p_data;
+
+      while (done_fetching == false)
+      {
+         p_data = pf_cpm_peek_begin (p_cpm);
+         if ((p_data != NULL) && (memcmp (p_data, &p_data[32], 32) != 0))
+         {
+            peek_errors++;
+         }
+         pf_cpm_peek_end (p_cpm);
+      }
+   });
+
+   while ((done == false) || (last < frames))
+   {
+      bool new_flag;
+      uint8_t * p_data;
+      uint32_t seq;
+
+      pf_cpm_get_buf (p_cpm, &new_flag, &p_data);
+      if (new_flag)
+      {
+         fetched++;
+         memcpy (&seq, p_data, sizeof(seq));
+         /* Frames are never torn and never older than the previous one */
+         if ((seq <= last) || (memcmp (p_data, &p_data[32], 32) != 0))
+         {
+            errors++;
+         }
+         last = seq;
+      }
+      pf_cpm_get_buf_end (p_cpm);
+   }
+   done_fetching = true;
+   producer.join();
+   peeker.join();
+
+   EXPECT_EQ (0u, errors);
+   EXPECT_EQ (0u, peek_errors);
+   EXPECT_EQ (frames, last);
+   EXPECT_GT (fetched, 0u);
+
+   for (ix = 0; ix < NELEMENTS(p_cpm->buffers); ix++)
+   {
+      if (p_cpm->buffers[ix] != NULL)
+      {
+         os_buf_free ((os_buf_t *)p_cpm->buffers[ix]);
+      }
+   }
+   free (p_ar);
+   free (net);
+}
@@ -20,10 +20,138 @@
 
 #include <gtest/gtest.h>
 
+#define TEST_FRAME_ID_ALARM_HIGH    0xfc01
+#define TEST_FRAME_ID_ALARM_LOW     0xfe01
 
 class EthTest : public PnetIntegrationTest {};
 
+class EthUnitTest : public PnetUnitTest
+{
+protected:
+   pnet_t *net;
+
+   virtual void SetUp() override
+   {
+      net = pf_arena_create(NULL);
+      pf_eth_init(net);
+   };
+
+   virtual void TearDown() override
+   {
+      pf_arena_destroy(net);
+   };
+};
+
+static int test_frame_handler(
+   pnet_t                  *net,
+   uint16_t                frame_id,
+   os_buf_t                *p_buf,
+   uint16_t                frame_id_pos,
+   void                    *p_arg)
+{
+   return 1;
+}
 
 TEST_F (EthTest, EthRunTest)
 {
 }
+
+TEST_F (EthUnitTest, EthFrameIdMapAddFindRemove)
+{
+   int arg1 = 1;
+   int arg2 = 2;
+   pf_eth_frame_id_map_t *p_entry;
+
+   EXPECT_EQ (nullptr, pf_eth_frame_id_map_find(net, 0x8000));
+
+   pf_eth_frame_id_map_add(net, 0x8000, test_frame_handler, &arg1, false);
+   pf_eth_frame_id_map_add(net, TEST_FRAME_ID_ALARM_LOW, test_frame_handler, &arg1, false);
+   pf_eth_frame_id_map_add(net, TEST_FRAME_ID_ALARM_LOW, test_frame_handler, &arg2, false);
+   pf_eth_frame_id_map_add(net, PF_DCP_HELLO_FRAME_ID, test_frame_handler, NULL, false);
+
+   p_entry = pf_eth_frame_id_map_find(net, 0x8000);
+   ASSERT_NE (nullptr, p_entry);
+   EXPECT_EQ (0x8000, p_entry->frame_id);
+   EXPECT_EQ (&arg1, p_entry->p_arg);
+   EXPECT_EQ (nullptr, pf_eth_frame_id_map_find(net, 0x8001));
+
+   /* The oldest entry of a duplicated frame id is found first */
+   p_entry = pf_eth_frame_id_map_find(net, TEST_FRAME_ID_ALARM_LOW);
+   ASSERT_NE (nullptr, p_entry);
+   EXPECT_EQ (&arg1, p_entry->p_arg);
+
+   pf_eth_frame_id_map_remove(net, TEST_FRAME_ID_ALARM_LOW);
+   p_entry = pf_eth_frame_id_map_find(net, TEST_FRAME_ID_ALARM_LOW);
+   ASSERT_NE (nullptr, p_entry);
+   EXPECT_EQ (&arg2, p_entry->p_arg);
+
+   pf_eth_frame_id_map_remove(net, TEST_FRAME_ID_ALARM_LOW);
+   EXPECT_EQ (nullptr, pf_eth_frame_id_map_find(net, TEST_FRAME_ID_ALARM_LOW));
+   EXPECT_NE (nullptr, pf_eth_frame_id_map_find(net, 0x8000));
+   EXPECT_NE (nullptr, pf_eth_frame_id_map_find(net, PF_DCP_HELLO_FRAME_ID));
+
+   /* Freed entries are reused */
+   pf_eth_frame_id_map_remove(net, 0x8000);
+   pf_eth_frame_id_map_add(net, 0x8001, test_frame_handler, &arg2, false);
+   p_entry = pf_eth_frame_id_map_find(net, 0x8001);
+   ASSERT_NE (nullptr, p_entry);
+   EXPECT_EQ (&net->eth_id_map[0], p_entry);
+   EXPECT_EQ (nullptr, pf_eth_frame_id_map_find(net, 0x8000));
+}
+
+TEST_F (EthUnitTest, EthFrameIdMapFillAndEmpty)
+{
+   uint16_t ix;
+
+   for (ix = 0; ix < net->eth_id_map_size; ix++)
+   {
+      pf_eth_frame_id_map_add(net, 0xC000 + ix, test_frame_handler, NULL, false);
+   }
+   for (ix = 0; ix < net->eth_id_map_size; ix++)
+   {
+      EXPECT_NE (nullptr, pf_eth_frame_id_map_find(net, 0xC000 + ix));
+   }
+
+   /* No more room */
+   pf_eth_frame_id_map_add(net, 0xB000, test_frame_handler, NULL, false);
+   EXPECT_EQ (nullptr, pf_eth_frame_id_map_find(net, 0xB000));
+
+   for (ix = 0; ix < net->eth_id_map_size; ix++)
+   {
+      pf_eth_frame_id_map_remove(net, 0xC000 + ix);
+   }
+   for (ix = 0; ix <= net->eth_id_hash_mask; ix++)
+   {
+      EXPECT_EQ (PF_ETH_HASH_NONE, net->eth_id_hash[ix]);
+   }
+}
+
+TEST_F (EthUnitTest, EthFrameIdMapRemovedEntryWaitsForReaders)
+{
+   uint16_t hash = (0x8000 ^ (0x8000 >> 8)) & net->eth_id_hash_mask;
+   uint16_t other = 0x8001;
+
+   /* A second frame id in the same hash chain */
+   while (((other ^ (other >> 8)) & net->eth_id_hash_mask) != hash)
+   {
+      other++;
+   }
+   pf_eth_frame_id_map_add(net, 0x8000, test_frame_handler, NULL, false);
+   pf_eth_frame_id_map_add(net, other, test_frame_handler, NULL, false);
+   EXPECT_EQ (1u, net->eth_id_map[0].next);
+
+   /* While a receiver is inside a lookup, the removed entry keeps its link */
+   atomic_store(&net->eth_id_readers, 1U);
+   pf_eth_frame_id_map_remove(net, 0x8000);
+   pf_eth_frame_id_map_add(net, 0x9000, test_frame_handler, NULL, false);
+   EXPECT_EQ (&net->eth_id_map[2], pf_eth_frame_id_map_find(net, 0x9000));
+   EXPECT_EQ (1u, net->eth_id_map[0].next);
+   EXPECT_EQ (&net->eth_id_map[1], pf_eth_frame_id_map_find(net, other));
+
+   /* And is reused when no receiver can be on it */
+   atomic_store(&net->eth_id_readers, 0U);
+   pf_eth_frame_id_map_add(net, 0x9001, test_frame_handler, NULL, false);
+   EXPECT_EQ (&net->eth_id_map[0], pf_eth_frame_id_map_find(net, 0x9001));
+   EXPECT_EQ (nullptr, pf_eth_frame_id_map_find(net, 0x8000));
+   EXPECT_EQ (&net->eth_id_map[1], pf_eth_frame_id_map_find(net, other));
+}
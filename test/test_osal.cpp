@@ -15,12 +15,26 @@
 
 /**
  * @file
- * @brief Unit tests of features from osal; timer, mbox, sem
+ * @brief Unit tests of features from osal; timer, mbox, sem, buffers
  *
  */
 
 #include "osal.h"
 #include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <arpa/inet.h>
 
 static int expired_calls;
 static void * expired_arg;
@@ -107,8 +121,8 @@ TEST (Osal, MboxShouldNotTimeout)
    void * msg;
    int tmo;
 
-   os_mbox_post (mbox, (void *)1, OS_WAIT_FOREVER);
-   tmo = os_mbox_fetch (mbox, &msg, OS_WAIT_FOREVER);
+   os_mbox_post (mbox, (void *)1);
+   tmo = os_mbox_fetch (mbox, &msg);
 
    EXPECT_EQ (0, tmo);
    EXPECT_EQ (1, (long)msg);
@@ -116,31 +130,496 @@ TEST (Osal, MboxShouldNotTimeout)
    os_mbox_destroy (mbox);
 }
 
-TEST (Osal, FetchFromEmptyMboxShouldTimeout)
+TEST (Osal, FetchFromEmptyMboxShouldFail)
 {
    os_mbox_t * mbox = os_mbox_create(2);
    void * msg;
    int tmo;
 
-   tmo = os_mbox_fetch (mbox, &msg, 100);
+   tmo = os_mbox_fetch (mbox, &msg);
    EXPECT_EQ (1, tmo);
 
    os_mbox_destroy (mbox);
 }
 
-TEST (Osal, PostToFullMBoxShouldTimeout)
+TEST (Osal, PostToFullMBoxShouldFail)
 {
    os_mbox_t * mbox = os_mbox_create(2);
    int tmo;
 
-   os_mbox_post (mbox, (void *)1, 100);
-   os_mbox_post (mbox, (void *)2, 100);
-   tmo = os_mbox_post (mbox, (void *)3, 100);
+   os_mbox_post (mbox, (void *)1);
+   os_mbox_post (mbox, (void *)2);
+   tmo = os_mbox_post (mbox, (void *)3);
    EXPECT_EQ (1, tmo);
+   EXPECT_TRUE (os_mbox_is_full (mbox));
 
    os_mbox_destroy (mbox);
 }
 
+TEST (Osal, MboxShouldHoldExactlySizeMessages)
+{
+   // 3 messages need 4 slots in the ring, but only 3 may be posted
+   os_mbox_t * mbox = os_mbox_create(3);
+   void * msg;
+   long ix;
+
+   for (ix = 1; ix <= 3; ix++)
+   {
+      EXPECT_EQ (0, os_mbox_post (mbox, (void *)ix));
+   }
+   EXPECT_TRUE (os_mbox_is_full (mbox));
+   EXPECT_EQ (1, os_mbox_post (mbox, (void *)4));
+
+   // Wrap around several times, in order
+   for (ix = 1; ix <= 20; ix++)
+   {
+      EXPECT_EQ (0, os_mbox_fetch (mbox, &msg));
+      EXPECT_EQ (ix, (long)msg);
+      EXPECT_FALSE (os_mbox_is_full (mbox));
+      EXPECT_EQ (0, os_mbox_post (mbox, (void *)(ix + 3)));
+   }
+
+   os_mbox_destroy (mbox);
+}
+
+TEST (Osal, MboxFetchWaitShouldWakeOnPost)
+{
+   os_mbox_t * mbox = os_mbox_create(2);
+   void * msg = NULL;
+   uint64_t t0;
+
+   t0 = os_get_current_time_us();
+   EXPECT_EQ (1, os_mbox_fetch_wait (mbox, &msg, 20 * 1000));
+   EXPECT_GE (os_get_current_time_us() - t0, 20 * 1000u);
+
+   std::thread poster ([mbox]() {
+      os_usleep (10 * 1000);
+      os_mbox_post (mbox, (void *)5);
+   });
+   EXPECT_EQ (0, os_mbox_fetch_wait (mbox, &msg, OS_WAIT_FOREVER));
+   EXPECT_EQ (5, (long)msg);
+   poster.join();
+
+   os_mbox_destroy (mbox);
+}
+
+TEST (Osal, MboxConcurrentPostFetch)
+{
+   const uint32_t n_producers = 4;
+   const uint32_t n_msgs = 50000;
+   os_mbox_t * mbox = os_mbox_create (64);
+   std::vector<std::thread> threads;
+   std::vector<uint32_t> last (n_producers, 0);
+   uint32_t received = 0;
+   uint32_t errors = 0;
+   void * msg;
+
+   for (uint32_t t = 0; t < n_producers; t++)
+   {
+      threads.emplace_back ([mbox, t, n_msgs]() {
+         for (uint32_t seq = 1; seq <= n_msgs; seq++)
+         {
+            while (os_mbox_post (mbox, (void *)(((uintptr_t)t << 24) | seq)) != 0)
+            {
+               std::this_thread::yield();
+            }
+         }
+      });
+   }
+   while (received < n_producers * n_msgs)
+   {
+      if (os_mbox_fetch (mbox, &msg) != 0)
+      {
+         std::this_thread::yield();
+         continue;
+      }
+      uint32_t t = (uint32_t)((uintptr_t)msg >> 24);
+      uint32_t seq = (uint32_t)((uintptr_t)msg & 0xFFFFFF);
+      // Messages from one producer must arrive once and in order
+      if ((t >= n_producers) || (seq != last[t] + 1))
+      {
+         errors++;
+      }
+      if (t < n_producers)
+      {
+         last[t] = seq;
+      }
+      received++;
+   }
+   for (std::thread & thread : threads)
+   {
+      thread.join();
+   }
+
+   EXPECT_EQ (0u, errors);
+   EXPECT_FALSE (os_mbox_is_full (mbox));
+   EXPECT_EQ (1, os_mbox_fetch (mbox, &msg));
+
+   os_mbox_destroy (mbox);
+}
+
+TEST (Osal, BufShouldComeFromPool)
+{
+   os_buf_stats_t before;
+   os_buf_stats_t after;
+   os_buf_t * p;
+
+   os_buf_get_stats (&before, NULL);
+   p = os_buf_alloc (100);
+   ASSERT_TRUE (p != NULL);
+   EXPECT_EQ (100u, p->len);
+
+   os_buf_get_stats (&after, NULL);
+   EXPECT_EQ (before.used + 1, after.used);
+   EXPECT_EQ (before.fallback, after.fallback);
+   EXPECT_GE (after.high_water, after.used);
+
+   os_buf_free (p);
+   os_buf_get_stats (&after, NULL);
+   EXPECT_EQ (before.used, after.used);
+
+   // Double free is detected and ignored
+   os_buf_free (p);
+   os_buf_get_stats (&after, NULL);
+   EXPECT_EQ (before.used, after.used);
+}
+
+static int n_external_released;
+
+static void external_buf_release (os_buf_t * p)
+{
+   n_external_released++;
+}
+
+TEST (Osal, BufKeepShouldCopyExternalBuffers)
+{
+   uint8_t frame[60];
+   os_buf_t external;
+   os_buf_t * p;
+   os_buf_t * p_kept;
+
+   // Pool buffers are kept as they are
+   p = os_buf_alloc_with_wait (OS_BUF_MAX_SIZE);
+   ASSERT_TRUE (p != NULL);
+   EXPECT_EQ (p, os_buf_keep (p));
+   os_buf_free (p);
+
+   // Buffers owned elsewhere are copied and released
+   memset (frame, 0x5a, sizeof (frame));
+   memset (&external, 0, sizeof (external));
+   external.payload = frame;
+   external.len = sizeof (frame);
+   external.memory_type = MEMORY_TYPE_EXTERNAL;
+   external.release = external_buf_release;
+   n_external_released = 0;
+
+   p_kept = os_buf_keep (&external);
+   ASSERT_TRUE (p_kept != NULL);
+   EXPECT_NE (&external, p_kept);
+   EXPECT_EQ (1, n_external_released);
+   EXPECT_EQ (sizeof (frame), p_kept->len);
+   EXPECT_EQ (0, memcmp (frame, p_kept->payload, sizeof (frame)));
+   os_buf_free (p_kept);
+}
+
+TEST (Osal, BufPoolShouldFallBackWhenEmpty)
+{
+   std::vector<os_buf_t *> bufs;
+   os_buf_stats_t before;
+   os_buf_stats_t after;
+   uint32_t ix;
+
+   os_buf_get_stats (NULL, &before);
+   for (ix = 0; ix < before.size + 2; ix++)
+   {
+      bufs.push_back (os_buf_alloc_with_wait (OS_BUF_MAX_SIZE));
+      ASSERT_TRUE (bufs.back() != NULL);
+   }
+
+   os_buf_get_stats (NULL, &after);
+   EXPECT_EQ (before.size, after.used);
+   EXPECT_EQ (before.size, after.high_water);
+   EXPECT_EQ (before.fallback + before.used + 2, after.fallback);
+
+   for (os_buf_t * p : bufs)
+   {
+      os_buf_free (p);
+   }
+   os_buf_get_stats (NULL, &after);
+   EXPECT_EQ (before.used, after.used);
+}
+
+TEST (Osal, BufPoolConcurrentAllocFree)
+{
+   const uint32_t n_threads = 4;
+   const uint32_t rounds = 100000;
+   std::vector<std::thread> threads;
+   std::atomic<uint32_t> errors (0);
+   os_buf_stats_t before;
+   os_buf_stats_t after;
+
+   os_buf_get_stats (NULL, &before);
+
+   auto start = std::chrono::steady_clock::now();
+   for (uint32_t t = 0; t < n_threads; t++)
+   {
+      threads.emplace_back ([&errors, t, rounds]() {
+         os_buf_t * held[8];
+         uint32_t round;
+         uint32_t ix;
+
+         for (round = 0; round < rounds / NELEMENTS(held); round++)
+         {
+            for (ix = 0; ix < NELEMENTS(held); ix++)
+            {
+               held[ix] = os_buf_alloc_with_wait (OS_BUF_MAX_SIZE);
+               memset (held[ix]->payload, (int)t, 64);
+            }
+            for (ix = 0; ix < NELEMENTS(held); ix++)
+            {
+               // No other thread may own the same buffer
+               if (((uint8_t *)held[ix]->payload)[63] != (uint8_t)t)
+               {
+                  errors++;
+               }
+               os_buf_free (held[ix]);
+            }
+         }
+      });
+   }
+   for (std::thread & thread : threads)
+   {
+      thread.join();
+   }
+   auto stop = std::chrono::steady_clock::now();
+
+   os_buf_get_stats (NULL, &after);
+   EXPECT_EQ (0u, errors.load());
+   EXPECT_EQ (before.used, after.used);
+   EXPECT_LE (after.high_water, after.size);
+
+   printf ("[ BENCH    ] %u threads: %.1f ns per os_buf_alloc_with_wait + os_buf_free\n",
+           (unsigned)n_threads,
+           std::chrono::duration<double, std::nano>(stop - start).count() / (n_threads * rounds));
+}
+
+TEST (Osal, MemStatsShouldCountAllocations)
+{
+   const uint32_t rounds = 1000;
+   os_mem_stats_t stats;
+   void * ptr;
+   uint32_t ix;
+
+   os_mem_reset_stats();
+   for (ix = 0; ix < rounds; ix++)
+   {
+      ptr = os_malloc (64 + (ix % 8) * 32);
+      os_free (ptr);
+   }
+   os_free (NULL);
+
+   os_mem_get_stats (&stats);
+   EXPECT_NE (nullptr, stats.p_backend);
+#if defined(USE_MEM_STATS)
+   EXPECT_EQ (rounds, stats.n_alloc);
+   EXPECT_EQ (rounds, stats.n_free);
+   EXPECT_LE (stats.alloc_ns_max * 1ULL, stats.alloc_ns_total);
+#else
+   EXPECT_EQ (0u, stats.n_alloc);
+   EXPECT_EQ (0u, stats.n_free);
+#endif
+}
+
+static void * rt_thread_entry (void * arg)
+{
+   cpu_set_t * p_cpus = (cpu_set_t *)arg;
+
+   pthread_getaffinity_np (pthread_self(), sizeof (*p_cpus), p_cpus);
+   return NULL;
+}
+
+TEST (Osal, ThreadShouldGetConfiguredCpus)
+{
+   os_rt_cfg_t rt_cfg;
+   cpu_set_t cpus;
+   os_thread_t * thread;
+
+   memset (&rt_cfg, 0, sizeof (rt_cfg));
+   rt_cfg.stack_prefault = 16 * 1024;
+   rt_cfg.nbr_threads = 1;
+   rt_cfg.threads[0].name = "rt_test";
+   rt_cfg.threads[0].policy = OS_SCHED_OTHER;
+   rt_cfg.threads[0].cpu_mask = 0x1;
+   EXPECT_EQ (0, os_rt_configure (&rt_cfg));
+
+   CPU_ZERO (&cpus);
+   thread = os_thread_create ("rt_test", 0, 32 * 1024, rt_thread_entry, &cpus);
+   ASSERT_NE (nullptr, thread);
+   pthread_join (*thread, NULL);
+   EXPECT_EQ (1, CPU_COUNT (&cpus));
+   EXPECT_TRUE (CPU_ISSET (0, &cpus));
+
+   /* Other threads are not affected */
+   CPU_ZERO (&cpus);
+   thread = os_thread_create ("rt_other", 0, 32 * 1024, rt_thread_entry, &cpus);
+   ASSERT_NE (nullptr, thread);
+   pthread_join (*thread, NULL);
+   EXPECT_EQ (sysconf (_SC_NPROCESSORS_ONLN), CPU_COUNT (&cpus));
+
+   memset (&rt_cfg, 0, sizeof (rt_cfg));
+   EXPECT_EQ (0, os_rt_configure (&rt_cfg));
+}
+
+static void * policy_thread_entry (void * arg)
+{
+   int * p_policy = (int *)arg;
+   struct sched_param param;
+
+   pthread_getschedparam (pthread_self(), p_policy, &param);
+   return NULL;
+}
+
+TEST (Osal, BackgroundThreadShouldBeSchedOther)
+{
+   os_rt_cfg_t rt_cfg;
+   os_thread_t * thread;
+   int policy = -1;
+
+   memset (&rt_cfg, 0, sizeof (rt_cfg));
+   rt_cfg.policy = OS_SCHED_FIFO;
+   EXPECT_EQ (0, os_rt_configure (&rt_cfg));
+
+   thread = os_thread_create_background ("bg_test", 32 * 1024, policy_thread_entry, &policy);
+   ASSERT_NE (nullptr, thread);
+   pthread_join (*thread, NULL);
+   EXPECT_EQ (SCHED_OTHER, policy);
+
+   memset (&rt_cfg, 0, sizeof (rt_cfg));
+   EXPECT_EQ (0, os_rt_configure (&rt_cfg));
+}
+
+TEST (Osal, LogShouldKeepConnectBurst)
+{
+   /* A connect logs about 50 messages at debug level, from one thread */
+   const uint32_t n_msgs = 200;
+   os_log_stats_t before;
+   os_log_stats_t after;
+
+   os_log_get_stats (&before);
+   std::thread producer ([&] {
+      for (uint32_t ix = 0; ix < n_msgs; ix++)
+      {
+         os_log (0x01, "os_log burst %u\n", (unsigned)ix);
+      }
+   });
+   producer.join();
+   os_log_flush();
+   os_log_get_stats (&after);
+
+   EXPECT_EQ (0u, after.n_dropped - before.n_dropped);
+}
+
+TEST (Osal, LogShouldQueueOrCountEveryMessage)
+{
+   const uint32_t n_msgs = 100;
+   os_log_stats_t before;
+   os_log_stats_t after;
+
+   os_log_get_stats (&before);
+   std::thread producer ([&] {
+      for (uint32_t ix = 0; ix < n_msgs; ix++)
+      {
+         os_log (0x01, "os_log test %u\n", (unsigned)ix);
+      }
+   });
+   producer.join();
+   os_log_flush();
+   os_log_get_stats (&after);
+
+   EXPECT_EQ (n_msgs, (after.n_logged - before.n_logged) +
+                      (after.n_dropped - before.n_dropped) +
+                      (after.n_sync - before.n_sync));
+}
+
+TEST (Osal, UdpPollShouldReportReadableSocket)
+{
+   int poll_id;
+   int rx, tx;
+   uint32_t ready[4];
+   uint8_t data[8] = { 1, 2, 3, 4 };
+   uint64_t t0, t1;
+
+   poll_id = os_udp_poll_create();
+   ASSERT_GE (poll_id, 0);
+   rx = os_udp_open (OS_IPADDR_LOOPBACK, 0x8C00);
+   tx = os_udp_open (OS_IPADDR_LOOPBACK, 0x8C01);
+   ASSERT_GT (rx, 0);
+   ASSERT_GT (tx, 0);
+   EXPECT_EQ (0, os_udp_poll_add (poll_id, rx));
+
+   // Nothing to read: should wait for the whole timeout
+   t0 = os_get_current_time_us();
+   EXPECT_EQ (0, os_udp_poll_wait (poll_id, ready, NELEMENTS(ready), 20 * 1000));
+   t1 = os_get_current_time_us();
+   EXPECT_GE (t1 - t0, 20 * 1000u);
+
+   EXPECT_EQ (4, os_udp_sendto (tx, OS_IPADDR_LOOPBACK, 0x8C00, data, 4));
+   EXPECT_EQ (1, os_udp_poll_wait (poll_id, ready, NELEMENTS(ready), 1000 * 1000));
+   EXPECT_EQ ((uint32_t)rx, ready[0]);
+
+   os_udp_poll_remove (poll_id, rx);
+   EXPECT_EQ (0, os_udp_poll_wait (poll_id, ready, NELEMENTS(ready), 0));
+
+   os_udp_close (rx);
+   os_udp_close (tx);
+   os_udp_poll_destroy (poll_id);
+}
+
+TEST (Osal, UdpBatchShouldDrainAllPendingDatagrams)
+{
+   int rx, tx;
+   int ix;
+   uint8_t tx_data[5][4];
+   uint8_t rx_data[8][16];
+   os_udp_msg_t tx_msgs[5];
+   os_udp_msg_t rx_msgs[8];
+
+   rx = os_udp_open (OS_IPADDR_LOOPBACK, 0x8C02);
+   tx = os_udp_open (OS_IPADDR_LOOPBACK, 0x8C03);
+   ASSERT_GT (rx, 0);
+   ASSERT_GT (tx, 0);
+
+   for (ix = 0; ix < 5; ix++)
+   {
+      memset (tx_data[ix], ix, sizeof(tx_data[ix]));
+      tx_msgs[ix].data = tx_data[ix];
+      tx_msgs[ix].size = ix + 1;
+      tx_msgs[ix].addr = OS_IPADDR_LOOPBACK;
+      tx_msgs[ix].port = 0x8C02;
+   }
+   for (ix = 0; ix < 8; ix++)
+   {
+      rx_msgs[ix].data = rx_data[ix];
+      rx_msgs[ix].size = sizeof(rx_data[ix]);
+   }
+
+   EXPECT_EQ (5, os_udp_sendmmsg (tx, tx_msgs, 5));
+   EXPECT_EQ (5, os_udp_recvmmsg (rx, rx_msgs, 8));
+   for (ix = 0; ix < 5; ix++)
+   {
+      EXPECT_EQ (ix + 1, rx_msgs[ix].len);
+      EXPECT_EQ (ix, rx_data[ix][0]);
+      EXPECT_EQ (OS_IPADDR_LOOPBACK, rx_msgs[ix].addr);
+      EXPECT_EQ (0x8C03, rx_msgs[ix].port);
+   }
+
+   // Nothing more pending, and no blocking
+   EXPECT_EQ (0, os_udp_recvmmsg (rx, rx_msgs, 8));
+
+   os_udp_close (rx);
+   os_udp_close (tx);
+}
+
 TEST (Osal, CyclicTimer)
 {
    int t0, t1;
@@ -183,3 +662,431 @@ TEST (Osal, OneshotTimer)
 
    os_timer_destroy (timer);
 }
+
+TEST (Osal, TimerStatsShouldCountExpiries)
+{
+   os_timer_t * timer;
+   os_timer_stats_t stats;
+
+   timer = os_timer_create (5 * 1000, expired, NULL, false);
+   ASSERT_TRUE (timer != NULL);
+   os_timer_start (timer);
+   os_usleep (100 * 1000);
+   os_timer_stop (timer);
+
+   os_timer_get_stats (timer, &stats);
+   EXPECT_NEAR (20, stats.n_expiries + stats.n_overruns, 2);
+   EXPECT_LE (stats.jitter_ns_avg, stats.jitter_ns_max);
+
+   os_timer_destroy (timer);
+}
+
+TEST (Osal, TimerPeriodOfOneSecondOrMore)
+{
+   os_timer_t * timer;
+   os_timer_stats_t stats;
+
+   timer = os_timer_create (1100 * 1000, expired, NULL, true);
+   ASSERT_TRUE (timer != NULL);
+   os_timer_start (timer);
+
+   os_usleep (900 * 1000);
+   os_timer_get_stats (timer, &stats);
+   EXPECT_EQ (0u, stats.n_expiries);
+
+   os_usleep (400 * 1000);
+   os_timer_get_stats (timer, &stats);
+   EXPECT_EQ (1u, stats.n_expiries);
+
+   os_timer_destroy (timer);
+}
+
+static std::atomic<uint32_t> self_destroy_expiries (0);
+static void self_destroy_expired (os_timer_t * timer, void * arg)
+{
+   os_timer_stats_t stats;
+
+   /* Neither may deadlock on the timer service */
+   os_timer_get_stats (timer, &stats);
+   self_destroy_expiries = stats.n_expiries;
+   os_timer_destroy (timer);
+}
+
+TEST (Osal, TimerCallbackMayDestroyItsTimer)
+{
+   os_timer_t * timer;
+
+   timer = os_timer_create (5 * 1000, self_destroy_expired, NULL, false);
+   ASSERT_TRUE (timer != NULL);
+   os_timer_start (timer);
+   os_usleep (100 * 1000);
+
+   EXPECT_EQ (1u, self_destroy_expiries);
+
+   /* The service still runs other timers */
+   timer = os_timer_create (5 * 1000, expired, NULL, true);
+   ASSERT_TRUE (timer != NULL);
+   expired_calls = 0;
+   os_timer_start (timer);
+   os_usleep (50 * 1000);
+   EXPECT_EQ (1, expired_calls);
+   os_timer_destroy (timer);
+}
+
+struct PersistDone
+{
+   std::string file_name;
+   uint32_t seq;
+   int result;
+};
+
+static std::mutex persist_done_mutex;
+static std::vector<PersistDone> persist_done;
+
+static void persist_cb (void * arg, const char * p_file_name, uint32_t seq, int result)
+{
+   std::lock_guard<std::mutex> lock (persist_done_mutex);
+   persist_done.push_back ({p_file_name, seq, result});
+}
+
+static std::string read_file (const std::string & name)
+{
+   std::ifstream in (name, std::ios::binary);
+   return std::string (std::istreambuf_iterator<char> (in), std::istreambuf_iterator<char>());
+}
+
+static void write_file (const std::string & name, const std::string & content)
+{
+   std::ofstream out (name, std::ios::binary | std::ios::trunc);
+   out << content;
+}
+
+/* Same CRC as the journal, to build one */
+static uint32_t crc32 (const std::string & data)
+{
+   uint32_t crc = 0xFFFFFFFFU;
+
+   for (unsigned char c : data)
+   {
+      crc ^= c;
+      for (int bit = 0; bit < 8; bit++)
+      {
+         crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+      }
+   }
+   return ~crc;
+}
+
+static void append_u32 (std::string & s, uint32_t value)
+{
+   s.append ((const char *)&value, sizeof (value));
+}
+
+class PersistTest : public ::testing::Test
+{
+protected:
+   virtual void SetUp()
+   {
+      char tmpl[] = "/tmp/pnet_persistXXXXXX";
+
+      ASSERT_TRUE (mkdtemp (tmpl) != NULL);
+      dir = tmpl;
+      journal = dir + "/journal";
+      file_a = dir + "/a.dat";
+      file_b = dir + "/b.dat";
+      persist_done.clear();
+   }
+
+   virtual void TearDown()
+   {
+      EXPECT_EQ (0, os_persist_flush (1000));
+      cfg.cb = NULL;
+      (void)os_persist_init (&cfg);
+      unlink (file_a.c_str());
+      unlink (file_b.c_str());
+      unlink (journal.c_str());
+      rmdir (dir.c_str());
+   }
+
+   void init()
+   {
+      memset (&cfg, 0, sizeof (cfg));
+      cfg.p_journal = journal.c_str();
+      cfg.coalesce_us = 50 * 1000;
+      cfg.cb = persist_cb;
+      ASSERT_EQ (0, os_persist_init (&cfg));
+   }
+
+   os_persist_cfg_t cfg;
+   std::string dir;
+   std::string journal;
+   std::string file_a;
+   std::string file_b;
+};
+
+TEST_F (PersistTest, PersistShouldCoalesceAndSkipUnchanged)
+{
+   os_persist_stats_t before;
+   os_persist_stats_t after;
+   uint32_t seq = 0;
+
+   init();
+   os_persist_get_stats (&before);
+
+   // A burst is one write, with the last content
+   EXPECT_EQ (0, os_persist_write (file_a.c_str(), "one", 3, NULL));
+   EXPECT_EQ (0, os_persist_write (file_a.c_str(), "two", 3, NULL));
+   EXPECT_EQ (0, os_persist_write (file_a.c_str(), "three", 5, &seq));
+   EXPECT_EQ (0, os_persist_write (file_b.c_str(), "bee", 3, NULL));
+   EXPECT_EQ (0, os_persist_flush (1000));
+
+   EXPECT_EQ ("three", read_file (file_a));
+   EXPECT_EQ ("bee", read_file (file_b));
+   EXPECT_EQ (0u, read_file (journal).size());
+   os_persist_get_stats (&after);
+   EXPECT_EQ (2u, after.n_coalesced - before.n_coalesced);
+   EXPECT_EQ (1u, after.n_commits - before.n_commits);
+   EXPECT_EQ (1u, after.n_journaled - before.n_journaled);
+   EXPECT_EQ (2u, after.n_written - before.n_written);
+   {
+      std::lock_guard<std::mutex> lock (persist_done_mutex);
+      ASSERT_EQ (2u, persist_done.size());
+      EXPECT_EQ (file_a, persist_done[0].file_name);
+      EXPECT_EQ (seq, persist_done[0].seq);
+      EXPECT_EQ (0, persist_done[0].result);
+      EXPECT_EQ (0, persist_done[1].result);
+   }
+
+   // Same content again is not written
+   EXPECT_EQ (0, os_persist_write (file_a.c_str(), "three", 5, NULL));
+   EXPECT_EQ (0, os_persist_flush (1000));
+   os_persist_get_stats (&before);
+   EXPECT_EQ (1u, before.n_unchanged - after.n_unchanged);
+   EXPECT_EQ (after.n_written, before.n_written);
+}
+
+static std::atomic<bool> persist_cb_entered;
+static std::atomic<bool> persist_cb_release;
+
+static void persist_blocking_cb (void * arg, const char * p_file_name, uint32_t seq, int result)
+{
+   persist_cb_entered = true;
+   while (persist_cb_release == false)
+   {
+      std::this_thread::sleep_for (std::chrono::milliseconds (1));
+   }
+}
+
+TEST_F (PersistTest, PersistWriteShouldNotWaitForCommit)
+{
+   std::atomic<bool> written (false);
+
+   persist_cb_entered = false;
+   persist_cb_release = false;
+   init();
+   cfg.cb = persist_blocking_cb;
+   ASSERT_EQ (0, os_persist_init (&cfg));
+
+   // The callback runs within the commit, and holds it
+   EXPECT_EQ (0, os_persist_write (file_a.c_str(), "one", 3, NULL));
+   while (persist_cb_entered == false)
+   {
+      std::this_thread::sleep_for (std::chrono::milliseconds (1));
+   }
+
+   std::thread writer ([&] {
+      EXPECT_EQ (0, os_persist_write (file_b.c_str(), "bee", 3, NULL));
+      written = true;
+   });
+   for (int i = 0; (i < 1000) && (written == false); i++)
+   {
+      std::this_thread::sleep_for (std::chrono::milliseconds (1));
+   }
+   EXPECT_TRUE (written);
+   persist_cb_release = true;
+   writer.join();
+
+   EXPECT_EQ (0, os_persist_flush (1000));
+   EXPECT_EQ ("bee", read_file (file_b));
+}
+
+TEST_F (PersistTest, PersistShouldReplayCompleteJournal)
+{
+   std::string records;
+   std::string content;
+
+   write_file (file_a, "old a");
+   write_file (file_b, "old b");
+
+   // A batch that was journaled, but not applied before a crash
+   append_u32 (records, 0x574E5050U);
+   append_u32 (records, file_a.size());
+   append_u32 (records, 5);
+   records += file_a + "new a";
+   append_u32 (records, 0x574E5050U);
+   append_u32 (records, file_b.size());
+   append_u32 (records, 5);
+   records += file_b + "new b";
+   content = records;
+   append_u32 (content, 0x434E5050U);
+   append_u32 (content, 2);
+   append_u32 (content, records.size());
+   append_u32 (content, crc32 (records));
+   write_file (journal, content);
+
+   init();
+   EXPECT_EQ ("new a", read_file (file_a));
+   EXPECT_EQ ("new b", read_file (file_b));
+   EXPECT_EQ (0u, read_file (journal).size());
+}
+
+TEST_F (PersistTest, PersistShouldDiscardTornJournal)
+{
+   std::string records;
+
+   write_file (file_a, "old a");
+
+   // Crash while writing the journal: no trailer
+   append_u32 (records, 0x574E5050U);
+   append_u32 (records, file_a.size());
+   append_u32 (records, 5);
+   records += file_a + "new a";
+   write_file (journal, records);
+
+   init();
+   EXPECT_EQ ("old a", read_file (file_a));
+   EXPECT_EQ (0u, read_file (journal).size());
+}
+
+static std::mutex netif_done_mutex;
+static std::vector<os_netif_result_t> netif_done;
+
+static void netif_cb (void * arg, const os_netif_result_t * p_result)
+{
+   std::lock_guard<std::mutex> lock (netif_done_mutex);
+   netif_done.push_back (*p_result);
+}
+
+TEST (Osal, NetifShouldReportFailureWithTiming)
+{
+   os_netif_stats_t before;
+   os_netif_stats_t after;
+   uint32_t seq = 0;
+
+   netif_done.clear();
+   os_netif_set_callback (netif_cb, NULL);
+   os_netif_get_stats (&before);
+
+   // Not contiguous, or empty
+   EXPECT_EQ (-1, os_netif_set_ip_suite ("pnet_none0", 0xC0A80005, 0xFF00FF00, 0, NULL));
+   EXPECT_EQ (-1, os_netif_set_ip_suite ("pnet_none0", 0xC0A80005, 0, 0, NULL));
+
+   EXPECT_EQ (0, os_netif_set_ip_suite ("pnet_none0", 0xC0A80005, 0xFFFFFF00, 0, &seq));
+   EXPECT_EQ (0, os_netif_flush (1000));
+   os_netif_set_callback (NULL, NULL);
+
+   os_netif_get_stats (&after);
+   EXPECT_EQ (1u, after.n_requests - before.n_requests);
+   EXPECT_EQ (1u, after.n_errors - before.n_errors);
+   EXPECT_EQ (before.n_done, after.n_done);
+   {
+      std::lock_guard<std::mutex> lock (netif_done_mutex);
+      ASSERT_EQ (1u, netif_done.size());
+      EXPECT_EQ (seq, netif_done[0].seq);
+      EXPECT_EQ (-1, netif_done[0].result);
+      EXPECT_EQ (ENODEV, netif_done[0].error);
+      EXPECT_LT (netif_done[0].apply_us, 1000u * 1000u);
+   }
+}
+
+/**
+ * Get the IPv4 address and prefix length of an interface. 0 if none.
+ */
+static uint32_t netif_addr (const char * ifname, int * p_prefix_len)
+{
+   struct ifaddrs * p_list;
+   uint32_t addr = 0;
+
+   *p_prefix_len = 0;
+   if (getifaddrs (&p_list) != 0)
+   {
+      return 0;
+   }
+   for (struct ifaddrs * p = p_list; p != NULL; p = p->ifa_next)
+   {
+      if ((p->ifa_addr != NULL) && (p->ifa_addr->sa_family == AF_INET) &&
+          (strcmp (p->ifa_name, ifname) == 0))
+      {
+         addr = ntohl (((struct sockaddr_in *)p->ifa_addr)->sin_addr.s_addr);
+         *p_prefix_len = __builtin_popcount (((struct sockaddr_in *)p->ifa_netmask)->sin_addr.s_addr);
+      }
+   }
+   freeifaddrs (p_list);
+   return addr;
+}
+
+/**
+ * Get the default routes, as "interface gateway metric" lines of /proc/net/route.
+ */
+static std::vector<std::string> netif_default_routes()
+{
+   std::vector<std::string> routes;
+   std::ifstream file ("/proc/net/route");
+   std::string line;
+   char ifname[IFNAMSIZ + 1];
+   unsigned dst, gw, flags, refcnt, use, metric;
+
+   while (std::getline (file, line))
+   {
+      if ((sscanf (line.c_str(), "%16s %x %x %x %u %u %u", ifname, &dst, &gw, &flags,
+                   &refcnt, &use, &metric) == 7) && (dst == 0))
+      {
+         routes.push_back (std::string (ifname) + " " + std::to_string (ntohl (gw)) +
+                           " " + std::to_string (metric));
+      }
+   }
+   return routes;
+}
+
+static bool netif_has_route (const std::vector<std::string> & routes, const std::string & route)
+{
+   return std::find (routes.begin(), routes.end(), route) != routes.end();
+}
+
+TEST (Osal, NetifShouldSetAddressAndOwnDefaultRoute)
+{
+   const char * ifname = "pnet_test0";
+   const std::string own_route = std::string (ifname) + " " + std::to_string (0x0A630001) +
+                                 " " + std::to_string (OS_NETIF_ROUTE_METRIC);
+   std::vector<std::string> system_routes;
+   std::vector<std::string> routes;
+   int prefix_len;
+
+   if (system ("ip link add pnet_test0 type veth peer name pnet_test1 2>/dev/null && "
+               "ip link set pnet_test0 up && ip link set pnet_test1 up") != 0)
+   {
+      (void)system ("ip link del pnet_test0 2>/dev/null");
+      GTEST_SKIP() << "Could not create a veth interface";
+   }
+   system_routes = netif_default_routes();
+
+   EXPECT_EQ (0, os_netif_set_ip_suite (ifname, 0x0A630005, 0xFFFFFF00, 0x0A630001, NULL));
+   EXPECT_EQ (0, os_netif_flush (1000));
+   EXPECT_EQ (0x0A630005u, netif_addr (ifname, &prefix_len));
+   EXPECT_EQ (24, prefix_len);
+   routes = netif_default_routes();
+   EXPECT_TRUE (netif_has_route (routes, own_route));
+   for (const std::string & route : system_routes)
+   {
+      EXPECT_TRUE (netif_has_route (routes, route)) << route;
+   }
+
+   /* A new address replaces the old one. No gateway deletes the own route only */
+   EXPECT_EQ (0, os_netif_set_ip_suite (ifname, 0x0A640007, 0xFFFF0000, 0, NULL));
+   EXPECT_EQ (0, os_netif_flush (1000));
+   EXPECT_EQ (0x0A640007u, netif_addr (ifname, &prefix_len));
+   EXPECT_EQ (16, prefix_len);
+   EXPECT_EQ (system_routes, netif_default_routes());
+
+   (void)system ("ip link del pnet_test0");
+}
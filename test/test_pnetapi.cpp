@@ -304,6 +304,19 @@ TEST_F (PnetapiTest, PnetapiRunTest)
    EXPECT_EQ(appdata.call_counters.state_calls, 4);
    EXPECT_EQ(appdata.cmdev_state, PNET_EVENT_DATA);
 
+   printf("\nRead the IOCR statistics\n");
+   pnet_iocr_statistics_t stats;
+   uint32_t recv_cnt = 0;
+   uint32_t inter_arrival_cnt = 0;
+   for (ix = 0; pnet_get_iocr_statistics(net, appdata.main_arep, ix, &stats) == 0; ix++)
+   {
+      recv_cnt += stats.cpm_recv_cnt;
+      inter_arrival_cnt += stats.cpm_inter_arrival.count;
+   }
+   EXPECT_EQ(ix, 2u);
+   EXPECT_GE(recv_cnt, 400u);
+   EXPECT_EQ(inter_arrival_cnt, recv_cnt - 1);
+
    printf("\nRead more data when no new data received\n");
    iops = 88;     /* Something non-valid */
    in_len = sizeof(in_data);
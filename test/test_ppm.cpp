@@ -20,10 +20,260 @@
 
 #include <gtest/gtest.h>
 
+#include <stdlib.h>
+
 
 class PpmTest : public PnetIntegrationTest {};
 
+class PpmUnitTest : public PnetUnitTest {};
+
+/* One AR with one input IOCR in state RUN, with an 8 byte input image:
+ *   desc 0: data 0..3, IOPS 4
+ *   desc 1: IOCS 5 (output sub-module)
+ *   desc 2: not in use
+ *   desc 3: data 6..9, outside the image
+ */
+class PpmImageTest : public PnetUnitTest
+{
+protected:
+   pnet_t                  *net;
+   pf_ar_t                 *p_ar;
+   pf_ppm_t                *p_ppm;
+
+   virtual void SetUp() override
+   {
+      pf_iocr_t            *p_iocr;
+
+      net = (pnet_t *)calloc(1, sizeof(*net));
+      p_ar = (pf_ar_t *)calloc(1, sizeof(*p_ar));
+      net->max_ar = 1;
+      net->cmrpc_ar = p_ar;
+
+      p_ar->nbr_iocrs = 1;
+      p_iocr = &p_ar->iocrs[0];
+      p_iocr->param.iocr_type = PF_IOCR_TYPE_INPUT;
+      p_iocr->nbr_data_desc = 4;
+      p_iocr->data_desc[0].in_use = true;
+      p_iocr->data_desc[0].data_offset = 0;
+      p_iocr->data_desc[0].data_length = 4;
+      p_iocr->data_desc[0].iops_offset = 4;
+      p_iocr->data_desc[0].iops_length = 1;
+      p_iocr->data_desc[1].in_use = true;
+      p_iocr->data_desc[1].iocs_offset = 5;
+      p_iocr->data_desc[1].iocs_length = 1;
+      p_iocr->data_desc[3].in_use = true;
+      p_iocr->data_desc[3].data_offset = 6;
+      p_iocr->data_desc[3].data_length = 4;
+
+      p_ppm = &p_iocr->ppm;
+      p_ppm->state = PF_PPM_STATE_RUN;
+      p_ppm->buffer_data_length = 8;
+      p_ppm->dirty_start = UINT16_MAX;
+      p_ppm->dirty_end = 0;
+   };
+
+   virtual void TearDown() override
+   {
+      free(p_ar);
+      free(net);
+   };
+
+   /** The input data the sender reads */
+   const uint8_t *published()
+   {
+      return p_ppm->buffer_data[atomic_load(&p_ppm->buffer_seq) & 1];
+   }
+};
+
+
+static uint8_t connect_req[] =
+{
+                                                             0x04, 0x00, 0x28, 0x00, 0x10, 0x00,
+ 0x00, 0x00, 0x00, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0x01, 0xbe, 0xef,
+ 0xfe, 0xed, 0x01, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0xa0, 0x24, 0x42,
+ 0xdf, 0x7d, 0xbb, 0xac, 0x97, 0xe2, 0x76, 0x54, 0x9f, 0x47, 0xa5, 0xbd, 0xa5, 0xe3, 0x7d, 0x98,
+ 0xe5, 0xda, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+ 0xff, 0xff, 0xff, 0xff, 0x86, 0x01, 0x00, 0x00, 0x00, 0x00, 0x24, 0x10, 0x00, 0x00, 0x72, 0x01,
+ 0x00, 0x00, 0x24, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x72, 0x01, 0x00, 0x00, 0x01, 0x01,
+ 0x00, 0x42, 0x01, 0x00, 0x00, 0x01, 0x30, 0xab, 0xa9, 0xa3, 0xf7, 0x64, 0xb7, 0x44, 0xb3, 0xb6,
+ 0x7e, 0xe2, 0x8a, 0x1a, 0x02, 0xcb, 0x00, 0x02, 0xc8, 0x5b, 0x76, 0xe6, 0x89, 0xdf, 0xde, 0xa0,
+ 0x00, 0x00, 0x6c, 0x97, 0x11, 0xd1, 0x82, 0x71, 0x00, 0x01, 0xf0, 0x00, 0x00, 0x01, 0x40, 0x00,
+ 0x00, 0x11, 0x02, 0x58, 0x88, 0x92, 0x00, 0x0c, 0x72, 0x74, 0x2d, 0x6c, 0x61, 0x62, 0x73, 0x2d,
+ 0x64, 0x65, 0x6d, 0x6f, 0x01, 0x02, 0x00, 0x50, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x88, 0x92,
+ 0x00, 0x00, 0x00, 0x02, 0x00, 0x28, 0x80, 0x01, 0x00, 0x20, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+ 0xff, 0xff, 0xff, 0xff, 0x00, 0x03, 0x00, 0x03, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+ 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+ 0x80, 0x00, 0x00, 0x01, 0x00, 0x00, 0x80, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x01, 0x00, 0x03,
+ 0x00, 0x01, 0x00, 0x01, 0x00, 0x01, 0x00, 0x05, 0x01, 0x02, 0x00, 0x50, 0x01, 0x00, 0x00, 0x02,
+ 0x00, 0x02, 0x88, 0x92, 0x00, 0x00, 0x00, 0x02, 0x00, 0x28, 0x80, 0x00, 0x00, 0x20, 0x00, 0x01,
+ 0x00, 0x01, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x00, 0x03, 0x00, 0x03, 0xc0, 0x00, 0x00, 0x00,
+ 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x01,
+ 0x00, 0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x01,
+ 0x00, 0x00, 0x80, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x01, 0x00, 0x03, 0x01, 0x04, 0x00, 0x3c,
+ 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+ 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x01,
+ 0x80, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x01, 0x80, 0x01,
+ 0x00, 0x00, 0x80, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x01, 0x01, 0x04, 0x00, 0x26,
+ 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x32, 0x00, 0x00,
+ 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x01, 0x01, 0x01,
+ 0x00, 0x02, 0x00, 0x01, 0x01, 0x01, 0x01, 0x03, 0x00, 0x16, 0x01, 0x00, 0x00, 0x01, 0x88, 0x92,
+ 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0x00, 0x02, 0x00, 0xc8, 0xc0, 0x00, 0xa0, 0x00
+};
+
+static uint8_t release_req[] =
+{
+                                                             0x04, 0x00, 0x28, 0x00, 0x10, 0x00,
+ 0x00, 0x00, 0x00, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0x01, 0xbe, 0xef,
+ 0xfe, 0xed, 0x01, 0x00, 0xa0, 0xde, 0x97, 0x6c, 0xd1, 0x11, 0x82, 0x71, 0x00, 0xa0, 0x24, 0x42,
+ 0xdf, 0x7d, 0xbb, 0xac, 0x97, 0xe2, 0x76, 0x54, 0x9f, 0x47, 0xa5, 0xbd, 0xa5, 0xe3, 0x7d, 0x98,
+ 0xe5, 0xda, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x01, 0x00,
+ 0xff, 0xff, 0xff, 0xff, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e, 0x00, 0x00, 0x00, 0x20, 0x00,
+ 0x00, 0x00, 0x3e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x01, 0x14,
+ 0x00, 0x1c, 0x01, 0x00, 0x00, 0x00, 0x30, 0xab, 0xa9, 0xa3, 0xf7, 0x64, 0xb7, 0x44, 0xb3, 0xb6,
+ 0x7e, 0xe2, 0x8a, 0x1a, 0x02, 0xcb, 0x00, 0x02, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00
+};
+
 
 TEST_F (PpmTest, PpmRunTest)
 {
 }
+
+TEST_F (PpmTest, PpmImageLayoutTest)
+{
+   pnet_input_image_layout_t layout;
+   pf_ar_t                 *p_ar = NULL;
+   pf_iocr_t               *p_iocr;
+   pf_iodata_object_t      *p_iodata = NULL;
+   uint16_t                ix;
+
+   mock_set_os_udp_recvfrom_buffer(connect_req, sizeof(connect_req));
+   os_usleep(TEST_UDP_DELAY);
+   EXPECT_EQ(appdata.call_counters.connect_calls, 1);
+   ASSERT_EQ(pf_ar_find_by_arep(net, appdata.main_arep, &p_ar), 0);
+
+   ASSERT_EQ(pnet_input_get_image_layout(net, TEST_API_IDENT, 1, 1, &layout), 0);
+   EXPECT_EQ(layout.arep, appdata.main_arep);
+   ASSERT_LT(layout.crep, p_ar->nbr_iocrs);
+   p_iocr = &p_ar->iocrs[layout.crep];
+   EXPECT_EQ(p_iocr->param.iocr_type, PF_IOCR_TYPE_INPUT);
+   EXPECT_EQ(layout.image_length, p_iocr->param.c_sdu_length);
+   for (ix = 0; ix < p_iocr->nbr_data_desc; ix++)
+   {
+      if ((p_iocr->data_desc[ix].slot_nbr == 1) && (p_iocr->data_desc[ix].subslot_nbr == 1))
+      {
+         p_iodata = &p_iocr->data_desc[ix];
+      }
+   }
+   ASSERT_TRUE(p_iodata != NULL);
+   EXPECT_EQ(layout.data_offset, p_iodata->data_offset);
+   EXPECT_EQ(layout.data_length, 1);
+   EXPECT_EQ(layout.iops_offset, p_iodata->iops_offset);
+   EXPECT_EQ(layout.iops_length, 1);
+   EXPECT_EQ(layout.iocs_offset, p_iodata->iocs_offset);
+   EXPECT_EQ(layout.iocs_length, 1);
+   EXPECT_LE(layout.data_offset + layout.data_length, layout.image_length);
+   EXPECT_LE(layout.iops_offset + layout.iops_length, layout.image_length);
+
+   /* No such sub-slot */
+   EXPECT_EQ(pnet_input_get_image_layout(net, TEST_API_IDENT, 1, 99, &layout), -1);
+
+   mock_set_os_udp_recvfrom_buffer(release_req, sizeof(release_req));
+   os_usleep(TEST_UDP_DELAY);
+   EXPECT_EQ(appdata.call_counters.release_calls, 1);
+   EXPECT_EQ(pnet_input_get_image_layout(net, TEST_API_IDENT, 1, 1, &layout), -1);
+}
+
+TEST_F (PpmImageTest, SetImageShouldPublishImage)
+{
+   const uint8_t           image[8] = {1, 2, 3, 4, PNET_IOXS_GOOD, PNET_IOXS_GOOD, 7, 8};
+
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 0, image, sizeof(image)), 0);
+   EXPECT_EQ(memcmp(published(), image, sizeof(image)), 0);
+
+   /* Only the descriptors within the image have data */
+   EXPECT_TRUE(p_ar->iocrs[0].data_desc[0].data_avail);
+   EXPECT_TRUE(p_ar->iocrs[0].data_desc[1].data_avail);
+   EXPECT_FALSE(p_ar->iocrs[0].data_desc[2].data_avail);
+   EXPECT_FALSE(p_ar->iocrs[0].data_desc[3].data_avail);
+}
+
+TEST_F (PpmImageTest, SetImageShouldRejectWrongLength)
+{
+   const uint8_t           image[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+   const uint8_t           zero[8] = {0};
+
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 0, image, 7), -1);
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 0, image, 9), -1);
+   EXPECT_EQ(memcmp(published(), zero, sizeof(zero)), 0);
+   EXPECT_FALSE(p_ar->iocrs[0].data_desc[0].data_avail);
+}
+
+TEST_F (PpmImageTest, SetImageShouldRejectWrongState)
+{
+   const uint8_t           image[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+   const uint8_t           zero[8] = {0};
+
+   p_ppm->state = PF_PPM_STATE_W_START;
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 0, image, sizeof(image)), -1);
+   EXPECT_EQ(memcmp(published(), zero, sizeof(zero)), 0);
+   EXPECT_FALSE(p_ar->iocrs[0].data_desc[0].data_avail);
+
+   /* Not an input IOCR */
+   p_ppm->state = PF_PPM_STATE_RUN;
+   p_ar->iocrs[0].param.iocr_type = PF_IOCR_TYPE_OUTPUT;
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 0, image, sizeof(image)), -1);
+
+   /* No such IOCR */
+   p_ar->iocrs[0].param.iocr_type = PF_IOCR_TYPE_INPUT;
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 1, image, sizeof(image)), -1);
+   EXPECT_EQ(memcmp(published(), zero, sizeof(zero)), 0);
+}
+
+TEST_F (PpmImageTest, SetImageInBatchShouldPublishAtBatchEnd)
+{
+   const uint8_t           image1[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+   const uint8_t           image2[8] = {11, 12, 13, 14, 15, 16, 17, 18};
+   uint32_t                seq = atomic_load(&p_ppm->buffer_seq);
+
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 0, image1, sizeof(image1)), 0);
+   EXPECT_EQ(memcmp(published(), image1, sizeof(image1)), 0);
+   EXPECT_EQ(atomic_load(&p_ppm->buffer_seq), seq + 1);
+
+   pf_ppm_batch_begin(net);
+   EXPECT_EQ(pf_ppm_set_image(net, p_ar, 0, image2, sizeof(image2)), 0);
+   EXPECT_EQ(memcmp(published(), image1, sizeof(image1)), 0);
+   EXPECT_EQ(atomic_load(&p_ppm->buffer_seq), seq + 1);
+
+   pf_ppm_batch_end(net);
+   EXPECT_EQ(memcmp(published(), image2, sizeof(image2)), 0);
+   EXPECT_EQ(atomic_load(&p_ppm->buffer_seq), seq + 2);
+
+   /* Nothing written, nothing published */
+   pf_ppm_batch_begin(net);
+   pf_ppm_batch_end(net);
+   EXPECT_EQ(atomic_load(&p_ppm->buffer_seq), seq + 2);
+
+   /* Both buffers are up to date, so a partial write keeps the rest */
+   EXPECT_EQ(memcmp(p_ppm->buffer_data[0], p_ppm->buffer_data[1], sizeof(image2)), 0);
+}
+
+TEST_F (PpmUnitTest, HistogramShouldBucketByLog2)
+{
+   pnet_histogram_t hist;
+
+   pf_histogram_reset (&hist);
+   pf_histogram_add (&hist, 500);            /* < 1 us */
+   pf_histogram_add (&hist, 1000);           /* 1 us */
+   pf_histogram_add (&hist, 1999);           /* 1 us */
+   pf_histogram_add (&hist, 1000000);        /* 1 ms: 2^9 .. 2^10 us */
+   pf_histogram_add (&hist, 10000000000ULL); /* Saturates */
+
+   EXPECT_EQ (5u, hist.count);
+   EXPECT_EQ (500u, hist.min_ns);
+   EXPECT_EQ (UINT32_MAX, hist.max_ns);
+   EXPECT_EQ (1u, hist.buckets[0]);
+   EXPECT_EQ (2u, hist.buckets[1]);
+   EXPECT_EQ (1u, hist.buckets[10]);
+   EXPECT_EQ (1u, hist.buckets[PNET_HISTOGRAM_BUCKETS - 1]);
+   EXPECT_EQ (500ULL + 1000 + 1999 + 1000000 + UINT32_MAX, hist.sum_ns);
+}
@@ -19,11 +19,174 @@
 #include "pf_includes.h"
 
 #include <gtest/gtest.h>
+#include <vector>
 
+#define TEST_TICK_INTERVAL_US       1000
+
+static const char *test_sched_name = "test";
 
 class SchedulerTest : public PnetIntegrationTest {};
 
+class SchedulerUnitTest : public PnetUnitTest
+{
+protected:
+   pnet_t *net;
+
+   virtual void SetUp() override
+   {
+      net = pf_arena_create(NULL);
+      pf_scheduler_init(net, TEST_TICK_INTERVAL_US);
+      calls = 0;
+   };
+
+   virtual void TearDown() override
+   {
+      os_mutex_destroy(net->scheduler_timeout_mutex);
+      pf_arena_destroy(net);
+   };
+
+public:
+   static uint32_t calls;
+   static uintptr_t order[16];
+};
+
+uint32_t SchedulerUnitTest::calls;
+uintptr_t SchedulerUnitTest::order[16];
+
+static void test_record_cb(
+   pnet_t                  *net,
+   void                    *arg,
+   uint32_t                current_time)
+{
+   if (SchedulerUnitTest::calls < NELEMENTS(SchedulerUnitTest::order))
+   {
+      SchedulerUnitTest::order[SchedulerUnitTest::calls] = (uintptr_t)arg;
+   }
+   SchedulerUnitTest::calls++;
+}
+
+/**
+ * Re-arms itself until the counter reaches 10, the way the PPM does.
+ */
+static void test_rearm_cb(
+   pnet_t                  *net,
+   void                    *arg,
+   uint32_t                current_time)
+{
+   uint32_t                timeout;
+
+   SchedulerUnitTest::calls++;
+   if (SchedulerUnitTest::calls < 10)
+   {
+      EXPECT_EQ (0, pf_scheduler_add(net, 1000, test_sched_name, test_rearm_cb, arg, &timeout));
+   }
+}
+
+/**
+ * Call the tick function until the callback counter reaches the expected
+ * value. Give up after a long time, so a broken scheduler fails the test
+ * instead of hanging it.
+ */
+static void run_ticks(pnet_t *net, uint32_t expected_calls)
+{
+   uint32_t                ix;
+
+   for (ix = 0; ix < 20000; ix++)
+   {
+      pf_scheduler_tick(net);
+      if (SchedulerUnitTest::calls >= expected_calls)
+      {
+         break;
+      }
+      os_usleep(500);
+   }
+}
+
 
 TEST_F (SchedulerTest, ShedulerRunTest)
 {
 }
+
+TEST_F (SchedulerUnitTest, SchedulerExpiryOrder)
+{
+   uint32_t                t1, t2, t3, t4;
+
+   /* 100 ms is on the second level of the wheel */
+   ASSERT_EQ (0, pf_scheduler_add(net, 100000, test_sched_name, test_record_cb, (void *)4, &t4));
+   ASSERT_EQ (0, pf_scheduler_add(net, 20000, test_sched_name, test_record_cb, (void *)3, &t3));
+   ASSERT_EQ (0, pf_scheduler_add(net, 5000, test_sched_name, test_record_cb, (void *)2, &t2));
+   ASSERT_EQ (0, pf_scheduler_add(net, 1000, test_sched_name, test_record_cb, (void *)1, &t1));
+
+   run_ticks(net, 4);
+   EXPECT_EQ (4u, calls);
+   EXPECT_EQ (1u, order[0]);
+   EXPECT_EQ (2u, order[1]);
+   EXPECT_EQ (3u, order[2]);
+   EXPECT_EQ (4u, order[3]);
+   EXPECT_EQ (0u, net->scheduler_timeout_cnt);
+}
+
+TEST_F (SchedulerUnitTest, SchedulerSameTickOrder)
+{
+   uint32_t                timeout;
+
+   /* Close together, mostly in the same tick. Latest expiry first, then two equal ones. */
+   ASSERT_EQ (0, pf_scheduler_add(net, 2600, test_sched_name, test_record_cb, (void *)4, &timeout));
+   ASSERT_EQ (0, pf_scheduler_add(net, 2400, test_sched_name, test_record_cb, (void *)3, &timeout));
+   ASSERT_EQ (0, pf_scheduler_add(net, 2200, test_sched_name, test_record_cb, (void *)1, &timeout));
+   ASSERT_EQ (0, pf_scheduler_add(net, 2200, test_sched_name, test_record_cb, (void *)2, &timeout));
+
+   run_ticks(net, 4);
+   EXPECT_EQ (4u, calls);
+   EXPECT_EQ (1u, order[0]);
+   EXPECT_EQ (2u, order[1]);
+   EXPECT_EQ (3u, order[2]);
+   EXPECT_EQ (4u, order[3]);
+}
+
+TEST_F (SchedulerUnitTest, SchedulerRemove)
+{
+   uint32_t                t1, t2;
+
+   ASSERT_EQ (0, pf_scheduler_add(net, 2000, test_sched_name, test_record_cb, (void *)1, &t1));
+   ASSERT_EQ (0, pf_scheduler_add(net, 3000, test_sched_name, test_record_cb, (void *)2, &t2));
+   pf_scheduler_remove(net, test_sched_name, t1);
+
+   run_ticks(net, 1);
+   EXPECT_EQ (1u, calls);
+   EXPECT_EQ (2u, order[0]);
+
+   /* Removing an expired timeout is harmless */
+   pf_scheduler_remove(net, test_sched_name, t2);
+   EXPECT_EQ (1u, calls);
+}
+
+TEST_F (SchedulerUnitTest, SchedulerRearmFromCallback)
+{
+   uint32_t                timeout;
+
+   ASSERT_EQ (0, pf_scheduler_add(net, 1000, test_sched_name, test_rearm_cb, NULL, &timeout));
+   run_ticks(net, 10);
+   EXPECT_EQ (10u, calls);
+   EXPECT_EQ (0u, net->scheduler_timeout_cnt);
+}
+
+TEST_F (SchedulerUnitTest, SchedulerOutOfResources)
+{
+   std::vector<uint32_t>   timeouts(net->scheduler_max_timeouts);
+   uint32_t                extra;
+   uint32_t                ix;
+
+   for (ix = 0; ix < net->scheduler_max_timeouts; ix++)
+   {
+      ASSERT_EQ (0, pf_scheduler_add(net, 1000000 + ix, test_sched_name, test_record_cb, NULL, &timeouts[ix]));
+   }
+   EXPECT_EQ (-1, pf_scheduler_add(net, 1000, test_sched_name, test_record_cb, NULL, &extra));
+
+   for (ix = 0; ix < net->scheduler_max_timeouts; ix++)
+   {
+      pf_scheduler_remove(net, test_sched_name, timeouts[ix]);
+   }
+   EXPECT_EQ (0u, net->scheduler_timeout_cnt);
+   EXPECT_EQ (0, pf_scheduler_add(net, 1000, test_sched_name, test_record_cb, NULL, &extra));
+}
@@ -0,0 +1,151 @@
+/*********************************************************************
+ *        _       _         _
+ *  _ __ | |_  _ | |  __ _ | |__   ___
+ * | '__|| __|(_)| | / _` || '_ \ / __|
+ * | |   | |_  _ | || (_| || |_) |\__ \
+ * |_|    \__|(_)|_| \__,_||_.__/ |___/
+ *
+ * www.rt-labs.com
+ * Copyright 2018 rt-labs AB, Sweden.
+ *
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ ********************************************************************/
+
+#include "utils_for_testing.h"
+#include "mocks.h"
+
+#include "pf_includes.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#define TEST_TRACE_DUMP_SIZE        (256 * 1024)
+
+#if PNET_TRACE != 0
+
+class TraceUnitTest : public PnetUnitTest
+{
+protected:
+   std::vector<uint8_t> dump;
+
+   virtual void SetUp() override
+   {
+      dump.resize(TEST_TRACE_DUMP_SIZE);
+   };
+
+   /* Return the records with the given argument, as dumped */
+   std::vector<pf_trace_record_t> find(uint32_t arg)
+   {
+      std::vector<pf_trace_record_t> found;
+      pf_trace_dump_header_t header;
+      pf_trace_record_t record;
+      int len = pnet_trace_dump(dump.data(), dump.size());
+
+      EXPECT_GE (len, (int)sizeof(header));
+      memcpy(&header, dump.data(), sizeof(header));
+      EXPECT_EQ (PF_TRACE_DUMP_MAGIC, header.magic);
+      EXPECT_EQ (PF_TRACE_DUMP_VERSION, header.version);
+      EXPECT_EQ (sizeof(pf_trace_record_t), header.record_size);
+      EXPECT_EQ (len, (int)(sizeof(header) + header.n_records * sizeof(record)));
+      for (uint32_t ix = 0; ix < header.n_records; ix++)
+      {
+         memcpy(&record, &dump[sizeof(header) + ix * sizeof(record)], sizeof(record));
+         if (record.arg == arg)
+         {
+            found.push_back(record);
+         }
+      }
+
+      return found;
+   }
+};
+
+TEST_F (TraceUnitTest, TraceShouldDumpRecordsInOrder)
+{
+   std::vector<pf_trace_record_t> records;
+
+   pf_trace_record(PF_TRACE_EVENT_PPM_FINISH, 0xC0FFEE01);
+   pf_trace_record(PF_TRACE_EVENT_PPM_SEND, 0xC0FFEE01);
+   pf_trace_record(PF_TRACE_EVENT_PPM_FLUSH, 0xC0FFEE01);
+
+   records = find(0xC0FFEE01);
+   ASSERT_EQ (3u, records.size());
+   EXPECT_EQ (PF_TRACE_EVENT_PPM_FINISH, records[0].event);
+   EXPECT_EQ (PF_TRACE_EVENT_PPM_SEND, records[1].event);
+   EXPECT_EQ (PF_TRACE_EVENT_PPM_FLUSH, records[2].event);
+   EXPECT_LE (records[0].timestamp, records[1].timestamp);
+   EXPECT_LE (records[1].timestamp, records[2].timestamp);
+   EXPECT_EQ (records[0].buffer, records[2].buffer);
+}
+
+TEST_F (TraceUnitTest, TraceShouldUseOneBufferPerThread)
+{
+   std::vector<pf_trace_record_t> records;
+
+   pf_trace_record(PF_TRACE_EVENT_ALARM_SEND, 0xC0FFEE02);
+   std::thread other ([] {
+      pf_trace_record(PF_TRACE_EVENT_ALARM_SEND, 0xC0FFEE02);
+   });
+   other.join();
+
+   records = find(0xC0FFEE02);
+   ASSERT_EQ (2u, records.size());
+   EXPECT_NE (records[0].buffer, records[1].buffer);
+}
+
+TEST_F (TraceUnitTest, TraceShouldReleaseBufferOfExitedThread)
+{
+   std::vector<pf_trace_record_t> records;
+   uint32_t ix;
+
+   /* More short-lived threads than buffers, one after the other */
+   for (ix = 0; ix < 32; ix++)
+   {
+      std::thread other ([] {
+         pf_trace_record(PF_TRACE_EVENT_ALARM_SEND, 0xC0FFEE05);
+      });
+      other.join();
+   }
+
+   records = find(0xC0FFEE05);
+   EXPECT_EQ (32u, records.size());
+}
+
+TEST_F (TraceUnitTest, TraceShouldKeepNewestWhenFull)
+{
+   std::vector<pf_trace_record_t> records;
+   uint32_t ix;
+
+   for (ix = 0; ix < 10000; ix++)
+   {
+      pf_trace_record(PF_TRACE_EVENT_ETH_RX, 0xC0FFEE03);
+   }
+   pf_trace_record(PF_TRACE_EVENT_ETH_RX, 0xC0FFEE04);
+
+   records = find(0xC0FFEE04);
+   EXPECT_EQ (1u, records.size());
+   records = find(0xC0FFEE03);
+   EXPECT_GT (records.size(), 0u);
+   EXPECT_LT (records.size(), 10000u);
+}
+
+TEST_F (TraceUnitTest, DumpShouldFailWithoutRoomForHeader)
+{
+   EXPECT_EQ (-1, pnet_trace_dump(dump.data(), sizeof(pf_trace_dump_header_t) - 1));
+   EXPECT_EQ ((int)sizeof(pf_trace_dump_header_t),
+              pnet_trace_dump(dump.data(), sizeof(pf_trace_dump_header_t)));
+}
+
+#else
+
+TEST (Trace, DumpShouldFailWhenDisabled)
+{
+   uint8_t buffer[64];
+
+   EXPECT_EQ (-1, pnet_trace_dump(buffer, sizeof(buffer)));
+}
+
+#endif /* PNET_TRACE != 0 */
@@ -454,6 +454,9 @@ void PnetIntegrationTestBase::available_modules_and_submodules_init()
 
 void PnetIntegrationTestBase::cfg_init()
 {
+   /* Fields not set below, like the capacities, keep their defaults */
+   memset(&pnet_default_cfg, 0, sizeof(pnet_default_cfg));
+
    pnet_default_cfg.state_cb = my_state_ind;
    pnet_default_cfg.connect_cb = my_connect_ind;
    pnet_default_cfg.release_cb = my_release_ind;
@@ -255,6 +255,15 @@ protected:
 
    virtual void cfg_init();
 
+   /* The periodic timer refers to this test, so stop it before the test is deleted */
+   virtual void TearDown() override
+   {
+      if (appdata.periodic_timer != NULL)
+      {
+         os_timer_destroy(appdata.periodic_timer);
+         appdata.periodic_timer = NULL;
+      }
+   };
 };
 
 
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#********************************************************************
+#        _       _         _
+#  _ __ | |_  _ | |  __ _ | |__   ___
+# | '__|| __|(_)| | / _` || '_ \ / __|
+# | |   | |_  _ | || (_| || |_) |\__ \
+# |_|    \__|(_)|_| \__,_||_.__/ |___/
+#
+# www.rt-labs.com
+# Copyright 2018 rt-labs AB, Sweden.
+#
+# This software is dual-licensed under GPLv3 and a commercial
+# license. See the file LICENSE.md distributed with this software for
+# full license information.
+#*******************************************************************/
+
+"""Convert a p-net trace dump (see pnet_trace_dump()) to the Chrome trace
+event JSON format, which chrome://tracing and ui.perfetto.dev can open.
+
+Usage: pnet_trace_to_json.py [--big-endian] pnet_trace.bin > trace.json
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+DUMP_MAGIC = 0x52544e50  # "PNTR"
+DUMP_VERSION = 1
+
+# Keep in sync with pf_trace_event_values_t in src/common/pf_trace.h
+EVENT_ETH_RX = 1
+EVENT_CPM_ACCEPT = 2
+EVENT_CPM_REJECT = 3
+EVENT_PPM_FINISH = 4
+EVENT_PPM_SEND = 5
+EVENT_PPM_FLUSH = 6
+EVENT_TICK_BEGIN = 7
+EVENT_TICK_END = 8
+EVENT_ALARM_SEND = 9
+
+EVENTS = {
+    EVENT_ETH_RX: ("eth rx", "frame_id"),
+    EVENT_CPM_ACCEPT: ("cpm accept", "cycle"),
+    EVENT_CPM_REJECT: ("cpm reject", "line"),
+    EVENT_PPM_FINISH: ("ppm finish", "cycle"),
+    EVENT_PPM_SEND: ("ppm send", "frame_id"),
+    EVENT_PPM_FLUSH: ("ppm flush", None),
+    EVENT_TICK_BEGIN: ("tick", None),
+    EVENT_TICK_END: ("tick", "expired"),
+    EVENT_ALARM_SEND: ("alarm send", "frame_id"),
+}
+
+
+def read_dump(data, endian):
+    """Return the records of a dump as (timestamp_ns, event, buffer, arg)."""
+    header = struct.Struct(endian + "IHHII")
+    magic, version, record_size, n_records, _ = header.unpack_from(data, 0)
+    if magic != DUMP_MAGIC:
+        raise ValueError("not a p-net trace dump, or wrong byte order")
+    if version != DUMP_VERSION:
+        raise ValueError("unsupported dump version %u" % version)
+
+    record = struct.Struct(endian + "QHHI")
+    if record_size < record.size:
+        raise ValueError("unsupported record size %u" % record_size)
+    if header.size + n_records * record_size > len(data):
+        raise ValueError("dump is truncated")
+
+    return [record.unpack_from(data, header.size + ix * record_size)
+            for ix in range(n_records)]
+
+
+def to_chrome_events(records):
+    """Convert records to Chrome trace events, one track per buffer."""
+    events = []
+    for buffer in sorted({r[2] for r in records}):
+        events.append({"ph": "M", "name": "thread_name", "pid": 1,
+                       "tid": buffer, "args": {"name": "p-net %u" % buffer}})
+
+    t0 = min((r[0] for r in records), default=0)
+    for timestamp, event, buffer, arg in sorted(records):
+        name, arg_name = EVENTS.get(event, ("event %u" % event, "arg"))
+        entry = {"name": name, "cat": "pnet", "pid": 1, "tid": buffer,
+                 "ts": (timestamp - t0) / 1000.0}
+        if event == EVENT_TICK_BEGIN:
+            entry["ph"] = "B"
+        elif event == EVENT_TICK_END:
+            entry["ph"] = "E"
+        else:
+            entry["ph"] = "i"
+            entry["s"] = "t"
+        if arg_name is not None:
+            entry["args"] = {arg_name: arg}
+        events.append(entry)
+
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="file written from pnet_trace_dump()")
+    parser.add_argument("--big-endian", action="store_true",
+                        help="the dump was made on a big-endian target")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        records = read_dump(f.read(), ">" if args.big_endian else "<")
+
+    json.dump({"traceEvents": to_chrome_events(records),
+               "displayTimeUnit": "ns"}, sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()